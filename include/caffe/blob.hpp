@@ -24,7 +24,8 @@ template <typename Dtype>
 class Blob {
  public:
   Blob()
-       : data_(), diff_(), count_(0), capacity_(0) {}
+       : data_(), diff_(), count_(0), capacity_(0), data_offset_(0),
+         diff_offset_(0), view_(false) {}
 
   /// @brief Deprecated; use <code>Blob(const vector<int>& shape)</code>.
   explicit Blob(const int num, const int channels, const int height,
@@ -51,6 +52,31 @@ class Blob {
   void Reshape(const vector<int>& shape);
   void Reshape(const BlobShape& shape);
   void ReshapeLike(const Blob& other);
+  /**
+   * @brief Make this Blob a view of part of other's data and diff, without
+   *        copying: element (i_0, ..., i_k) of the view is element
+   *        offset + i_0 * strides[0] + ... + i_k * strides[k] of other.
+   *
+   * With strides empty the view is dense (row-major over shape), and can be
+   * used wherever a Blob can; a strided view only supports Contiguous(),
+   * and its raw data pointers may not be taken until Contiguous() has been
+   * called.  Writes through the view land in other's memory.  The view lasts
+   * until ReleaseView() or Contiguous(), or until a Reshape, ShareData or
+   * set_cpu_data gives this Blob memory of its own.
+   *
+   * @param other a contiguous Blob; may itself be a dense view.
+   * @param offset the element of other at index (0, ..., 0) of the view.
+   * @param strides the per-axis element strides, one per axis of shape.
+   */
+  void ShareView(const Blob& other, const vector<int>& shape, int offset,
+                 const vector<int>& strides = vector<int>());
+  /// @brief End a view, giving this Blob memory of its own (not copied).
+  void ReleaseView();
+  /**
+   * @brief Make this Blob dense: a strided view is gathered into memory of
+   *        its own (with a fresh diff); a dense Blob is left as it is.
+   */
+  void Contiguous();
   inline string shape_string() const {
     ostringstream stream;
     for (int i = 0; i < shape_.size(); ++i) {
@@ -128,6 +154,33 @@ class Blob {
     return axis_index;
   }
 
+  /// @brief Whether the elements are stored densely in row-major order.
+  inline bool is_contiguous() const { return strides_.empty(); }
+  /// @brief Whether this Blob's memory belongs to another Blob (ShareView).
+  inline bool is_view() const { return view_; }
+  /// @brief The distance in elements between neighbours along axis.
+  inline int stride(int axis) const {
+    axis = CanonicalAxisIndex(axis);
+    return strides_.empty() ? count(axis + 1) : strides_[axis];
+  }
+  /// @brief The element of data() where this Blob's data starts.
+  inline int data_offset() const { return data_offset_; }
+  /// @brief The element of diff() where this Blob's diff starts.
+  inline int diff_offset() const { return diff_offset_; }
+  /**
+   * @brief Whether this Blob's data is element offset onwards of other's
+   *        memory, i.e. writes to other already reach this Blob.
+   */
+  inline bool SharesDataWith(const Blob& other, int offset = 0) const {
+    return data_ && data_ == other.data_ &&
+        data_offset_ == other.data_offset_ + offset;
+  }
+  /// @brief Likewise for the diff.
+  inline bool SharesDiffWith(const Blob& other, int offset = 0) const {
+    return diff_ && diff_ == other.diff_ &&
+        diff_offset_ == other.diff_offset_ + offset;
+  }
+
   /// @brief Deprecated legacy shape accessor num: use shape(0) instead.
   inline int num() const { return LegacyShape(0); }
   /// @brief Deprecated legacy shape accessor channels: use shape(1) instead.
@@ -218,9 +271,34 @@ class Blob {
 
   const Dtype* cpu_data() const;
   void set_cpu_data(Dtype* data);
+  /**
+   * @brief Reshapes this Blob to shape and makes its data the external host
+   *        memory at data, without copying it.
+   *
+   * owner (e.g. a shared_ptr with a custom deleter, or one to the object
+   * that owns data) is held as long as the memory is in use by this Blob or
+   * any Blob sharing its data, so data stays valid until then.  Unlike
+   * set_cpu_data(data), this never redirects memory shared with other Blob%s;
+   * memory of its own of the same size is reused, so calling this once per
+   * batch allocates nothing (on the host or the device).  The memory is
+   * written to whenever the Blob's data is; a later Reshape to a larger
+   * count gives the Blob memory of its own.
+   */
+  void set_cpu_data(Dtype* data, const vector<int>& shape,
+                    const shared_ptr<void>& owner = shared_ptr<void>());
+  /**
+   * @brief Likewise for external memory laid out with the given per-axis
+   *        element strides; call Contiguous() before using the data.
+   */
+  void set_cpu_data(Dtype* data, const vector<int>& shape,
+                    const vector<int>& strides,
+                    const shared_ptr<void>& owner = shared_ptr<void>());
   const int* gpu_shape() const;
   const Dtype* gpu_data() const;
   void set_gpu_data(Dtype* data);
+  /// @brief Likewise for external device memory.
+  void set_gpu_data(Dtype* data, const vector<int>& shape,
+                    const shared_ptr<void>& owner = shared_ptr<void>());
   const Dtype* cpu_diff() const;
   const Dtype* gpu_diff() const;
   Dtype* mutable_cpu_data();
@@ -229,7 +307,13 @@ class Blob {
   Dtype* mutable_gpu_diff();
   void Update();
   void FromProto(const BlobProto& proto, bool reshape = true);
-  void ToProto(BlobProto* proto, bool write_diff = false) const;
+  /**
+   * @brief Writes the shape and data (and diff, if write_diff) to proto, in
+   *        full precision or, with precision FP16 or BF16, as 16-bit values
+   *        taking half the space of floats; FromProto reads either.
+   */
+  void ToProto(BlobProto* proto, bool write_diff = false,
+               BlobProto::Precision precision = BlobProto::FULL) const;
 
   /// @brief Compute the sum of absolute values (L1 norm) of the data.
   Dtype asum_data() const;
@@ -244,6 +328,11 @@ class Blob {
   void scale_data(Dtype scale_factor);
   /// @brief Scale the blob diff by a constant factor.
   void scale_diff(Dtype scale_factor);
+  /**
+   * @brief Set the blob diff to zero, skipping the work entirely if the diff
+   *        has not been written since it was allocated or last zeroed.
+   */
+  void zero_diff();
 
   /**
    * @brief Set the data_ shared_ptr to point to the SyncedMemory holding the
@@ -263,6 +352,14 @@ class Blob {
    * shared_ptr calls its destructor when reset with the "=" operator.
    */
   void ShareDiff(const Blob& other);
+  /**
+   * @brief Set the data_ shared_ptr to point to data, a SyncedMemory that may
+   *        be larger than this Blob and shared with other Blob%s -- used by
+   *        Net's memory planner.
+   *
+   * A later Reshape beyond data's size gives this Blob memory of its own.
+   */
+  void SetDataMemory(const shared_ptr<SyncedMemory>& data);
 
   bool ShapeEquals(const BlobProto& other);
 
@@ -273,6 +370,17 @@ class Blob {
   vector<int> shape_;
   int count_;
   int capacity_;
+  // Where this Blob starts in data_ and diff_, in elements; nonzero only
+  // for views.
+  int data_offset_;
+  int diff_offset_;
+  // Per-axis element strides of a strided view; empty when dense.
+  vector<int> strides_;
+  bool view_;
+
+ private:
+  // Set shape_ and count_ without touching the memory.
+  void SetShape(const vector<int>& shape);
 
   DISABLE_COPY_AND_ASSIGN(Blob);
 };  // class Blob
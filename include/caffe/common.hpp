@@ -17,6 +17,7 @@
 #include <vector>
 
 #include "caffe/util/device_alternate.hpp"
+#include "caffe/util/philox.hpp"
 
 // Convert macro to string
 #define STRINGIFY(m) #m
@@ -148,6 +149,15 @@ class Caffe {
   inline static void set_mode(Brew mode) { Get().mode_ = mode; }
   // Sets the random seed of both boost and curand
   static void set_random_seed(const unsigned int seed);
+  // The seed behind the counter-based streams; reset by set_random_seed.
+  inline static unsigned int random_seed() { return Get().random_seed_; }
+  // A counter-based stream keyed by (random_seed(), id, iteration). Unlike
+  // rng_stream(), draws from it do not depend on the order or the thread in
+  // which they are made; see caffe_rng_stream_uniform.
+  static PhiloxStream philox_stream(const unsigned int id,
+      const uint64_t iteration);
+  // A stable stream id derived from a name, e.g. a layer name.
+  static unsigned int philox_stream_id(const string& name);
   // Sets the device. Since we have cublas and curand stuff, set device also
   // requires us to reset those values.
   static void SetDevice(const int device_id);
@@ -173,6 +183,7 @@ class Caffe {
   curandGenerator_t curand_generator_;
 #endif
   shared_ptr<RNG> random_generator_;
+  unsigned int random_seed_;
 
   Brew mode_;
 
@@ -0,0 +1,63 @@
+#ifndef CAFFE_HALF_BLOB_HPP_
+#define CAFFE_HALF_BLOB_HPP_
+
+#include <boost/weak_ptr.hpp>
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/syncedmem.hpp"
+#include "caffe/util/half.hpp"
+
+namespace caffe {
+
+/**
+ * @brief A copy of a Blob's data in 16-bit storage, IEEE half (FP16) or
+ *        bfloat16 (BF16): half the memory of a float Blob, for data that is
+ *        read far more often than it is written, such as inference weights.
+ *
+ * The values are only stored; math on them goes through caffe_cpu_from_half
+ * or caffe_cpu_gemm_half, which compute in Dtype.  Host memory only.
+ */
+template <typename Dtype>
+class HalfBlob {
+ public:
+  explicit HalfBlob(BlobProto::Precision precision);
+
+  /// @brief Reshapes to source's shape and rounds its data to 16 bits.
+  void CopyFrom(const Blob<Dtype>& source);
+  /**
+   * @brief Returns whether this holds source's current data: CopyFrom(source)
+   *        was the last copy, and source's data has not been handed out for
+   *        writing (or replaced) since.
+   */
+  bool IsCopyOf(const Blob<Dtype>& source) const;
+  /// @brief Expands the values into target, reshaping it.
+  void CopyTo(Blob<Dtype>* target) const;
+
+  inline BlobProto::Precision precision() const { return precision_; }
+  inline const vector<int>& shape() const { return shape_; }
+  inline int count() const { return count_; }
+  /// @brief The values, if precision() is FP16.
+  const fp16* cpu_fp16() const;
+  /// @brief The values, if precision() is BF16.
+  const bf16* cpu_bf16() const;
+
+ protected:
+  BlobProto::Precision precision_;
+  shared_ptr<SyncedMemory> data_;
+  vector<int> shape_;
+  int count_;
+  // What the last CopyFrom read, to tell whether it has changed since.
+  boost::weak_ptr<SyncedMemory> source_;
+  unsigned int source_version_;
+  int source_offset_;
+
+  DISABLE_COPY_AND_ASSIGN(HalfBlob);
+};  // class HalfBlob
+
+}  // namespace caffe
+
+#endif  // CAFFE_HALF_BLOB_HPP_
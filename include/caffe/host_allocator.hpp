@@ -0,0 +1,81 @@
+#ifndef CAFFE_HOST_ALLOCATOR_HPP_
+#define CAFFE_HOST_ALLOCATOR_HPP_
+
+#include <boost/atomic.hpp>
+
+#include <string>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/// Alignment of the memory handed out by every HostAllocator, in bytes: a
+/// cache line, and enough for any SIMD load.
+const size_t kHostAlignment = 64;
+
+/**
+ * @brief Supplies the host memory of SyncedMemory (except for the pinned
+ *        memory it takes from CUDA in GPU mode), and counts what it hands
+ *        out.
+ *
+ * Implementations override DoAllocate and DoFree, which may be called from
+ * any thread, and must return memory aligned to kHostAlignment bytes.
+ */
+class HostAllocator {
+ public:
+  HostAllocator();
+  virtual ~HostAllocator() {}
+
+  /// @brief Returns size bytes of host memory.
+  void* Allocate(size_t size);
+  /// @brief Takes back memory that Allocate(size) returned.
+  void Free(void* ptr, size_t size);
+  /// @brief Hands any memory kept for reuse back to the system.
+  virtual void ReleaseCached() {}
+
+  virtual const char* type() const = 0;
+
+  /// @brief The number of Allocate calls so far.
+  size_t allocations() const { return allocations_; }
+  /// @brief The bytes allocated and not yet freed.
+  size_t bytes_in_use() const { return bytes_in_use_; }
+  /// @brief The high-water mark of bytes_in_use() since the last ResetPeak.
+  size_t peak_bytes_in_use() const { return peak_bytes_in_use_; }
+  void ResetPeak() { peak_bytes_in_use_ = bytes_in_use_.load(); }
+
+ protected:
+  virtual void* DoAllocate(size_t size) = 0;
+  virtual void DoFree(void* ptr, size_t size) = 0;
+
+ private:
+  boost::atomic<size_t> allocations_;
+  boost::atomic<size_t> bytes_in_use_;
+  boost::atomic<size_t> peak_bytes_in_use_;
+
+  DISABLE_COPY_AND_ASSIGN(HostAllocator);
+};
+
+/**
+ * @brief Creates a HostAllocator of the given type:
+ *   - "malloc": the system allocator (mkl_malloc with USE_MKL), the default.
+ *   - "pooled": rounds sizes up to size classes (four per power of two) and
+ *     keeps freed blocks for reuse, first in a cache of the freeing thread
+ *     and then in free lists shared by all threads, so the reshapes of
+ *     variable-size inputs stop reaching the system allocator once every
+ *     size has been seen.  ReleaseCached empties the shared free lists and
+ *     the calling thread's cache.
+ */
+shared_ptr<HostAllocator> CreateHostAllocator(const string& type);
+
+/// @brief The allocator SyncedMemory takes host memory from.
+const shared_ptr<HostAllocator>& host_allocator();
+/**
+ * @brief Makes SyncedMemory take host memory from allocator from now on;
+ *        memory allocated before goes back to the allocator it came from.
+ *        Like Caffe::set_mode, call it before starting other threads.
+ */
+void set_host_allocator(const shared_ptr<HostAllocator>& allocator);
+
+}  // namespace caffe
+
+#endif  // CAFFE_HOST_ALLOCATOR_HPP_
@@ -41,7 +41,7 @@ class Layer {
    * layer.
    */
   explicit Layer(const LayerParameter& param)
-    : layer_param_(param) {
+    : layer_param_(param), allow_top_views_(true) {
       // Set phase and copy blobs (if there are any).
       phase_ = param.phase();
       if (layer_param_.blobs_size() > 0) {
@@ -162,15 +162,46 @@ class Layer {
   }
   vector<string>& blob_names(){ return blob_names_;}
 
+  /**
+   * @brief Returns the index of the blob in a saved copy of this layer (with
+   *        num_source_blobs blobs) that is loaded into blobs()[0].  Layers 
+   *        that can be built with only some of their parameters (e.g. the 
+   *        decoder-only VAELayer) skip the leading ones they don't have.
+   */
+  virtual int TrainedBlobsOffset(const int num_source_blobs) const {
+    return 0;
+  }
+
+  /**
+   * @brief Returns true if Forward draws from the thread's global random
+   *        generator or touches other state shared beyond this layer's own
+   *        bottoms and tops.  A Net with parallel_forward runs such layers
+   *        on the calling thread, in layer order.  (Layers with subnets are
+   *        also treated this way if any layer of a subnet is.)
+   */
+  virtual inline bool ForwardUsesGlobalState() const { return false; }
+
+  /**
+   * @brief Returns true if running Forward again on the same bottoms gives
+   *        the same tops, which is what recomputing activations (see
+   *        UnrollParameter.checkpoint_interval) relies on.  Layers that draw
+   *        random numbers, or advance a counter of their own, return false.
+   */
+  virtual inline bool ForwardIsRepeatable() const {
+    return !ForwardUsesGlobalState();
+  }
+
   /**
    * @brief Returns the layer parameter.
    */
   const LayerParameter& layer_param() const { return layer_param_; }
 
   /**
-   * @brief Writes the layer parameter to a protocol buffer
+   * @brief Writes the layer parameter to a protocol buffer, with the blobs in
+   *        the given precision (see Blob::ToProto)
    */
-  virtual void ToProto(LayerParameter* param, bool write_diff = false);
+  virtual void ToProto(LayerParameter* param, bool write_diff = false,
+      BlobProto::Precision precision = BlobProto::FULL);
 
   /**
    * @brief Returns the scalar loss associated with a top blob at a given index.
@@ -295,6 +326,16 @@ class Layer {
     param_propagate_down_[param_id] = value;
   }
 
+  /**
+   * @brief Returns whether the layer may make its top blobs views of its
+   *        bottoms' memory (Blob::ShareView) instead of copying into them.
+   *
+   * Net turns this off for layers whose tops are modified in place or carry
+   * a loss weight, as writes to a view land in the bottom.
+   */
+  inline bool allow_top_views() const { return allow_top_views_; }
+  inline void set_allow_top_views(bool value) { allow_top_views_ = value; }
+
   inline vector<shared_ptr<Net<Dtype> > > subnets() { return subnets_;}
 
   //recursive list of intermediates, usually for 
@@ -324,6 +365,9 @@ class Layer {
   /** Vector indicating whether to compute the diff of each param blob. */
   vector<bool> param_propagate_down_;
 
+  /** Whether the tops may be views of the bottoms; see allow_top_views(). */
+  bool allow_top_views_;
+
   /** The vector that indicates whether each top blob has a non-zero weight in
    *  the objective function. */
   vector<Dtype> loss_;
@@ -441,6 +485,11 @@ template <typename Dtype>
 inline Dtype Layer<Dtype>::Forward(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
   Dtype loss = 0;
+  // Layers read their bottoms through raw pointers, which a strided view
+  // does not have until it is gathered.
+  for (int bottom_id = 0; bottom_id < bottom.size(); ++bottom_id) {
+    bottom[bottom_id]->Contiguous();
+  }
   Reshape(bottom, top);
   switch (Caffe::mode()) {
   case Caffe::CPU:
@@ -491,12 +540,13 @@ inline void Layer<Dtype>::Backward(const vector<Blob<Dtype>*>& top,
 
 // Serialize LayerParameter to protocol buffer
 template <typename Dtype>
-void Layer<Dtype>::ToProto(LayerParameter* param, bool write_diff) {
+void Layer<Dtype>::ToProto(LayerParameter* param, bool write_diff,
+    BlobProto::Precision precision) {
   param->Clear();
   param->CopyFrom(layer_param_);
   param->clear_blobs();
   for (int i = 0; i < blobs_.size(); ++i) {
-    blobs_[i]->ToProto(param->add_blobs(), write_diff);
+    blobs_[i]->ToProto(param->add_blobs(), write_diff, precision);
   }
 }
 
@@ -7,9 +7,11 @@
 
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
+#include "caffe/internal_thread.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/net.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/blocking_queue.hpp"
 #include "caffe/util/format.hpp"
 
 namespace caffe {
@@ -23,6 +25,9 @@ namespace caffe {
  *        model), and only the parameters associated with this subnet are 
  *        updated.  In the next pass, the gradient is propagated through both 
  *        the subnets, and only the first (normally the generator) is updated.
+ *        When a solver drives the net, the phase follows the solver iteration
+ *        rather than the number of Backward calls (see UpdatePhase), so it 
+ *        stays in step with param_group schedules, iter_size and snapshots.
  * 
  *        Note that this implementation has two instances of subnet2 because in
  *        generative adversarial networks, the discriminator (subnet2) takes 
@@ -31,12 +36,31 @@ namespace caffe {
  *        The "f" in subnet2f_ stands for "fixed" (this is the instance that is
  *        used for computing the subnet1 update without modifying the subnet2 
  *        constants.
+ *
+ *        With async set, the discriminator pass over the real data (which 
+ *        does not depend on the generator) runs on a worker thread while this
+ *        thread samples the generator and runs the discriminator over the 
+ *        generated batch.  The worker has its own instance of subnet2 
+ *        (subnet2ext_layer_) that shares subnet2's weights but not its 
+ *        diffs, which are added into subnet2's once both passes are done.  
+ *        Its nets share the model's NetScheduler, so subnet2 may not use 
+ *        phase counters in async mode (checked at setup).
+ *        With prefetch_generated also set, the last generator step keeps a 
+ *        copy of its batch in gen_buffer_, and the discriminator step after
+ *        it trains on that copy instead of sampling the generator again.
+ *
+ *        The parameters are named <layer>::subnet1::* and <layer>::subnet2::*,
+ *        so each subnet can be its own solver param_group, with its own update
+ *        rule and a schedule matching subnet2_k (see ParamGroupParameter).  
+ *        Then the subnet that is not being trained is left completely alone, 
+ *        momentum and weight decay included.
  */
 template <typename Dtype>
-class AdversarialSubnetPairLayer : public Layer<Dtype> {
+class AdversarialSubnetPairLayer : public Layer<Dtype>, public InternalThread {
  public:
   explicit AdversarialSubnetPairLayer(const LayerParameter& param)
       : Layer<Dtype>(param) {}
+  virtual ~AdversarialSubnetPairLayer() { this->StopInternalThread(); }
   virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
@@ -47,6 +71,8 @@ class AdversarialSubnetPairLayer : public Layer<Dtype> {
   virtual inline int MaxBottomBlobs() const { return -1; }
   virtual inline int MinNumTopBlobs() const { return 2; }
   virtual inline int MaxNumTopBlobs() const { return -1; }
+  //keeps a phase counter and runs a thread of its own
+  virtual inline bool ForwardUsesGlobalState() const { return true; }
 
   virtual inline bool AllowForceBackward(const int bottom_index) const {
     return true;
@@ -59,6 +85,16 @@ class AdversarialSubnetPairLayer : public Layer<Dtype> {
   virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
+  //the worker loop for async mode: runs RealDataPass once per queued job
+  virtual void InternalThreadEntry();
+  //forward and backward of subnet2ext_layer_ over the real data
+  void RealDataPass();
+  //sets the phase from the solver iteration, if a solver drives the net
+  void UpdatePhase();
+  //points subnet2ext_layer_'s weights at subnet2_layer_'s again, if they have
+  //been re-bound (e.g. by Solver::Test) since the last time
+  void ShareDiscriminatorWeights();
+
   //the number of iterations to train subnet2 before spending one on subnet1
   int subnet2_k_;
 
@@ -96,6 +132,18 @@ class AdversarialSubnetPairLayer : public Layer<Dtype> {
   //N_geninputs_.  N_gen_ is the number of outputs of subnet1, and N_patterns_ 
   //is the size of those output blobs along axis 0.
   int N_geninputs_, N_gen_, N_patterns_;
+
+  //async mode: the second discriminator instance, and the queues that hand
+  //real-data passes to the worker thread and report them done
+  bool async_, prefetch_generated_;
+  shared_ptr<Layer<Dtype> > subnet2ext_layer_;
+  BlockingQueue<int> jobs_, jobs_done_;
+
+  //the generated batch kept for the next discriminator step, and the bottom 
+  //list that feeds it to subnet2
+  vector<shared_ptr<Blob<Dtype> > > gen_buffer_;
+  vector<Blob<Dtype>*> subnet2buf_bottom_vec_;
+  bool gen_buffer_ready_;
 };
 
 }  // namespace caffe
@@ -17,7 +17,7 @@ namespace caffe {
 /**
  * @brief Given a bottom blob representing a D-dimensional vector of 
  *        probabilities p_{i}, randomly draw a 0 or 1 for each entry,
- *        choosing 0 with probability p_{i} and 1 with probability 1-p_{i}.
+ *        choosing 1 with probability p_{i} and 0 with probability 1-p_{i}.
  * 
  * Bottom blobs:
  *  - p, probability vector (arbitrary shape)
@@ -39,6 +39,7 @@ class BernoulliSampleLayer : public Layer<Dtype> {
   virtual inline const char* type() const { return "BernoulliSample"; }
   virtual inline int ExactNumBottomBlobs() const { return 1; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
+  virtual inline bool ForwardUsesGlobalState() const { return true; }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -44,6 +44,8 @@ class CropLayer : public Layer<Dtype> {
   Blob<int> offsets;
   Blob<int> src_strides_;
   Blob<int> dest_strides_;
+  // Where the crop starts in the bottom, when the top is a view of it.
+  int view_offset_;
 
  private:
   // Recursive copy function.
@@ -39,6 +39,8 @@ class DropoutLayer : public NeuronLayer<Dtype> {
       const vector<Blob<Dtype>*>& top);
 
   virtual inline const char* type() const { return "Dropout"; }
+  // draws its mask from the global random generator
+  virtual inline bool ForwardUsesGlobalState() const { return true; }
 
  protected:
   /**
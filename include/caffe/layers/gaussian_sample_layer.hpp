@@ -31,12 +31,15 @@ namespace caffe {
  * 
  * Top blobs:
  *  - x', a random sample from the D-dimensional distribution 
- *    gaus(mu,sigma)
+ *    gaus(mu,sigma).  If gaussian_mc_param.num_samples is M>1, M samples are 
+ *    drawn for each item and stacked along axis 0, so that sample iM of item 
+ *    i is at index iM*N+i (shape (N*M,...)); mu and sigma are broadcast 
+ *    rather than copied, and their gradients are summed over the samples.
  *  - sigma (optional).  Some downstream things (like GaussianLossLayer) 
  *    need to have a mu and a sigma as inputs.  If a sigma blob is provided
  *    in this layer's bottom vector, it is copied over to this; otherwise, 
  *    this is reshaped to match mu and filled with the constant value taken
- *    from the .prototxt.
+ *    from the .prototxt.  It has the same shape as x'.
 */
 
 template <typename Dtype>
@@ -54,6 +57,7 @@ class GaussianSampleLayer : public Layer<Dtype> {
   virtual inline int MaxNumBottomBlobs() const { return 2; }
   virtual inline int MinNumTopBlobs() const { return 1; }
   virtual inline int MaxNumTopBlobs() const { return 2; }
+  virtual inline bool ForwardUsesGlobalState() const { return true; }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -66,9 +70,12 @@ class GaussianSampleLayer : public Layer<Dtype> {
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
+  //scratch for the summed dmu (data) and dsigma (diff) of Backward_gpu
   Blob<Dtype> temp_;
   Dtype sigma_;
   Dtype cliplimit_;
+  //number of Monte Carlo samples drawn per input
+  int num_samples_;
 
 };
 
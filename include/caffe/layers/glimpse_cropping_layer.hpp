@@ -14,15 +14,24 @@ namespace caffe{
  *        input to a glimpse network
  *
  * Bottom blobs:
- *  - the full image
- *  - a location tuple describing where to crop from
+ *  - the full image, shape (N,C,H,W)
+ *  - a location tuple describing where to crop from, shape (N*M,2).  With 
+ *    M>1 (e.g. several Monte Carlo glimpse locations per image, as drawn by 
+ *    GaussianSampleLayer with num_samples=M), location iM*N+i crops from 
+ *    image i; the images are read in place, not replicated.
  *  - (optional) if the image is a variable-sized image embedded in a larger
  *    fixed size blob, the third bottom blob provides the boundaries of the 
- *    embedded image
+ *    embedded image, one per image
  * 
  * Top blobs:
- *  - the cropped image
+ *  - the cropped image, one per location tuple, shape (N*M,C*L,window,window)
  *
+ * The glimpse is a foveated pyramid of L levels, L=max(depth,do_downsamp ? 
+ * 2 : 1).  Level l covers a square of window*scalefac^l pixels (scalefac 
+ * defaults to 2) at the same location, box-averaged down to window x window,
+ * and fills channels [l*C,(l+1)*C) of the top blob.  Coarse levels are read 
+ * from a summed-area table of the image built once per forward pass, so each
+ * glimpse pixel costs four reads whatever its scale.
  */
 template <typename Dtype>
 class GlimpseCroppingLayer : public Layer<Dtype> {
@@ -49,11 +58,30 @@ class GlimpseCroppingLayer : public Layer<Dtype> {
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
+  //fill integral_ with the summed-area table of each image plane
+  void BuildIntegral_cpu(const Blob<Dtype>* image);
+  void BuildIntegral_gpu(const Blob<Dtype>* image);
+  //image bounds for image img, honoring the optional embedding bounds
+  void ImageBounds(const Dtype* embed_bounds, int img, int* H, int* W) const;
+
   //the cropped region is a square with crop_size_ pixels on a side
   int crop_size_;  
   int channels_;
   int height_, width_;
-  bool do_downsamp_;
+  //number of pyramid levels
+  int num_levels_;
+  //side of the image square each level covers
+  vector<int> level_extent_;
+  //per level, the crop_size_+1 edges of the grid of averaging boxes, as 
+  //offsets into the level's square, shape (L,crop_size_+1)
+  Blob<int> box_edges_;
+  //per level, the box each offset into the level's square falls in, shape
+  //(L,largest extent)
+  Blob<int> box_index_;
+  //summed-area table of bottom[0], shape (N,C,H+1,W+1); only needed when 
+  //some level is downsampled
+  Blob<Dtype> integral_;
+  bool use_integral_;
 };
 
 }  // namespace caffe
@@ -34,6 +34,8 @@ class HDF5DataLayer : public Layer<Dtype> {
   virtual inline const char* type() const { return "HDF5Data"; }
   virtual inline int ExactNumBottomBlobs() const { return 0; }
   virtual inline int MinTopBlobs() const { return 1; }
+  // reshuffles (with the global random generator) on reaching the end
+  virtual inline bool ForwardUsesGlobalState() const { return true; }
 
  protected:
   void Next();
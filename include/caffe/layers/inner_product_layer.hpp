@@ -4,6 +4,7 @@
 #include <vector>
 
 #include "caffe/blob.hpp"
+#include "caffe/half_blob.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 
@@ -28,6 +29,9 @@ class InnerProductLayer : public Layer<Dtype> {
   virtual inline const char* type() const { return "InnerProduct"; }
   virtual inline int ExactNumBottomBlobs() const { return 1; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
+  /// Writes the 16-bit weights back first if release_full_weights freed them.
+  virtual void ToProto(LayerParameter* param, bool write_diff = false,
+      BlobProto::Precision precision = BlobProto::FULL);
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -45,6 +49,16 @@ class InnerProductLayer : public Layer<Dtype> {
   bool bias_term_;
   Blob<Dtype> bias_multiplier_;
   bool transpose_;  ///< if true, assume transposed weights
+  /// Whether release_full_weights has freed the weights since the last copy:
+  /// their memory has been replaced and not touched since.
+  inline bool full_weights_released() const {
+    return release_full_weights_ &&
+        this->blobs_[0]->data()->head() == SyncedMemory::UNINITIALIZED;
+  }
+
+  /// 16-bit copy of the weights for Forward_cpu, if weight_precision is set
+  shared_ptr<HalfBlob<Dtype> > half_weight_;
+  bool release_full_weights_;
 };
 
 }  // namespace caffe
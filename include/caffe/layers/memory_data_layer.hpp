@@ -37,6 +37,12 @@ class MemoryDataLayer : public BaseDataLayer<Dtype> {
   // Reset should accept const pointers, but can't, because the memory
   //  will be given to Blob, which is mutable
   void Reset(Dtype* data, Dtype* label, int n);
+  /**
+   * @brief Like Reset(data, label, n), but holds owner (see
+   *        Blob::set_cpu_data) for as long as the layer or its tops use the
+   *        memory, so the caller need not keep it alive.
+   */
+  void Reset(Dtype* data, Dtype* label, int n, const shared_ptr<void>& owner);
   void set_batch_size(int new_size);
 
   int batch_size() { return batch_size_; }
@@ -51,6 +57,7 @@ class MemoryDataLayer : public BaseDataLayer<Dtype> {
   int batch_size_, channels_, height_, width_, size_;
   Dtype* data_;
   Dtype* labels_;
+  shared_ptr<void> owner_;
   int n_;
   size_t pos_;
   Blob<Dtype> added_data_;
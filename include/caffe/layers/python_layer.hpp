@@ -35,6 +35,8 @@ class PythonLayer : public Layer<Dtype> {
   }
 
   virtual inline const char* type() const { return "Python"; }
+  // Python code must run on the thread holding the interpreter.
+  virtual inline bool ForwardUsesGlobalState() const { return true; }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -29,6 +29,7 @@ class RandomLayer : public Layer<Dtype> {
   virtual inline const char* type() const { return "Random"; }
   virtual inline int ExactNumBottomBlobs() const { return 0; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
+  virtual inline bool ForwardUsesGlobalState() const { return true; }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
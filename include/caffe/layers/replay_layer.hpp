@@ -0,0 +1,75 @@
+#ifndef CAFFE_REPLAY_LAYER_HPP_
+#define CAFFE_REPLAY_LAYER_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+template <typename Dtype> class ReplayBuffer;
+
+/**
+ * @brief An experience replay buffer.  Each forward pass stores the incoming
+ *        batch of (input, action, reward, ...) tuples and emits a batch of
+ *        the same size sampled from everything stored so far.
+ *
+ * The buffer is a fixed arena of num_slots slots, each holding one whole
+ * tuple, allocated once up front.  New tuples go into slots freed by
+ * retirement first, and otherwise overwrite the slots in ring order.  With
+ * max_use_count>0 a slot is retired once it has been sampled that many times.
+ * Layers with the same buffer_index share one buffer, e.g. an acting net
+ * that fills it and a training net that samples from it.
+ *
+ * Bottom blobs:
+ *  - K tuple components, each of shape (N,...)
+ *  - (if num_categories>1) the category of each tuple, shape (N), with values
+ *    in [0,num_categories).  Batches are stratified: each category that has
+ *    stored tuples gets an equal share of the batch.
+ *
+ * Top blobs:
+ *  - K sampled tuple components, the same shapes as the bottoms.  In the TEST
+ *    phase the bottoms are passed through unchanged.
+ *
+ * Replayed tuples carry no gradient back to the nets that produced them, so
+ * in the TRAIN phase Backward zeroes the bottom diffs; in the TEST phase it
+ * passes the gradient through, like Forward.
+ */
+template <typename Dtype>
+class ReplayLayer : public Layer<Dtype> {
+ public:
+  explicit ReplayLayer(const LayerParameter& param)
+      : Layer<Dtype>(param) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  virtual inline const char* type() const { return "Replay"; }
+  virtual inline int MinBottomBlobs() const { return 1; }
+  virtual inline int MinTopBlobs() const { return 1; }
+  //samples with the global random generator
+  virtual inline bool ForwardUsesGlobalState() const { return true; }
+
+  //the number of tuples currently stored
+  int size() const;
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+
+  shared_ptr<ReplayBuffer<Dtype> > buffer_;
+  int num_categories_;
+  //number of tuple components, i.e. bottoms excluding the category
+  int num_components_;
+  //the slots to gather for the current batch
+  vector<int> batch_slots_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_REPLAY_LAYER_HPP_
@@ -19,7 +19,8 @@ namespace caffe {
  * Bottom blobs:
  *   - predictions:  shape (N*M,C,T) where C is the number of channels and T is 
  *     the number of timesteps, and M is an integer (like the number of toyMC 
- *     tosses for each input)
+ *     tosses for each input); toss iM of input i is at index iM*N+i, which is 
+ *     the layout GaussianSampleLayer produces with num_samples=M
  *   - labels:  shape (N,t), where the values are integers ranging from 0 to 
  *     C-1 (inclusive) and T is evenly divisble by the number of targets t
  *   - rewards:  shape (N*M,T).  This input is ignored during the forward pass, 
@@ -54,9 +55,15 @@ class RewardLayer : public Layer<Dtype> {
       const vector<Blob<Dtype>*>& top);
   virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+  virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
   bool per_target_rewards_;
   Blob<Dtype> diff_;
+  //predicted class per (sample,timestep), used by the GPU path
+  Blob<int> argmax_;
   int num_targets_;
   Dtype max_correct_, min_pred_;
 };
@@ -30,6 +30,20 @@ namespace caffe {
  *        layers that need to be treated differently than the rest of the 
  *        network in some way:  multi-phase training (as in adversarial 
  *        networks), unrolled recurrent networks, etc.
+ *
+ *        By default the subnet outputs are copied into the top blobs on every
+ *        Forward (and the top diffs copied back on every Backward).  Setting 
+ *        shared_outputs for a top blob instead makes that top blob share the 
+ *        SyncedMemory of the subnet output (data) and of the blob that 
+ *        receives the output's gradient (diff), so that no copies are made.
+ *
+ *        Layers with the same share_subnet key share a single subnet, i.e. 
+ *        one set of layers and weights, built by whichever of them is set up 
+ *        first.  Each keeps its own activation blobs and swaps them into the 
+ *        subnet (see Net::reset_blobs) before every pass, as UnrollLayer does 
+ *        for its timesteps.  As there, state that a layer of the subnet keeps 
+ *        in the layer object itself between forward and backward (dropout 
+ *        masks, max-pooling indices, ...) is shared too.
  */
 template <typename Dtype>
 class SubnetLayer : public Layer<Dtype> {
@@ -44,6 +58,8 @@ class SubnetLayer : public Layer<Dtype> {
   virtual inline const char* type() const { return "Subnet"; }
   virtual inline int MinNumBottomBlobs() const { return 0; }
   virtual inline int MinNumTopBlobs() const { return 0; }
+  //a shared subnet is used by more than one layer
+  virtual inline bool ForwardUsesGlobalState() const { return shares_subnet_; }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -55,42 +71,59 @@ class SubnetLayer : public Layer<Dtype> {
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
+  //returns the index of the subnet blob that receives the gradient for top 
+  //blob i: the bottom of its pseudo-loss, i.e. either the output blob itself 
+  //or the split that insert_splits put in front of the pseudo-loss
+  int output_diff_blob_index(int i);
+
+  //Some calling functions (such as UnrollLayer) may want to swap out the 
+  //internal blobs used by the subnet (see Net::reset_blobs), which leaves 
+  //subnet_input_blobs_ etc. stale.  This re-reads them from the blob indices 
+  //resolved in LayerSetUp, but only if the subnet's blobs_generation() has 
+  //changed since the last time.
+  void RefreshBlobHandles();
+
+  //for top blobs with shared_outputs set: OutputIsBound checks that top still 
+  //aliases the subnet output (a Reshape or a blob swap by e.g. UnrollLayer 
+  //can break this), and BindOutput (re-)establishes the aliasing
+  bool OutputIsBound(int i, Blob<Dtype>* top);
+  void BindOutput(int i, Blob<Dtype>* top);
+  //zeroes the subnet's blob diffs ahead of a backward pass, skipping those 
+  //that are still clean or that alias the diff of one of the top blobs
+  void ClearSubnetDiffs(const vector<Blob<Dtype>*>& top);
+  //re-shares the subnet's weights if they may have been re-bound (e.g. by 
+  //Solver::Test calling test_net->ShareTrainedLayersWith(net_.get())) since 
+  //the last time
+  void RefreshWeights();
+  //with share_subnet: InitBlobSet sets up this layer's own activation blobs 
+  //for the subnet and the nets nested in it, and BindBlobSet swaps them in 
+  //if another layer sharing the subnet has swapped in its own since
+  void InitBlobSet(bool built_here);
+  void BindBlobSet();
 
   shared_ptr<Net<Dtype> > subnet_;
   int last_layer_index_;
   
   //some applications (like multi-phase training) may want a subnet that only 
-  //does, e.g., a backward pass every Nth iteration. This layer supports that 
-  //by keeping a counter that tells how many times the subnet has gotten a call
-  //to Forward or Backward.  The counter value itself is static because in 
-  //general you may want to coordinate this behavior across different subnets 
-  //(for example, in a GAN you have a generator and a discriminator, and the 
-  //training algorithm has only one getting trained for a while, followed by 
-  //an iteration where only the other gets trained).  The next few variables
-  //enable that call counting.
-
-  //increments on backward if false; in either case, increment happens only if 
-  //phase_counter_index_>=0 and phase_counter_reset_>0
-  bool increment_on_forward_; 
-
-  //when phase_counter_[phase_counter_index_]==phase_counter_reset, the phase 
-  //counter gets reset to 0 
-  int phase_counter_index_, phase_counter_reset_; 
-  static vector<int> phase_counter_;
-
-  //meaning of forward_mode_ and backward_mode_:
-  //0(default)==>always do forward/back; 
-  //1==>only if counter is zero; 
-  //2==>only if counter is non-zero; 
-  //3==>never
-  //also:  to zero out this layer's parameter diffs after the backward pass 
-  //has completed use backward_mode==4 (to do it when phase_counter!=0) 
-  //or backward_mode==5 (to do it when phase_counter==0)
-  int forward_mode_, backward_mode_;  
+  //does, e.g., a backward pass every Nth iteration.  That schedule 
+  //(phase_counter_index, forward_mode, backward_mode, ... in subnet_param) is 
+  //carried out by the enclosing Net's NetScheduler, which decides before each 
+  //pass whether this layer runs at all; see net_scheduler.hpp.
 
   vector<bool> shared_inputs_;
+  vector<bool> shared_outputs_;
   vector<shared_ptr<Blob<Dtype> > > subnet_input_blobs_;
   vector<shared_ptr<Blob<Dtype> > > subnet_output_blobs_;
+  vector<shared_ptr<Blob<Dtype> > > subnet_output_diff_blobs_;
+  vector<int> subnet_input_idx_, subnet_output_idx_, subnet_output_diff_idx_;
+  int blobs_generation_, weights_generation_;
+
+  //prefix of the subnet's layer names: this layer's name, or the 
+  //share_subnet key
+  string subnet_prefix_;
+  bool shares_subnet_;
+  vector<shared_ptr<Net<Dtype> > > blob_set_nets_;
+  vector<vector<shared_ptr<Blob<Dtype> > > > blob_set_;
 
 
 };
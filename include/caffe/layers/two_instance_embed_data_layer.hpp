@@ -17,8 +17,9 @@ namespace caffe {
  * @brief A data layer for a multi-object detection benchmark, intended for use
  *        with the MNIST handwritten digits dataset.  This class takes two 
  *        instances of the input patterns and randomly places them on a
- *        100x100 blank image.  Produces up to three top blobs:
- *        the 100x100 image itself, a labels blob with shape (N,2) to
+ *        blank canvas (100x100 unless data_param.canvas_height/canvas_width
+ *        say otherwise).  Produces up to three top blobs:
+ *        the canvas itself, a labels blob with shape (N,2) to
  *        specify the two digits, and a location truth blob with 
  *        shape (N,4) to specify the (x,y) coordinates where the two input
  *        instances were placed.
@@ -43,6 +44,13 @@ class TwoInstanceEmbedDataLayer : public BasePrefetchingDataLayer<Dtype> {
   virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
 
+  //clears one canvas_height x canvas_width item of the batch and draws the
+  //uint8 pattern (channels x height x width) on it twice, with top-left
+  //corners (offsets[0],offsets[1]) and (offsets[2],offsets[3]), scaling
+  //brightness to [0,1].  the second instance wins where the two overlap.
+  static void EmbedInstances(const string& pixels, int channels, int height,
+      int width, const int* offsets, int canvas_height, int canvas_width,
+      Dtype* canvas);
 
  protected:
   void Next();
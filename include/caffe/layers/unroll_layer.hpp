@@ -44,6 +44,17 @@ namespace caffe {
  *            concatenated across time to form a single blob of shape 
  *            (<original shape>,T), which is published as a top blob of this 
  *            layer.
+ *
+ *        By default the intermediate blobs of the subnet are stored for every 
+ *        timestep, so memory grows linearly with the number of timesteps. 
+ *        Setting unroll_param.checkpoint_interval to k keeps only k copies 
+ *        and, during Backward, re-runs each k-step segment forward (starting 
+ *        from the recurrent outputs, which are always kept) before 
+ *        backpropagating through it.  That only gives the right gradients 
+ *        if the recomputed segment matches the original one, so 
+ *        checkpointing is limited to CPU mode and to subnets whose layers 
+ *        are all repeatable (see Layer::ForwardIsRepeatable): no sampling 
+ *        layers, and no phase counters.
  */
 template <typename Dtype>
 class UnrollLayer : public Layer<Dtype> {
@@ -60,11 +71,13 @@ class UnrollLayer : public Layer<Dtype> {
   virtual inline int MaxBottomBlobs() const { return -1; }
   virtual inline int MinNumTopBlobs() const { return 0; }
   virtual inline int MaxNumTopBlobs() const { return -1; }
-
   virtual inline bool AllowForceBackward(const int bottom_index) const {
     return true;
   }
 
+  /// @brief bytes of activation memory (data and diff) held by this layer
+  inline size_t peak_memory_bytes() const { return peak_memory_bytes_; }
+
  protected:
 
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -74,6 +87,27 @@ class UnrollLayer : public Layer<Dtype> {
   virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
+  //run the subnet forward/backward for a single timestep, with the subnet 
+  //bound to the blobs of that timestep's slot
+  void ForwardTimestep(int itime);
+  void BackwardTimestep(int itime);
+  //the top blobs interleave time along their last axis: ScatterTimestep 
+  //writes timestep itime's outputs into its slice of them, and 
+  //GatherTimestep reads the gradient for that timestep back out
+  void ScatterTimestep(int itime, const vector<Blob<Dtype>*>& top);
+  void GatherTimestep(int itime, const vector<Blob<Dtype>*>& top);
+  void ScatterTimestep_gpu(int itime, const vector<Blob<Dtype>*>& top);
+  void ReshapeTops(const vector<Blob<Dtype>*>& top);
+  //binds the subnet(s) to the intermediate blobs in subnet_blobs_[islot]
+  void BindSlot(int islot);
+  inline int slot(int itime) const { return itime % num_slots_; }
+  //bytes of data+diff needed for the given number of subnet blob copies plus 
+  //the per-timestep outputs, which are always kept for every timestep
+  size_t MemoryFootprint(int num_slots) const;
+  //whether a subnet layer (and everything nested in it) gives the same 
+  //results when run forward again, as recomputing a segment requires
+  static bool SubnetLayerIsRepeatable(Layer<Dtype>* layer);
+
   //the number of forward/backward passes to do over the sampling subnet during 
   //this->Forward()
   int num_timesteps_, N_recur_,N_input_,N_output_;
@@ -84,36 +118,25 @@ class UnrollLayer : public Layer<Dtype> {
 
   shared_ptr<Layer<Dtype> > subnet_layer_;
 
-  //indices: [itime][isubnet][iblob]; stores 
-  //subnet_layer_subnet()[isubnet]->blobs() at each timestep
+  //with checkpointing, intermediates are only kept for num_slots_ timesteps 
+  //at a time; timestep itime uses slot(itime)
+  int checkpoint_interval_, num_slots_;
+  size_t peak_memory_bytes_;
+
+  //indices: [islot][isubnet][iblob]; stores 
+  //subnet_layer_subnet()[isubnet]->blobs() for each slot (== each timestep 
+  //unless checkpointing is on)
   vector<vector<vector<shared_ptr<Blob<Dtype> > > > > subnet_blobs_;
+  //per-timestep inputs/outputs of the subnet.  The recurrent outputs at 
+  //one timestep are used directly as the recurrent inputs at the next, and 
+  //without checkpointing the outputs alias the subnet's output blobs (see 
+  //SubnetParameter.shared_outputs) instead of being copied out of them
   vector<vector<Blob<Dtype>*> > subnet_bottom_vec_; 
   vector<vector<Blob<Dtype>*> > subnet_top_vec_;   
+  //the per-time inputs feed every timestep, and each timestep's backward pass 
+  //overwrites their (shared) diff: their gradient is summed up here
+  vector<shared_ptr<Blob<Dtype> > > input_diff_sum_;
 
-  //subnet_top_vec_ entries get used by reshape_layer_ as well as by 
-  //subnet_bottom_vec_ at the next timestep, so we need a split layer
-  vector<vector<shared_ptr<Layer<Dtype> > > > split_layer_;
-
-  //indices: [itime][iprod][iblob(==itime)] where iprod indexes the N_output_ 
-  //products of the subnet
-  vector<vector<vector<Blob<Dtype>*> > > split_bottom_vec_; 
-  vector<vector<vector<Blob<Dtype>*> > > split_top_vec_;
-
-  //consolidate the output blobs across time
-  vector<vector<shared_ptr<Layer<Dtype> > > > reshape_layer_;
-
-  //indices: [itime][iprod][iblob(==itime)] where iprod indexes the N_output_ 
-  //products of the subnet
-  vector<vector<vector<Blob<Dtype>*> > > reshape_bottom_vec_; 
-  vector<vector<vector<Blob<Dtype>*> > > reshape_top_vec_;
-
-  vector<shared_ptr<Layer<Dtype> > > concat_layer_;
-
-  //indices: [iprod][iblob(==itime)] where iprod indexes the N_recur_+N_output_ 
-  //products of the subnet
-  vector<vector<Blob<Dtype>*> > concat_bottom_vec_; 
-  vector<vector<Blob<Dtype>*> > concat_top_vec_; 
-  
 };
 
 }  // namespace caffe
@@ -29,6 +29,16 @@ namespace caffe {
  * input, whereas the sample x' in the optional third top blob is a sample 
  * from p.
  *
+ * With decoder_only set, only the decoder is built, for sampling:
+ * Bottom blobs:
+ *   - latent samples z (or, with latent_sigma>0, their means)
+ *   - optional: a data point x, if the decoder (under decoder_stage) needs it
+ * Top blobs:
+ *   - zero, since there is no loss without the encoder
+ *   - the latent samples z that were decoded
+ *   - the samples x' drawn from p(x'|z)
+ * The decoder can run over the batch decoder_batch_size samples at a time, 
+ * which bounds the memory it needs for large latent batches.
  */
 template <typename Dtype>
 class VAELayer : public Layer<Dtype> {
@@ -50,18 +60,42 @@ class VAELayer : public Layer<Dtype> {
     return true;
   }
 
+  //decoder-only sampling draws from a new counter value on every pass
+  virtual inline bool ForwardIsRepeatable() const {
+    return !(decoder_only_ && latent_sigma_>0);
+  }
+
+  //a saved full VAE has the encoder's blobs ahead of the decoder's
+  virtual int TrainedBlobsOffset(const int num_source_blobs) const {
+    if(!decoder_only_ || num_source_blobs<this->blobs_.size()) return 0;
+    return num_source_blobs-this->blobs_.size();
+  }
+
  protected:
 
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
   virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+  void ForwardDecoderOnly(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
 
   int n_latent_;
   string encoder_prototxt_, decoder_prototxt_;
   Dtype encoder_loss_weight_;
   bool decoder_only_;
 
+  //decoder-only sampling: the chunk size (0 for the whole batch), the spread
+  //of the latent samples around bottom 0, and the counter-based stream that 
+  //they are drawn from
+  int decoder_batch_size_;
+  Dtype latent_sigma_;
+  unsigned int stream_id_;
+  uint64_t forward_count_;
+  //the decoder's inputs and output for one chunk, used in place of the 
+  //bottom and top blobs when chunking or sampling
+  Blob<Dtype> latent_chunk_, x_chunk_, sample_chunk_;
+
   shared_ptr<Layer<Dtype> > encoder_layer_;
   vector<Blob<Dtype>*> encoder_bottom_vec_;
   vector<Blob<Dtype>*> encoder_top_vec_;
@@ -10,7 +10,13 @@
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/layer.hpp"
+#include "caffe/net_scheduler.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/blocking_queue.hpp"
+
+// Forward declare boost::thread instead of including boost/thread.hpp, as
+// in internal_thread.hpp.
+namespace boost { class thread; }
 
 namespace caffe {
 
@@ -26,7 +32,7 @@ class Net {
   explicit Net(const NetParameter& param);
   explicit Net(const string& param_file, Phase phase,
       const int level = 0, const vector<string>* stages = NULL);
-  virtual ~Net() {}
+  virtual ~Net();
 
   /// @brief Initialize a network with a NetParameter.
   void Init(const NetParameter& param);
@@ -114,8 +120,9 @@ class Net {
   void CopyTrainedLayersFrom(const string trained_filename);
   void CopyTrainedLayersFromBinaryProto(const string trained_filename);
   void CopyTrainedLayersFromHDF5(const string trained_filename);
-  /// @brief Writes the net to a proto.
-  void ToProto(NetParameter* param, bool write_diff = false) const;
+  /// @brief Writes the net to a proto, with the weights in precision.
+  void ToProto(NetParameter* param, bool write_diff = false,
+      BlobProto::Precision precision = BlobProto::FULL) const;
   /// @brief Writes the net to an HDF5 file.
   void ToHDF5(const string& filename, bool write_diff = false) const;
 
@@ -134,6 +141,21 @@ class Net {
 
   /// @brief replace the list of blobs with the list passed in as an argument
   void reset_blobs(vector<shared_ptr<Blob<Dtype> > >& updated);
+  /**
+   * @brief returns a counter that changes every time reset_blobs swaps out
+   *        the blobs of this net, so that callers caching blob pointers know
+   *        when to refresh them.
+   */
+  inline int blobs_generation() const { return blobs_generation_; }
+  /**
+   * @brief returns a counter that changes every time the parameter blobs of
+   *        this net may have been re-bound to other memory (see
+   *        ShareTrainedLayersWith and CopyTrainedLayersFrom), so that layers
+   *        wrapping it know when ShareWeights has to be called again.
+   */
+  inline int weights_generation() const { return weights_generation_; }
+  /// @brief bumps weights_generation() of this net and of its layers' subnets
+  void WeightsRebound();
 
   /// @brief returns the layers
   inline const vector<shared_ptr<Layer<Dtype> > >& layers() const {
@@ -201,6 +223,10 @@ class Net {
     return param_names_index_;
   }
   inline const vector<int>& param_owners() const { return param_owners_; }
+  /// @brief for each param, its index into learnable_params()
+  inline const vector<int>& learnable_param_ids() const {
+    return learnable_param_ids_;
+  }
   inline const vector<string>& param_display_names() const {
     return param_display_names_;
   }
@@ -226,6 +252,14 @@ class Net {
 
   void set_debug_info(const bool value) { debug_info_ = value; }
 
+  /// @brief The scheduler that decides which layers run in each pass.
+  const shared_ptr<NetScheduler>& scheduler() const { return scheduler_; }
+  /**
+   * @brief Makes this net, and the nets nested in its layers, use scheduler.
+   *        Init calls it to hand its own scheduler down to the nested nets.
+   */
+  void set_scheduler(const shared_ptr<NetScheduler>& scheduler);
+
   // Helpers for Init.
   /**
    * @brief Remove layers that the user specified should be excluded given the current
@@ -276,6 +310,43 @@ class Net {
   void AppendParam(const NetParameter& param, const int layer_id,
                    const int param_id);
 
+  /**
+   * @brief For plan_memory: lets blobs whose lifetimes over the layer order
+   *        do not overlap share data memory, reusing the smallest free buffer
+   *        that is large enough (or growing the largest free one).  Blobs
+   *        already sharing memory (e.g. Split tops) are planned as one.
+   */
+  void PlanMemory(const NetParameter& param);
+  /**
+   * @brief Builds the graph of forward dependencies between layers: layer j
+   *        waits for layer i < j if j reads what i writes, writes what i
+   *        reads or writes, or if both use global state (see
+   *        Layer::ForwardUsesGlobalState).  Blobs that share memory count as
+   *        one.
+   */
+  void InitForwardDependencies();
+  /// @brief Whether a layer, or any layer in its subnets, uses global state.
+  static bool LayerForwardUsesGlobalState(Layer<Dtype>* layer);
+  /**
+   * @brief ForwardFromTo for parallel_forward: each layer is handed to the
+   *        worker threads as soon as the layers it depends on are done, in
+   *        ascending order, except for those that use global state, which
+   *        run on the calling thread.  Layer losses are summed in layer
+   *        order, so the result is bit-identical to a sequential pass.
+   */
+  Dtype ForwardParallel(int start, int end);
+  void DispatchForward(int layer_id, set<int>* caller_ready);
+  void ForwardWorkerEntry();
+  void StopForwardWorkers();
+
+  /// @brief Asks the scheduler which of the layers start..end run (forward
+  ///        order), recording the answers in forward_run_.
+  void PlanForward(int start, int end);
+  /// @brief Likewise for the backward pass from start down to end.
+  void PlanBackward(int start, int end);
+  /// @brief Zeroes the diffs of a layer's parameters.
+  void ClearLayerParamDiffs(int layer_id);
+
   /// @brief Helper for displaying debug info in Forward.
   void ForwardDebugInfo(const int layer_id);
   /// @brief Helper for displaying debug info in Backward.
@@ -300,6 +371,10 @@ class Net {
   vector<string> blob_names_;
   map<string, int> blob_names_index_;
   vector<bool> blob_need_backward_;
+  /// incremented by reset_blobs
+  int blobs_generation_;
+  /// incremented by WeightsRebound
+  int weights_generation_;
   /// bottom_vecs stores the vectors containing the input for each layer.
   /// They don't actually host the blobs (blobs_ does), so we simply store
   /// pointers.
@@ -343,6 +418,28 @@ class Net {
   size_t memory_used_;
   /// Whether to compute and display debug info for the net.
   bool debug_info_;
+  shared_ptr<NetScheduler> scheduler_;
+  /// whether each layer asks the scheduler before it runs, and the answers
+  /// for the current pass
+  vector<bool> layer_scheduled_;
+  vector<bool> forward_run_;
+  vector<bool> backward_run_;
+  vector<bool> backward_clear_param_diffs_;
+  /// parallel_forward state: the dependency graph, the layers that must run
+  /// on the calling thread, and the worker threads with their queues
+  bool parallel_forward_;
+  int forward_threads_;
+  vector<vector<int> > forward_preds_;
+  vector<vector<int> > forward_succs_;
+  vector<bool> forward_on_caller_;
+  vector<Dtype> forward_losses_;
+  vector<shared_ptr<boost::thread> > forward_workers_;
+  BlockingQueue<int> forward_jobs_;
+  BlockingQueue<int> forward_done_;
+  /// the calling thread's thread-local state, mirrored by the workers
+  unsigned int forward_seed_;
+  int forward_solver_count_;
+  int forward_solver_rank_;
   // Callbacks
   vector<Callback*> before_forward_;
   vector<Callback*> after_forward_;
@@ -0,0 +1,68 @@
+#ifndef CAFFE_NET_SCHEDULER_HPP_
+#define CAFFE_NET_SCHEDULER_HPP_
+
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief Decides which layers of a Net run in each pass, for training
+ *        schedules in which parts of a model take turns (e.g. the generator
+ *        and the discriminator of a GAN).
+ *
+ * A layer opts in by setting subnet_param.phase_counter_index >= 0.  Layers
+ * with the same index share a counter, which each of them with
+ * phase_counter_reset > 0 advances once per forward pass (if
+ * increment_on_forward) or backward pass (otherwise); at the end of a
+ * backward pass the counter wraps back to 0 once it exceeds
+ * phase_counter_reset.  forward_mode and backward_mode then say when the
+ * layer runs, judged by the counter before the layer advances it:
+ *   0: always, 1: only if the counter is 0, 2: only if it is not, 3: never.
+ * backward_mode 4 and 5 always run the backward pass, and afterwards zero the
+ * layer's parameter diffs if the counter is non-zero (4) or zero (5).
+ *
+ * Each top-level Net owns one scheduler and shares it with the nets nested
+ * in its layers (see Net::set_scheduler), so the counters coordinate the
+ * layers of one model but are independent between nets, solvers and threads.
+ * The Net plans every pass with the scheduler before running it, so layers
+ * that are not to run are never dispatched at all.
+ */
+class NetScheduler {
+ public:
+  NetScheduler() : iteration_(-1) {}
+
+  /// @brief Whether a layer with this schedule runs its next forward pass.
+  bool Forward(const SubnetParameter& schedule);
+  /**
+   * @brief Whether a layer with this schedule runs its next backward pass,
+   *        and (zero_param_diffs) whether its parameter diffs are to be
+   *        zeroed after it.
+   */
+  bool Backward(const SubnetParameter& schedule, bool* zero_param_diffs);
+
+  /// @brief The current value of counter index.
+  int counter(int index) const;
+
+  /**
+   * @brief The solver iteration the net is computing (set by Solver::Step for
+   *        its train net), or -1 if no solver drives the net.  Every pass of
+   *        an iteration sees the same value, however large iter_size is.
+   */
+  int iteration() const { return iteration_; }
+  void set_iteration(int iteration) { iteration_ = iteration; }
+
+ protected:
+  int& mutable_counter(int index);
+
+  vector<int> counters_;
+  int iteration_;
+
+  DISABLE_COPY_AND_ASSIGN(NetScheduler);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_NET_SCHEDULER_HPP_
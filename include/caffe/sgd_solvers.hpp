@@ -30,6 +30,16 @@ class SGDSolver : public Solver<Dtype> {
   virtual void Normalize(int param_id);
   virtual void Regularize(int param_id);
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  // The SGD and Adam update rules, taking the settings that a param_group
+  // may override as arguments. t is the number of updates so far, counting
+  // this one.
+  void SGDUpdateValue(int param_id, Dtype rate, Dtype momentum);
+  void AdamUpdateValue(int param_id, Dtype rate, Dtype beta1, Dtype beta2,
+      Dtype eps_hat, int t);
+  // Whether some param_group uses Adam in a solver that is not Adam, which
+  // then keeps Adam's second moments at the end of history_, as AdamSolver
+  // does.
+  bool NeedsAdamHistory() const;
   virtual void ClipGradients();
   virtual void SnapshotSolverState(const string& model_filename);
   virtual void SnapshotSolverStateToBinaryProto(const string& model_filename);
@@ -46,6 +46,7 @@ class Solver {
   void Init(const SolverParameter& param);
   void InitTrainNet();
   void InitTestNets();
+  void InitParamGroups();
 
   // Client of the Solver optionally may call this in order to set the function
   // that the solver uses to see what action it should take (e.g. snapshot or
@@ -73,6 +74,10 @@ class Solver {
     return test_nets_;
   }
   int iter() const { return iter_; }
+  // Whether param_group group (-1 for the parameters in no group) is updated
+  // at iteration iter, and how many updates it has had up to and including it.
+  bool ParamGroupActive(int group, int iter) const;
+  int ParamGroupSteps(int group, int iter) const;
 
   // Invoked at specific points during an iteration
   class Callback {
@@ -115,6 +120,8 @@ class Solver {
   shared_ptr<Net<Dtype> > net_;
   vector<shared_ptr<Net<Dtype> > > test_nets_;
   vector<Callback*> callbacks_;
+  // the param_group of each learnable param of net_, or -1
+  vector<int> param_group_ids_;
   vector<Dtype> losses_;
   Dtype smoothed_loss_;
 
@@ -3,51 +3,11 @@
 
 #include <cstdlib>
 
-#ifdef USE_MKL
-  #include "mkl.h"
-#endif
-
 #include "caffe/common.hpp"
+#include "caffe/host_allocator.hpp"
 
 namespace caffe {
 
-// If CUDA is available and in GPU mode, host memory will be allocated pinned,
-// using cudaMallocHost. It avoids dynamic pinning for transfers (DMA).
-// The improvement in performance seems negligible in the single GPU case,
-// but might be more significant for parallel training. Most importantly,
-// it improved stability for large models on many GPUs.
-inline void CaffeMallocHost(void** ptr, size_t size, bool* use_cuda) {
-#ifndef CPU_ONLY
-  if (Caffe::mode() == Caffe::GPU) {
-    CUDA_CHECK(cudaMallocHost(ptr, size));
-    *use_cuda = true;
-    return;
-  }
-#endif
-#ifdef USE_MKL
-  *ptr = mkl_malloc(size ? size:1, 64);
-#else
-  *ptr = malloc(size);
-#endif
-  *use_cuda = false;
-  CHECK(*ptr) << "host allocation of size " << size << " failed";
-}
-
-inline void CaffeFreeHost(void* ptr, bool use_cuda) {
-#ifndef CPU_ONLY
-  if (use_cuda) {
-    CUDA_CHECK(cudaFreeHost(ptr));
-    return;
-  }
-#endif
-#ifdef USE_MKL
-  mkl_free(ptr);
-#else
-  free(ptr);
-#endif
-}
-
-
 /**
  * @brief Manages memory allocation and synchronization between the host (CPU)
  *        and device (GPU).
@@ -61,13 +21,30 @@ class SyncedMemory {
   ~SyncedMemory();
   const void* cpu_data();
   void set_cpu_data(void* data);
+  /**
+   * @brief Makes data, which this SyncedMemory does not own, its host memory.
+   *        owner (e.g. a shared_ptr with a custom deleter, or one to the
+   *        object that owns data) is held until the host memory is replaced
+   *        or this SyncedMemory is destroyed, keeping data alive meanwhile.
+   */
+  void set_cpu_data(void* data, const shared_ptr<void>& owner);
   const void* gpu_data();
   void set_gpu_data(void* data);
+  /// @brief Likewise for device memory.
+  void set_gpu_data(void* data, const shared_ptr<void>& owner);
   void* mutable_cpu_data();
   void* mutable_gpu_data();
   enum SyncedHead { UNINITIALIZED, HEAD_AT_CPU, HEAD_AT_GPU, SYNCED };
   SyncedHead head() { return head_; }
   size_t size() { return size_; }
+  // true if a mutable pointer has been handed out (or the memory replaced)
+  // since construction or the last mark_clean(); fresh memory is zero-filled,
+  // so a clean SyncedMemory still holds whatever it was last cleaned to.
+  bool dirty() const { return dirty_; }
+  void mark_clean() { dirty_ = false; }
+  // counts the mutable pointers handed out (and replacements of the memory),
+  // so that a copy derived from it can tell whether it may be out of date
+  unsigned int version() const { return version_; }
 
 #ifndef CPU_ONLY
   void async_gpu_push(const cudaStream_t& stream);
@@ -78,13 +55,27 @@ class SyncedMemory {
 
   void to_cpu();
   void to_gpu();
+  // If CUDA is available and in GPU mode, host memory will be allocated
+  // pinned, using cudaMallocHost. It avoids dynamic pinning for transfers
+  // (DMA).  The improvement in performance seems negligible in the single GPU
+  // case, but might be more significant for parallel training. Most
+  // importantly, it improved stability for large models on many GPUs.
+  // Otherwise it comes from host_allocator().
+  void malloc_host();
+  void free_host();
   void* cpu_ptr_;
   void* gpu_ptr_;
   size_t size_;
   SyncedHead head_;
   bool own_cpu_data_;
   bool cpu_malloc_use_cuda_;
+  shared_ptr<HostAllocator> cpu_allocator_;
   bool own_gpu_data_;
+  // keep memory that is not owned alive, if set
+  shared_ptr<void> cpu_owner_;
+  shared_ptr<void> gpu_owner_;
+  bool dirty_;
+  unsigned int version_;
   int device_;
 
   DISABLE_COPY_AND_ASSIGN(SyncedMemory);
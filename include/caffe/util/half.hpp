@@ -0,0 +1,116 @@
+#ifndef CAFFE_UTIL_HALF_HPP_
+#define CAFFE_UTIL_HALF_HPP_
+
+#include <stdint.h>
+#include <cstring>
+
+#ifdef __F16C__
+#include <immintrin.h>
+#endif
+
+namespace caffe {
+
+// 16-bit storage formats.  They only hold values: arithmetic happens after
+// converting to float (see caffe_cpu_from_half and caffe_cpu_gemm_half).
+
+/// @brief IEEE 754 half precision: 5 exponent and 10 mantissa bits.
+struct fp16 {
+  uint16_t bits;
+};
+
+/// @brief bfloat16: the upper half of a float, 8 exponent and 7 mantissa
+///        bits -- float's range at a quarter of half's precision.
+struct bf16 {
+  uint16_t bits;
+};
+
+inline uint32_t float_bits(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));  // NOLINT(caffe/alt_fn)
+  return bits;
+}
+
+inline float bits_float(uint32_t bits) {
+  float value;
+  memcpy(&value, &bits, sizeof(value));  // NOLINT(caffe/alt_fn)
+  return value;
+}
+
+/// @brief Rounds to the nearest half, ties to even; overflows to infinity.
+inline fp16 float_to_fp16(float value) {
+  fp16 result;
+#ifdef __F16C__
+  result.bits = _cvtss_sh(value, 0);
+#else
+  // F. Giesen's branch-light conversion (float_to_half_fast3_rtne).
+  uint32_t bits = float_bits(value);
+  const uint32_t sign = bits & 0x80000000u;
+  bits ^= sign;
+  uint16_t half;
+  if (bits >= (127u + 16) << 23) {
+    // too large for a half: infinity, or a quiet NaN
+    half = bits > 0x7f800000u ? 0x7e00 : 0x7c00;
+  } else if (bits < 113u << 23) {
+    // a subnormal half (or zero): let float addition do the rounding
+    const uint32_t magic = ((127u - 15) + (23 - 10) + 1) << 23;
+    half = float_bits(bits_float(bits) + bits_float(magic)) - magic;
+  } else {
+    const uint32_t mantissa_odd = (bits >> 13) & 1;
+    bits += (static_cast<uint32_t>(15 - 127) << 23) + 0xfff + mantissa_odd;
+    half = bits >> 13;
+  }
+  result.bits = half | (sign >> 16);
+#endif
+  return result;
+}
+
+inline float fp16_to_float(fp16 value) {
+#ifdef __F16C__
+  return _cvtsh_ss(value.bits);
+#else
+  const uint32_t shifted_exponent = 0x7c00u << 13;
+  uint32_t bits = (value.bits & 0x7fffu) << 13;
+  const uint32_t exponent = bits & shifted_exponent;
+  bits += (127u - 15) << 23;
+  if (exponent == shifted_exponent) {
+    // infinity or NaN
+    bits += (128u - 16) << 23;
+  } else if (exponent == 0) {
+    // zero or subnormal: renormalize
+    bits += 1u << 23;
+    bits = float_bits(bits_float(bits) - bits_float(113u << 23));
+  }
+  return bits_float(bits | (value.bits & 0x8000u) << 16);
+#endif
+}
+
+/// @brief Rounds to the nearest bfloat16, ties to even.
+inline bf16 float_to_bf16(float value) {
+  uint32_t bits = float_bits(value);
+  bf16 result;
+  if ((bits & 0x7fffffffu) > 0x7f800000u) {
+    // keep NaNs NaN (and quiet) rather than rounding them to infinity
+    result.bits = (bits >> 16) | 0x40;
+  } else {
+    result.bits = (bits + 0x7fff + ((bits >> 16) & 1)) >> 16;
+  }
+  return result;
+}
+
+inline float bf16_to_float(bf16 value) {
+  return bits_float(static_cast<uint32_t>(value.bits) << 16);
+}
+
+// Overloads for code templated on the storage format.
+inline void float_to_half(float value, fp16* half) {
+  *half = float_to_fp16(value);
+}
+inline void float_to_half(float value, bf16* half) {
+  *half = float_to_bf16(value);
+}
+inline float half_to_float(fp16 half) { return fp16_to_float(half); }
+inline float half_to_float(bf16 half) { return bf16_to_float(half); }
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_HALF_HPP_
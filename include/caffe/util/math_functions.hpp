@@ -8,6 +8,7 @@
 
 #include "caffe/common.hpp"
 #include "caffe/util/device_alternate.hpp"
+#include "caffe/util/half.hpp"
 #include "caffe/util/mkl_alternate.hpp"
 
 namespace caffe {
@@ -88,6 +89,21 @@ void caffe_rng_bernoulli(const int n, const Dtype p, int* r);
 template <typename Dtype>
 void caffe_rng_bernoulli(const int n, const Dtype p, unsigned int* r);
 
+// caffe_rng_stream_* fill r[i] with element offset + i of a counter-based
+// stream (see Caffe::philox_stream). The result does not depend on how the
+// range is split across calls or threads; the GPU versions draw the same
+// values, up to the rounding of the device math library. Uniforms lie in the
+// open interval (a, b).
+template <typename Dtype>
+void caffe_rng_stream_uniform(const PhiloxStream& stream, const int n,
+                              const Dtype a, const Dtype b, Dtype* r,
+                              const int offset = 0);
+
+template <typename Dtype>
+void caffe_rng_stream_gaussian(const PhiloxStream& stream, const int n,
+                               const Dtype mu, const Dtype sigma, Dtype* r,
+                               const int offset = 0);
+
 template <typename Dtype>
 void caffe_exp(const int n, const Dtype* a, Dtype* y);
 
@@ -145,6 +161,30 @@ DEFINE_CAFFE_CPU_UNARY_FUNC(fabs, y[i] = std::fabs(x[i]))
 template <typename Dtype>
 void caffe_cpu_scale(const int n, const Dtype alpha, const Dtype *x, Dtype* y);
 
+// Conversions between Dtype and the 16-bit storage formats fp16 and
+// bf16 (see caffe/util/half.hpp), rounding to nearest even.
+template <typename Dtype, typename Half>
+void caffe_cpu_to_half(const int n, const Dtype* x, Half* y);
+
+template <typename Dtype, typename Half>
+void caffe_cpu_from_half(const int n, const Half* x, Dtype* y);
+
+// caffe_cpu_gemm with B (or A) stored as fp16 or bf16.  The 16-bit
+// operand is expanded to Dtype a panel of the K dimension at a time, so the
+// products are accumulated in Dtype by the usual BLAS gemm, and a full
+// precision copy of the operand never exists.
+template <typename Dtype, typename Half>
+void caffe_cpu_gemm_half(const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+    const Dtype alpha, const Dtype* A, const Half* B, const Dtype beta,
+    Dtype* C);
+
+template <typename Dtype, typename Half>
+void caffe_cpu_gemm_half(const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+    const Dtype alpha, const Half* A, const Dtype* B, const Dtype beta,
+    Dtype* C);
+
 #ifndef CPU_ONLY  // GPU
 
 // Decaf gpu gemm provides an interface that is almost the same as the cpu
@@ -239,6 +279,16 @@ void caffe_gpu_rng_gaussian(const int n, const Dtype mu, const Dtype sigma,
 template <typename Dtype>
 void caffe_gpu_rng_bernoulli(const int n, const Dtype p, int* r);
 
+template <typename Dtype>
+void caffe_gpu_rng_stream_uniform(const PhiloxStream& stream, const int n,
+                                  const Dtype a, const Dtype b, Dtype* r,
+                                  const int offset = 0);
+
+template <typename Dtype>
+void caffe_gpu_rng_stream_gaussian(const PhiloxStream& stream, const int n,
+                                   const Dtype mu, const Dtype sigma, Dtype* r,
+                                   const int offset = 0);
+
 template <typename Dtype>
 void caffe_gpu_dot(const int n, const Dtype* x, const Dtype* y, Dtype* out);
 
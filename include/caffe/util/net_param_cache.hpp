@@ -0,0 +1,28 @@
+#ifndef CAFFE_UTIL_NET_PARAM_CACHE_H_
+#define CAFFE_UTIL_NET_PARAM_CACHE_H_
+
+#include <string>
+
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+// Read (and upgrade) a text NetParameter as ReadNetParamsFromTextFileOrDie
+// does, but parse each file only once per process: later calls get a copy of
+// the cached result.  The files are assumed not to change while the process
+// runs; call ClearNetParamsCache if they do.
+void ReadNetParamsFromTextFileCached(const string& param_file,
+                                     NetParameter* param);
+
+// As above, then merge state into the file's own state (phase and level
+// replace it, stages are added) and filter the net by it as Net::FilterNet
+// does.  The filtered result is cached per (file, state).
+void ReadFilteredNetParamsCached(const string& param_file,
+                                 const NetState& state, NetParameter* param);
+
+// Drop everything cached by the two functions above.
+void ClearNetParamsCache();
+
+}  // namespace caffe
+
+#endif   // CAFFE_UTIL_NET_PARAM_CACHE_H_
@@ -0,0 +1,121 @@
+#ifndef CAFFE_UTIL_PHILOX_HPP_
+#define CAFFE_UTIL_PHILOX_HPP_
+
+#include <stdint.h>
+#include <math.h>
+
+// Usable from both host code and CUDA kernels.
+#ifdef __CUDACC__
+#define CAFFE_PHILOX_INLINE __host__ __device__ inline
+#else
+#define CAFFE_PHILOX_INLINE inline
+#endif
+
+namespace caffe {
+
+/**
+ * @brief Key of a counter-based random stream.
+ *
+ * Philox4x32-10 (Salmon et al., "Parallel Random Numbers: As Easy as 1, 2,
+ * 3", SC 2011) maps a 128-bit counter and a 64-bit key to four random 32-bit
+ * words with no state in between. The key is (seed, id) and the counter is
+ * (block, 0, iteration), so element i of a stream depends only on
+ * (seed, id, iteration, i): any range of elements can be generated
+ * independently, in any order, by any number of CPU threads or CUDA threads,
+ * and always comes out bit-identical.
+ */
+struct PhiloxStream {
+  uint32_t seed;
+  // distinguishes independent streams under one seed, e.g. one per layer
+  uint32_t id;
+  uint64_t iteration;
+};
+
+CAFFE_PHILOX_INLINE void philox_mulhilo(const uint32_t a, const uint32_t b,
+    uint32_t* hi, uint32_t* lo) {
+  const uint64_t product = static_cast<uint64_t>(a) * b;
+  *hi = static_cast<uint32_t>(product >> 32);
+  *lo = static_cast<uint32_t>(product);
+}
+
+/// @brief The Philox4x32 bijection with 10 rounds.
+CAFFE_PHILOX_INLINE void philox4x32_10(const uint32_t in[4], uint32_t key0,
+    uint32_t key1, uint32_t out[4]) {
+  uint32_t x0 = in[0], x1 = in[1], x2 = in[2], x3 = in[3];
+  for (int round = 0; round < 10; ++round) {
+    uint32_t hi0, lo0, hi1, lo1;
+    philox_mulhilo(0xD2511F53u, x0, &hi0, &lo0);
+    philox_mulhilo(0xCD9E8D57u, x2, &hi1, &lo1);
+    x0 = hi1 ^ x1 ^ key0;
+    x1 = lo1;
+    x2 = hi0 ^ x3 ^ key1;
+    x3 = lo0;
+    key0 += 0x9E3779B9u;
+    key1 += 0xBB67AE85u;
+  }
+  out[0] = x0;
+  out[1] = x1;
+  out[2] = x2;
+  out[3] = x3;
+}
+
+/// @brief The four random words of block b; element i lives in block i / 4.
+CAFFE_PHILOX_INLINE void philox_block(const PhiloxStream& stream,
+    const uint32_t block, uint32_t out[4]) {
+  const uint32_t ctr[4] = { block, 0u,
+      static_cast<uint32_t>(stream.iteration),
+      static_cast<uint32_t>(stream.iteration >> 32) };
+  philox4x32_10(ctr, stream.seed, stream.id, out);
+}
+
+// Maps a random word to the open interval (0, 1), never returning 0 or 1 so
+// that it can go straight into a log.
+CAFFE_PHILOX_INLINE float philox_open_uniform(const uint32_t x, float) {
+  return ((x >> 8) + 0.5f) * (1.0f / 16777216.0f);
+}
+
+CAFFE_PHILOX_INLINE double philox_open_uniform(const uint32_t x, double) {
+  return (x + 0.5) * (1.0 / 4294967296.0);
+}
+
+// Box-Muller transform of two uniforms into two standard normals.
+CAFFE_PHILOX_INLINE void philox_box_muller(const float u0, const float u1,
+    float* z0, float* z1) {
+  const float r = sqrtf(-2.0f * logf(u0));
+  const float theta = 6.283185307179586f * u1;
+  *z0 = r * cosf(theta);
+  *z1 = r * sinf(theta);
+}
+
+CAFFE_PHILOX_INLINE void philox_box_muller(const double u0, const double u1,
+    double* z0, double* z1) {
+  const double r = sqrt(-2.0 * log(u0));
+  const double theta = 6.283185307179586 * u1;
+  *z0 = r * cos(theta);
+  *z1 = r * sin(theta);
+}
+
+/// @brief Four uniforms in (0, 1) from block b of the stream.
+template <typename Dtype>
+CAFFE_PHILOX_INLINE void philox_uniform4(const PhiloxStream& stream,
+    const uint32_t block, Dtype out[4]) {
+  uint32_t bits[4];
+  philox_block(stream, block, bits);
+  for (int i = 0; i < 4; ++i) {
+    out[i] = philox_open_uniform(bits[i], Dtype(0));
+  }
+}
+
+/// @brief Four standard normals from block b of the stream.
+template <typename Dtype>
+CAFFE_PHILOX_INLINE void philox_gaussian4(const PhiloxStream& stream,
+    const uint32_t block, Dtype out[4]) {
+  Dtype u[4];
+  philox_uniform4(stream, block, u);
+  philox_box_muller(u[0], u[1], &out[0], &out[1]);
+  philox_box_muller(u[2], u[3], &out[2], &out[3]);
+}
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_PHILOX_HPP_
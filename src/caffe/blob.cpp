@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <climits>
 #include <vector>
 
@@ -20,7 +21,7 @@ void Blob<Dtype>::Reshape(const int num, const int channels, const int height,
 }
 
 template <typename Dtype>
-void Blob<Dtype>::Reshape(const vector<int>& shape) {
+void Blob<Dtype>::SetShape(const vector<int>& shape) {
   CHECK_LE(shape.size(), kMaxBlobAxes);
   count_ = 1;
   shape_.resize(shape.size());
@@ -37,10 +38,21 @@ void Blob<Dtype>::Reshape(const vector<int>& shape) {
     shape_[i] = shape[i];
     shape_data[i] = shape[i];
   }
+}
+
+template <typename Dtype>
+void Blob<Dtype>::Reshape(const vector<int>& shape) {
+  // The strides of a strided Blob only make sense for its own shape.
+  if (!strides_.empty() && shape != shape_) { capacity_ = 0; }
+  SetShape(shape);
   if (count_ > capacity_) {
     capacity_ = count_;
     data_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
     diff_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
+    data_offset_ = 0;
+    diff_offset_ = 0;
+    strides_.clear();
+    view_ = false;
   }
 }
 
@@ -63,17 +75,111 @@ template <typename Dtype>
 Blob<Dtype>::Blob(const int num, const int channels, const int height,
     const int width)
   // capacity_ must be initialized before calling Reshape
-  : capacity_(0) {
+  : capacity_(0), data_offset_(0), diff_offset_(0), view_(false) {
   Reshape(num, channels, height, width);
 }
 
 template <typename Dtype>
 Blob<Dtype>::Blob(const vector<int>& shape)
   // capacity_ must be initialized before calling Reshape
-  : capacity_(0) {
+  : capacity_(0), data_offset_(0), diff_offset_(0), view_(false) {
   Reshape(shape);
 }
 
+// Whether strides lay shape out densely in row-major order.
+static bool IsDense(const vector<int>& shape, const vector<int>& strides) {
+  int dense_stride = 1;
+  for (int i = shape.size() - 1; i >= 0; --i) {
+    if (shape[i] > 1 && strides[i] != dense_stride) { return false; }
+    dense_stride *= shape[i];
+  }
+  return true;
+}
+
+// One past the last element that shape and strides reach.
+static int Extent(const vector<int>& shape, const vector<int>& strides) {
+  int extent = 1;
+  for (int i = 0; i < shape.size(); ++i) {
+    if (shape[i] == 0) { return 0; }
+    CHECK_GE(strides[i], 0);
+    extent += (shape[i] - 1) * strides[i];
+  }
+  return extent;
+}
+
+template <typename Dtype>
+void Blob<Dtype>::ShareView(const Blob& other, const vector<int>& shape,
+    int offset, const vector<int>& strides) {
+  CHECK(other.is_contiguous()) << "Cannot view a strided Blob";
+  CHECK(other.data_ && other.diff_);
+  CHECK_GE(offset, 0);
+  SetShape(shape);
+  vector<int> view_strides(strides);
+  if (view_strides.empty()) {
+    for (int i = 0; i < shape.size(); ++i) {
+      view_strides.push_back(count(i + 1));
+    }
+  }
+  CHECK_EQ(view_strides.size(), shape.size());
+  CHECK_LE(offset + Extent(shape, view_strides), other.count())
+      << "View " << shape_string() << " at offset " << offset
+      << " is out of range of " << other.shape_string();
+  data_ = other.data_;
+  diff_ = other.diff_;
+  data_offset_ = other.data_offset_ + offset;
+  diff_offset_ = other.diff_offset_ + offset;
+  if (IsDense(shape, view_strides)) {
+    strides_.clear();
+  } else {
+    strides_ = view_strides;
+  }
+  // Reshape must reallocate before outgrowing the view.
+  capacity_ = count_;
+  view_ = true;
+}
+
+template <typename Dtype>
+void Blob<Dtype>::ReleaseView() {
+  if (!view_ && strides_.empty() && data_offset_ == 0 && diff_offset_ == 0) {
+    return;
+  }
+  capacity_ = count_;
+  data_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
+  diff_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
+  data_offset_ = 0;
+  diff_offset_ = 0;
+  strides_.clear();
+  view_ = false;
+}
+
+template <typename Dtype>
+void Blob<Dtype>::Contiguous() {
+  if (strides_.empty()) { return; }
+  shared_ptr<SyncedMemory> dense(new SyncedMemory(count_ * sizeof(Dtype)));
+  const Dtype* src = static_cast<const Dtype*>(data_->cpu_data()) +
+      data_offset_;
+  Dtype* dst = static_cast<Dtype*>(dense->mutable_cpu_data());
+  // Walk the elements in row-major order, stepping src along the strides.
+  vector<int> index(num_axes(), 0);
+  int src_offset = 0;
+  for (int i = 0; i < count_; ++i) {
+    dst[i] = src[src_offset];
+    for (int axis = num_axes() - 1; axis >= 0; --axis) {
+      src_offset += strides_[axis];
+      if (++index[axis] < shape_[axis]) { break; }
+      src_offset -= strides_[axis] * shape_[axis];
+      index[axis] = 0;
+    }
+  }
+  data_ = dense;
+  diff_.reset(new SyncedMemory(count_ * sizeof(Dtype)));
+  capacity_ = count_;
+  data_offset_ = 0;
+  diff_offset_ = 0;
+  strides_.clear();
+  view_ = false;
+}
+
 template <typename Dtype>
 const int* Blob<Dtype>::gpu_shape() const {
   CHECK(shape_data_);
@@ -83,12 +189,15 @@ const int* Blob<Dtype>::gpu_shape() const {
 template <typename Dtype>
 const Dtype* Blob<Dtype>::cpu_data() const {
   CHECK(data_);
-  return (const Dtype*)data_->cpu_data();
+  CHECK(strides_.empty()) << "Call Contiguous() before using a strided Blob";
+  return (const Dtype*)data_->cpu_data() + data_offset_;
 }
 
 template <typename Dtype>
 void Blob<Dtype>::set_cpu_data(Dtype* data) {
   CHECK(data);
+  // Don't redirect the memory of the Blob this one is a view of.
+  ReleaseView();
   // Make sure CPU and GPU sizes remain equal
   size_t size = count_ * sizeof(Dtype);
   if (data_->size() != size) {
@@ -98,15 +207,52 @@ void Blob<Dtype>::set_cpu_data(Dtype* data) {
   data_->set_cpu_data(data);
 }
 
+template <typename Dtype>
+void Blob<Dtype>::set_cpu_data(Dtype* data, const vector<int>& shape,
+    const shared_ptr<void>& owner) {
+  CHECK(data);
+  Reshape(shape);
+  ReleaseView();
+  // Memory of the same size that no other Blob shares only needs its host
+  // pointer swapped; its device memory, if any, is kept for the next copy.
+  const size_t size = count_ * sizeof(Dtype);
+  if (data_.use_count() > 1 || data_->size() != size) {
+    data_.reset(new SyncedMemory(size));
+  }
+  data_->set_cpu_data(data, owner);
+  // Reshape must reallocate before outgrowing the external memory.
+  capacity_ = count_;
+}
+
+template <typename Dtype>
+void Blob<Dtype>::set_cpu_data(Dtype* data, const vector<int>& shape,
+    const vector<int>& strides, const shared_ptr<void>& owner) {
+  CHECK_EQ(strides.size(), shape.size());
+  if (IsDense(shape, strides)) {
+    set_cpu_data(data, shape, owner);
+    return;
+  }
+  CHECK(data);
+  Reshape(shape);
+  ReleaseView();
+  data_.reset(new SyncedMemory(Extent(shape, strides) * sizeof(Dtype)));
+  data_->set_cpu_data(data, owner);
+  strides_ = strides;
+  capacity_ = count_;
+}
+
 template <typename Dtype>
 const Dtype* Blob<Dtype>::gpu_data() const {
   CHECK(data_);
-  return (const Dtype*)data_->gpu_data();
+  CHECK(strides_.empty()) << "Call Contiguous() before using a strided Blob";
+  return (const Dtype*)data_->gpu_data() + data_offset_;
 }
 
 template <typename Dtype>
 void Blob<Dtype>::set_gpu_data(Dtype* data) {
   CHECK(data);
+  // Don't redirect the memory of the Blob this one is a view of.
+  ReleaseView();
   // Make sure CPU and GPU sizes remain equal
   size_t size = count_ * sizeof(Dtype);
   if (data_->size() != size) {
@@ -116,52 +262,95 @@ void Blob<Dtype>::set_gpu_data(Dtype* data) {
   data_->set_gpu_data(data);
 }
 
+template <typename Dtype>
+void Blob<Dtype>::set_gpu_data(Dtype* data, const vector<int>& shape,
+    const shared_ptr<void>& owner) {
+  CHECK(data);
+  Reshape(shape);
+  ReleaseView();
+  // As for host memory: the host copy, if any, is kept for the next sync.
+  const size_t size = count_ * sizeof(Dtype);
+  if (data_.use_count() > 1 || data_->size() != size) {
+    data_.reset(new SyncedMemory(size));
+  }
+  data_->set_gpu_data(data, owner);
+  capacity_ = count_;
+}
+
 template <typename Dtype>
 const Dtype* Blob<Dtype>::cpu_diff() const {
   CHECK(diff_);
-  return (const Dtype*)diff_->cpu_data();
+  CHECK(strides_.empty()) << "Call Contiguous() before using a strided Blob";
+  return (const Dtype*)diff_->cpu_data() + diff_offset_;
 }
 
 template <typename Dtype>
 const Dtype* Blob<Dtype>::gpu_diff() const {
   CHECK(diff_);
-  return (const Dtype*)diff_->gpu_data();
+  CHECK(strides_.empty()) << "Call Contiguous() before using a strided Blob";
+  return (const Dtype*)diff_->gpu_data() + diff_offset_;
 }
 
 template <typename Dtype>
 Dtype* Blob<Dtype>::mutable_cpu_data() {
   CHECK(data_);
-  return static_cast<Dtype*>(data_->mutable_cpu_data());
+  CHECK(strides_.empty()) << "Call Contiguous() before using a strided Blob";
+  return static_cast<Dtype*>(data_->mutable_cpu_data()) + data_offset_;
 }
 
 template <typename Dtype>
 Dtype* Blob<Dtype>::mutable_gpu_data() {
   CHECK(data_);
-  return static_cast<Dtype*>(data_->mutable_gpu_data());
+  CHECK(strides_.empty()) << "Call Contiguous() before using a strided Blob";
+  return static_cast<Dtype*>(data_->mutable_gpu_data()) + data_offset_;
 }
 
 template <typename Dtype>
 Dtype* Blob<Dtype>::mutable_cpu_diff() {
   CHECK(diff_);
-  return static_cast<Dtype*>(diff_->mutable_cpu_data());
+  CHECK(strides_.empty()) << "Call Contiguous() before using a strided Blob";
+  return static_cast<Dtype*>(diff_->mutable_cpu_data()) + diff_offset_;
 }
 
 template <typename Dtype>
 Dtype* Blob<Dtype>::mutable_gpu_diff() {
   CHECK(diff_);
-  return static_cast<Dtype*>(diff_->mutable_gpu_data());
+  CHECK(strides_.empty()) << "Call Contiguous() before using a strided Blob";
+  return static_cast<Dtype*>(diff_->mutable_gpu_data()) + diff_offset_;
 }
 
 template <typename Dtype>
 void Blob<Dtype>::ShareData(const Blob& other) {
   CHECK_EQ(count_, other.count());
+  CHECK(other.is_contiguous()) << "Call Contiguous() before sharing a "
+      << "strided Blob";
+  if (!strides_.empty()) { ReleaseView(); }
   data_ = other.data();
+  data_offset_ = other.data_offset_;
+  // Reshape must reallocate before outgrowing other's memory.
+  capacity_ = std::min(capacity_, other.capacity_);
 }
 
 template <typename Dtype>
 void Blob<Dtype>::ShareDiff(const Blob& other) {
   CHECK_EQ(count_, other.count());
+  CHECK(other.is_contiguous()) << "Call Contiguous() before sharing a "
+      << "strided Blob";
+  if (!strides_.empty()) { ReleaseView(); }
   diff_ = other.diff();
+  diff_offset_ = other.diff_offset_;
+  // Reshape must reallocate before outgrowing other's memory.
+  capacity_ = std::min(capacity_, other.capacity_);
+}
+
+template <typename Dtype>
+void Blob<Dtype>::SetDataMemory(const shared_ptr<SyncedMemory>& data) {
+  CHECK(data);
+  CHECK_GE(data->size(), (data_offset_ + count_) * sizeof(Dtype));
+  data_ = data;
+  // Reshape must reallocate before outgrowing the shared memory.
+  capacity_ = std::min<size_t>(capacity_,
+      data->size() / sizeof(Dtype) - data_offset_);
 }
 
 // The "update" method is used for parameter blobs in a Net, which are stored
@@ -176,17 +365,13 @@ void Blob<Dtype>::Update() {
   switch (data_->head()) {
   case SyncedMemory::HEAD_AT_CPU:
     // perform computation on CPU
-    caffe_axpy<Dtype>(count_, Dtype(-1),
-        static_cast<const Dtype*>(diff_->cpu_data()),
-        static_cast<Dtype*>(data_->mutable_cpu_data()));
+    caffe_axpy<Dtype>(count_, Dtype(-1), cpu_diff(), mutable_cpu_data());
     break;
   case SyncedMemory::HEAD_AT_GPU:
   case SyncedMemory::SYNCED:
 #ifndef CPU_ONLY
     // perform computation on GPU
-    caffe_gpu_axpy<Dtype>(count_, Dtype(-1),
-        static_cast<const Dtype*>(diff_->gpu_data()),
-        static_cast<Dtype*>(data_->mutable_gpu_data()));
+    caffe_gpu_axpy<Dtype>(count_, Dtype(-1), gpu_diff(), mutable_gpu_data());
 #else
     NO_GPU;
 #endif
@@ -406,6 +591,43 @@ void Blob<Dtype>::scale_diff(Dtype scale_factor) {
   }
 }
 
+template <> void Blob<unsigned int>::zero_diff() {
+  NOT_IMPLEMENTED;
+}
+
+template <> void Blob<int>::zero_diff() {
+  NOT_IMPLEMENTED;
+}
+
+template <typename Dtype>
+void Blob<Dtype>::zero_diff() {
+  if (!diff_ || !diff_->dirty()) { return; }
+  CHECK(strides_.empty()) << "Call Contiguous() before using a strided Blob";
+  // clear the whole allocation, not just count_, so that a later Reshape
+  // within capacity can't expose stale values in a diff marked clean; a view
+  // only clears its own part of memory that other Blobs also use
+  const bool partial = view_ || diff_offset_ != 0;
+  const int size = partial ? count_ : diff_->size() / sizeof(Dtype);
+  const int offset = partial ? diff_offset_ : 0;
+  switch (Caffe::mode()) {
+  case Caffe::CPU:
+    caffe_set(size, Dtype(0),
+        static_cast<Dtype*>(diff_->mutable_cpu_data()) + offset);
+    break;
+  case Caffe::GPU:
+#ifndef CPU_ONLY
+    caffe_gpu_set(size, Dtype(0),
+        static_cast<Dtype*>(diff_->mutable_gpu_data()) + offset);
+#else
+    NO_GPU;
+#endif
+    break;
+  default:
+    LOG(FATAL) << "Unknown caffe mode: " << Caffe::mode();
+  }
+  if (!partial) { diff_->mark_clean(); }
+}
+
 template <typename Dtype>
 bool Blob<Dtype>::ShapeEquals(const BlobProto& other) {
   if (other.has_num() || other.has_channels() ||
@@ -441,20 +663,16 @@ void Blob<Dtype>::CopyFrom(const Blob& source, bool copy_diff, bool reshape) {
   switch (Caffe::mode()) {
   case Caffe::GPU:
     if (copy_diff) {
-      caffe_copy(count_, source.gpu_diff(),
-          static_cast<Dtype*>(diff_->mutable_gpu_data()));
+      caffe_copy(count_, source.gpu_diff(), mutable_gpu_diff());
     } else {
-      caffe_copy(count_, source.gpu_data(),
-          static_cast<Dtype*>(data_->mutable_gpu_data()));
+      caffe_copy(count_, source.gpu_data(), mutable_gpu_data());
     }
     break;
   case Caffe::CPU:
     if (copy_diff) {
-      caffe_copy(count_, source.cpu_diff(),
-          static_cast<Dtype*>(diff_->mutable_cpu_data()));
+      caffe_copy(count_, source.cpu_diff(), mutable_cpu_diff());
     } else {
-      caffe_copy(count_, source.cpu_data(),
-          static_cast<Dtype*>(data_->mutable_cpu_data()));
+      caffe_copy(count_, source.cpu_data(), mutable_cpu_data());
     }
     break;
   default:
@@ -462,6 +680,66 @@ void Blob<Dtype>::CopyFrom(const Blob& source, bool copy_diff, bool reshape) {
   }
 }
 
+// BlobProto half_data and half_diff hold little-endian 16-bit values.
+template <typename Dtype, typename Half>
+static void EncodeHalf(const int count, const Dtype* x, string* bytes) {
+  bytes->resize(2 * count);
+  if (count == 0) { return; }
+  vector<Half> half(count);
+  caffe_cpu_to_half(count, x, &half[0]);
+  for (int i = 0; i < count; ++i) {
+    (*bytes)[2 * i] = static_cast<char>(half[i].bits & 0xff);
+    (*bytes)[2 * i + 1] = static_cast<char>(half[i].bits >> 8);
+  }
+}
+
+template <typename Dtype, typename Half>
+static void DecodeHalf(const string& bytes, const int count, Dtype* y) {
+  CHECK_EQ(bytes.size(), 2 * count);
+  if (count == 0) { return; }
+  vector<Half> half(count);
+  for (int i = 0; i < count; ++i) {
+    half[i].bits = static_cast<uint8_t>(bytes[2 * i]) |
+        static_cast<uint8_t>(bytes[2 * i + 1]) << 8;
+  }
+  // through float, so that integer Blobs load too
+  vector<float> values(count);
+  caffe_cpu_from_half(count, &half[0], &values[0]);
+  for (int i = 0; i < count; ++i) {
+    y[i] = values[i];
+  }
+}
+
+template <typename Dtype>
+static void FromHalfBytes(const BlobProto::Precision precision,
+    const string& bytes, const int count, Dtype* y) {
+  switch (precision) {
+  case BlobProto::FP16:
+    DecodeHalf<Dtype, fp16>(bytes, count, y);
+    break;
+  case BlobProto::BF16:
+    DecodeHalf<Dtype, bf16>(bytes, count, y);
+    break;
+  default:
+    LOG(FATAL) << "Unknown BlobProto precision " << precision;
+  }
+}
+
+template <typename Dtype>
+static void ToHalfBytes(const BlobProto::Precision precision,
+    const int count, const Dtype* x, string* bytes) {
+  switch (precision) {
+  case BlobProto::FP16:
+    EncodeHalf<Dtype, fp16>(count, x, bytes);
+    break;
+  case BlobProto::BF16:
+    EncodeHalf<Dtype, bf16>(count, x, bytes);
+    break;
+  default:
+    LOG(FATAL) << "Unknown BlobProto precision " << precision;
+  }
+}
+
 template <typename Dtype>
 void Blob<Dtype>::FromProto(const BlobProto& proto, bool reshape) {
   if (reshape) {
@@ -487,7 +765,9 @@ void Blob<Dtype>::FromProto(const BlobProto& proto, bool reshape) {
   }
   // copy data
   Dtype* data_vec = mutable_cpu_data();
-  if (proto.double_data_size() > 0) {
+  if (proto.precision() != BlobProto::FULL) {
+    FromHalfBytes(proto.precision(), proto.half_data(), count_, data_vec);
+  } else if (proto.double_data_size() > 0) {
     CHECK_EQ(count_, proto.double_data_size());
     for (int i = 0; i < count_; ++i) {
       data_vec[i] = proto.double_data(i);
@@ -498,7 +778,10 @@ void Blob<Dtype>::FromProto(const BlobProto& proto, bool reshape) {
       data_vec[i] = proto.data(i);
     }
   }
-  if (proto.double_diff_size() > 0) {
+  if (proto.precision() != BlobProto::FULL && proto.has_half_diff()) {
+    FromHalfBytes(proto.precision(), proto.half_diff(), count_,
+                  mutable_cpu_diff());
+  } else if (proto.double_diff_size() > 0) {
     CHECK_EQ(count_, proto.double_diff_size());
     Dtype* diff_vec = mutable_cpu_diff();
     for (int i = 0; i < count_; ++i) {
@@ -513,12 +796,38 @@ void Blob<Dtype>::FromProto(const BlobProto& proto, bool reshape) {
   }
 }
 
+template <typename Dtype>
+static void HalfToProto(const Blob<Dtype>& blob, BlobProto* proto,
+    bool write_diff, BlobProto::Precision precision) {
+  proto->clear_data();
+  proto->clear_diff();
+  proto->clear_double_data();
+  proto->clear_double_diff();
+  proto->set_precision(precision);
+  ToHalfBytes(precision, blob.count(), blob.cpu_data(),
+              proto->mutable_half_data());
+  if (write_diff) {
+    ToHalfBytes(precision, blob.count(), blob.cpu_diff(),
+                proto->mutable_half_diff());
+  } else {
+    proto->clear_half_diff();
+  }
+}
+
 template <>
-void Blob<double>::ToProto(BlobProto* proto, bool write_diff) const {
+void Blob<double>::ToProto(BlobProto* proto, bool write_diff,
+    BlobProto::Precision precision) const {
   proto->clear_shape();
   for (int i = 0; i < shape_.size(); ++i) {
     proto->mutable_shape()->add_dim(shape_[i]);
   }
+  if (precision != BlobProto::FULL) {
+    HalfToProto(*this, proto, write_diff, precision);
+    return;
+  }
+  proto->clear_precision();
+  proto->clear_half_data();
+  proto->clear_half_diff();
   proto->clear_double_data();
   proto->clear_double_diff();
   const double* data_vec = cpu_data();
@@ -534,11 +843,19 @@ void Blob<double>::ToProto(BlobProto* proto, bool write_diff) const {
 }
 
 template <>
-void Blob<float>::ToProto(BlobProto* proto, bool write_diff) const {
+void Blob<float>::ToProto(BlobProto* proto, bool write_diff,
+    BlobProto::Precision precision) const {
   proto->clear_shape();
   for (int i = 0; i < shape_.size(); ++i) {
     proto->mutable_shape()->add_dim(shape_[i]);
   }
+  if (precision != BlobProto::FULL) {
+    HalfToProto(*this, proto, write_diff, precision);
+    return;
+  }
+  proto->clear_precision();
+  proto->clear_half_data();
+  proto->clear_half_diff();
   proto->clear_data();
   proto->clear_diff();
   const float* data_vec = cpu_data();
@@ -49,17 +49,38 @@ void GlobalInit(int* pargc, char*** pargv) {
   ::google::InstallFailureSignalHandler();
 }
 
+PhiloxStream Caffe::philox_stream(const unsigned int id,
+    const uint64_t iteration) {
+  PhiloxStream stream;
+  stream.seed = random_seed();
+  stream.id = id;
+  stream.iteration = iteration;
+  return stream;
+}
+
+unsigned int Caffe::philox_stream_id(const string& name) {
+  // 32-bit FNV-1a
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < name.size(); ++i) {
+    hash ^= static_cast<unsigned char>(name[i]);
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
 #ifdef CPU_ONLY  // CPU-only Caffe.
 
 Caffe::Caffe()
-    : random_generator_(), mode_(Caffe::CPU),
-      solver_count_(1), solver_rank_(0), multiprocess_(false) { }
+    : random_generator_(), random_seed_(cluster_seedgen()),
+      mode_(Caffe::CPU), solver_count_(1), solver_rank_(0),
+      multiprocess_(false) { }
 
 Caffe::~Caffe() { }
 
 void Caffe::set_random_seed(const unsigned int seed) {
   // RNG seed
   Get().random_generator_.reset(new RNG(seed));
+  Get().random_seed_ = seed;
 }
 
 void Caffe::SetDevice(const int device_id) {
@@ -106,7 +127,7 @@ void* Caffe::RNG::generator() {
 
 Caffe::Caffe()
     : cublas_handle_(NULL), curand_generator_(NULL), random_generator_(),
-    mode_(Caffe::CPU),
+    random_seed_(cluster_seedgen()), mode_(Caffe::CPU),
     solver_count_(1), solver_rank_(0), multiprocess_(false) {
   // Try to create a cublas handler, and report an error if failed (but we will
   // keep the program running as one might just want to run CPU code).
@@ -145,6 +166,7 @@ void Caffe::set_random_seed(const unsigned int seed) {
   }
   // RNG seed
   Get().random_generator_.reset(new RNG(seed));
+  Get().random_seed_ = seed;
 }
 
 void Caffe::SetDevice(const int device_id) {
@@ -0,0 +1,70 @@
+#include <vector>
+
+#include "caffe/half_blob.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+HalfBlob<Dtype>::HalfBlob(BlobProto::Precision precision)
+  : precision_(precision), count_(0), source_version_(0), source_offset_(0) {
+  CHECK(precision == BlobProto::FP16 || precision == BlobProto::BF16)
+      << "HalfBlob needs a 16-bit precision, not "
+      << BlobProto::Precision_Name(precision);
+}
+
+template <typename Dtype>
+void HalfBlob<Dtype>::CopyFrom(const Blob<Dtype>& source) {
+  shape_ = source.shape();
+  count_ = source.count();
+  if (!data_ || data_->size() < count_ * sizeof(uint16_t)) {
+    data_.reset(new SyncedMemory(count_ * sizeof(uint16_t)));
+  }
+  const Dtype* source_data = source.cpu_data();
+  void* data = data_->mutable_cpu_data();
+  if (precision_ == BlobProto::FP16) {
+    caffe_cpu_to_half(count_, source_data, static_cast<fp16*>(data));
+  } else {
+    caffe_cpu_to_half(count_, source_data, static_cast<bf16*>(data));
+  }
+  source_ = source.data();
+  source_version_ = source.data()->version();
+  source_offset_ = source.data_offset();
+}
+
+template <typename Dtype>
+bool HalfBlob<Dtype>::IsCopyOf(const Blob<Dtype>& source) const {
+  shared_ptr<SyncedMemory> memory = source_.lock();
+  return memory && memory == source.data() &&
+      memory->version() == source_version_ &&
+      source.data_offset() == source_offset_ && source.shape() == shape_;
+}
+
+template <typename Dtype>
+void HalfBlob<Dtype>::CopyTo(Blob<Dtype>* target) const {
+  target->Reshape(shape_);
+  if (count_ == 0) { return; }
+  if (precision_ == BlobProto::FP16) {
+    caffe_cpu_from_half(count_, cpu_fp16(), target->mutable_cpu_data());
+  } else {
+    caffe_cpu_from_half(count_, cpu_bf16(), target->mutable_cpu_data());
+  }
+}
+
+template <typename Dtype>
+const fp16* HalfBlob<Dtype>::cpu_fp16() const {
+  CHECK_EQ(precision_, BlobProto::FP16);
+  CHECK(data_);
+  return static_cast<const fp16*>(data_->cpu_data());
+}
+
+template <typename Dtype>
+const bf16* HalfBlob<Dtype>::cpu_bf16() const {
+  CHECK_EQ(precision_, BlobProto::BF16);
+  CHECK(data_);
+  return static_cast<const bf16*>(data_->cpu_data());
+}
+
+INSTANTIATE_CLASS(HalfBlob);
+
+}  // namespace caffe
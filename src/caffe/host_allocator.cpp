@@ -0,0 +1,204 @@
+#include <boost/thread.hpp>
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+
+#ifdef USE_MKL
+  #include "mkl.h"
+#endif
+
+#include "caffe/common.hpp"
+#include "caffe/host_allocator.hpp"
+
+namespace caffe {
+
+HostAllocator::HostAllocator()
+  : allocations_(0), bytes_in_use_(0), peak_bytes_in_use_(0) {
+}
+
+void* HostAllocator::Allocate(size_t size) {
+  void* ptr = DoAllocate(size);
+  CHECK(ptr) << "host allocation of size " << size << " failed";
+  DCHECK_EQ(reinterpret_cast<size_t>(ptr) % kHostAlignment, 0);
+  ++allocations_;
+  const size_t in_use = (bytes_in_use_ += size);
+  size_t peak = peak_bytes_in_use_.load();
+  while (in_use > peak &&
+         !peak_bytes_in_use_.compare_exchange_weak(peak, in_use)) {}
+  return ptr;
+}
+
+void HostAllocator::Free(void* ptr, size_t size) {
+  bytes_in_use_ -= size;
+  DoFree(ptr, size);
+}
+
+static void* AlignedMalloc(size_t size) {
+#ifdef USE_MKL
+  return mkl_malloc(size ? size : 1, kHostAlignment);
+#else
+  void* ptr = NULL;
+  return posix_memalign(&ptr, kHostAlignment, size ? size : 1) ? NULL : ptr;
+#endif
+}
+
+static void AlignedFree(void* ptr) {
+#ifdef USE_MKL
+  mkl_free(ptr);
+#else
+  free(ptr);
+#endif
+}
+
+class MallocHostAllocator : public HostAllocator {
+ public:
+  MallocHostAllocator() {}
+  virtual const char* type() const { return "malloc"; }
+
+ protected:
+  virtual void* DoAllocate(size_t size) { return AlignedMalloc(size); }
+  virtual void DoFree(void* ptr, size_t size) { AlignedFree(ptr); }
+};
+
+// Size classes: 64 bytes, then four per power of two (80, 96, 112, 128,
+// 160, ...), so that rounding up wastes at most a quarter of a block.
+static const size_t kMinClassBytes = 64;
+static const int kNumSizeClasses = 1 + 4 * (sizeof(size_t) * 8 - 6);
+
+static int SizeClass(size_t size) {
+  if (size <= kMinClassBytes) { return 0; }
+  // 2^k < size <= 2^(k+1), split into steps of 2^(k-2)
+  int k = 0;
+  while ((size - 1) >> (k + 1)) { ++k; }
+  return 1 + 4 * (k - 6) + static_cast<int>((size - 1) >> (k - 2)) - 4;
+}
+
+static size_t SizeClassBytes(int size_class) {
+  if (size_class == 0) { return kMinClassBytes; }
+  const int k = 6 + (size_class - 1) / 4;
+  return static_cast<size_t>((size_class - 1) % 4 + 5) << (k - 2);
+}
+
+// The free lists shared by all threads.  Thread caches hold a reference, so
+// that blocks cached by a thread outliving the allocator still get freed.
+struct PooledFreeLists {
+  PooledFreeLists() : blocks(kNumSizeClasses) {}
+  ~PooledFreeLists() { Release(); }
+  void Release() {
+    boost::mutex::scoped_lock lock(mutex);
+    for (int c = 0; c < blocks.size(); ++c) {
+      for (int i = 0; i < blocks[c].size(); ++i) { AlignedFree(blocks[c][i]); }
+      blocks[c].clear();
+    }
+  }
+
+  boost::mutex mutex;
+  vector<vector<void*> > blocks;
+};
+
+// Blocks freed by one thread, reused by its next allocations without
+// locking, up to kMaxBytes.
+struct PooledThreadCache {
+  static const size_t kMaxBytes = 32 << 20;
+
+  explicit PooledThreadCache(const shared_ptr<PooledFreeLists>& shared)
+    : shared(shared), blocks(kNumSizeClasses), bytes(0) {}
+  ~PooledThreadCache() { Flush(); }
+  void Flush() {
+    boost::mutex::scoped_lock lock(shared->mutex);
+    for (int c = 0; c < blocks.size(); ++c) {
+      shared->blocks[c].insert(shared->blocks[c].end(), blocks[c].begin(),
+                               blocks[c].end());
+      blocks[c].clear();
+    }
+    bytes = 0;
+  }
+
+  shared_ptr<PooledFreeLists> shared;
+  vector<vector<void*> > blocks;
+  size_t bytes;
+};
+
+class PooledHostAllocator : public HostAllocator {
+ public:
+  PooledHostAllocator() : shared_(new PooledFreeLists()) {}
+  virtual const char* type() const { return "pooled"; }
+  virtual void ReleaseCached() {
+    if (cache_.get()) { cache_->Flush(); }
+    shared_->Release();
+  }
+
+ protected:
+  virtual void* DoAllocate(size_t size) {
+    const int c = SizeClass(size);
+    PooledThreadCache* cache = thread_cache();
+    if (!cache->blocks[c].empty()) {
+      void* ptr = cache->blocks[c].back();
+      cache->blocks[c].pop_back();
+      cache->bytes -= SizeClassBytes(c);
+      return ptr;
+    }
+    {
+      boost::mutex::scoped_lock lock(shared_->mutex);
+      if (!shared_->blocks[c].empty()) {
+        void* ptr = shared_->blocks[c].back();
+        shared_->blocks[c].pop_back();
+        return ptr;
+      }
+    }
+    return AlignedMalloc(SizeClassBytes(c));
+  }
+
+  virtual void DoFree(void* ptr, size_t size) {
+    const int c = SizeClass(size);
+    const size_t bytes = SizeClassBytes(c);
+    PooledThreadCache* cache = thread_cache();
+    if (cache->bytes + bytes <= PooledThreadCache::kMaxBytes) {
+      cache->blocks[c].push_back(ptr);
+      cache->bytes += bytes;
+      return;
+    }
+    boost::mutex::scoped_lock lock(shared_->mutex);
+    shared_->blocks[c].push_back(ptr);
+  }
+
+ private:
+  PooledThreadCache* thread_cache() {
+    if (!cache_.get()) { cache_.reset(new PooledThreadCache(shared_)); }
+    return cache_.get();
+  }
+
+  shared_ptr<PooledFreeLists> shared_;
+  boost::thread_specific_ptr<PooledThreadCache> cache_;
+};
+
+shared_ptr<HostAllocator> CreateHostAllocator(const string& type) {
+  if (type == "malloc") {
+    return shared_ptr<HostAllocator>(new MallocHostAllocator());
+  }
+  if (type == "pooled") {
+    return shared_ptr<HostAllocator>(new PooledHostAllocator());
+  }
+  LOG(FATAL) << "Unknown host allocator " << type;
+  return shared_ptr<HostAllocator>();
+}
+
+static shared_ptr<HostAllocator>& current_host_allocator() {
+  // Never destroyed, so that memory freed during static destruction still
+  // has somewhere to go.
+  static shared_ptr<HostAllocator>* allocator =
+      new shared_ptr<HostAllocator>(CreateHostAllocator("malloc"));
+  return *allocator;
+}
+
+const shared_ptr<HostAllocator>& host_allocator() {
+  return current_host_allocator();
+}
+
+void set_host_allocator(const shared_ptr<HostAllocator>& allocator) {
+  CHECK(allocator);
+  current_host_allocator() = allocator;
+}
+
+}  // namespace caffe
@@ -1,3 +1,4 @@
+#include <boost/thread.hpp>
 #include <string>
 #include <vector>
 
@@ -7,6 +8,7 @@
 #include "caffe/layer.hpp"
 #include "caffe/layers/adversarial_subnet_pair_layer.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/net_param_cache.hpp"
 #include "caffe/util/upgrade_proto.hpp"
 
 namespace caffe {
@@ -24,6 +26,14 @@ void AdversarialSubnetPairLayer<Dtype>::LayerSetUp(
       this->layer_param_.adversarial_pair_param().subnet1_prototxt();
   subnet2_prototxt_=
       this->layer_param_.adversarial_pair_param().subnet2_prototxt();
+  async_=this->layer_param_.adversarial_pair_param().async();
+  prefetch_generated_=
+      this->layer_param_.adversarial_pair_param().prefetch_generated();
+  CHECK(!async_ || do_external_) 
+      << "async only applies with do_data_concat, since it overlaps the pass "
+      << "over the real data with the rest";
+  CHECK(!prefetch_generated_ || async_) << "prefetch_generated needs async";
+  gen_buffer_ready_=false;
 
 
   phase_counter_=0;
@@ -34,7 +44,7 @@ void AdversarialSubnetPairLayer<Dtype>::LayerSetUp(
   //subnet1 and subnet2, so let's take a peek at the prototxt for subnet1 
   //before we really get started setting up layers
   NetParameter net_param_1;  
-  ReadNetParamsFromTextFileOrDie(subnet1_prototxt_, &net_param_1);
+  ReadNetParamsFromTextFileCached(subnet1_prototxt_, &net_param_1);
   const LayerParameter subnet1_input_layer_param = net_param_1.layer(0);
   const InputParameter subnet1_input_param = 
       subnet1_input_layer_param.input_param();
@@ -131,7 +141,40 @@ void AdversarialSubnetPairLayer<Dtype>::LayerSetUp(
   subnet2_layer_=LayerRegistry<Dtype>::CreateLayer(subnet2_param);
   subnet2_layer_->SetUp(subnet2_bottom_vec_,subnet2_top_vec_);
   subnet2_layer_->Reshape(subnet2_bottom_vec_,subnet2_top_vec_);
-  subnet2_layer_->Reshape(subnet2ext_bottom_vec_,subnet2ext_top_vec_);
+  if(async_){
+    //the worker thread gets its own instance of subnet2, so that the real 
+    //data pass can run alongside the generated data pass
+    LayerParameter subnet2ext_param(subnet2_param);
+    subnet2ext_param.set_name(this->layer_param_.name()+"_subnet2ext");
+    subnet2ext_layer_=LayerRegistry<Dtype>::CreateLayer(subnet2ext_param);
+    subnet2ext_layer_->SetUp(subnet2ext_bottom_vec_,subnet2ext_top_vec_);
+    subnet2ext_layer_->Reshape(subnet2ext_bottom_vec_,subnet2ext_top_vec_);
+    CHECK_EQ(subnet2ext_layer_->blobs().size(),subnet2_layer_->blobs().size());
+    //the worker's nets share the model's NetScheduler, whose phase counters 
+    //are not meant for two threads at once: the worker may not advance any
+    for(int i=0;i<subnet2ext_layer_->subnets().size();i++){
+      const vector<shared_ptr<Layer<Dtype> > >& layers=
+          subnet2ext_layer_->subnets()[i]->layers();
+      for(int j=0;j<layers.size();j++){
+        CHECK_LT(layers[j]->layer_param().subnet_param().phase_counter_index(),
+                 0) << this->layer_param_.name() << ": async is not supported "
+            << "when subnet2 uses phase counters (layer "
+            << layers[j]->layer_param().name() << ")";
+      }
+    }
+    ShareDiscriminatorWeights();
+  } else {
+    subnet2_layer_->Reshape(subnet2ext_bottom_vec_,subnet2ext_top_vec_);
+  }
+
+  if(prefetch_generated_){
+    for(int i=0;i<N_gen_;i++){
+      gen_buffer_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+      gen_buffer_[i]->ReshapeLike(*top[i]);
+      subnet2buf_bottom_vec_.push_back(gen_buffer_[i].get());
+    }
+    subnet2buf_bottom_vec_.push_back(&is_not_real_data_);
+  }
 
   
   // This layer's parameters are any parameters in subnet1_layer_ 
@@ -170,6 +213,12 @@ void AdversarialSubnetPairLayer<Dtype>::LayerSetUp(
   for(int i=0;i<subnet2_layer_->subnets().size();i++){
     this->subnets_.push_back(subnet2_layer_->subnets()[i]);
   }
+  //listed so that Net::WeightsRebound reaches them too
+  if(async_){
+    for(int i=0;i<subnet2ext_layer_->subnets().size();i++){
+      this->subnets_.push_back(subnet2ext_layer_->subnets()[i]);
+    }
+  }
 
 
   this->param_propagate_down_.clear();
@@ -184,26 +233,118 @@ void AdversarialSubnetPairLayer<Dtype>::Reshape(
 
   subnet1_layer_->Reshape(subnet1_bottom_vec_,subnet1_top_vec_);
   subnet2_layer_->Reshape(subnet2_bottom_vec_,subnet2_top_vec_);
-  subnet2_layer_->Reshape(subnet2ext_bottom_vec_,subnet2ext_top_vec_);
+  if(async_){
+    subnet2ext_layer_->Reshape(subnet2ext_bottom_vec_,subnet2ext_top_vec_);
+  } else {
+    subnet2_layer_->Reshape(subnet2ext_bottom_vec_,subnet2ext_top_vec_);
+  }
+
+  //a kept batch of the wrong shape is of no use to the next step
+  for(int i=0;i<gen_buffer_.size();i++){
+    if(gen_buffer_[i]->shape()==top[i]->shape()) continue;
+    gen_buffer_[i]->ReshapeLike(*top[i]);
+    gen_buffer_ready_=false;
+  }
 
 }
 
+template <typename Dtype>
+void AdversarialSubnetPairLayer<Dtype>::ShareDiscriminatorWeights() {
+  bool rebound(false);
+  for(int i=0;i<subnet2_layer_->blobs().size();i++){
+    Blob<Dtype>* weights=subnet2_layer_->blobs()[i].get();
+    Blob<Dtype>* ext_weights=subnet2ext_layer_->blobs()[i].get();
+    //sync the weights here, so that both threads only ever read them
+    if(Caffe::mode()==Caffe::GPU) weights->gpu_data();
+    else weights->cpu_data();
+    if(ext_weights->data()==weights->data()) continue;
+    ext_weights->ShareData(*weights);
+    rebound=true;
+  }
+  //the params inside subnet2ext that are shared with these ones still point 
+  //at the old memory; this has its next Forward re-share them
+  if(rebound){
+    for(int i=0;i<subnet2ext_layer_->subnets().size();i++){
+      subnet2ext_layer_->subnets()[i]->WeightsRebound();
+    }
+  }
+}
+
+template <typename Dtype>
+void AdversarialSubnetPairLayer<Dtype>::RealDataPass() {
+  //subnet2ext's diffs are its own, so they start from zero every time and 
+  //get added into subnet2's by the calling thread
+  for(int i=0;i<subnet2ext_layer_->subnets().size();i++){
+    subnet2ext_layer_->subnets()[i]->ClearParamDiffs();
+  }
+  vector<bool> propagate_down(subnet2ext_bottom_vec_.size(),true);
+  subnet2ext_layer_->Forward(subnet2ext_bottom_vec_,subnet2ext_top_vec_);
+  subnet2ext_layer_->Backward(subnet2ext_top_vec_,
+                              propagate_down,
+                              subnet2ext_bottom_vec_);
+}
+
+template <typename Dtype>
+void AdversarialSubnetPairLayer<Dtype>::InternalThreadEntry() {
+  try {
+    while(!must_stop()){
+      int job=jobs_.pop();
+      RealDataPass();
+      jobs_done_.push(job);
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted exception is expected on shutdown
+  }
+}
+
+template <typename Dtype>
+void AdversarialSubnetPairLayer<Dtype>::UpdatePhase() {
+  const int iter=this->subnets_[0]->scheduler()->iteration();
+  if(iter<0) return;
+  //subnet1 trains on the first subnet2_k_ iterations of every subnet2_k_+1,
+  //the schedule of the param_group example in caffe.proto.  All the passes
+  //of an iteration (iter_size>1) share a phase, and a resumed solver picks
+  //up where it stopped.
+  phase_counter_=iter%(subnet2_k_+1);
+  phase_switch_=phase_counter_<subnet2_k_ ? 1 : 2;
+  if(phase_switch_==2) phase_counter_=0;
+}
+
 template <typename Dtype>
 void AdversarialSubnetPairLayer<Dtype>::Forward_cpu(
     const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
 
-  subnet1_layer_->Forward(subnet1_bottom_vec_,subnet1_top_vec_);
-  subnet2_layer_->Forward(subnet2_bottom_vec_,subnet2_top_vec_);
-  
+  UpdatePhase();
 
   vector<bool> subnet2_propagate_down;
   for(int i=0;i<subnet2_bottom_vec_.size();i++){
     subnet2_propagate_down.push_back(true);
   }
-  subnet2_layer_->Backward(subnet2_top_vec_,
-                           subnet2_propagate_down,
-                           subnet2_bottom_vec_);
+
+  //async: hand the real data pass to the worker right away; it needs nothing
+  //from the generator
+  const bool overlap=async_ && phase_switch_==2;
+  if(overlap){
+    ShareDiscriminatorWeights();
+    if(!this->is_started()) this->StartInternalThread();
+    jobs_.push(0);
+  }
+
+  if(overlap && gen_buffer_ready_){
+    //the batch kept from the last generator step stands in for a new sample
+    subnet2_layer_->Forward(subnet2buf_bottom_vec_,subnet2_top_vec_);
+    subnet2_layer_->Backward(subnet2_top_vec_,
+                             subnet2_propagate_down,
+                             subnet2buf_bottom_vec_);
+    gen_buffer_ready_=false;
+  } else {
+    subnet1_layer_->Forward(subnet1_bottom_vec_,subnet1_top_vec_);
+    subnet2_layer_->Forward(subnet2_bottom_vec_,subnet2_top_vec_);
+    subnet2_layer_->Backward(subnet2_top_vec_,
+                             subnet2_propagate_down,
+                             subnet2_bottom_vec_);
+  }
 
   //phase_switch:  
   //  1==> subnet1 is getting trained: run Fwd passes over generated images 
@@ -223,6 +364,24 @@ void AdversarialSubnetPairLayer<Dtype>::Forward_cpu(
     for(int i=0;i<subnet2_layer_->subnets().size();i++){
       subnet2_layer_->subnets()[i]->ClearParamDiffs();
     }
+
+    //if subnet2 trains next, keep this batch for it
+    if(prefetch_generated_ && phase_counter_+1>=subnet2_k_){
+      for(int i=0;i<N_gen_;i++){
+        caffe_copy(top[i]->count(),top[i]->cpu_data(),
+                   gen_buffer_[i]->mutable_cpu_data());
+      }
+      gen_buffer_ready_=true;
+    }
+  } else if(overlap){
+    //wait for the worker, then add its gradients to subnet2's
+    jobs_done_.pop();
+    for(int i=0;i<subnet2_layer_->blobs().size();i++){
+      caffe_axpy(subnet2_layer_->blobs()[i]->count(),
+                 Dtype(1.),
+                 subnet2ext_layer_->blobs()[i]->cpu_diff(),
+                 subnet2_layer_->blobs()[i]->mutable_cpu_diff());
+    }
   } else {
     subnet2_layer_->Forward(subnet2ext_bottom_vec_,subnet2ext_top_vec_);
     subnet2_layer_->Backward(subnet2ext_top_vec_,
@@ -255,6 +414,8 @@ void AdversarialSubnetPairLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>&
   }
 
 
+  //when a solver drives the net, UpdatePhase follows its iteration instead
+  if(this->subnets_[0]->scheduler()->iteration()>=0) return;
   phase_counter_++;
   if(phase_switch_==1) {
     if(phase_counter_>=subnet2_k_) {
@@ -270,10 +431,6 @@ void AdversarialSubnetPairLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>&
 
 }
 
-#ifdef CPU_ONLY
-STUB_GPU_FORWARD(AdversarialSubnetPairLayer, Forward);
-#endif
-
 INSTANTIATE_CLASS(AdversarialSubnetPairLayer);
 REGISTER_LAYER_CLASS(AdversarialSubnetPair);
 
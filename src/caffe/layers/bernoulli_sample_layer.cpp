@@ -32,20 +32,13 @@ void BernoulliSampleLayer<Dtype>::Forward_cpu(
 
   const Dtype* p=bottom[0]->cpu_data();
 
-  int N=bottom[0]->shape(0);
-  int D=bottom[0]->count(1);
+  const int count=bottom[0]->count();
 
+  //draw all the uniforms in one call, then threshold them in place
   Dtype* sample=top[0]->mutable_cpu_data();
-  for(int item=0;item<N;item++){
-    for(int idim=0;idim<D;idim++){
-      Dtype rand;
-      caffe_rng_uniform<Dtype>(1,0.,1.,&rand);
-      if(rand>p[item*D+idim]) {
-        sample[item*D+idim]=0;
-      } else {
-        sample[item*D+idim]=1;
-      }
-    }
+  caffe_rng_uniform<Dtype>(count,0.,1.,sample);
+  for(int i=0;i<count;i++){
+    sample[i]=(sample[i]>p[i]) ? Dtype(0) : Dtype(1);
   }
 
 
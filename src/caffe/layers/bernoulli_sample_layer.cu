@@ -11,20 +11,11 @@ namespace caffe {
 
 template <typename Dtype>
 __global__ void BernoulliSampleForward(const int nthreads, const Dtype* p, 
-      const int D, Dtype* sample){
+      Dtype* sample){
 
   CUDA_KERNEL_LOOP(index, nthreads) {
-
-    if(index>=nthreads) return;
-
-    int item = index/D;
-    int idim   = index%D;
-
-    if(sample[item*D+idim]>p[item*D+idim]) {
-      sample[item*D+idim]=0;
-    } else {
-      sample[item*D+idim]=1;
-    }
+    //sample holds uniform draws on the way in
+    sample[index]=(sample[index]>p[index]) ? Dtype(0) : Dtype(1);
   }
 
 }
@@ -34,21 +25,16 @@ template <typename Dtype>
 void BernoulliSampleLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
 
-
   const Dtype* p=bottom[0]->gpu_data();
   Dtype* sample=top[0]->mutable_gpu_data();
-  int N=bottom[0]->shape(0);
-  int D=bottom[0]->count(1);
-
-  caffe_gpu_rng_uniform<Dtype>(bottom[0]->count(),0.,1.,sample);
-
-    BernoulliSampleForward<Dtype><<<CAFFE_GET_BLOCKS(bottom[0]->count()), CAFFE_CUDA_NUM_THREADS>>>(
-        bottom[0]->count(), p, D, sample);
-
+  const int count=bottom[0]->count();
 
+  caffe_gpu_rng_uniform<Dtype>(count,0.,1.,sample);
+  // NOLINT_NEXT_LINE(whitespace/operators)
+  BernoulliSampleForward<Dtype><<<CAFFE_GET_BLOCKS(count), CAFFE_CUDA_NUM_THREADS>>>(
+      count, p, sample);
   CUDA_POST_KERNEL_CHECK;
 
-
 }
 
 
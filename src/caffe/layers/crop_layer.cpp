@@ -68,6 +68,24 @@ void CropLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
     offset_data[i] = crop_offset;
   }
   top[0]->Reshape(new_shape);
+  // If every axis before the last cropped one is cut down to a single index,
+  // the crop is a contiguous run of the bottom and the top can be a view.
+  int last_cropped = input_dim - 1;
+  while (last_cropped > 0 &&
+         new_shape[last_cropped] == bottom[0]->shape(last_cropped)) {
+    --last_cropped;
+  }
+  bool contiguous = this->allow_top_views();
+  view_offset_ = 0;
+  for (int i = 0; i < input_dim; ++i) {
+    if (i < last_cropped && new_shape[i] != 1) { contiguous = false; }
+    view_offset_ += offset_data[i] * bottom[0]->count(i + 1);
+  }
+  if (contiguous) {
+    top[0]->ShareView(*bottom[0], new_shape, view_offset_);
+  } else {
+    top[0]->ReleaseView();
+  }
   // Compute strides
   src_strides_.Reshape(offsets_shape);
   dest_strides_.Reshape(offsets_shape);
@@ -121,6 +139,7 @@ void CropLayer<Dtype>::crop_copy(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void CropLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
+  if (top[0]->SharesDataWith(*bottom[0], view_offset_)) { return; }
   std::vector<int> indices(top[0]->num_axes(), 0);
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
@@ -134,7 +153,13 @@ void CropLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   const Dtype* top_diff = top[0]->cpu_diff();
   Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
 
-  if (propagate_down[0]) {
+  if (propagate_down[0] && top[0]->SharesDiffWith(*bottom[0], view_offset_)) {
+    // The top diff is already in place; clear the rest around it.
+    const int end = view_offset_ + top[0]->count();
+    caffe_set(view_offset_, static_cast<Dtype>(0), bottom_diff);
+    caffe_set(bottom[0]->count() - end, static_cast<Dtype>(0),
+        bottom_diff + end);
+  } else if (propagate_down[0]) {
     caffe_set(bottom[0]->count(), static_cast<Dtype>(0), bottom_diff);
     std::vector<int> indices(top[0]->num_axes(), 0);
     crop_copy(bottom, top, offsets.cpu_data(), indices, 0, top_diff,
@@ -16,13 +16,10 @@ void GaussianSampleLayer<Dtype>::LayerSetUp(
     CHECK_EQ(bottom[0]->count(),bottom[1]->count()) << "mu and sigma must have the same count";
   }
 
-  top[0]->ReshapeLike(*(bottom[0]));
-  temp_.ReshapeLike(*(bottom[0]));
-
-  if(top.size()>=2) top[1]->ReshapeLike(*(bottom[0]));
-
   sigma_=fmaxf(0.01,this->layer_param().gaussian_mc_param().sigma());
   cliplimit_=this->layer_param_.clip_param().cliplimit();
+  num_samples_=this->layer_param_.gaussian_mc_param().num_samples();
+  CHECK_GT(num_samples_,0) << "num_samples must be positive";
 
 }
 
@@ -31,10 +28,11 @@ template <typename Dtype>
 void GaussianSampleLayer<Dtype>::Reshape(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
 
-  top[0]->ReshapeLike(*(bottom[0]));
-  temp_.ReshapeLike(*(bottom[0]));
+  vector<int> top_shape(bottom[0]->shape());
+  top_shape[0]*=num_samples_;
+  top[0]->Reshape(top_shape);
 
-  if(top.size()>=2) top[1]->ReshapeLike(*(bottom[0]));
+  if(top.size()>=2) top[1]->Reshape(top_shape);
 
 }
 
@@ -47,27 +45,37 @@ void GaussianSampleLayer<Dtype>::Forward_cpu(
   const Dtype* sigma=NULL;
   if(bottom.size()>1) sigma=bottom[1]->cpu_data();
 
-  int N=bottom[0]->shape(0);
-  int D=bottom[0]->count(1);
-
-  Dtype* sample=top[1]->mutable_cpu_data();
-  for(int item=0;item<N;item++){
-    for(int idim=0;idim<D;idim++){
-      Dtype sig=sigma_;
-      if(sigma) sig=fmaxf(0.01,fabs(sigma[item*D+idim]));
-      caffe_rng_gaussian<Dtype>(1,mu[item*D+idim],sig,&(sample[item*D+idim]));
+  //the samples for MC draw iM are a contiguous block of the top blob, laid 
+  //over the same mu and sigma as every other draw
+  const int count=bottom[0]->count();
+
+  //draw all the standard normals in one call, then shift and scale them in 
+  //place; with a fixed sigma the scaling is folded into the draw
+  Dtype* sample=top[0]->mutable_cpu_data();
+  caffe_rng_gaussian<Dtype>(top[0]->count(),Dtype(0),
+                            sigma ? Dtype(1) : Dtype(sigma_),sample);
+  for(int iM=0;iM<num_samples_;iM++){
+    Dtype* draw=sample+iM*count;
+    if(sigma){
+      for(int i=0;i<count;i++){
+        draw[i]=mu[i]+draw[i]*fmaxf(0.01,fabs(sigma[i]));
+      }
+    } else {
+      caffe_axpy(count,Dtype(1),mu,draw);
     }
   }
 
   if(top.size()>=2){
-    if(bottom.size()>1){
-      caffe_copy(bottom[1]->count(),
-                 bottom[1]->cpu_data(),
-                 top[1]->mutable_cpu_data());
-    } else {
-      caffe_set(top[1]->count(),
-                sigma_,
-                top[1]->mutable_cpu_data());
+    for(int iM=0;iM<num_samples_;iM++){
+      if(bottom.size()>1){
+        caffe_copy(count,
+                   bottom[1]->cpu_data(),
+                   top[1]->mutable_cpu_data()+iM*count);
+      } else {
+        caffe_set(count,
+                  sigma_,
+                  top[1]->mutable_cpu_data()+iM*count);
+      }
     }
   }
 
@@ -88,23 +96,32 @@ void GaussianSampleLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   Dtype* dsigma=NULL;
   if(bottom.size()>1) dsigma=bottom[1]->mutable_cpu_diff();
 
-  int N=bottom[0]->shape(0);
-  int D=bottom[0]->shape(1);
+  const int count=bottom[0]->count();
 
-  Dtype maxgrad=0;
-  for(int item=0;item<N;item++){
-    for(int idim=0;idim<D;idim++){
-      dmu[item*D+idim]=samp_diff[item*D+idim]; 
+  //mu and sigma are shared by all MC draws, so their gradients are summed 
+  //over the draws
+  caffe_set(count,Dtype(0),dmu);
+  if(dsigma) caffe_set(count,Dtype(0),dsigma);
+  for(int iM=0;iM<num_samples_;iM++){
+    for(int i=0;i<count;i++){
+      const int k=iM*count+i;
+      dmu[i]+=samp_diff[k]; 
       if(sigma) {
-        Dtype sig=fmaxf(0.01,fabs(sigma[item*D+idim]));
-        dsigma[item*D+idim]=samp_diff[item*D+idim]*(sample[item*D+idim]-mu[item*D+idim])/sig;
-        if(fabs(dsigma[item*D+idim])>maxgrad || fabs(dmu[item*D+idim])>maxgrad) maxgrad=fmaxf(fabs(dsigma[item*D+idim]),fabs(dmu[item*D+idim]));
+        Dtype sig=fmaxf(0.01,fabs(sigma[i]));
+        dsigma[i]+=samp_diff[k]*(sample[k]-mu[i])/sig;
       }
     }
   }
 
+  Dtype maxgrad=0;
+  if(sigma){
+    for(int i=0;i<count;i++){
+      maxgrad=fmaxf(maxgrad,fmaxf(fabs(dsigma[i]),fabs(dmu[i])));
+    }
+  }
+
   if(cliplimit_>0 && maxgrad>cliplimit_ && sigma!=NULL){
-    for(int i=0;i<bottom[0]->count();i++){
+    for(int i=0;i<count;i++){
       dmu[i]*=cliplimit_/maxgrad;
       dsigma[i]*=cliplimit_/maxgrad;
     }
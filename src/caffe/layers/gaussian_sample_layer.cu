@@ -11,27 +11,44 @@ namespace caffe {
 template <typename Dtype>
 __global__ void GaussianSampleBackward(const int nthreads, 
     const Dtype* mu, const Dtype* sigma, const Dtype* samp_diff, 
-    const Dtype* sample, const int D, const int N, const bool have_dsigma, Dtype* dmu, Dtype* dsigma) {
+    const Dtype* sample, const int num_samples, const bool have_dsigma, 
+    Dtype* dmu, Dtype* dsigma) {
   CUDA_KERNEL_LOOP(index, nthreads) {
 
     if(index>=nthreads) return;
 
-    int item = index/D;
-    int idim   = index%D;
-
-    dmu[item*D+idim]=samp_diff[item*D+idim];
-    if(have_dsigma){
-      Dtype sig=fmaxf(0.01,fabs(sigma[item*D+idim]));
-      dsigma[item*D+idim]=samp_diff[item*D+idim]
-                         *(sample[item*D+idim]-mu[item*D+idim])/sig;
-
+    //sum over the MC draws, which are stacked nthreads apart in the top blob
+    Dtype gmu=0, gsigma=0;
+    Dtype sig=1.;
+    if(have_dsigma) sig=fmaxf(0.01,fabs(sigma[index]));
+    for(int iM=0;iM<num_samples;iM++){
+      const int k=iM*nthreads+index;
+      gmu+=samp_diff[k];
+      if(have_dsigma) gsigma+=samp_diff[k]*(sample[k]-mu[index])/sig;
     }
+    dmu[index]=gmu;
+    if(have_dsigma) dsigma[index]=gsigma;
 
   }
 
 }
 
 
+template <typename Dtype>
+__global__ void GaussianSampleForward(const int nthreads, const int count,
+    const Dtype* mu, const Dtype* sigma, Dtype* sample) {
+  CUDA_KERNEL_LOOP(index, nthreads) {
+
+    if(index>=nthreads) return;
+
+    //sample holds standard normal draws on the way in
+    const int i=index%count;
+    sample[index]=mu[i]+sample[index]*fmaxf(0.01,fabs(sigma[i]));
+
+  }
+}
+
+
 
 
 template <typename Dtype>
@@ -67,26 +84,33 @@ void GaussianSampleLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
   if(bottom.size()>1) sigma=bottom[1]->gpu_data();
   Dtype* sample=top[0]->mutable_gpu_data();
 
+  const int count=bottom[0]->count();
   if(sigma){
-    caffe_gpu_rng_gaussian<Dtype>(bottom[0]->count(),Dtype(0.),Dtype(1.),sample);
-    caffe_gpu_mul<Dtype>(bottom[0]->count(),sample,sigma,sample);
+    caffe_gpu_rng_gaussian<Dtype>(top[0]->count(),Dtype(0.),Dtype(1.),sample);
+    // NOLINT_NEXT_LINE(whitespace/operators)
+    GaussianSampleForward<Dtype><<<CAFFE_GET_BLOCKS(top[0]->count()), CAFFE_CUDA_NUM_THREADS>>>(
+        top[0]->count(), count, mu, sigma, sample);
   } else {
-    caffe_gpu_rng_gaussian<Dtype>(bottom[0]->count(),Dtype(0.),Dtype(sigma_),sample);
+    caffe_gpu_rng_gaussian<Dtype>(top[0]->count(),Dtype(0.),Dtype(sigma_),sample);
+    for(int iM=0;iM<num_samples_;iM++){
+      caffe_gpu_add<Dtype>(count,sample+iM*count,mu,sample+iM*count);
+    }
   }
-  caffe_gpu_add<Dtype>(bottom[0]->count(),sample,mu,sample);
 
   CUDA_POST_KERNEL_CHECK;
 
 
   if(top.size()>=2){
-    if(bottom.size()>1){
-      caffe_copy(bottom[1]->count(),
-                 bottom[1]->gpu_data(),
-                 top[1]->mutable_gpu_data());
-    } else {
-      caffe_set(top[1]->count(),
-                sigma_,
-                top[1]->mutable_cpu_data());
+    for(int iM=0;iM<num_samples_;iM++){
+      if(bottom.size()>1){
+        caffe_copy(count,
+                   bottom[1]->gpu_data(),
+                   top[1]->mutable_gpu_data()+iM*count);
+      } else {
+        caffe_gpu_set(count,
+                      sigma_,
+                      top[1]->mutable_gpu_data()+iM*count);
+      }
     }
   }
 
@@ -107,18 +131,21 @@ void GaussianSampleLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
   Dtype* dsigma=NULL;
   if(bottom.size()>1) dsigma=bottom[1]->mutable_gpu_diff();
 
-  int N=bottom[0]->shape(0);
-  int D=bottom[0]->shape(1);
+  int D=bottom[0]->count(1);
 
+  //the summed gradients are staged in temp_ before clipping; only this path 
+  //needs it, so it is sized here rather than in Reshape
+  temp_.ReshapeLike(*(bottom[0]));
   GaussianSampleBackward<Dtype><<<CAFFE_GET_BLOCKS(bottom[0]->count()), CAFFE_CUDA_NUM_THREADS>>>(
-      bottom[0]->count(), mu, sigma, samp_diff, sample, D, N, dsigma!=NULL,
-      temp_.mutable_gpu_data(), temp_.mutable_gpu_diff());  //last args are dmu, dsigma
+      bottom[0]->count(), mu, sigma, samp_diff, sample, num_samples_, 
+      dsigma!=NULL, temp_.mutable_gpu_data(), temp_.mutable_gpu_diff());  //last args are dmu, dsigma
 
   CUDA_POST_KERNEL_CHECK;
 
-  if(sigma==NULL) return;
-
-  if(cliplimit_>0){
+  if(cliplimit_<=0 || sigma==NULL){
+    caffe_copy(temp_.count(),temp_.gpu_data(),dmu);
+    if(dsigma) caffe_copy(temp_.count(),temp_.gpu_diff(),dsigma);
+  } else {
     int maxgrad_mu_idx,maxgrad_sigma_idx;
     caffe_gpu_absmax<Dtype>(temp_.count(),temp_.gpu_data(),&maxgrad_mu_idx);
     caffe_gpu_absmax<Dtype>(temp_.count(),temp_.gpu_diff(),&maxgrad_sigma_idx);
@@ -1,5 +1,7 @@
 #include <algorithm>
 #include <cfloat>
+#include <cmath>
+#include <cstring>
 #include <vector>
 
 #include "caffe/util/math_functions.hpp"
@@ -18,7 +20,8 @@ void GlimpseCroppingLayer<Dtype>::LayerSetUp(
        this->layer_param_.glimpse_cropping_param();
 
   crop_size_=glimpse_param.window();
-  do_downsamp_=glimpse_param.do_downsamp();
+  num_levels_=max<int>(glimpse_param.depth(),glimpse_param.do_downsamp()?2:1);
+  const double scalefac=glimpse_param.scalefac();
 
   CHECK_GT(crop_size_,0) 
       << "Glimpse crop size must be greater than zero";
@@ -26,6 +29,39 @@ void GlimpseCroppingLayer<Dtype>::LayerSetUp(
       << "Glimpse crop size must be less than original image width";
   CHECK_LT(crop_size_,bottom[0]->shape(3)) 
       << "Glimpse crop size must be less than original image height";
+  CHECK_GE(scalefac,1.) << "Glimpse scalefac must be at least 1";
+
+  //level l splits a square of crop_size_*scalefac^l pixels into a 
+  //crop_size_ x crop_size_ grid of boxes of (nearly) equal size
+  vector<int> edges_shape(2);
+  edges_shape[0]=num_levels_;
+  edges_shape[1]=crop_size_+1;
+  box_edges_.Reshape(edges_shape);
+  int* edges=box_edges_.mutable_cpu_data();
+  level_extent_.resize(num_levels_);
+  use_integral_=false;
+  for(int il=0;il<num_levels_;il++){
+    const double scale=std::pow(scalefac,il);
+    for(int i=0;i<=crop_size_;i++){
+      edges[il*(crop_size_+1)+i]=(int)(i*scale+1e-6);
+    }
+    level_extent_[il]=edges[il*(crop_size_+1)+crop_size_];
+    if(level_extent_[il]>crop_size_) use_integral_=true;
+  }
+
+  vector<int> index_shape(2);
+  index_shape[0]=num_levels_;
+  index_shape[1]=level_extent_[num_levels_-1];
+  box_index_.Reshape(index_shape);
+  int* index=box_index_.mutable_cpu_data();
+  for(int il=0;il<num_levels_;il++){
+    for(int i=0;i<crop_size_;i++){
+      for(int d=edges[il*(crop_size_+1)+i];
+          d<edges[il*(crop_size_+1)+i+1];d++){
+        index[il*index_shape[1]+d]=i;
+      }
+    }
+  }
 }
 
 template <typename Dtype>
@@ -37,17 +73,81 @@ void GlimpseCroppingLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   CHECK_EQ(bottom[1]->shape(1),2) 
       << "Second bottom blob for GlimpseCroppingLayer must be a "
       << "location tuple for each batch element";
+  CHECK_EQ(bottom[1]->shape(0)%bottom[0]->shape(0),0)
+      << "The number of location tuples must be a multiple of the number "
+      << "of images";
+  if(bottom.size()==3){
+    CHECK_EQ(bottom[2]->shape(0),bottom[0]->shape(0))
+        << "Need one set of embedding bounds per image";
+  }
 
   channels_ = bottom[0]->channels();
   height_ = bottom[0]->height();
   width_ = bottom[0]->width();
 
-  if(do_downsamp_){
-    top[0]->Reshape(bottom[0]->num(), channels_*2, crop_size_, crop_size_);
-  } else {
-    top[0]->Reshape(bottom[0]->num(), channels_, crop_size_, crop_size_);
+  const int max_window=level_extent_[num_levels_-1];
+  CHECK_LE(max_window,height_) 
+      << "Coarsest glimpse level (" << max_window << " pixels) does not fit "
+      << "in the image height";
+  CHECK_LE(max_window,width_) 
+      << "Coarsest glimpse level (" << max_window << " pixels) does not fit "
+      << "in the image width";
+
+  top[0]->Reshape(bottom[1]->num(), channels_*num_levels_, crop_size_, 
+                  crop_size_);
+  if(use_integral_){
+    integral_.Reshape(bottom[0]->num(), channels_, height_+1, width_+1);
   }
+}
 
+template <typename Dtype>
+void GlimpseCroppingLayer<Dtype>::ImageBounds(const Dtype* embed_bounds,
+      int img, int* H, int* W) const {
+  *H=height_;
+  *W=width_;
+  if(embed_bounds!=NULL){
+    *H=embed_bounds[2*img];
+    *W=embed_bounds[2*img+1];
+    CHECK(*H<=height_ && *W<=width_) 
+        << "Embedding bounds exceed the image blob; are W and H mixed up?";
+  }
+}
+
+//in-place inclusive prefix sums of a rows x cols plane, along each row and
+//then along each column
+template <typename Dtype>
+static void PrefixSum2D(Dtype* plane, const int rows, const int cols) {
+  for(int r=0;r<rows;r++){
+    Dtype* row=plane+r*cols;
+    for(int c=1;c<cols;c++) row[c]+=row[c-1];
+  }
+  for(int r=1;r<rows;r++){
+    const Dtype* above=plane+(r-1)*cols;
+    Dtype* row=plane+r*cols;
+    for(int c=0;c<cols;c++) row[c]+=above[c];
+  }
+}
+
+template <typename Dtype>
+void GlimpseCroppingLayer<Dtype>::BuildIntegral_cpu(const Blob<Dtype>* image) {
+  const Dtype* data=image->cpu_data();
+  Dtype* integral=integral_.mutable_cpu_data();
+  const int num_planes=image->shape(0)*channels_;
+  const int plane_size=(height_+1)*(width_+1);
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+  for(int p=0;p<num_planes;p++){
+    //entry (r,c) holds the sum of the image over [0,r) x [0,c)
+    Dtype* I=integral+p*plane_size;
+    std::memset(I,0,(width_+1)*sizeof(Dtype));
+    for(int r=0;r<height_;r++){
+      Dtype* row=I+(r+1)*(width_+1);
+      row[0]=0;
+      std::memcpy(row+1,data+(p*height_+r)*width_,width_*sizeof(Dtype));
+    }
+    PrefixSum2D(I,height_+1,width_+1);
+  }
 }
 
 template <typename Dtype>
@@ -62,41 +162,53 @@ void GlimpseCroppingLayer<Dtype>::Forward_cpu(
   }
   Dtype* glimpse_data = top[0]->mutable_cpu_data();
 
-  for(int iN=0;iN<bottom[0]->shape(0);iN++){
-    float crop_x=location_tuple[iN*2]; 
-    float crop_y=location_tuple[iN*2+1]; 
-    int W=width_;
-    int H=height_;
-    if(embed_bounds!=NULL){
-      H=embed_bounds[2*iN];
-      W=embed_bounds[2*iN+1];
-      if(W>width_ || H>height_) {
-        std::cout << "Oops, looks like you mixed up W and H!" << std::endl;
-        exit(0);
-      }
-    }
-    int crop_xmin_pix=(int)(crop_x*(H-crop_size_));
-    int crop_ymin_pix=(int)(crop_y*(W-crop_size_));
-    for(int ich=0;ich<bottom[0]->shape(1);ich++){
-      for(int iX=0;iX<crop_size_;iX++){
-        for(int iY=0;iY<crop_size_;iY++){
-          glimpse_data[top[0]->offset(iN,ich,iX,iY)]=
-            full_data[bottom[0]->offset(iN,ich,crop_xmin_pix+iX,crop_ymin_pix+iY)];
-          if(do_downsamp_){
-            int crop_xmin_pix_ds=(int)(crop_x*(H-2*crop_size_));
-            int crop_ymin_pix_ds=(int)(crop_y*(W-2*crop_size_));
-
-            Dtype downsamp=
-              (full_data[bottom[0]->offset(iN,ich,crop_xmin_pix_ds+iX*2,
-                                           crop_ymin_pix_ds+iY*2)]
-              +full_data[bottom[0]->offset(iN,ich,crop_xmin_pix_ds+iX*2,
-                                           crop_ymin_pix_ds+iY*2+1)]
-              +full_data[bottom[0]->offset(iN,ich,crop_xmin_pix_ds+iX*2+1,
-                                           crop_ymin_pix_ds+iY*2)]
-              +full_data[bottom[0]->offset(iN,ich,crop_xmin_pix_ds+iX*2+1,
-                                           crop_ymin_pix_ds+iY*2+1)])/4.;
-            int topoff=top[0]->offset(iN,ich+bottom[0]->shape(1),iX,iY);
-            glimpse_data[topoff]=downsamp;
+  if(use_integral_) BuildIntegral_cpu(bottom[0]);
+  const Dtype* integral = use_integral_ ? integral_.cpu_data() : NULL;
+  const int* edges=box_edges_.cpu_data();
+
+  const int num_images=bottom[0]->shape(0);
+  const int num_locs=bottom[1]->shape(0);
+  const int crop_area=crop_size_*crop_size_;
+  const int integral_width=width_+1;
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+  for(int iN=0;iN<num_locs;iN++){
+    //with several locations per image, location iN crops from image iN%N
+    const int img=iN%num_images;
+    const float crop_x=location_tuple[iN*2]; 
+    const float crop_y=location_tuple[iN*2+1]; 
+    int H, W;
+    ImageBounds(embed_bounds,img,&H,&W);
+    for(int il=0;il<num_levels_;il++){
+      const int extent=level_extent_[il];
+      const int* e=edges+il*(crop_size_+1);
+      const int crop_xmin_pix=(int)(crop_x*(H-extent));
+      const int crop_ymin_pix=(int)(crop_y*(W-extent));
+      for(int ich=0;ich<channels_;ich++){
+        const int plane=img*channels_+ich;
+        Dtype* dst=glimpse_data+
+            ((iN*num_levels_+il)*channels_+ich)*crop_area;
+        if(extent==crop_size_){
+          //rows of the crop are contiguous in the image
+          const Dtype* src=full_data+
+              (plane*height_+crop_xmin_pix)*width_+crop_ymin_pix;
+          for(int iX=0;iX<crop_size_;iX++){
+            std::memcpy(dst+iX*crop_size_,src+iX*width_,
+                        crop_size_*sizeof(Dtype));
+          }
+          continue;
+        }
+        //box averages from four reads of the summed-area table
+        const Dtype* I=integral+plane*(height_+1)*integral_width+
+            crop_xmin_pix*integral_width+crop_ymin_pix;
+        for(int iX=0;iX<crop_size_;iX++){
+          const Dtype* I0=I+e[iX]*integral_width;
+          const Dtype* I1=I+e[iX+1]*integral_width;
+          const int rows=e[iX+1]-e[iX];
+          for(int iY=0;iY<crop_size_;iY++){
+            const Dtype sum=I1[e[iY+1]]-I1[e[iY]]-I0[e[iY+1]]+I0[e[iY]];
+            dst[iX*crop_size_+iY]=sum/(rows*(e[iY+1]-e[iY]));
           }
         }
       }
@@ -107,7 +219,83 @@ void GlimpseCroppingLayer<Dtype>::Forward_cpu(
 template <typename Dtype>
 void GlimpseCroppingLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  //the crop origin is quantized to whole pixels, so there is no gradient 
+  //with respect to the location
+  if(propagate_down[1]){
+    caffe_set(bottom[1]->count(),Dtype(0),bottom[1]->mutable_cpu_diff());
+  }
+  if(!propagate_down[0]) return;
+
+  const Dtype* glimpse_diff = top[0]->cpu_diff();
+  const Dtype* location_tuple = bottom[1]->cpu_data();
+  const Dtype* embed_bounds = NULL; 
+  if(bottom.size()==3){
+    embed_bounds=bottom[2]->cpu_data();
+  }
+  Dtype* full_diff = bottom[0]->mutable_cpu_diff();
+  caffe_set(bottom[0]->count(),Dtype(0),full_diff);
 
+  const int* edges=box_edges_.cpu_data();
+  const int num_images=bottom[0]->shape(0);
+  const int num_locs=bottom[1]->shape(0);
+  const int crop_area=crop_size_*crop_size_;
+  const int integral_width=width_+1;
+  //parallel over images rather than locations, so that the glimpses of 
+  //several locations in the same image never accumulate concurrently
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+  for(int img=0;img<num_images;img++){
+    int H, W;
+    ImageBounds(embed_bounds,img,&H,&W);
+    //the adjoint of the box sums: each box adds its gradient at its four 
+    //corners, and a 2D prefix sum then spreads it over the box
+    vector<Dtype> spread(use_integral_ ? (height_+1)*integral_width : 0);
+    for(int ich=0;ich<channels_;ich++){
+      const int plane=img*channels_+ich;
+      Dtype* plane_diff=full_diff+plane*height_*width_;
+      std::fill(spread.begin(),spread.end(),Dtype(0));
+      for(int iN=img;iN<num_locs;iN+=num_images){
+        const float crop_x=location_tuple[iN*2]; 
+        const float crop_y=location_tuple[iN*2+1]; 
+        for(int il=0;il<num_levels_;il++){
+          const int extent=level_extent_[il];
+          const int* e=edges+il*(crop_size_+1);
+          const int crop_xmin_pix=(int)(crop_x*(H-extent));
+          const int crop_ymin_pix=(int)(crop_y*(W-extent));
+          const Dtype* src=glimpse_diff+
+              ((iN*num_levels_+il)*channels_+ich)*crop_area;
+          if(extent==crop_size_){
+            for(int iX=0;iX<crop_size_;iX++){
+              Dtype* out=plane_diff+(crop_xmin_pix+iX)*width_+crop_ymin_pix;
+              for(int iY=0;iY<crop_size_;iY++) out[iY]+=src[iX*crop_size_+iY];
+            }
+            continue;
+          }
+          Dtype* S=&spread[crop_xmin_pix*integral_width+crop_ymin_pix];
+          for(int iX=0;iX<crop_size_;iX++){
+            Dtype* S0=S+e[iX]*integral_width;
+            Dtype* S1=S+e[iX+1]*integral_width;
+            const int rows=e[iX+1]-e[iX];
+            for(int iY=0;iY<crop_size_;iY++){
+              const Dtype g=src[iX*crop_size_+iY]/(rows*(e[iY+1]-e[iY]));
+              S0[e[iY]]+=g;
+              S0[e[iY+1]]-=g;
+              S1[e[iY]]-=g;
+              S1[e[iY+1]]+=g;
+            }
+          }
+        }
+      }
+      if(!use_integral_) continue;
+      PrefixSum2D(&spread[0],height_+1,integral_width);
+      for(int r=0;r<height_;r++){
+        const Dtype* in=&spread[r*integral_width];
+        Dtype* out=plane_diff+r*width_;
+        for(int c=0;c<width_;c++) out[c]+=in[c];
+      }
+    }
+  }
 }
 
 
@@ -7,64 +7,147 @@
 
 namespace caffe {
 
+//copy each image plane into the interior of its (H+1)x(W+1) table, leaving
+//a zero first row and column
+template <typename Dtype>
+__global__ void IntegralPad(const int nthreads, const Dtype* const image,
+    const int height, const int width, Dtype* const integral) {
+  CUDA_KERNEL_LOOP(index, nthreads) {
+    const int c=index%(width+1);
+    const int r=(index/(width+1))%(height+1);
+    const int p=index/(width+1)/(height+1);
+    integral[index]=(r==0 || c==0) ? Dtype(0) :
+        image[(p*height+r-1)*width+c-1];
+  }
+}
+
+//one thread per row of every plane
+template <typename Dtype>
+__global__ void IntegralRowScan(const int nthreads, const int cols,
+    Dtype* const integral) {
+  CUDA_KERNEL_LOOP(index, nthreads) {
+    Dtype* row=integral+index*cols;
+    for(int c=1;c<cols;c++) row[c]+=row[c-1];
+  }
+}
+
+//one thread per column of every plane
+template <typename Dtype>
+__global__ void IntegralColScan(const int nthreads, const int rows, 
+    const int cols, Dtype* const integral) {
+  CUDA_KERNEL_LOOP(index, nthreads) {
+    Dtype* col=integral+(index/cols)*rows*cols+index%cols;
+    for(int r=1;r<rows;r++) col[r*cols]+=col[(r-1)*cols];
+  }
+}
+
+//one thread per glimpse pixel: index runs over (location,level,channel,x,y)
 template <typename Dtype>
 __global__ void GlimpseCropForward(const int nthreads,
-    const Dtype* const bottom_data, const Dtype* location_tuple, 
-    const int num, const int channels, const Dtype* embed_bounds, 
-    const int height, const int width, const int crop_size, 
-    const bool do_downsamp, Dtype* const top_data) {
+    const Dtype* const bottom_data, const Dtype* const integral, 
+    const Dtype* location_tuple, const int num_images, const int channels, 
+    const Dtype* embed_bounds, const int height, const int width, 
+    const int crop_size, const int num_levels, const int* const box_edges, 
+    Dtype* const top_data) {
   CUDA_KERNEL_LOOP(index, nthreads) {
+    const int iY=index%crop_size;
+    const int iX=(index/crop_size)%crop_size;
+    const int ich=(index/crop_size/crop_size)%channels;
+    const int il=(index/crop_size/crop_size/channels)%num_levels;
+    const int iN=index/crop_size/crop_size/channels/num_levels;
+    //with several locations per image, location iN crops from image iN%N
+    const int img=iN%num_images;
 
-    if(index>=nthreads) return;
+    int W=width;
+    int H=height;
+    if(embed_bounds!=NULL){
+      H=embed_bounds[2*img];
+      W=embed_bounds[2*img+1];
+    }
 
-    const int iN=index/channels;
-    const int ich=index%channels;
+    const int* e=box_edges+il*(crop_size+1);
+    const int extent=e[crop_size];
+    const float crop_x=location_tuple[iN*2];  
+    const float crop_y=location_tuple[iN*2+1];  
+    const int x0=(int)(crop_x*(H-extent));
+    const int y0=(int)(crop_y*(W-extent));
+    const int plane=img*channels+ich;
+
+    if(extent==crop_size){
+      top_data[index]=bottom_data[(plane*height+x0+iX)*width+y0+iY];
+    } else {
+      //box average from four reads of the summed-area table
+      const Dtype* I=integral+(plane*(height+1)+x0)*(width+1)+y0;
+      const Dtype* I0=I+e[iX]*(width+1);
+      const Dtype* I1=I+e[iX+1]*(width+1);
+      const Dtype sum=I1[e[iY+1]]-I1[e[iY]]-I0[e[iY+1]]+I0[e[iY]];
+      top_data[index]=sum/((e[iX+1]-e[iX])*(e[iY+1]-e[iY]));
+    }
+  }
+}
+
+//one thread per image pixel, gathering from every glimpse box that covers 
+//it, so several locations in the same image need no atomics
+template <typename Dtype>
+__global__ void GlimpseCropBackward(const int nthreads,
+    const Dtype* const top_diff, const Dtype* location_tuple, 
+    const int num_images, const int num_locs, const int channels, 
+    const Dtype* embed_bounds, const int height, const int width, 
+    const int crop_size, const int num_levels, const int* const box_edges, 
+    const int* const box_index, const int max_extent, 
+    Dtype* const bottom_diff) {
+  CUDA_KERNEL_LOOP(index, nthreads) {
+    const int w=index%width;
+    const int h=(index/width)%height;
+    const int ich=(index/width/height)%channels;
+    const int img=index/width/height/channels;
 
     int W=width;
     int H=height;
     if(embed_bounds!=NULL){
-      H=embed_bounds[2*iN];
-      W=embed_bounds[2*iN+1];
+      H=embed_bounds[2*img];
+      W=embed_bounds[2*img+1];
     }
 
-    float crop_x=location_tuple[iN*2];  
-    float crop_y=location_tuple[iN*2+1];  
-    int crop_xmin_pix=(int)(crop_x*(H-crop_size));
-    int crop_ymin_pix=(int)(crop_y*(W-crop_size));
-
-    for(int iX=0;iX<crop_size;iX++){
-      for(int iY=0;iY<crop_size;iY++){
-        if(do_downsamp){
-            top_data[(((iN*channels*2)+ich)*crop_size+iX)*crop_size+iY]=
-                bottom_data[(((iN*channels)+ich)*height+crop_xmin_pix+iX)
-                            *width+crop_ymin_pix+iY];
-
-            int crop_xmin_pix_ds=(int)(crop_x*(H-2*crop_size));
-            int crop_ymin_pix_ds=(int)(crop_y*(W-2*crop_size));
-
-            Dtype downsamp=
-              (bottom_data[(((iN*channels)+ich)*height+crop_xmin_pix_ds+iX*2)
-                           *width+crop_ymin_pix_ds+iY*2]
-              +bottom_data[(((iN*channels)+ich)*height+crop_xmin_pix_ds+iX*2+1)
-                           *width+crop_ymin_pix_ds+iY*2]
-              +bottom_data[(((iN*channels)+ich)*height+crop_xmin_pix_ds+iX*2)
-                           *width+crop_ymin_pix_ds+iY*2+1]
-              +bottom_data[(((iN*channels)+ich)*height+crop_xmin_pix_ds+iX*2+1)
-                           *width+crop_ymin_pix_ds+iY*2+1])/4.;
-
-            int topoff=(((iN*channels*2)+ich+channels)*crop_size+iX)*crop_size+iY;
-            top_data[topoff]=downsamp;
-        
-        } else {
-            top_data[(((iN*channels)+ich)*crop_size+iX)*crop_size+iY]=
-              bottom_data[(((iN*channels)+ich)*height+crop_xmin_pix+iX)
-                          *width+crop_ymin_pix+iY];
-        }
+    Dtype grad=0;
+    for(int iN=img;iN<num_locs;iN+=num_images){
+      const float crop_x=location_tuple[iN*2];  
+      const float crop_y=location_tuple[iN*2+1];  
+      for(int il=0;il<num_levels;il++){
+        const int* e=box_edges+il*(crop_size+1);
+        const int extent=e[crop_size];
+        const int dx=h-(int)(crop_x*(H-extent));
+        const int dy=w-(int)(crop_y*(W-extent));
+        if(dx<0 || dy<0 || dx>=extent || dy>=extent) continue;
+        const int iX=box_index[il*max_extent+dx];
+        const int iY=box_index[il*max_extent+dy];
+        grad+=top_diff[(((iN*num_levels+il)*channels+ich)*crop_size+iX)
+                       *crop_size+iY]/((e[iX+1]-e[iX])*(e[iY+1]-e[iY]));
       }
     }
+    bottom_diff[index]=grad;
   }
 }
 
+template <typename Dtype>
+void GlimpseCroppingLayer<Dtype>::BuildIntegral_gpu(const Blob<Dtype>* image) {
+  Dtype* integral=integral_.mutable_gpu_data();
+  const int num_planes=image->shape(0)*channels_;
+  const int count=integral_.count();
+  // NOLINT_NEXT_LINE(whitespace/operators)
+  IntegralPad<Dtype><<<CAFFE_GET_BLOCKS(count), CAFFE_CUDA_NUM_THREADS>>>(
+      count, image->gpu_data(), height_, width_, integral);
+  const int num_rows=num_planes*(height_+1);
+  // NOLINT_NEXT_LINE(whitespace/operators)
+  IntegralRowScan<Dtype><<<CAFFE_GET_BLOCKS(num_rows), CAFFE_CUDA_NUM_THREADS>>>(
+      num_rows, width_+1, integral);
+  const int num_cols=num_planes*(width_+1);
+  // NOLINT_NEXT_LINE(whitespace/operators)
+  IntegralColScan<Dtype><<<CAFFE_GET_BLOCKS(num_cols), CAFFE_CUDA_NUM_THREADS>>>(
+      num_cols, height_+1, width_+1, integral);
+  CUDA_POST_KERNEL_CHECK;
+}
+
 template <typename Dtype>
 void GlimpseCroppingLayer<Dtype>::Forward_gpu(
       const vector<Blob<Dtype>*>& bottom,
@@ -80,11 +163,15 @@ void GlimpseCroppingLayer<Dtype>::Forward_gpu(
 
   Dtype* glimpse_data = top[0]->mutable_gpu_data();
 
+  if(use_integral_) BuildIntegral_gpu(bottom[0]);
+  const Dtype* integral = use_integral_ ? integral_.gpu_data() : NULL;
 
-  GlimpseCropForward<Dtype><<<CAFFE_GET_BLOCKS(bottom[0]->num()*channels_), CAFFE_CUDA_NUM_THREADS>>>(
-      bottom[0]->num()*channels_, full_data, location_tuple, bottom[0]->num(), 
-      channels_, embed_bounds,height_, width_, crop_size_, do_downsamp_, 
-      glimpse_data);
+  const int count=top[0]->count();
+  // NOLINT_NEXT_LINE(whitespace/operators)
+  GlimpseCropForward<Dtype><<<CAFFE_GET_BLOCKS(count), CAFFE_CUDA_NUM_THREADS>>>(
+      count, full_data, integral, location_tuple, bottom[0]->num(), channels_, 
+      embed_bounds, height_, width_, crop_size_, num_levels_, 
+      box_edges_.gpu_data(), glimpse_data);
 
   CUDA_POST_KERNEL_CHECK;
 }
@@ -92,7 +179,27 @@ void GlimpseCroppingLayer<Dtype>::Forward_gpu(
 
 template <typename Dtype>
 void GlimpseCroppingLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
-      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {}
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  if(propagate_down[1]){
+    caffe_gpu_set(bottom[1]->count(),Dtype(0),bottom[1]->mutable_gpu_diff());
+  }
+  if(!propagate_down[0]) return;
+
+  const Dtype* embed_bounds = NULL;
+  if(bottom.size()==3){
+    embed_bounds=bottom[2]->gpu_data();
+  }
+
+  const int count=bottom[0]->count();
+  // NOLINT_NEXT_LINE(whitespace/operators)
+  GlimpseCropBackward<Dtype><<<CAFFE_GET_BLOCKS(count), CAFFE_CUDA_NUM_THREADS>>>(
+      count, top[0]->gpu_diff(), bottom[1]->gpu_data(), bottom[0]->num(), 
+      bottom[1]->num(), channels_, embed_bounds, height_, width_, crop_size_,
+      num_levels_, box_edges_.gpu_data(), box_index_.gpu_data(), 
+      box_index_.shape(1), bottom[0]->mutable_gpu_diff());
+
+  CUDA_POST_KERNEL_CHECK;
+}
 
 
 INSTANTIATE_LAYER_GPU_FUNCS(GlimpseCroppingLayer);
@@ -52,6 +52,20 @@ void InnerProductLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     }
   }  // parameter initialization
   this->param_propagate_down_.resize(this->blobs_.size(), true);
+  const BlobProto::Precision weight_precision =
+      this->layer_param_.inner_product_param().weight_precision();
+  if (weight_precision != BlobProto::FULL) {
+    half_weight_.reset(new HalfBlob<Dtype>(weight_precision));
+    LOG_IF(WARNING, Caffe::mode() == Caffe::GPU) << this->layer_param_.name()
+        << ": weight_precision only applies to Forward_cpu; on the GPU the "
+        << "full-precision weights are used";
+  }
+  release_full_weights_ =
+      this->layer_param_.inner_product_param().release_full_weights();
+  if (release_full_weights_) {
+    CHECK(half_weight_) << "release_full_weights needs a weight_precision";
+    CHECK_EQ(this->phase_, TEST) << "release_full_weights is for inference";
+  }
 }
 
 template <typename Dtype>
@@ -85,10 +99,34 @@ void InnerProductLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
-  const Dtype* weight = this->blobs_[0]->cpu_data();
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, transpose_ ? CblasNoTrans : CblasTrans,
-      M_, N_, K_, (Dtype)1.,
-      bottom_data, weight, (Dtype)0., top_data);
+  if (half_weight_) {
+    // Refresh the 16-bit copy only when the weights have changed.
+    if (!full_weights_released() &&
+        !half_weight_->IsCopyOf(*this->blobs_[0])) {
+      half_weight_->CopyFrom(*this->blobs_[0]);
+    }
+    // Unless another Blob shares them, replace the weights by memory that is
+    // only allocated if they are written again (e.g. by CopyTrainedLayersFrom).
+    if (release_full_weights_ && !full_weights_released() &&
+        this->blobs_[0]->data().use_count() == 1) {
+      this->blobs_[0]->SetDataMemory(shared_ptr<SyncedMemory>(
+          new SyncedMemory(this->blobs_[0]->count() * sizeof(Dtype))));
+    }
+    if (half_weight_->precision() == BlobProto::FP16) {
+      caffe_cpu_gemm_half(CblasNoTrans,
+          transpose_ ? CblasNoTrans : CblasTrans, M_, N_, K_, (Dtype)1.,
+          bottom_data, half_weight_->cpu_fp16(), (Dtype)0., top_data);
+    } else {
+      caffe_cpu_gemm_half(CblasNoTrans,
+          transpose_ ? CblasNoTrans : CblasTrans, M_, N_, K_, (Dtype)1.,
+          bottom_data, half_weight_->cpu_bf16(), (Dtype)0., top_data);
+    }
+  } else {
+    const Dtype* weight = this->blobs_[0]->cpu_data();
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, transpose_ ? CblasNoTrans : CblasTrans,
+        M_, N_, K_, (Dtype)1.,
+        bottom_data, weight, (Dtype)0., top_data);
+  }
   if (bias_term_) {
     caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, M_, N_, 1, (Dtype)1.,
         bias_multiplier_.cpu_data(),
@@ -100,6 +138,8 @@ template <typename Dtype>
 void InnerProductLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down,
     const vector<Blob<Dtype>*>& bottom) {
+  CHECK(!full_weights_released())
+      << "release_full_weights has freed the weights Backward needs";
   if (this->param_propagate_down_[0]) {
     const Dtype* top_diff = top[0]->cpu_diff();
     const Dtype* bottom_data = bottom[0]->cpu_data();
@@ -140,6 +180,14 @@ void InnerProductLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   }
 }
 
+template <typename Dtype>
+void InnerProductLayer<Dtype>::ToProto(LayerParameter* param, bool write_diff,
+    BlobProto::Precision precision) {
+  // The 16-bit values are all that is left; expanding them is exact.
+  if (full_weights_released()) { half_weight_->CopyTo(this->blobs_[0].get()); }
+  Layer<Dtype>::ToProto(param, write_diff, precision);
+}
+
 #ifdef CPU_ONLY
 STUB_GPU(InnerProductLayer);
 #endif
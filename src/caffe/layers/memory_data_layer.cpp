@@ -81,6 +81,12 @@ void MemoryDataLayer<Dtype>::AddMatVector(const vector<cv::Mat>& mat_vector,
 
 template <typename Dtype>
 void MemoryDataLayer<Dtype>::Reset(Dtype* data, Dtype* labels, int n) {
+  Reset(data, labels, n, shared_ptr<void>());
+}
+
+template <typename Dtype>
+void MemoryDataLayer<Dtype>::Reset(Dtype* data, Dtype* labels, int n,
+    const shared_ptr<void>& owner) {
   CHECK(data);
   CHECK(labels);
   CHECK_EQ(n % batch_size_, 0) << "n must be a multiple of batch size";
@@ -91,6 +97,7 @@ void MemoryDataLayer<Dtype>::Reset(Dtype* data, Dtype* labels, int n) {
   }
   data_ = data;
   labels_ = labels;
+  owner_ = owner;
   n_ = n;
   pos_ = 0;
 }
@@ -108,10 +115,15 @@ template <typename Dtype>
 void MemoryDataLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   CHECK(data_) << "MemoryDataLayer needs to be initialized by calling Reset";
-  top[0]->Reshape(batch_size_, channels_, height_, width_);
-  top[1]->Reshape(batch_size_, 1, 1, 1);
-  top[0]->set_cpu_data(data_ + pos_ * size_);
-  top[1]->set_cpu_data(labels_ + pos_);
+  const int data_shape[] = { batch_size_, channels_, height_, width_ };
+  const int label_shape[] = { batch_size_, 1, 1, 1 };
+  // The tops hold owner_ too, so the arrays outlive a Reset while in use.
+  // Batches of the same size reuse the tops' memory objects (and so their
+  // device buffers); only the host pointers move.
+  top[0]->set_cpu_data(data_ + pos_ * size_,
+      vector<int>(data_shape, data_shape + 4), owner_);
+  top[1]->set_cpu_data(labels_ + pos_,
+      vector<int>(label_shape, label_shape + 4), owner_);
   pos_ = (pos_ + batch_size_) % n_;
   if (pos_ == 0)
     has_new_data_ = false;
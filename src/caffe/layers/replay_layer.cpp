@@ -0,0 +1,265 @@
+#include <boost/thread.hpp>
+#include <boost/weak_ptr.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <vector>
+
+#include "caffe/layers/replay_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/rng.hpp"
+
+namespace caffe {
+
+/**
+ * @brief The storage behind ReplayLayer: a contiguous arena of fixed-size
+ *        slots plus, per category, the list of occupied slots.
+ */
+template <typename Dtype>
+class ReplayBuffer {
+ public:
+  ReplayBuffer(int num_slots, const vector<int>& component_counts,
+      int num_categories, int max_use_count)
+      : num_slots_(num_slots), max_use_count_(max_use_count), cursor_(0),
+        counts_(component_counts), members_(num_categories) {
+    slot_size_=0;
+    for(int k=0;k<counts_.size();k++){
+      offsets_.push_back(slot_size_);
+      slot_size_+=counts_[k];
+    }
+    arena_.resize(size_t(num_slots_)*slot_size_);
+    category_.resize(num_slots_,-1);
+    position_.resize(num_slots_,-1);
+    use_count_.resize(num_slots_,0);
+    //hand out slots 0,1,2,... first
+    for(int i=num_slots_-1;i>=0;i--) free_.push_back(i);
+  }
+
+  boost::mutex& mutex() { return mutex_; }
+
+  bool Matches(const vector<int>& component_counts, int num_categories) const {
+    return counts_==component_counts && members_.size()==num_categories;
+  }
+
+  int size() const { return num_slots_-free_.size(); }
+
+  //copy item i of each component into a slot
+  void Insert(const vector<const Dtype*>& components, int i, int category) {
+    int slot;
+    if(!free_.empty()){
+      slot=free_.back();
+      free_.pop_back();
+    } else {
+      //full: overwrite in ring order, i.e. roughly the oldest tuple
+      slot=cursor_;
+      cursor_=(cursor_+1)%num_slots_;
+      Remove(slot);
+    }
+    Dtype* dst=&arena_[size_t(slot)*slot_size_];
+    for(int k=0;k<counts_.size();k++){
+      std::memcpy(dst+offsets_[k],components[k]+size_t(i)*counts_[k],
+                  counts_[k]*sizeof(Dtype));
+    }
+    category_[slot]=category;
+    use_count_[slot]=0;
+    position_[slot]=members_[category].size();
+    members_[category].push_back(slot);
+  }
+
+  //draw n slots, splitting the batch evenly over the non-empty categories
+  void Sample(int n, vector<int>* slots) {
+    vector<int> categories;
+    for(int c=0;c<members_.size();c++){
+      if(!members_[c].empty()) categories.push_back(c);
+    }
+    CHECK(!categories.empty()) << "Cannot sample from an empty replay buffer";
+    shuffle(categories.begin(),categories.end());
+    const int share=n/categories.size();
+    const int remainder=n%categories.size();
+    slots->clear();
+    for(int ic=0;ic<categories.size();ic++){
+      const vector<int>& members=members_[categories[ic]];
+      const int num=share+(ic<remainder ? 1 : 0);
+      for(int j=0;j<num;j++){
+        slots->push_back(members[caffe_rng_rand()%members.size()]);
+      }
+    }
+    shuffle(slots->begin(),slots->end());
+  }
+
+  //one pass over the batch, copying every component of each sampled slot
+  void Gather(const vector<int>& slots, const vector<Dtype*>& components) {
+    for(int i=0;i<slots.size();i++){
+      const Dtype* src=&arena_[size_t(slots[i])*slot_size_];
+      for(int k=0;k<counts_.size();k++){
+        std::memcpy(components[k]+size_t(i)*counts_[k],src+offsets_[k],
+                    counts_[k]*sizeof(Dtype));
+      }
+    }
+  }
+
+  //count the uses of a gathered batch and retire the used-up slots
+  void Use(const vector<int>& slots) {
+    for(int i=0;i<slots.size();i++){
+      const int slot=slots[i];
+      if(category_[slot]<0) continue;  //already retired by this batch
+      use_count_[slot]++;
+      if(max_use_count_>0 && use_count_[slot]>=max_use_count_){
+        Remove(slot);
+        free_.push_back(slot);
+      }
+    }
+  }
+
+ private:
+  //drop an occupied slot from its category list (swap with the last entry)
+  void Remove(int slot) {
+    const int c=category_[slot];
+    if(c<0) return;
+    vector<int>& members=members_[c];
+    const int pos=position_[slot];
+    members[pos]=members.back();
+    position_[members[pos]]=pos;
+    members.pop_back();
+    category_[slot]=-1;
+    position_[slot]=-1;
+  }
+
+  int num_slots_;
+  int max_use_count_;
+  int slot_size_;
+  int cursor_;
+  vector<int> counts_, offsets_;
+  vector<Dtype> arena_;
+  //per slot: category (-1 when free), index in members_, times sampled
+  vector<int> category_, position_, use_count_;
+  vector<vector<int> > members_;
+  vector<int> free_;
+  boost::mutex mutex_;
+
+  DISABLE_COPY_AND_ASSIGN(ReplayBuffer);
+};
+
+//buffers shared between layers with the same buffer_index; they are freed
+//when the last such layer goes away
+template <typename Dtype>
+static shared_ptr<ReplayBuffer<Dtype> > GetReplayBuffer(int buffer_index,
+    int num_slots, const vector<int>& component_counts, int num_categories,
+    int max_use_count) {
+  static boost::mutex registry_mutex;
+  static std::map<int, boost::weak_ptr<ReplayBuffer<Dtype> > > registry;
+  boost::mutex::scoped_lock lock(registry_mutex);
+  shared_ptr<ReplayBuffer<Dtype> > buffer=registry[buffer_index].lock();
+  if(!buffer){
+    buffer.reset(new ReplayBuffer<Dtype>(num_slots,component_counts,
+                                         num_categories,max_use_count));
+    registry[buffer_index]=buffer;
+  }
+  CHECK(buffer->Matches(component_counts,num_categories))
+      << "Replay layers sharing buffer " << buffer_index
+      << " must store tuples of the same layout";
+  return buffer;
+}
+
+template <typename Dtype>
+void ReplayLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  const ReplayParameter& replay_param=this->layer_param_.replay_param();
+  num_categories_=replay_param.num_categories();
+  CHECK_GT(replay_param.num_slots(),0) << "num_slots must be positive";
+  CHECK_GT(num_categories_,0) << "num_categories must be positive";
+
+  num_components_=bottom.size()-(num_categories_>1 ? 1 : 0);
+  CHECK_GT(num_components_,0) << "Nothing to store in the replay buffer";
+  CHECK_EQ(top.size(),num_components_)
+      << "Need one top blob per stored tuple component";
+
+  vector<int> component_counts;
+  for(int k=0;k<num_components_;k++){
+    component_counts.push_back(bottom[k]->count(1));
+  }
+  buffer_=GetReplayBuffer<Dtype>(replay_param.buffer_index(),
+      replay_param.num_slots(),component_counts,num_categories_,
+      replay_param.max_use_count());
+}
+
+template <typename Dtype>
+void ReplayLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  const int num=bottom[0]->shape(0);
+  vector<int> component_counts;
+  for(int k=0;k<num_components_;k++){
+    CHECK_EQ(bottom[k]->shape(0),num)
+        << "All tuple components must have the same batch size";
+    component_counts.push_back(bottom[k]->count(1));
+    top[k]->ReshapeLike(*bottom[k]);
+  }
+  CHECK(buffer_->Matches(component_counts,num_categories_))
+      << "The tuple layout cannot change once the replay buffer exists";
+  if(num_categories_>1){
+    CHECK_EQ(bottom[num_components_]->count(),num)
+        << "Need one category per tuple";
+  }
+}
+
+template <typename Dtype>
+int ReplayLayer<Dtype>::size() const {
+  boost::mutex::scoped_lock lock(buffer_->mutex());
+  return buffer_->size();
+}
+
+template <typename Dtype>
+void ReplayLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  if(this->phase_==TEST){
+    for(int k=0;k<num_components_;k++){
+      caffe_copy(bottom[k]->count(),bottom[k]->cpu_data(),
+                 top[k]->mutable_cpu_data());
+    }
+    return;
+  }
+
+  const int num=bottom[0]->shape(0);
+  vector<const Dtype*> components(num_components_);
+  vector<Dtype*> outputs(num_components_);
+  for(int k=0;k<num_components_;k++){
+    components[k]=bottom[k]->cpu_data();
+    outputs[k]=top[k]->mutable_cpu_data();
+  }
+  const Dtype* category=NULL;
+  if(num_categories_>1) category=bottom[num_components_]->cpu_data();
+
+  boost::mutex::scoped_lock lock(buffer_->mutex());
+  for(int i=0;i<num;i++){
+    int c=0;
+    if(category){
+      c=static_cast<int>(category[i]);
+      CHECK(c>=0 && c<num_categories_) << "Category " << c << " out of range";
+    }
+    buffer_->Insert(components,i,c);
+  }
+  buffer_->Sample(num,&batch_slots_);
+  buffer_->Gather(batch_slots_,outputs);
+  buffer_->Use(batch_slots_);
+}
+
+template <typename Dtype>
+void ReplayLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  //the category, if any, never has a gradient
+  for(int i=0;i<bottom.size();i++){
+    if(!propagate_down[i]) continue;
+    if(this->phase_==TEST && i<num_components_){
+      caffe_copy(bottom[i]->count(),top[i]->cpu_diff(),
+                 bottom[i]->mutable_cpu_diff());
+    } else {
+      caffe_set(bottom[i]->count(),Dtype(0),bottom[i]->mutable_cpu_diff());
+    }
+  }
+}
+
+INSTANTIATE_CLASS(ReplayLayer);
+REGISTER_LAYER_CLASS(Replay);
+
+}  // namespace caffe
@@ -46,6 +46,7 @@ void RewardLayer<Dtype>::Reshape(
   num_targets_=bottom[0]->shape(2)/t;
 
   diff_.ReshapeLike(*(bottom[2]));
+  argmax_.Reshape(bottom[2]->shape());
   vector<int> top_shape;
   top_shape.push_back(1);
   top[0]->Reshape(top_shape);
@@ -57,63 +58,66 @@ template <typename Dtype>
 void RewardLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
 
-  int N=bottom[1]->shape(0);
-  int M=bottom[0]->shape(0)/N;
-  int C=bottom[0]->shape(1);
-  int T=bottom[0]->shape(2);
+  const int N=bottom[1]->shape(0);
+  const int NM=bottom[0]->shape(0);
+  const int C=bottom[0]->shape(1);
+  const int T=bottom[0]->shape(2);
   int t=1;
   if(bottom[1]->shape().size()>1) t=bottom[1]->shape(1);
-  int timesteps_per_target=T/t;  
+  const int timesteps_per_target=T/t;  
   Dtype* diff=diff_.mutable_cpu_data();     //shape (N*M,T)
   Dtype* curr=diff_.mutable_cpu_diff();     
   const Dtype* pred=bottom[0]->cpu_data();  //shape (N*M,C,T)
-
   const Dtype* label=bottom[1]->cpu_data(); //shape (N,t)
-  Dtype total(0.), total_correct(0.);
-  for(int i=0;i<N;i++){
-    for(int iM=0;iM<M;iM++){
-      bool curriculum_ok(true);
-      for(int itarg=0;itarg<t;itarg++){
-        for(int istep=0;istep<timesteps_per_target;istep++){
-          int idx=iM*N+i;   
-          int idx_time=itarg*timesteps_per_target+istep;
-
-          if(per_target_rewards_){
-            idx_time=itarg*timesteps_per_target+(timesteps_per_target-1);
-          }
-
-          Dtype maxval=-1e30;  
-          int maxidx(0);
-
-          for(int j=0;j<C;j++){
-            int pred_offset=(idx*C+j)*T+idx_time;
-
-            if(pred[pred_offset]>maxval){
-              maxval=pred[pred_offset];
-              maxidx=j;
-            }
-          }
-          int label_offset=i*t+itarg;  
-          int diff_offset=idx*T+idx_time;
-          diff[diff_offset]=0;
-          curr[diff_offset]=1;
-          if(maxidx==(int)(label[label_offset])){
-            diff[diff_offset]=1;
-            total_correct+=1;
-          } else {
-            if(!curriculum_ok) curr[diff_offset]=0;
-            if(!per_target_rewards_ || 
-               (per_target_rewards_ && istep==timesteps_per_target-1)){
-              curriculum_ok=false;
-            }
-          }
-          total+=1.;
+
+  //one fused pass per sample (toss iM of input i is sample iM*N+i): the 
+  //argmax over C for all T timesteps at once, sweeping the contiguous 
+  //T-long rows of the sample's (C,T) slice, then the rewards and the 
+  //curriculum cutoff in time order
+  int num_correct=0;
+#ifdef _OPENMP
+  #pragma omp parallel for reduction(+:num_correct)
+#endif
+  for(int idx=0;idx<NM;idx++){
+    vector<Dtype> maxval(T,Dtype(-1e30));
+    vector<int> maxidx(T,0);
+    const Dtype* sample_pred=pred+idx*C*T;
+    for(int j=0;j<C;j++){
+      const Dtype* row=sample_pred+j*T;
+      for(int itime=0;itime<T;itime++){
+        if(row[itime]>maxval[itime]){
+          maxval[itime]=row[itime];
+          maxidx[itime]=j;
+        }
+      }
+    }
+
+    const Dtype* sample_label=label+(idx%N)*t;
+    Dtype* sample_diff=diff+idx*T;
+    Dtype* sample_curr=curr+idx*T;
+    bool curriculum_ok(true);
+    for(int itarg=0;itarg<t;itarg++){
+      const int first=itarg*timesteps_per_target;
+      const int last=first+timesteps_per_target-1;
+      //with per-target rewards only the target's last timestep is scored
+      if(per_target_rewards_){
+        for(int itime=first;itime<last;itime++){
+          sample_diff[itime]=0;
+          sample_curr[itime]=0;
         }
       }
+      for(int itime=per_target_rewards_ ? last : first;itime<=last;itime++){
+        const bool correct=(maxidx[itime]==(int)(sample_label[itarg]));
+        sample_diff[itime]=correct ? 1 : 0;
+        sample_curr[itime]=(correct || curriculum_ok) ? 1 : 0;
+        if(correct) num_correct++;
+        else curriculum_ok=false;
+      }
     }
   }
 
-  top[0]->mutable_cpu_data()[0] = total_correct/total;
+  const int num_scored=NM*(per_target_rewards_ ? t : T);
+  top[0]->mutable_cpu_data()[0] = Dtype(num_correct)/num_scored;
   caffe_copy(diff_.count(),diff_.cpu_data(),top[1]->mutable_cpu_data());
   caffe_copy(diff_.count(),diff_.cpu_data(),top[1]->mutable_cpu_diff());
 }
@@ -0,0 +1,104 @@
+#include <vector>
+
+#include "caffe/layers/reward_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+//one thread per (sample,timestep); neighbouring threads read neighbouring 
+//timesteps of each class row, so the loads coalesce
+template <typename Dtype>
+__global__ void RewardArgmax(const int nthreads, const Dtype* const pred,
+    const int C, const int T, int* const argmax) {
+  CUDA_KERNEL_LOOP(index, nthreads) {
+    const int idx=index/T;
+    const int itime=index%T;
+    const Dtype* col=pred+idx*C*T+itime;
+    Dtype maxval=-1e30;
+    int maxidx=0;
+    for(int j=0;j<C;j++){
+      if(col[j*T]>maxval){
+        maxval=col[j*T];
+        maxidx=j;
+      }
+    }
+    argmax[index]=maxidx;
+  }
+}
+
+//one thread per sample, walking its timesteps in order for the curriculum
+template <typename Dtype>
+__global__ void RewardCurriculum(const int nthreads, const int* const argmax,
+    const Dtype* const label, const int N, const int T, const int t, 
+    const bool per_target_rewards, Dtype* const diff, Dtype* const curr) {
+  CUDA_KERNEL_LOOP(idx, nthreads) {
+    const int timesteps_per_target=T/t;
+    const int* sample_argmax=argmax+idx*T;
+    const Dtype* sample_label=label+(idx%N)*t;
+    Dtype* sample_diff=diff+idx*T;
+    Dtype* sample_curr=curr+idx*T;
+    bool curriculum_ok=true;
+    for(int itarg=0;itarg<t;itarg++){
+      const int first=itarg*timesteps_per_target;
+      const int last=first+timesteps_per_target-1;
+      if(per_target_rewards){
+        for(int itime=first;itime<last;itime++){
+          sample_diff[itime]=0;
+          sample_curr[itime]=0;
+        }
+      }
+      for(int itime=per_target_rewards ? last : first;itime<=last;itime++){
+        const bool correct=(sample_argmax[itime]==(int)(sample_label[itarg]));
+        sample_diff[itime]=correct ? 1 : 0;
+        sample_curr[itime]=(correct || curriculum_ok) ? 1 : 0;
+        if(!correct) curriculum_ok=false;
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void RewardLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) {
+
+  const int N=bottom[1]->shape(0);
+  const int NM=bottom[0]->shape(0);
+  const int C=bottom[0]->shape(1);
+  const int T=bottom[0]->shape(2);
+  int t=1;
+  if(bottom[1]->shape().size()>1) t=bottom[1]->shape(1);
+
+  const int count=NM*T;
+  // NOLINT_NEXT_LINE(whitespace/operators)
+  RewardArgmax<Dtype><<<CAFFE_GET_BLOCKS(count), CAFFE_CUDA_NUM_THREADS>>>(
+      count, bottom[0]->gpu_data(), C, T, argmax_.mutable_gpu_data());
+  // NOLINT_NEXT_LINE(whitespace/operators)
+  RewardCurriculum<Dtype><<<CAFFE_GET_BLOCKS(NM), CAFFE_CUDA_NUM_THREADS>>>(
+      NM, argmax_.gpu_data(), bottom[1]->gpu_data(), N, T, t, 
+      per_target_rewards_, diff_.mutable_gpu_data(), diff_.mutable_gpu_diff());
+  CUDA_POST_KERNEL_CHECK;
+
+  //rewards are 0 or 1, so their sum is the number of correct predictions
+  Dtype num_correct;
+  caffe_gpu_asum(diff_.count(),diff_.gpu_data(),&num_correct);
+  const int num_scored=NM*(per_target_rewards_ ? t : T);
+  top[0]->mutable_cpu_data()[0] = num_correct/num_scored;
+  caffe_copy(diff_.count(),diff_.gpu_data(),top[1]->mutable_gpu_data());
+  caffe_copy(diff_.count(),diff_.gpu_data(),top[1]->mutable_gpu_diff());
+}
+
+template <typename Dtype>
+void RewardLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
+    const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+
+  const int count=bottom[2]->count();
+  caffe_copy(count,diff_.gpu_data(),bottom[2]->mutable_gpu_diff());
+  caffe_copy(count,diff_.gpu_data(),bottom[2]->mutable_gpu_data());
+  if(bottom.size()>3){
+    caffe_copy(count,diff_.gpu_diff(),bottom[3]->mutable_gpu_diff());
+  }
+}
+
+INSTANTIATE_LAYER_GPU_FUNCS(RewardLayer);
+
+}  // namespace caffe
@@ -69,6 +69,20 @@ void SliceLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   if (top.size() == 1) {
     top[0]->ShareData(*bottom[0]);
     top[0]->ShareDiff(*bottom[0]);
+    return;
+  }
+  // With nothing before the slice axis each top is a contiguous run of the
+  // bottom, so it can be a view of it rather than a copy.
+  const bool views = num_slices_ == 1 && this->allow_top_views();
+  int offset_slice_axis = 0;
+  for (int i = 0; i < top.size(); ++i) {
+    if (views) {
+      top[i]->ShareView(*bottom[0], top[i]->shape(),
+                        offset_slice_axis * slice_size_);
+    } else {
+      top[i]->ReleaseView();
+    }
+    offset_slice_axis += top[i]->shape(slice_axis_);
   }
 }
 
@@ -80,14 +94,17 @@ void SliceLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   const Dtype* bottom_data = bottom[0]->cpu_data();
   const int bottom_slice_axis = bottom[0]->shape(slice_axis_);
   for (int i = 0; i < top.size(); ++i) {
-    Dtype* top_data = top[i]->mutable_cpu_data();
     const int top_slice_axis = top[i]->shape(slice_axis_);
-    for (int n = 0; n < num_slices_; ++n) {
-      const int top_offset = n * top_slice_axis * slice_size_;
-      const int bottom_offset =
-          (n * bottom_slice_axis + offset_slice_axis) * slice_size_;
-      caffe_copy(top_slice_axis * slice_size_,
-          bottom_data + bottom_offset, top_data + top_offset);
+    // A view of the bottom already holds its slice.
+    if (!top[i]->SharesDataWith(*bottom[0], offset_slice_axis * slice_size_)) {
+      Dtype* top_data = top[i]->mutable_cpu_data();
+      for (int n = 0; n < num_slices_; ++n) {
+        const int top_offset = n * top_slice_axis * slice_size_;
+        const int bottom_offset =
+            (n * bottom_slice_axis + offset_slice_axis) * slice_size_;
+        caffe_copy(top_slice_axis * slice_size_,
+            bottom_data + bottom_offset, top_data + top_offset);
+      }
     }
     offset_slice_axis += top_slice_axis;
   }
@@ -101,14 +118,16 @@ void SliceLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
   const int bottom_slice_axis = bottom[0]->shape(slice_axis_);
   for (int i = 0; i < top.size(); ++i) {
-    const Dtype* top_diff = top[i]->cpu_diff();
     const int top_slice_axis = top[i]->shape(slice_axis_);
-    for (int n = 0; n < num_slices_; ++n) {
-      const int top_offset = n * top_slice_axis * slice_size_;
-      const int bottom_offset =
-          (n * bottom_slice_axis + offset_slice_axis) * slice_size_;
-      caffe_copy(top_slice_axis * slice_size_,
-          top_diff + top_offset, bottom_diff + bottom_offset);
+    if (!top[i]->SharesDiffWith(*bottom[0], offset_slice_axis * slice_size_)) {
+      const Dtype* top_diff = top[i]->cpu_diff();
+      for (int n = 0; n < num_slices_; ++n) {
+        const int top_offset = n * top_slice_axis * slice_size_;
+        const int bottom_offset =
+            (n * bottom_slice_axis + offset_slice_axis) * slice_size_;
+        caffe_copy(top_slice_axis * slice_size_,
+            top_diff + top_offset, bottom_diff + bottom_offset);
+      }
     }
     offset_slice_axis += top_slice_axis;
   }
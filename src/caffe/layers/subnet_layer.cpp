@@ -1,4 +1,10 @@
+#include <boost/thread.hpp>
+#include <boost/weak_ptr.hpp>
+
+#include <algorithm>
+#include <map>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -7,12 +13,52 @@
 #include "caffe/layer.hpp"
 #include "caffe/layers/subnet_layer.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/net_param_cache.hpp"
 #include "caffe/util/upgrade_proto.hpp"
 
 namespace caffe {
 
+//subnets shared between layers with the same share_subnet key (per phase 
+//and per solver, so that e.g. the train and test nets never mix); they are 
+//freed when the last such layer goes away.  Each entry also records the 
+//definition the subnet was built from, which every later layer must match.
 template <typename Dtype>
-vector<int> SubnetLayer<Dtype>::phase_counter_;
+static shared_ptr<Net<Dtype> > GetSharedSubnet(const string& share_key,
+    Phase phase, const NetParameter& net_param, bool* built_here) {
+  static boost::mutex registry_mutex;
+  static std::map<string, std::pair<boost::weak_ptr<Net<Dtype> >, string> > 
+      registry;
+  ostringstream oss;
+  oss << share_key << "::" << phase << "::" << Caffe::solver_rank();
+  const string key(oss.str());
+  const string definition(net_param.SerializeAsString());
+  *built_here=false;
+  {
+    boost::mutex::scoped_lock lock(registry_mutex);
+    shared_ptr<Net<Dtype> > net=registry[key].first.lock();
+    if(net){
+      CHECK(registry[key].second==definition) 
+          << "Subnet layers sharing subnet " << share_key 
+          << " must have the same subnet definition and input shapes";
+      return net;
+    }
+  }
+
+  //build outside the lock, since the subnet may contain shared subnets too
+  shared_ptr<Net<Dtype> > net(new Net<Dtype>(net_param));
+  boost::mutex::scoped_lock lock(registry_mutex);
+  shared_ptr<Net<Dtype> > existing=registry[key].first.lock();
+  if(existing){
+    //another thread got there first; use its subnet and drop ours
+    CHECK(registry[key].second==definition) 
+        << "Subnet layers sharing subnet " << share_key 
+        << " must have the same subnet definition and input shapes";
+    return existing;
+  }
+  registry[key]=std::make_pair(boost::weak_ptr<Net<Dtype> >(net),definition);
+  *built_here=true;
+  return net;
+}
 
 template <typename Dtype>
 void SubnetLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
@@ -20,16 +66,6 @@ void SubnetLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
 
   string filename = this->layer_param_.subnet_param().prototxt_filename();
 
-  increment_on_forward_=this->layer_param_.subnet_param().increment_on_forward();
-  phase_counter_index_=this->layer_param_.subnet_param().phase_counter_index();
-  if(phase_counter_.size()<phase_counter_index_+1){
-    phase_counter_.resize(phase_counter_index_+1);
-  }
-  if(phase_counter_index_>=0) phase_counter_[phase_counter_index_]=0;
-  phase_counter_reset_=this->layer_param_.subnet_param().phase_counter_reset();
-  forward_mode_=this->layer_param_.subnet_param().forward_mode();
-  backward_mode_=this->layer_param_.subnet_param().backward_mode();
-
   shared_inputs_.clear();
   if(this->layer_param_.subnet_param().shared_inputs_size()>0){
     CHECK_EQ(
@@ -45,24 +81,37 @@ void SubnetLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     for(int i=0;i<bottom.size();i++) shared_inputs_.push_back(false);
   }
 
-  // Create a NetParameter and bind this layer's bottom/top blobs to its 
-  //inputs/outputs.
-  NetParameter net_param_unfilt; 
-  ReadNetParamsFromTextFileOrDie(filename, &net_param_unfilt);
+  shared_outputs_.clear();
+  if(this->layer_param_.subnet_param().shared_outputs_size()>0){
+    CHECK_EQ(
+          this->layer_param_.subnet_param().shared_outputs_size(),
+          top.size()
+    ) << "shared_outputs must be specified once for each top blob "
+      << "or not at all";
+    for(int i=0;i<top.size();i++) {
+      shared_outputs_.push_back(
+         this->layer_param_.subnet_param().shared_outputs(i));
+    }
+  } else {
+    for(int i=0;i<top.size();i++) shared_outputs_.push_back(false);
+  }
 
+  // Create a NetParameter and bind this layer's bottom/top blobs to its 
+  //inputs/outputs.  Parsing and filtering go through a process-wide cache, 
+  //since composite models tend to build many subnets from the same file.
+  NetState state;
   if(this->layer_param_.subnet_param().force_test_phase()){
-    net_param_unfilt.mutable_state()->set_phase(caffe::TEST);
+    state.set_phase(caffe::TEST);
   } else {
-    net_param_unfilt.mutable_state()->set_phase(this->layer_param_.phase());
+    state.set_phase(this->layer_param_.phase());
   }
 
   if(this->layer_param_.subnet_param().stage().size()>0){
-    net_param_unfilt.mutable_state()->add_stage(
-      this->layer_param_.subnet_param().stage());
+    state.add_stage(this->layer_param_.subnet_param().stage());
   }
 
   NetParameter net_param;
-  Net<Dtype>::FilterNet(net_param_unfilt, &net_param);
+  ReadFilteredNetParamsCached(filename, state, &net_param);
   if(this->layer_param_.subnet_param().force_backward()){
     net_param.set_force_backward(true);
   }
@@ -80,6 +129,7 @@ void SubnetLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
 
   subnet_input_blobs_.resize(bottom.size());
   subnet_output_blobs_.resize(top.size());
+  subnet_output_diff_blobs_.resize(top.size());
   if(bottom.size()>0){
     CHECK_EQ(input_layer_param->type().compare("Input"),0) 
         << "First layer of subnet must be input layer";
@@ -123,8 +173,12 @@ void SubnetLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   }
 
   //just to make sure there are no name collisions between the subnet and 
-  //any other stuff in the network
-  const string& layer_name = this->layer_param_.name();
+  //any other stuff in the network.  Layers sharing a subnet all use the 
+  //share_subnet key instead, so that they agree on the subnet definition.
+  const string& share_key = this->layer_param_.subnet_param().share_subnet();
+  shares_subnet_ = !share_key.empty();
+  subnet_prefix_ = shares_subnet_ ? share_key : this->layer_param_.name();
+  const string& layer_name = subnet_prefix_;
   if (layer_name.size()) {
     for (int i = 0; i < net_param.layer_size(); ++i) {
       LayerParameter* layer = net_param.mutable_layer(i);
@@ -134,10 +188,19 @@ void SubnetLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     }
   }
 
-  subnet_.reset(new Net<Dtype>(net_param));
+  bool built_here(true);
+  if(shares_subnet_){
+    subnet_=GetSharedSubnet<Dtype>(share_key,this->phase_,net_param,
+                                   &built_here);
+  } else {
+    subnet_.reset(new Net<Dtype>(net_param));
+  }
 
   //if this subnet is to be loaded with pretrained constants, now is the time
-  if(this->layer_param_.subnet_param().has_pretrained_constants()){
+  //(a shared subnet got them from the layer that built it, and may have been 
+  //trained since)
+  if(built_here && 
+     this->layer_param_.subnet_param().has_pretrained_constants()){
     NetParameter trained_constants;
     ReadNetParamsFromBinaryFileOrDie(
         this->layer_param_.subnet_param().pretrained_constants(),
@@ -169,11 +232,20 @@ void SubnetLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   subnet_->set_debug_info(
       this->layer_param_.subnet_param().debug_info());
 
+  if(shares_subnet_) InitBlobSet(built_here);
+
+  //resolve the subnet's input and output blobs once, by index, so that 
+  //Forward and Backward don't have to look them up by name
+  subnet_input_idx_.resize(bottom.size());
+  subnet_output_idx_.resize(top.size());
+  subnet_output_diff_idx_.resize(top.size());
   for ( int i = 0; i < bottom.size(); ++i){
-    subnet_input_blobs_[i]=subnet_->blob_by_name(this->layer_param_.bottom(i));
-    CHECK(subnet_input_blobs_[i]!=NULL)
+    CHECK(subnet_->has_blob(this->layer_param_.bottom(i)))
       << "could not find input blob named " 
       << this->layer_param_.bottom(i) << " in " << filename << std::endl;
+    subnet_input_idx_[i]=
+        subnet_->blob_names_index().at(this->layer_param_.bottom(i));
+    subnet_input_blobs_[i]=subnet_->blobs()[subnet_input_idx_[i]];
 
     if(shared_inputs_[i]){
       subnet_input_blobs_[i]->ShareData(*(bottom[i]));
@@ -181,11 +253,19 @@ void SubnetLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     }
   }
   for ( int i = 0; i < top.size(); i++){
-    subnet_output_blobs_[i]=subnet_->blob_by_name(this->layer_param_.top(i));
-    CHECK(subnet_output_blobs_[i]!=NULL)
+    CHECK(subnet_->has_blob(this->layer_param_.top(i)))
       << "could not find output blob named " 
       << this->layer_param_.top(i) << " in " << filename << std::endl;
+    subnet_output_idx_[i]=
+        subnet_->blob_names_index().at(this->layer_param_.top(i));
+    subnet_output_diff_idx_[i]=output_diff_blob_index(i);
+    subnet_output_blobs_[i]=subnet_->blobs()[subnet_output_idx_[i]];
+    subnet_output_diff_blobs_[i]=subnet_->blobs()[subnet_output_diff_idx_[i]];
   }
+  blobs_generation_=subnet_->blobs_generation();
+  //the enclosing net shares its weights only after all layers are set up, so 
+  //make sure the first forward pass re-shares the subnet's weights
+  weights_generation_=-1;
 
   subnet_->Reshape();
 
@@ -265,10 +345,10 @@ void SubnetLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   this->param_propagate_down_.resize(this->blobs_.size(), true);
 
   // initialize the diffs of the subnet outputs to 0 -- we will compute 
-  // updates in Forward() and Backward()
+  // updates in Forward() and Backward() (a no-op unless something has already
+  // written them, so a forward-only net never allocates diff memory here)
   for (int i = 0; i < subnet_output_blobs_.size(); ++i) {
-    caffe_set(subnet_output_blobs_[i]->count(), Dtype(0),
-              subnet_output_blobs_[i]->mutable_cpu_diff());
+    subnet_output_blobs_[i]->zero_diff();
   }
 
 
@@ -299,10 +379,14 @@ template <typename Dtype>
 void SubnetLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
 
+  BindBlobSet();
   subnet_->Reshape();
+  RefreshBlobHandles();
 
   for(int i=0;i<top.size();i++){
     top[i]->ReshapeLike(*(subnet_output_blobs_[i]));
+    //the subnet's layers may have reallocated their outputs while reshaping
+    if(shared_outputs_[i] && !OutputIsBound(i,top[i])) BindOutput(i,top[i]);
   }
 
   this->subnets_.clear();
@@ -318,66 +402,32 @@ template <typename Dtype>
 void SubnetLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
 
-  bool just_quit(forward_mode_==3);
-  if(phase_counter_index_>=0){
-    if(forward_mode_==1){
-      if(phase_counter_[phase_counter_index_]!=0) just_quit=true;
-    } else if(forward_mode_==2){
-      if(phase_counter_[phase_counter_index_]==0) just_quit=true;
-    }
-  }
-  if(increment_on_forward_ && phase_counter_index_>=0 && phase_counter_reset_>0) phase_counter_[phase_counter_index_]++;
-
-  if(just_quit) return;
-
-  // Hacky fix for test time, borrowed from RecurrentLayer: reshare all the 
-  // internal shared blobs, which may currently point to a stale owner blob 
-  // that was dropped when Solver::Test called 
-  // test_net->ShareTrainedLayersWith(net_.get()).
-  // TODO: somehow make this work non-hackily.
-
-  if (this->phase_ == TEST || true) {
-    subnet_->ShareWeights();
-  }
-
-
-  //Some calling functions (such as UnrollLayer) may want to swap out the 
-  //internal blobs used by the subnet.  If this happens, the subnet_input_blobs_ 
-  //and subnet_output_blobs_ pointers will be stale.  And since these arrays 
-  //are not public, we have to fix that here.
-  for ( int i = 0; i < bottom.size(); ++i){
-    subnet_input_blobs_[i]=subnet_->blob_by_name(this->layer_param_.bottom(i));
-    if(!shared_inputs_[i]) continue;
-    subnet_input_blobs_[i]->ShareData(*(bottom[i]));
-    subnet_input_blobs_[i]->ShareDiff(*(bottom[i]));
-
-  }
-  for ( int i = 0; i < top.size(); i++){
-    subnet_output_blobs_[i]=subnet_->blob_by_name(this->layer_param_.top(i));
-  }
-
-
-  //can't always rely on solver to have initialized top/bottom diffs to zero 
-  //(since there are some layers that do fancy things using this class)
-  //so set them all to zero here:
-  for(int i=0;i<subnet_->blobs().size();i++){
-    caffe_set(subnet_->blobs()[i]->count(),
-              Dtype(0.),
-              subnet_->blobs()[i]->mutable_cpu_diff());
-  }
+  BindBlobSet();
+  RefreshWeights();
+  RefreshBlobHandles();
 
   //fill subnet input blobs with bottom data
   for(int i=0;i<bottom.size();i++){
-    if(!shared_inputs_[i]) continue;
-    subnet_input_blobs_[i]->ShareData(*(bottom[i]));
-    subnet_input_blobs_[i]->ShareDiff(*(bottom[i]));
+    if(shared_inputs_[i]){
+      subnet_input_blobs_[i]->ShareData(*(bottom[i]));
+      subnet_input_blobs_[i]->ShareDiff(*(bottom[i]));
+    } else {
+      caffe_copy(bottom[i]->count(),
+                 bottom[i]->cpu_data(),
+                 subnet_input_blobs_[i]->mutable_cpu_data());
+    }
   }
 
   //forward pass for subnet
   subnet_->Forward();
 
-  //read out top data from subnet and copy it into the top blobs
+  //read out top data from subnet and copy it into the top blobs (or, for 
+  //shared outputs, just make sure that the top blobs still alias them)
   for(int i=0;i<top.size();i++){
+    if(shared_outputs_[i]){
+      if(!OutputIsBound(i,top[i])) BindOutput(i,top[i]);
+      continue;
+    }
     caffe_copy(top[i]->count(),
                subnet_output_blobs_[i]->cpu_data(),
                top[i]->mutable_cpu_data());
@@ -389,94 +439,154 @@ template <typename Dtype>
 void SubnetLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
 
-  bool just_quit(backward_mode_==3);
-  if(phase_counter_index_>=0){
-    if(backward_mode_==1){
-      if(phase_counter_[phase_counter_index_]!=0) just_quit=true;
-    } else if(backward_mode_==2){
-      if(phase_counter_[phase_counter_index_]==0) just_quit=true;
-    }
-  }
-  if(!increment_on_forward_ && 
-      phase_counter_index_>=0 && 
-      phase_counter_reset_>0){
-    phase_counter_[phase_counter_index_]++;
-  }
-  if(phase_counter_reset_>0 && phase_counter_index_>=0){
-    if(phase_counter_[phase_counter_index_]>phase_counter_reset_){
-      phase_counter_[phase_counter_index_]=0;
-    }
-  }
-
-  if(just_quit) return;
-
-
-  //Some calling functions (such as UnrollLayer) may want to swap out the 
-  //internal blobs used by the subnet.  If this happens, the subnet_input_blobs_ 
-  //and subnet_output_blobs_ pointers will be stale.  And since these arrays 
-  //are not public, we have to fix that here.
+  BindBlobSet();
+  RefreshBlobHandles();
   for ( int i = 0; i < bottom.size(); ++i){
-    subnet_input_blobs_[i]=subnet_->blob_by_name(this->layer_param_.bottom(i));
     if(!shared_inputs_[i]) continue;
     subnet_input_blobs_[i]->ShareData(*(bottom[i]));
     subnet_input_blobs_[i]->ShareDiff(*(bottom[i]));
-
-  }
-  for ( int i = 0; i < top.size(); i++){
-   string blob_name=this->layer_param_.top(i);
-    //insert_splits sometimes adds a split for loss functions.  In so doing, it
-    //mangles the name of the blob by appending the layer's name.  But I don't 
-    //think there's a very easy way to get that layer's name here.  So I'll 
-    //just do this hack which will only work if the layer and the blob it 
-    //produces have the same name and the blob in question is the first in the 
-    //list.
-    string split_blob_name=blob_name+"_"+this->layer_param_.name()+"::"+
-                           blob_name+"_0_split_0";
-
-    if(subnet_->has_blob(split_blob_name)){
-      subnet_output_blobs_[i]=subnet_->blob_by_name(split_blob_name);
-    } else {
-      subnet_output_blobs_[i]=subnet_->blob_by_name(this->layer_param_.top(i));
-    }
   }
 
+  ClearSubnetDiffs(top);
 
-  //pass gradients from top blobs to subnet outputs
+  //pass gradients from top blobs to subnet outputs; shared outputs already 
+  //hold them unless the aliasing went stale since the forward pass
   for(int i=0;i<top.size();i++){
+    if(shared_outputs_[i] && OutputIsBound(i,top[i])) continue;
     caffe_copy(top[i]->count(),
                top[i]->cpu_diff(),
-               subnet_output_blobs_[i]->mutable_cpu_diff());
+               subnet_output_diff_blobs_[i]->mutable_cpu_diff());
     caffe_copy(top[i]->count(),
                top[i]->cpu_data(),
-               subnet_output_blobs_[i]->mutable_cpu_data());
+               subnet_output_diff_blobs_[i]->mutable_cpu_data());
   }
 
   subnet_->BackwardFrom(last_layer_index_);
 
 
-  //copy diffs to bottom
+  //copy diffs to bottom.  The bottom data is left alone: the subnet's copy 
+  //of it is only an input, and the bottom may have been re-bound (e.g. by 
+  //UnrollLayer) since the forward pass filled it
   for(int i=0;i<bottom.size();i++){
     if(shared_inputs_[i]) continue;
     caffe_copy(bottom[i]->count(),
                subnet_input_blobs_[i]->cpu_diff(),
                bottom[i]->mutable_cpu_diff());
-    caffe_copy(bottom[i]->count(),
-               subnet_input_blobs_[i]->cpu_data(),
-               bottom[i]->mutable_cpu_data());
   }
+}
 
-  if(phase_counter_index_>=0){
-    if((phase_counter_[phase_counter_index_]>0 && backward_mode_==4) || 
-       (phase_counter_[phase_counter_index_]==0 && backward_mode_==5)){
-      for(int i=0;i<this->blobs_.size();i++){
-        caffe_set(this->blobs_[i]->count(),
-                  Dtype(0.),
-                  this->blobs_[i]->mutable_cpu_diff());
-      }
+template <typename Dtype>
+int SubnetLayer<Dtype>::output_diff_blob_index(int i) {
+  //the pseudo-losses are the last layers of the subnet, one per top blob.  
+  //If the output is also used inside the subnet, insert_splits has put a 
+  //split in front of the pseudo-loss, and the split blob that feeds it is the 
+  //one whose diff the split layer adds up with the others; the blobs feeding 
+  //the other consumers get their diffs overwritten by those consumers' 
+  //backward passes.
+  const int pseudo_loss_index=
+      subnet_->layers().size()-this->layer_param_.top_size()+i;
+  return subnet_->bottom_ids(pseudo_loss_index)[0];
+}
+
+template <typename Dtype>
+void SubnetLayer<Dtype>::RefreshBlobHandles() {
+  if(subnet_->blobs_generation()==blobs_generation_) return;
+  const vector<shared_ptr<Blob<Dtype> > >& blobs=subnet_->blobs();
+  for(int i=0;i<subnet_input_idx_.size();i++){
+    subnet_input_blobs_[i]=blobs[subnet_input_idx_[i]];
+  }
+  for(int i=0;i<subnet_output_idx_.size();i++){
+    subnet_output_blobs_[i]=blobs[subnet_output_idx_[i]];
+    subnet_output_diff_blobs_[i]=blobs[subnet_output_diff_idx_[i]];
+  }
+  blobs_generation_=subnet_->blobs_generation();
+}
+
+template <typename Dtype>
+void SubnetLayer<Dtype>::ClearSubnetDiffs(const vector<Blob<Dtype>*>& top) {
+  //can't always rely on solver to have initialized top/bottom diffs to zero 
+  //(since there are some layers that do fancy things using this class), so 
+  //zero them before every backward pass.  Diffs that haven't been written 
+  //since they were last zeroed are skipped, and so are diffs that alias a top 
+  //blob's diff, since those already hold the incoming gradient.
+  for(int i=0;i<subnet_->blobs().size();i++){
+    Blob<Dtype>* blob=subnet_->blobs()[i].get();
+    if(blob->count()==0) continue;
+    bool holds_top_diff(false);
+    for(int j=0;j<top.size();j++){
+      if(top[j]->count()>0 && blob->diff()==top[j]->diff()) holds_top_diff=true;
     }
+    if(!holds_top_diff) blob->zero_diff();
   }
 }
 
+template <typename Dtype>
+void SubnetLayer<Dtype>::RefreshWeights() {
+  //reshare all the internal shared blobs, which may currently point to a 
+  //stale owner blob that was dropped when, e.g., Solver::Test called 
+  //test_net->ShareTrainedLayersWith(net_.get())
+  if(subnet_->weights_generation()==weights_generation_) return;
+  subnet_->ShareWeights();
+  weights_generation_=subnet_->weights_generation();
+}
+
+template <typename Dtype>
+void SubnetLayer<Dtype>::InitBlobSet(bool built_here) {
+  //the shared subnet plus every net nested inside it, each once
+  blob_set_nets_.clear();
+  blob_set_nets_.push_back(subnet_);
+  for(int i=0;i<subnet_->layers().size();i++){
+    const vector<shared_ptr<Net<Dtype> > >& nested=
+        subnet_->layers()[i]->subnets();
+    for(int j=0;j<nested.size();j++){
+      if(std::find(blob_set_nets_.begin(),blob_set_nets_.end(),nested[j])==
+         blob_set_nets_.end()) blob_set_nets_.push_back(nested[j]);
+    }
+  }
+
+  //the layer that built the subnet keeps the blobs it came with; the others 
+  //get fresh ones of the same shapes
+  blob_set_.resize(blob_set_nets_.size());
+  for(int i=0;i<blob_set_nets_.size();i++){
+    const vector<shared_ptr<Blob<Dtype> > >& blobs=blob_set_nets_[i]->blobs();
+    if(built_here){
+      blob_set_[i]=blobs;
+      continue;
+    }
+    blob_set_[i].resize(blobs.size());
+    for(int j=0;j<blobs.size();j++){
+      blob_set_[i][j].reset(new Blob<Dtype>());
+      blob_set_[i][j]->ReshapeLike(*blobs[j]);
+    }
+  }
+  BindBlobSet();
+}
+
+template <typename Dtype>
+void SubnetLayer<Dtype>::BindBlobSet() {
+  if(!shares_subnet_) return;
+  for(int i=0;i<blob_set_nets_.size();i++){
+    if(blob_set_nets_[i]->blobs()!=blob_set_[i]){
+      blob_set_nets_[i]->reset_blobs(blob_set_[i]);
+    }
+  }
+}
+
+template <typename Dtype>
+bool SubnetLayer<Dtype>::OutputIsBound(int i, Blob<Dtype>* top) {
+  if(subnet_output_blobs_[i]->count()==0) return true;
+  return top->count()==subnet_output_blobs_[i]->count() &&
+         top->data()==subnet_output_blobs_[i]->data() &&
+         top->diff()==subnet_output_diff_blobs_[i]->diff();
+}
+
+template <typename Dtype>
+void SubnetLayer<Dtype>::BindOutput(int i, Blob<Dtype>* top) {
+  top->ReshapeLike(*(subnet_output_blobs_[i]));
+  top->ShareData(*(subnet_output_blobs_[i]));
+  top->ShareDiff(*(subnet_output_diff_blobs_[i]));
+}
+
 #ifdef CPU_ONLY
 STUB_GPU_FORWARD(SubnetLayer, Forward);
 #endif
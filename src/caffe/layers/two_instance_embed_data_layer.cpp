@@ -1,8 +1,14 @@
 #ifdef USE_OPENCV
 #include <opencv2/core/core.hpp>
 #endif  // USE_OPENCV
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 #include <stdint.h>
+#include <string.h>
 
+#include <algorithm>
+#include <string>
 #include <vector>
 
 #include "caffe/data_transformer.hpp"
@@ -32,10 +38,15 @@ void TwoInstanceEmbedDataLayer<Dtype>::DataLayerSetUp(
   num_batches_so_far_=0;
   repeat_inputs_=this->layer_param_.data_param().repeat_inputs();
 
-  const int batch_size = this->layer_param_.data_param().batch_size();
+  const DataParameter& data_param = this->layer_param_.data_param();
+  const int batch_size = data_param.batch_size();
   // Read a data point, and use it to initialize the top blob.
   Datum datum;
   datum.ParseFromString(cursor_->value());
+  CHECK_LE(datum.height(), data_param.canvas_height())
+      << "Input patterns must fit on the canvas";
+  CHECK_LE(datum.width(), data_param.canvas_width())
+      << "Input patterns must fit on the canvas";
 
   // Use data_transformer to infer the expected blob shape from datum.
   vector<int> top_shape = this->data_transformer_->InferBlobShape(datum);
@@ -43,12 +54,11 @@ void TwoInstanceEmbedDataLayer<Dtype>::DataLayerSetUp(
   this->transformed_data_.Reshape(top_shape);
   // Reshape top[0] and prefetch_data according to the batch_size.
   top_shape[0] = batch_size;
-  vector<int> prefetch_shape=top_shape;
-  top_shape[2] = 100;
-  top_shape[3] = 100;
+  top_shape[2] = data_param.canvas_height();
+  top_shape[3] = data_param.canvas_width();
   top[0]->Reshape(top_shape);
   for (int i = 0; i < this->prefetch_.size(); ++i) {
-    this->prefetch_[i]->data_.Reshape(prefetch_shape);
+    this->prefetch_[i]->data_.Reshape(top_shape);
   }
   LOG(INFO) << "output data size: " << top[0]->num() << ","
       << top[0]->channels() << "," << top[0]->height() << ","
@@ -100,6 +110,33 @@ void TwoInstanceEmbedDataLayer<Dtype>::Next() {
 }
 
 
+template <typename Dtype>
+void TwoInstanceEmbedDataLayer<Dtype>::EmbedInstances(const string& pixels,
+    int channels, int height, int width, const int* offsets,
+    int canvas_height, int canvas_width, Dtype* canvas) {
+  CHECK_EQ(pixels.size(), channels*height*width)
+      << "Only raw uint8 patterns are supported";
+  const int plane=canvas_height*canvas_width;
+  //all-zero bits are 0.0 in IEEE floating point, so one memset clears it
+  memset(canvas,0,sizeof(Dtype)*channels*plane);
+  const uint8_t* src=reinterpret_cast<const uint8_t*>(pixels.data());
+  //scale brightness to [0,1]:  0.00390625=1/256
+  const Dtype scale=0.00390625;
+  for(int k=0;k<2;k++){
+    const int x0=offsets[2*k];
+    const int y0=offsets[2*k+1];
+    for(int ic=0;ic<channels;ic++){
+      for(int iy=0;iy<height;iy++){
+        const uint8_t* in=src+(ic*height+iy)*width;
+        Dtype* out=canvas+ic*plane+(y0+iy)*canvas_width+x0;
+        //contiguous, branch-free row conversion, which the compiler turns
+        //into SIMD uint8->float widening and multiplies
+        for(int ix=0;ix<width;ix++) out[ix]=static_cast<Dtype>(in[ix])*scale;
+      }
+    }
+  }
+}
+
 // This function is called on prefetch thread
 template<typename Dtype>
 void TwoInstanceEmbedDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
@@ -112,111 +149,109 @@ void TwoInstanceEmbedDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   CHECK(batch->data_.count());
   CHECK(this->transformed_data_.count());
 
-  // Reshape according to the first datum of each batch
-  // on single input batches allows for inputs of varying dimension.
-  const int batch_size = this->layer_param_.data_param().batch_size();
+  const DataParameter& data_param = this->layer_param_.data_param();
+  const int batch_size = data_param.batch_size();
+  const int canvas_height = data_param.canvas_height();
+  const int canvas_width = data_param.canvas_width();
   bool do_rand = true;
+#ifdef _OPENMP
+  const int threads = data_param.assembly_threads()>0 ?
+      data_param.assembly_threads() : omp_get_max_threads();
+#endif
+
+  //the cursor and the rng are walked here, serially and in item order, so
+  //the batch does not depend on the number of assembly threads
+  timer.Start();
+  vector<string> values;
+  for (int item_id = 0; item_id < batch_size; ++item_id) {
+    while (Skip()) {
+      Next();
+    }
+    if(repeat_inputs_==0 || item_id==0){
+      // get a datum
+      Next();
+      values.push_back(cursor_->value());
+    }
+  }
+  vector<Dtype> rand(4*batch_size);
+  caffe_rng_uniform<Dtype>(4*batch_size,0.,1.,&rand[0]);
+  read_time += timer.MicroSeconds();
+
+  //everything else is independent per item
+  timer.Start();
+  const int num_values=values.size();
+  vector<Datum> datums(num_values);
+#ifdef _OPENMP
+  #pragma omp parallel for num_threads(threads)
+#endif
+  for(int i=0;i<num_values;i++) datums[i].ParseFromString(values[i]);
 
-  Datum datum;
-  datum.ParseFromString(cursor_->value());
-
-  // Use data_transformer to infer the expected blob shape from datum.
-  vector<int> top_shape = this->data_transformer_->InferBlobShape(datum);
-
+  // Reshape according to the first datum of each batch
+  // on single input batches allows for inputs of varying dimension.
+  vector<int> top_shape = this->data_transformer_->InferBlobShape(datums[0]);
   this->transformed_data_.Reshape(top_shape);
-  // Reshape batch according to the batch_size.
   top_shape[0] = batch_size;
-  top_shape[2] = 100;
-  top_shape[3] = 100;
-
+  top_shape[2] = canvas_height;
+  top_shape[3] = canvas_width;
   batch->data_.Reshape(top_shape);
+  const int channels=top_shape[1];
 
   Dtype* top_data = batch->data_.mutable_cpu_data();
   Dtype* top_label = NULL;  // suppress warnings about uninitialized variables
   Dtype* loc_label = NULL;
-  for(int i=0;i<batch->data_.count();i++) top_data[i]=0;
-
   if (this->output_labels_) {
     top_label = batch->label_.mutable_cpu_data();
   }
   if(batch->multilabel_.size()>0){
     loc_label = batch->multilabel_[0]->mutable_cpu_data();
   }
-  Datum datum1;
-  Datum datum2;
-  for (int item_id = 0; item_id < batch_size; ++item_id) {
-    timer.Start();
-    while (Skip()) {
-      Next();
-    }
 
-    if(repeat_inputs_==0 || item_id==0){
-      // get a datum
-      Next();
-      datum1.ParseFromString(cursor_->value());
-      datum2.ParseFromString(cursor_->value());
-    }
-    const string& data1 = datum1.data();
-    const string& data2 = datum2.data();
-
-    read_time += timer.MicroSeconds();
-    timer.Start();
-
-    int xrange=top_shape[2]-datum1.width();
-    int yrange=top_shape[3]-datum1.height();
-
-    int offset1_x,offset1_y,offset2_x,offset2_y;
-    Dtype rand[4];
-    caffe_rng_uniform<Dtype>(4,0.,1.,rand);
+#ifdef _OPENMP
+  #pragma omp parallel for num_threads(threads)
+#endif
+  for (int item_id = 0; item_id < batch_size; ++item_id) {
+    //both instances are drawn from the same datum
+    const Datum& datum=datums[repeat_inputs_==0 ? item_id : 0];
+    CHECK_EQ(datum.channels(),channels);
+    CHECK_LE(datum.height(),canvas_height);
+    CHECK_LE(datum.width(),canvas_width);
+    const int xrange=canvas_width-datum.width();
+    const int yrange=canvas_height-datum.height();
+
+    //(x,y) of the first instance, then of the second
+    int offsets[4];
     if(do_rand){
-      offset1_x=(int)(xrange*rand[0]);
-      offset1_y=(int)(yrange*rand[1]);
-      offset2_x=(int)(xrange*rand[2]);
-      offset2_y=(int)(yrange*rand[3]);
+      const Dtype* r=&rand[4*item_id];
+      offsets[0]=(int)(xrange*r[0]);
+      offsets[1]=(int)(yrange*r[1]);
+      offsets[2]=(int)(xrange*r[2]);
+      offsets[3]=(int)(yrange*r[3]);
     } else {
-      offset1_x=(int)(xrange*0.25);  
-      offset1_y=(int)(yrange*0.5); 
-      offset2_x=(int)(xrange*0.75); 
-      offset2_y=(int)(yrange*0.5);  
+      offsets[0]=(int)(xrange*0.25);
+      offsets[1]=(int)(yrange*0.5);
+      offsets[2]=(int)(xrange*0.75);
+      offsets[3]=(int)(yrange*0.5);
     }
+    if(offsets[0]>offsets[2]) std::swap(offsets[0],offsets[2]);
 
-
-    if(offset1_x>offset2_x) std::swap(offset1_x,offset2_x);
-    
-    for(int ic=0;ic<datum1.channels();ic++){
-      for(int ix=0;ix<datum1.width();ix++){
-        for(int iy=0;iy<datum1.height();iy++){
-          int top_idx1= ((item_id*datum1.channels()+ic)*top_shape[2]
-                         +offset1_y+iy)*top_shape[3]+offset1_x+ix;
-          int top_idx2= ((item_id*datum2.channels()+ic)*top_shape[2]
-                         +offset2_y+iy)*top_shape[3]+offset2_x+ix;
-          int data_index = (ic * datum1.height() + iy) * datum1.width() + ix;  //same for datum1 and datum2
-          //scale brightness to [0,1]:  0.00390625=1/256
-          Dtype datum1_element = static_cast<Dtype>(
-              static_cast<uint8_t>(data1[data_index])) * 0.00390625; 
-          Dtype datum2_element = static_cast<Dtype>(
-              static_cast<uint8_t>(data2[data_index])) * 0.00390625;
- 
-          top_data[top_idx1]=datum1_element;
-          top_data[top_idx2]=datum2_element;
-
-        }
-      }
-    }  
+    EmbedInstances(datum.data(),channels,datum.height(),datum.width(),
+                   offsets,canvas_height,canvas_width,
+                   top_data+batch->data_.offset(item_id));
 
     // Copy label.
     if (this->output_labels_) {
-      top_label[item_id*2]=datum1.label();
-      top_label[item_id*2+1]=datum2.label();
+      top_label[item_id*2]=datum.label();
+      top_label[item_id*2+1]=datum.label();
     }
     if(batch->multilabel_.size()>0){
-      loc_label[item_id*4]=((Dtype)offset1_x)/xrange;
-      loc_label[item_id*4+1]=((Dtype)offset1_y)/yrange;
-      loc_label[item_id*4+2]=((Dtype)offset2_x)/xrange;
-      loc_label[item_id*4+3]=((Dtype)offset2_y)/yrange;
+      //a pattern that fills the canvas along an axis can only sit at 0
+      loc_label[item_id*4]=xrange>0 ? ((Dtype)offsets[0])/xrange : 0;
+      loc_label[item_id*4+1]=yrange>0 ? ((Dtype)offsets[1])/yrange : 0;
+      loc_label[item_id*4+2]=xrange>0 ? ((Dtype)offsets[2])/xrange : 0;
+      loc_label[item_id*4+3]=yrange>0 ? ((Dtype)offsets[3])/yrange : 0;
     }
-    trans_time += timer.MicroSeconds();
   }
+  trans_time += timer.MicroSeconds();
   timer.Stop();
   batch_timer.Stop();
   DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
@@ -7,6 +7,7 @@
 #include "caffe/layer.hpp"
 #include "caffe/layers/unroll_layer.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/net_param_cache.hpp"
 #include "caffe/util/upgrade_proto.hpp"
 
 namespace caffe {
@@ -19,6 +20,13 @@ void UnrollLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   num_timesteps_=this->layer_param_.unroll_param().num_timesteps();
   subnet_prototxt_=this->layer_param_.unroll_param().subnet_prototxt();
   N_recur_=this->layer_param_.unroll_param().recurrent_input_size();
+  checkpoint_interval_=
+      this->layer_param_.unroll_param().checkpoint_interval();
+  CHECK_GE(checkpoint_interval_,0) << "checkpoint_interval must be >= 0";
+  num_slots_=num_timesteps_;
+  if(checkpoint_interval_>0 && checkpoint_interval_<num_timesteps_){
+    num_slots_=checkpoint_interval_;
+  }
 
   recurrent_input_names_.clear();
   for(int i=0;i<N_recur_;i++) recurrent_input_names_.push_back(
@@ -27,16 +35,14 @@ void UnrollLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   //We need to know some things about how many blobs are produced/consumed by 
   //the subnet, so let's take a peek at the prototxt for it before we really 
   //get started setting up layers
-  NetParameter net_param_unfilt;  
-  ReadNetParamsFromTextFileOrDie(subnet_prototxt_, &net_param_unfilt);
-  net_param_unfilt.mutable_state()->set_phase(this->phase_);
+  NetState state;
+  state.set_phase(this->phase_);
   if(this->layer_param_.subnet_param().stage().size()>0){
-    net_param_unfilt.mutable_state()->add_stage(
-      this->layer_param_.subnet_param().stage());
+    state.add_stage(this->layer_param_.subnet_param().stage());
   }
 
   NetParameter net_param;
-  Net<Dtype>::FilterNet(net_param_unfilt, &net_param);
+  ReadFilteredNetParamsCached(subnet_prototxt_, state, &net_param);
 
   const LayerParameter subnet_input_layer_param = net_param.layer(0);
   const InputParameter subnet_input_param = 
@@ -82,13 +88,10 @@ void UnrollLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   subnet_blob_input_idx_.clear(); //coindexed with subnet_bottom_vec_
   vector<string> subnet_blob_input_names;
 
-  split_bottom_vec_.clear();
-  split_top_vec_.clear();
-  split_layer_.clear();
-
-  split_layer_.resize(num_timesteps_);
-  split_bottom_vec_.resize(num_timesteps_);
-  split_top_vec_.resize(num_timesteps_);
+  //without checkpointing every timestep keeps its own copy of the subnet 
+  //blobs, so the per-timestep outputs can simply alias the subnet's outputs 
+  //rather than being copied out of them
+  const bool share_outputs(num_slots_==num_timesteps_);
 
   for(int itime=0;itime<num_timesteps_;itime++){
     subnet_bottom_vec_.push_back(vector<Blob<Dtype>*>());
@@ -101,7 +104,7 @@ void UnrollLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
         subnet_bottom_vec_[itime].push_back(bottom[i]);
         subnet_blob_input_names.push_back(recurrent_input_names_[i]+"_in");
       } else {
-        subnet_bottom_vec_[itime].push_back(split_top_vec_[itime-1][i][1]);
+        subnet_bottom_vec_[itime].push_back(subnet_top_vec_[itime-1][i]);
       }
     } 
     for(int i=0;i<N_input_;i++){
@@ -116,11 +119,15 @@ void UnrollLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     for(int i=0;i<N_recur_;i++){
       if(itime==0){
         subnet_param.add_top(recurrent_input_names_[i]+"_out");
+        subnet_param.mutable_subnet_param()->add_shared_outputs(share_outputs);
       }
       subnet_top_vec_[itime].push_back(new Blob<Dtype>());  
     }
     for(int i=0;i<N_output_;i++){
-      if(itime==0) subnet_param.add_top(product_names_[i]);
+      if(itime==0){
+        subnet_param.add_top(product_names_[i]);
+        subnet_param.mutable_subnet_param()->add_shared_outputs(share_outputs);
+      }
       subnet_top_vec_[itime].push_back(new Blob<Dtype>());  
     }
 
@@ -136,62 +143,37 @@ void UnrollLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
             subnet_blob_input_names[i]));
       }
     }
-
-    for(int i=0;i<N_recur_;i++){
-      ostringstream oss;
-      oss << itime;
-      string itime_str(oss.str());
-      LayerParameter split_param;
-      split_param.set_name(this->layer_param_.name()
-          +"_"+recurrent_input_names_[i]+"_split_"+itime_str);
-      split_param.set_type("Split");
-
-      split_bottom_vec_[itime].push_back(vector<Blob<Dtype>*>());
-      split_top_vec_[itime].push_back(vector<Blob<Dtype>*>());
-
-      split_param.add_bottom(recurrent_input_names_[i]+"_out");
-      split_bottom_vec_[itime][i].push_back(subnet_top_vec_[itime][i]);
-
-      split_param.add_top(recurrent_input_names_[i]+"_split_for_concat_"
-          +itime_str);
-      split_top_vec_[itime][i].push_back(new Blob<Dtype>());
-
-      split_param.add_top(recurrent_input_names_[i]+"_split_for_next_time_"
-          +itime_str);
-      split_top_vec_[itime][i].push_back(new Blob<Dtype>());
-
-      split_layer_[itime].push_back(
-          LayerRegistry<Dtype>::CreateLayer(split_param));
-      split_layer_[itime][i]->SetUp(split_bottom_vec_[itime][i],
-          split_top_vec_[itime][i]);
-      split_layer_[itime][i]->Reshape(split_bottom_vec_[itime][i],
-          split_top_vec_[itime][i]);
-    }
   }
 
-  //we want to store the list of intermediate blobs for each timestep in 
-  //subnet_blobs_.  Note that blobs() here is Net<Dtype>::blobs(), the list 
-  //of intermediates blobs, not the list of learnable parameters.
-  subnet_blobs_.resize(num_timesteps_);
+  //we want to store the list of intermediate blobs for each timestep (or, 
+  //with checkpointing, for each slot) in subnet_blobs_.  Note that blobs() 
+  //here is Net<Dtype>::blobs(), the list of intermediates blobs, not the list 
+  //of learnable parameters.  Only the per-time inputs, which alias the same 
+  //bottom blobs at every timestep, are shared between slots: each slot keeps 
+  //its own copy of the recurrent inputs, since the backward pass of a 
+  //timestep needs the data that timestep was run on.
+  subnet_blobs_.clear();
+  subnet_blobs_.resize(num_slots_);
   for(int isubnet=0;isubnet<subnet_layer_->subnets().size();isubnet++){
     subnet_blobs_[0].push_back(subnet_layer_->subnets()[isubnet]->blobs());
   }
-  for(int itime=1;itime<num_timesteps_;itime++){
-    subnet_blobs_[itime].resize(subnet_layer_->subnets().size());
+  for(int islot=1;islot<num_slots_;islot++){
+    subnet_blobs_[islot].resize(subnet_layer_->subnets().size());
     for(int isubnet=0;isubnet<subnet_layer_->subnets().size();isubnet++){
-      subnet_blobs_[itime][isubnet].resize(subnet_blobs_[0][isubnet].size());
-      for(int iblob=0;iblob<subnet_blobs_[itime][isubnet].size();iblob++){
+      subnet_blobs_[islot][isubnet].resize(subnet_blobs_[0][isubnet].size());
+      for(int iblob=0;iblob<subnet_blobs_[islot][isubnet].size();iblob++){
         bool found(false);
         if(isubnet==0){
-          for(int isearch=0;isearch<subnet_blob_input_idx_.size();isearch++){
+          for(int isearch=N_recur_;isearch<subnet_blob_input_idx_.size();
+              isearch++){
             if(iblob==subnet_blob_input_idx_[isearch]) found=true;
           }
         }
         if(found){
-          subnet_blobs_[itime][isubnet][iblob]=subnet_blobs_[0][isubnet][iblob];
+          subnet_blobs_[islot][isubnet][iblob]=subnet_blobs_[0][isubnet][iblob];
         } else {
-          subnet_blobs_[itime][isubnet][iblob].reset(new Blob<Dtype>());
-          subnet_blobs_[itime][isubnet][iblob]->ReshapeLike(
+          subnet_blobs_[islot][isubnet][iblob].reset(new Blob<Dtype>());
+          subnet_blobs_[islot][isubnet][iblob]->ReshapeLike(
               *(subnet_blobs_[0][isubnet][iblob].get()));
         }
       }
@@ -199,105 +181,11 @@ void UnrollLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   }
 
 
-  //Finally, don't forget to concat the subnet products over time
-  reshape_bottom_vec_.clear();
-  reshape_top_vec_.clear();
-  reshape_layer_.clear();
-
-  reshape_layer_.resize(num_timesteps_);
-  reshape_bottom_vec_.resize(num_timesteps_);
-  reshape_top_vec_.resize(num_timesteps_);
-
-  concat_bottom_vec_.clear();
-  concat_top_vec_.clear();
-  concat_layer_.clear();
-  for(int i=0;i<N_recur_+N_output_;i++){
-
-    for(int itime=0;itime<num_timesteps_;itime++){
-      ostringstream oss;
-      oss << itime;
-      string itime_str(oss.str());
-      LayerParameter reshape_param;
-      if(i<N_recur_){
-        reshape_param.set_name(this->layer_param_.name()+"_"
-            +recurrent_input_names_[i]+"_reshape_"+itime_str);
-      } else {
-        reshape_param.set_name(this->layer_param_.name()+"_"
-            +product_names_[i-N_recur_]+"_reshape_"+itime_str);
-      }
-      reshape_param.set_type("Reshape");
-
-      for(int idim=0;idim<subnet_top_vec_[itime][i]->num_axes();idim++){
-        reshape_param.mutable_reshape_param()->mutable_shape()->add_dim(
-            subnet_top_vec_[itime][i]->shape(idim));
-      }
-      reshape_param.mutable_reshape_param()->mutable_shape()->add_dim(1);
-      reshape_bottom_vec_[itime].push_back(vector<Blob<Dtype>*>());
-      reshape_top_vec_[itime].push_back(vector<Blob<Dtype>*>());
-
-      if(i<N_recur_){
-        reshape_param.add_bottom(recurrent_input_names_[i]+"_split_for_concat_"
-            +itime_str);
-        reshape_bottom_vec_[itime][i].push_back(split_top_vec_[itime][i][0]);
-      } else {
-        reshape_param.add_bottom(product_names_[i-N_recur_]);
-        reshape_bottom_vec_[itime][i].push_back(subnet_top_vec_[itime][i]);
-      }
-      if(i<N_recur_){
-        reshape_param.add_top(recurrent_input_names_[i]+"_reshape_"+itime_str);
-      } else {
-        reshape_param.add_top(product_names_[i-N_recur_]+"_reshape_"+itime_str);
-      }
-      reshape_top_vec_[itime][i].push_back(new Blob<Dtype>());
-      reshape_layer_[itime].push_back(LayerRegistry<Dtype>::CreateLayer(
-          reshape_param));
-      reshape_layer_[itime][i]->SetUp(reshape_bottom_vec_[itime][i],
-          reshape_top_vec_[itime][i]);
-      reshape_layer_[itime][i]->Reshape(reshape_bottom_vec_[itime][i],
-          reshape_top_vec_[itime][i]);
-
-    }
-
-    LayerParameter concat_param;
-    if(i<N_recur_){
-      concat_param.set_name(this->layer_param_.name()+"_"+
-          recurrent_input_names_[i]+"_concat");
-    } else {
-      concat_param.set_name(this->layer_param_.name()+"_"+
-          product_names_[i-N_recur_]+"_concat");
-    }
-    concat_param.set_type("Concat");
-    concat_param.mutable_concat_param()->set_axis(
-        subnet_top_vec_[0][i]->num_axes()); 
-    concat_bottom_vec_.push_back(vector<Blob<Dtype>*>());
-    concat_top_vec_.push_back(vector<Blob<Dtype>*>());
-
-    for(int itime=0;itime<num_timesteps_;itime++){
-      ostringstream oss;
-      oss << itime;
-      string itime_str(oss.str());
- 
-      if(i<N_recur_){
-        concat_param.add_bottom(recurrent_input_names_[i]
-            +"_reshape_"+itime_str);
-      } else {
-        concat_param.add_bottom(product_names_[i-N_recur_]
-            +"_reshape_"+itime_str);
-      }
-      concat_bottom_vec_[i].push_back(reshape_top_vec_[itime][i][0]);
-    }
-    if(i<N_recur_){
-      concat_param.add_top(recurrent_input_names_[i]+"_concat");
-    } else {
-      concat_param.add_top(product_names_[i-N_recur_]+"_concat");
-    }
-    concat_top_vec_[i].push_back(top[i]);
-    concat_layer_.push_back(LayerRegistry<Dtype>::CreateLayer(concat_param));
-    concat_layer_[i]->SetUp(concat_bottom_vec_[i],concat_top_vec_[i]);
-    concat_layer_[i]->Reshape(concat_bottom_vec_[i],concat_top_vec_[i]);
-  }
-
-  
+  //Finally, the subnet products are concatenated over time: each top blob 
+  //has the shape of the corresponding subnet output with an extra axis of 
+  //length num_timesteps_ at the end, and every timestep writes its outputs 
+  //straight into its slice of it (see ScatterTimestep)
+  ReshapeTops(top);
 
   // This layer's parameters are any parameters in the subnet.
   // Note that blobs() here is Layer<Dtype>::blobs(), the list of learnable 
@@ -321,23 +209,24 @@ void UnrollLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   }
 
   //likewise, the intermediates here are the intermediates of the subnet at 
-  //each time (i.e. the contents of subnet_blobs_).
-  //I think we can safely ignore the reshape and concat top/bottom blobs.
+  //each time (i.e. the contents of subnet_blobs_; with checkpointing these 
+  //only hold the most recently computed timesteps, so they're named by slot).
   this->intermediates_.clear();
   this->intermediate_names_.clear();
-  for(int itime=0;itime<num_timesteps_;itime++){
+  const string slot_prefix(num_slots_<num_timesteps_ ? "::slot_" : "::time_");
+  for(int islot=0;islot<num_slots_;islot++){
     ostringstream oss;
-    oss << itime;
-    string itime_str(oss.str());
-    for(int isubnet=0;isubnet<subnet_blobs_[itime].size();isubnet++){
+    oss << islot;
+    string islot_str(oss.str());
+    for(int isubnet=0;isubnet<subnet_blobs_[islot].size();isubnet++){
       ostringstream oss2;
       oss2 << subnet_layer_->subnets()[isubnet]->name();
       string subname(oss2.str());
-      for(int iblob=0;iblob<subnet_blobs_[itime][isubnet].size();iblob++){
-        this->intermediates_.push_back(subnet_blobs_[itime][isubnet][iblob]);
+      for(int iblob=0;iblob<subnet_blobs_[islot][isubnet].size();iblob++){
+        this->intermediates_.push_back(subnet_blobs_[islot][isubnet][iblob]);
         this->intermediate_names_.push_back(subname+"::"
            +subnet_layer_->subnets()[isubnet]->blob_names()[iblob]
-           +"::time_"+itime_str);
+           +slot_prefix+islot_str);
       }
     }
   }
@@ -350,6 +239,35 @@ void UnrollLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   this->param_propagate_down_.clear();
   this->param_propagate_down_.resize(this->blobs_.size(), true);
 
+  input_diff_sum_.clear();
+  for(int i=0;i<N_input_;i++) input_diff_sum_.push_back(
+      shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+
+  //a recomputed segment has to come out exactly as it did in Forward: curand 
+  //draws, per-layer sampling counters and phase counters can't be replayed, 
+  //so anything that uses them would silently get the wrong gradients
+  if(num_slots_<num_timesteps_){
+    CHECK_EQ(Caffe::mode(),Caffe::CPU) << this->layer_param_.name()
+        << ": checkpoint_interval is only supported in CPU mode";
+    for(int isubnet=0;isubnet<this->subnets_.size();isubnet++){
+      const vector<shared_ptr<Layer<Dtype> > >& layers=
+          this->subnets_[isubnet]->layers();
+      for(int ilayer=0;ilayer<layers.size();ilayer++){
+        CHECK(SubnetLayerIsRepeatable(layers[ilayer].get()))
+            << this->layer_param_.name() << ": checkpoint_interval needs a "
+            << "subnet that can be re-run forward, but layer "
+            << layers[ilayer]->layer_param().name() << " ("
+            << layers[ilayer]->type() << ") samples or keeps a phase counter";
+      }
+    }
+  }
+
+  peak_memory_bytes_=MemoryFootprint(num_slots_);
+  LOG(INFO) << this->layer_param_.name() << ": keeping subnet activations for "
+            << num_slots_ << " of " << num_timesteps_ << " timesteps, "
+            << peak_memory_bytes_ << " bytes of activation memory ("
+            << MemoryFootprint(num_timesteps_) 
+            << " bytes without checkpointing)";
 }
 
 template <typename Dtype>
@@ -358,14 +276,9 @@ void UnrollLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
 
   for(int itime=0;itime<num_timesteps_;itime++){
     subnet_layer_->Reshape(subnet_bottom_vec_[itime],subnet_top_vec_[itime]);
-    for(int i=0;i<N_output_+N_recur_;i++){
-      reshape_layer_[itime][i]->Reshape(reshape_bottom_vec_[itime][i],
-          reshape_top_vec_[itime][i]);
-    }
-  }
-  for(int i=0;i<N_output_+N_recur_;i++){
-    concat_layer_[i]->Reshape(concat_bottom_vec_[i],concat_top_vec_[i]);
   }
+  ReshapeTops(top);
+  peak_memory_bytes_=MemoryFootprint(num_slots_);
 }
 
 template <typename Dtype>
@@ -373,27 +286,8 @@ void UnrollLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
 
   for(int itime=0;itime<num_timesteps_;itime++){
-    for(int isubnet=0;isubnet<subnet_blobs_[itime].size();isubnet++){
-      subnet_layer_->subnets()[isubnet]->reset_blobs(
-          subnet_blobs_[itime][isubnet]);
-      for(int iblob=0;iblob<subnet_blobs_[itime][isubnet].size();iblob++) {
-        caffe_set(subnet_blobs_[itime][isubnet][iblob]->count(),Dtype(0.),
-            subnet_blobs_[itime][isubnet][iblob]->mutable_cpu_diff());
-      }
-    }
-
-    subnet_layer_->Forward(subnet_bottom_vec_[itime],subnet_top_vec_[itime]);
-    for(int i=0;i<N_recur_;i++) {
-      split_layer_[itime][i]->Forward(split_bottom_vec_[itime][i],
-          split_top_vec_[itime][i]);
-    }
-    for(int i=0;i<N_output_+N_recur_;i++){
-      reshape_layer_[itime][i]->Forward(reshape_bottom_vec_[itime][i],
-          reshape_top_vec_[itime][i]);
-    }
-  }
-  for(int i=0;i<N_output_+N_recur_;i++){
-    concat_layer_[i]->Forward(concat_bottom_vec_[i],concat_top_vec_[i]);
+    ForwardTimestep(itime);
+    ScatterTimestep(itime,top);
   }
 
 }
@@ -402,48 +296,143 @@ template <typename Dtype>
 void UnrollLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
 
-  for(int i=0;i<N_output_+N_recur_;i++){
-    vector<bool> concat_propagate_down;
-    for(int j=0;j<concat_bottom_vec_[i].size();j++){
-      concat_propagate_down.push_back(true);  
+  //go backwards through time one segment of num_slots_ timesteps at a time.  
+  //The last segment is still resident from the forward pass (without 
+  //checkpointing, that's all of them); earlier ones are recomputed from their 
+  //recurrent inputs, which LayerSetUp made sure reproduces them exactly.
+  for(int i=0;i<N_input_;i++){
+    input_diff_sum_[i]->ReshapeLike(*bottom[N_recur_+i]);
+    caffe_set(input_diff_sum_[i]->count(),Dtype(0),
+              input_diff_sum_[i]->mutable_cpu_data());
+  }
+  int seg_start;
+  for(int seg_end=num_timesteps_;seg_end>0;seg_end=seg_start){
+    seg_start=((seg_end-1)/num_slots_)*num_slots_;
+    if(seg_end<num_timesteps_){
+      CHECK_EQ(Caffe::mode(),Caffe::CPU) << this->layer_param_.name()
+          << ": checkpoint_interval is only supported in CPU mode";
+      for(int itime=seg_start;itime<seg_end;itime++) ForwardTimestep(itime);
     }
-    concat_layer_[i]->Backward(concat_top_vec_[i],concat_propagate_down,
-        concat_bottom_vec_[i]);
-  } 
-
-  for(int itime=num_timesteps_-1;itime>=0;itime--){
-    for(int i=0;i<N_output_+N_recur_;i++){
-      vector<bool> reshape_propagate_down;
-      for(int j=0;j<reshape_bottom_vec_[itime][i].size();j++){
-        reshape_propagate_down.push_back(true);
+    for(int itime=seg_end-1;itime>=seg_start;itime--){
+      GatherTimestep(itime,top);
+      BackwardTimestep(itime);
+      for(int i=0;i<N_input_;i++){
+        caffe_axpy(input_diff_sum_[i]->count(),Dtype(1),
+                   bottom[N_recur_+i]->cpu_diff(),
+                   input_diff_sum_[i]->mutable_cpu_data());
       }
-      reshape_layer_[itime][i]->Backward(reshape_top_vec_[itime][i],
-          reshape_propagate_down,reshape_bottom_vec_[itime][i]);
     }
-    for(int i=0;i<N_recur_;i++){
-      vector<bool> split_propagate_down;
-      for(int j=0;j<split_bottom_vec_[itime][i].size();j++){
-        split_propagate_down.push_back(true);
-      }
-      split_layer_[itime][i]->Backward(split_top_vec_[itime][i],
-          split_propagate_down,split_bottom_vec_[itime][i]);
+  }
+  for(int i=0;i<N_input_;i++){
+    caffe_copy(input_diff_sum_[i]->count(),input_diff_sum_[i]->cpu_data(),
+               bottom[N_recur_+i]->mutable_cpu_diff());
+  }
 
-    }
+}
 
-    for(int isubnet=0;isubnet<subnet_blobs_[itime].size();isubnet++){
-      subnet_layer_->subnets()[isubnet]->reset_blobs(
-          subnet_blobs_[itime][isubnet]);
-    }
+template <typename Dtype>
+void UnrollLayer<Dtype>::ForwardTimestep(int itime) {
+  BindSlot(slot(itime));
+  subnet_layer_->Forward(subnet_bottom_vec_[itime],subnet_top_vec_[itime]);
+}
 
-    vector<bool> subnet_propagate_down;
-    for(int i=0;i<subnet_bottom_vec_[itime].size();i++){
-      subnet_propagate_down.push_back(true);
+template <typename Dtype>
+void UnrollLayer<Dtype>::BackwardTimestep(int itime) {
+  BindSlot(slot(itime));
+
+  vector<bool> subnet_propagate_down;
+  for(int i=0;i<subnet_bottom_vec_[itime].size();i++){
+    subnet_propagate_down.push_back(true);
+  }
+  subnet_layer_->Backward(subnet_top_vec_[itime],
+    subnet_propagate_down,subnet_bottom_vec_[itime]);
+}
+
+template <typename Dtype>
+void UnrollLayer<Dtype>::ScatterTimestep(int itime,
+    const vector<Blob<Dtype>*>& top) {
+  for(int i=0;i<N_recur_+N_output_;i++){
+    const int count=subnet_top_vec_[itime][i]->count();
+    const Dtype* src=subnet_top_vec_[itime][i]->cpu_data();
+    Dtype* dst=top[i]->mutable_cpu_data()+itime;
+    for(int j=0;j<count;j++) dst[j*num_timesteps_]=src[j];
+  }
+}
+
+template <typename Dtype>
+void UnrollLayer<Dtype>::GatherTimestep(int itime,
+    const vector<Blob<Dtype>*>& top) {
+  for(int i=0;i<N_recur_+N_output_;i++){
+    const int count=subnet_top_vec_[itime][i]->count();
+    const Dtype* src=top[i]->cpu_diff()+itime;
+    Dtype* dst=subnet_top_vec_[itime][i]->mutable_cpu_diff();
+    //a recurrent output also feeds the next timestep, whose backward pass has 
+    //already put its share of the gradient there
+    if(i<N_recur_ && itime<num_timesteps_-1){
+      for(int j=0;j<count;j++) dst[j]+=src[j*num_timesteps_];
+    } else {
+      for(int j=0;j<count;j++) dst[j]=src[j*num_timesteps_];
     }
-    subnet_layer_->Backward(subnet_top_vec_[itime],
-      subnet_propagate_down,subnet_bottom_vec_[itime]);
+  }
+}
+
+template <typename Dtype>
+void UnrollLayer<Dtype>::ReshapeTops(const vector<Blob<Dtype>*>& top) {
+  for(int i=0;i<N_recur_+N_output_;i++){
+    vector<int> top_shape(subnet_top_vec_[0][i]->shape());
+    top_shape.push_back(num_timesteps_);
+    top[i]->Reshape(top_shape);
+  }
+}
+
+template <typename Dtype>
+void UnrollLayer<Dtype>::BindSlot(int islot) {
+  //(diffs are zeroed by the subnet layers themselves, and only when a 
+  //backward pass actually runs)
+  for(int isubnet=0;isubnet<subnet_blobs_[islot].size();isubnet++){
+    subnet_layer_->subnets()[isubnet]->reset_blobs(
+        subnet_blobs_[islot][isubnet]);
+  }
+}
 
+template <typename Dtype>
+bool UnrollLayer<Dtype>::SubnetLayerIsRepeatable(Layer<Dtype>* layer) {
+  if(!layer->ForwardIsRepeatable()) return false;
+  if(layer->layer_param().subnet_param().phase_counter_index()>=0) return false;
+  const vector<shared_ptr<Net<Dtype> > > subnets=layer->subnets();
+  for(int isubnet=0;isubnet<subnets.size();isubnet++){
+    const vector<shared_ptr<Layer<Dtype> > >& layers=subnets[isubnet]->layers();
+    for(int ilayer=0;ilayer<layers.size();ilayer++){
+      if(!SubnetLayerIsRepeatable(layers[ilayer].get())) return false;
+    }
   }
+  return true;
+}
 
+template <typename Dtype>
+size_t UnrollLayer<Dtype>::MemoryFootprint(int num_slots) const {
+  //subnet intermediates, except the per-time inputs shared by all slots
+  size_t per_slot(0);
+  for(int isubnet=0;isubnet<subnet_blobs_[0].size();isubnet++){
+    for(int iblob=0;iblob<subnet_blobs_[0][isubnet].size();iblob++){
+      bool is_input(false);
+      if(isubnet==0){
+        for(int i=N_recur_;i<subnet_blob_input_idx_.size();i++){
+          if(iblob==subnet_blob_input_idx_[i]) is_input=true;
+        }
+      }
+      if(!is_input) per_slot+=2*subnet_blobs_[0][isubnet][iblob]->count();
+    }
+  }
+  //with checkpointing, the per-timestep outputs need storage of their own 
+  //(otherwise they alias the subnet outputs in their timestep's slot)
+  size_t per_timestep(0);
+  if(num_slots<num_timesteps_){
+    for(int i=0;i<subnet_top_vec_[0].size();i++){
+      per_timestep+=2*subnet_top_vec_[0][i]->count();
+    }
+  }
+  return sizeof(Dtype)*(num_slots*per_slot+num_timesteps_*per_timestep);
 }
 
 #ifdef CPU_ONLY
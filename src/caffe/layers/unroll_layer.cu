@@ -11,31 +11,34 @@
 
 namespace caffe {
 
+template <typename Dtype>
+__global__ void UnrollScatter(const int n, const int num_timesteps,
+    const Dtype* src, Dtype* dst) {
+  CUDA_KERNEL_LOOP(index, n) {
+    dst[index*num_timesteps]=src[index];
+  }
+}
+
+template <typename Dtype>
+void UnrollLayer<Dtype>::ScatterTimestep_gpu(int itime,
+    const vector<Blob<Dtype>*>& top) {
+  for(int i=0;i<N_recur_+N_output_;i++){
+    const int count=subnet_top_vec_[itime][i]->count();
+    // NOLINT_NEXT_LINE(whitespace/operators)
+    UnrollScatter<Dtype><<<CAFFE_GET_BLOCKS(count), CAFFE_CUDA_NUM_THREADS>>>(
+        count,num_timesteps_,subnet_top_vec_[itime][i]->gpu_data(),
+        top[i]->mutable_gpu_data()+itime);
+    CUDA_POST_KERNEL_CHECK;
+  }
+}
+
 template <typename Dtype>
 void UnrollLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
 
   for(int itime=0;itime<num_timesteps_;itime++){
-    for(int isubnet=0;isubnet<subnet_blobs_[itime].size();isubnet++){
-      for(int iblob=0;iblob<subnet_blobs_[itime][isubnet].size();iblob++) {
-        caffe_gpu_set<Dtype>(subnet_blobs_[itime][isubnet][iblob]->count(),
-            Dtype(0.),subnet_blobs_[itime][isubnet][iblob]->mutable_gpu_diff());
-      }
-      subnet_layer_->subnets()[isubnet]->reset_blobs(
-          subnet_blobs_[itime][isubnet]);
-    }
-    subnet_layer_->Forward(subnet_bottom_vec_[itime],subnet_top_vec_[itime]);
-    for(int i=0;i<N_recur_;i++) {
-      split_layer_[itime][i]->Forward(split_bottom_vec_[itime][i],
-          split_top_vec_[itime][i]);
-    }
-    for(int i=0;i<N_output_+N_recur_;i++){
-      reshape_layer_[itime][i]->Forward(reshape_bottom_vec_[itime][i],
-          reshape_top_vec_[itime][i]);
-    }
-  }
-  for(int i=0;i<N_output_+N_recur_;i++){
-    concat_layer_[i]->Forward(concat_bottom_vec_[i],concat_top_vec_[i]);
+    ForwardTimestep(itime);
+    ScatterTimestep_gpu(itime,top);
   }
 
 }
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <string>
 #include <vector>
 
@@ -11,6 +12,12 @@
 
 namespace caffe {
 
+//shape with axis 0 replaced by num (if num>0)
+static vector<int> ChunkShape(vector<int> shape, int num) {
+  if(num>0) shape[0]=num;
+  return shape;
+}
+
 template <typename Dtype>
 void VAELayer<Dtype>::LayerSetUp(
       const vector<Blob<Dtype>*>& bottom,
@@ -26,61 +33,51 @@ void VAELayer<Dtype>::LayerSetUp(
       this->layer_param_.vae_param().decoder_only();
 
   if(decoder_only_){
-
-
-    LayerParameter encoder_param;
-    encoder_param.set_name(this->layer_param_.name()+"_encoder");
-    encoder_param.set_type("Subnet");
-    encoder_param.mutable_subnet_param()->set_prototxt_filename(encoder_prototxt_);
-    encoder_param.add_bottom("X");  
-    encoder_bottom_vec_.push_back(bottom[1]);
-    encoder_param.add_top("loss");
-    encoder_top_vec_.push_back(new Blob<Dtype>());
-    encoder_param.add_top("sample");
-    encoder_top_vec_.push_back(top[1]);
-    encoder_layer_=LayerRegistry<Dtype>::CreateLayer(encoder_param);
-    encoder_layer_->SetUp(encoder_bottom_vec_,encoder_top_vec_);
-    encoder_layer_->Reshape(encoder_bottom_vec_,encoder_top_vec_);
-
-
+    //only the decoder is built, so that nothing of the encoder or the loss is
+    //ever allocated
+    CHECK_EQ(top.size(),3) 
+        << "decoder_only puts the decoded samples in the third top blob";
+    decoder_batch_size_=this->layer_param_.vae_param().decoder_batch_size();
+    latent_sigma_=this->layer_param_.vae_param().latent_sigma();
+    CHECK_GE(decoder_batch_size_,0);
+    CHECK_GE(latent_sigma_,0);
+    stream_id_=Caffe::philox_stream_id(this->layer_param_.name());
+    forward_count_=0;
+    const bool chunked=decoder_batch_size_>0;
+
+    //the decoder reads its inputs straight from latent_chunk_ etc. (or the 
+    //bottoms) and writes its samples straight into sample_chunk_ (or top 2)
     LayerParameter decoder_param;
     decoder_param.set_name(this->layer_param_.name()+"_decoder");
     decoder_param.set_type("Subnet");
-    decoder_param.mutable_subnet_param()->set_prototxt_filename(decoder_prototxt_);
+    SubnetParameter* subnet_param=decoder_param.mutable_subnet_param();
+    subnet_param->set_prototxt_filename(decoder_prototxt_);
+    subnet_param->set_stage(this->layer_param_.vae_param().decoder_stage());
     decoder_param.add_bottom("latent");
-    decoder_bottom_vec_.push_back(bottom[0]);
-    decoder_param.add_bottom("X");
-    decoder_bottom_vec_.push_back(bottom[1]);
-    decoder_param.add_top("loss");
-    decoder_top_vec_.push_back(new Blob<Dtype>());
-    if(top.size()>=3){
-      decoder_param.add_top("sample");
-      decoder_top_vec_.push_back(top[2]);
+    subnet_param->add_shared_inputs(true);
+    if(chunked || latent_sigma_>0){
+      latent_chunk_.Reshape(ChunkShape(bottom[0]->shape(),decoder_batch_size_));
+      decoder_bottom_vec_.push_back(&latent_chunk_);
+    } else {
+      decoder_bottom_vec_.push_back(bottom[0]);
     }
+    if(bottom.size()>1){
+      decoder_param.add_bottom("X");
+      subnet_param->add_shared_inputs(true);
+      if(chunked){
+        x_chunk_.Reshape(ChunkShape(bottom[1]->shape(),decoder_batch_size_));
+        decoder_bottom_vec_.push_back(&x_chunk_);
+      } else {
+        decoder_bottom_vec_.push_back(bottom[1]);
+      }
+    }
+    decoder_param.add_top("sample");
+    subnet_param->add_shared_outputs(true);
+    decoder_top_vec_.push_back(chunked ? &sample_chunk_ : top[2]);
     decoder_layer_=LayerRegistry<Dtype>::CreateLayer(decoder_param);
     decoder_layer_->SetUp(decoder_bottom_vec_,decoder_top_vec_);
     decoder_layer_->Reshape(decoder_bottom_vec_,decoder_top_vec_);
 
-
-    LayerParameter loss_combination_param;
-    loss_combination_param.set_name(this->layer_param_.name()+"_loss_combination");
-    loss_combination_param.set_type("Eltwise");
-    loss_combination_param.mutable_eltwise_param()->set_operation(EltwiseParameter_EltwiseOp_SUM);
-    loss_combination_param.mutable_eltwise_param()->add_coeff(encoder_loss_weight_);
-    loss_combination_param.mutable_eltwise_param()->add_coeff(1);
-    loss_combination_param.add_bottom("encoder_loss");
-    loss_combination_bottom_vec_.push_back(encoder_top_vec_[0]);
-    loss_combination_param.add_bottom("decoder_loss");
-    loss_combination_bottom_vec_.push_back(decoder_top_vec_[0]);
-    loss_combination_param.add_top(this->layer_param_.top(0));
-    loss_combination_top_vec_.push_back(top[0]);
-    loss_combination_layer_=
-        LayerRegistry<Dtype>::CreateLayer(loss_combination_param);
-    loss_combination_layer_->SetUp(loss_combination_bottom_vec_,
-                                   loss_combination_top_vec_);
-    loss_combination_layer_->Reshape(loss_combination_bottom_vec_,
-                                    loss_combination_top_vec_);
-
   } else {
 
     LayerParameter encoder_param;
@@ -155,7 +152,7 @@ void VAELayer<Dtype>::LayerSetUp(
   // and decoder_layer_
   this->blobs_.clear();
   this->blob_names_.clear();
-  for (int i = 0; i < encoder_layer_->blobs().size(); ++i) {
+  for (int i = 0; encoder_layer_ && i < encoder_layer_->blobs().size(); ++i) {
     this->blobs_.push_back(encoder_layer_->blobs()[i]);
     this->blob_names_.push_back(this->layer_param_.name()
                                +"::encoder::"+encoder_layer_->blob_names()[i]);
@@ -169,7 +166,7 @@ void VAELayer<Dtype>::LayerSetUp(
 
   this->intermediates_.clear();
   this->intermediate_names_.clear();
-  for(int i=0;i<encoder_layer_->intermediates().size();i++){
+  for(int i=0;encoder_layer_ && i<encoder_layer_->intermediates().size();i++){
     this->intermediates_.push_back(encoder_layer_->intermediates()[i]);
     this->intermediate_names_.push_back(encoder_layer_->intermediate_names()[i]);
   }
@@ -180,7 +177,7 @@ void VAELayer<Dtype>::LayerSetUp(
 
 
   this->subnets_.clear();
-  for(int i=0;i<encoder_layer_->subnets().size();i++){
+  for(int i=0;encoder_layer_ && i<encoder_layer_->subnets().size();i++){
     this->subnets_.push_back(encoder_layer_->subnets()[i]);
   }
   for(int i=0;i<decoder_layer_->subnets().size();i++){
@@ -199,8 +196,16 @@ void VAELayer<Dtype>::Reshape(
       const vector<Blob<Dtype>*>& top) {
 
   if(decoder_only_){
-    encoder_layer_->Reshape(encoder_bottom_vec_,encoder_top_vec_);
-    decoder_layer_->Reshape(decoder_bottom_vec_,decoder_top_vec_);
+    //no loss without the encoder
+    top[0]->Reshape(vector<int>());
+    top[1]->ReshapeLike(*bottom[0]);
+    if(decoder_batch_size_>0){
+      //the decoder stays at one chunk, whatever the batch size
+      top[2]->Reshape(ChunkShape(sample_chunk_.shape(),bottom[0]->shape(0)));
+    } else {
+      if(latent_sigma_>0) latent_chunk_.ReshapeLike(*bottom[0]);
+      decoder_layer_->Reshape(decoder_bottom_vec_,decoder_top_vec_);
+    }
   } else {
     encoder_layer_->Reshape(encoder_bottom_vec_,encoder_top_vec_);
     encsample_split_layer_->Reshape(encsample_split_bottom_vec_,encsample_split_top_vec_);
@@ -215,7 +220,7 @@ void VAELayer<Dtype>::Forward_cpu(
     const vector<Blob<Dtype>*>& top) {
 
   if(decoder_only_){
-    decoder_layer_->Forward(decoder_bottom_vec_,decoder_top_vec_);
+    ForwardDecoderOnly(bottom,top);
   } else {
     encoder_layer_->Forward(encoder_bottom_vec_,encoder_top_vec_);
     encsample_split_layer_->Forward(encsample_split_bottom_vec_,encsample_split_top_vec_);
@@ -224,11 +229,61 @@ void VAELayer<Dtype>::Forward_cpu(
   }
 }
 
+template <typename Dtype>
+void VAELayer<Dtype>::ForwardDecoderOnly(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) {
+  caffe_set(top[0]->count(),Dtype(0),top[0]->mutable_cpu_data());
+  if(decoder_batch_size_==0 && latent_sigma_==0){
+    decoder_layer_->Forward(decoder_bottom_vec_,decoder_top_vec_);
+    caffe_copy(bottom[0]->count(),bottom[0]->cpu_data(),
+               top[1]->mutable_cpu_data());
+    return;
+  }
+
+  const int num=bottom[0]->shape(0);
+  const int chunk=decoder_batch_size_>0 ? decoder_batch_size_ : num;
+  const int latent_count=bottom[0]->count(1);
+  const PhiloxStream stream=Caffe::philox_stream(stream_id_,forward_count_++);
+  for(int start=0;start<num;start+=chunk){
+    const int n=std::min(chunk,num-start);
+    Dtype* z=latent_chunk_.mutable_cpu_data();
+    const Dtype* mean=bottom[0]->cpu_data()+start*latent_count;
+    if(latent_sigma_>0){
+      //z=mean+sigma*eps in the decoder's input itself.  eps comes from the 
+      //position in the batch, so the samples don't depend on the chunk size.
+      caffe_rng_stream_gaussian(stream,n*latent_count,Dtype(0),latent_sigma_,
+                                z,start*latent_count);
+      caffe_axpy(n*latent_count,Dtype(1),mean,z);
+    } else {
+      caffe_copy(n*latent_count,mean,z);
+    }
+    //a short last chunk is padded with zeros, and its padding discarded
+    caffe_set((chunk-n)*latent_count,Dtype(0),z+n*latent_count);
+    caffe_copy(n*latent_count,z,top[1]->mutable_cpu_data()+start*latent_count);
+
+    if(decoder_batch_size_>0 && bottom.size()>1){
+      const int x_count=bottom[1]->count(1);
+      Dtype* x=x_chunk_.mutable_cpu_data();
+      caffe_copy(n*x_count,bottom[1]->cpu_data()+start*x_count,x);
+      caffe_set((chunk-n)*x_count,Dtype(0),x+n*x_count);
+    }
+
+    decoder_layer_->Forward(decoder_bottom_vec_,decoder_top_vec_);
+
+    if(decoder_batch_size_>0){
+      const int sample_count=sample_chunk_.count(1);
+      caffe_copy(n*sample_count,sample_chunk_.cpu_data(),
+                 top[2]->mutable_cpu_data()+start*sample_count);
+    }
+  }
+}
+
 template <typename Dtype>
 void VAELayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
 
-  if(decoder_only_) CHECK(false) << "No backward in decoder-only mode";
+  CHECK(!decoder_only_) << "VAE layer " << this->layer_param_.name()
+      << " is decoder_only, which is inference-only: it has no backward pass";
 
   vector<bool> loss_combination_propagate_down;
   loss_combination_propagate_down.push_back(true);
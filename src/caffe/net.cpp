@@ -1,4 +1,7 @@
+#include <boost/thread.hpp>
+
 #include <algorithm>
+#include <climits>
 #include <map>
 #include <set>
 #include <string>
@@ -40,6 +43,11 @@ Net<Dtype>::Net(const string& param_file, Phase phase,
   Init(param);
 }
 
+template <typename Dtype>
+Net<Dtype>::~Net() {
+  StopForwardWorkers();
+}
+
 template <typename Dtype>
 void Net<Dtype>::Init(const NetParameter& in_param) {
   // Set phase from the state.
@@ -59,6 +67,8 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
   map<string, int> blob_name_to_idx;
   set<string> available_blobs;
   memory_used_ = 0;
+  blobs_generation_ = 0;
+  weights_generation_ = 0;
   // For each layer, set up its input and output
   bottom_vecs_.resize(param.layer_size());
   top_vecs_.resize(param.layer_size());
@@ -66,6 +76,19 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
   param_id_vecs_.resize(param.layer_size());
   top_id_vecs_.resize(param.layer_size());
   bottom_need_backward_.resize(param.layer_size());
+  // Blobs some layer computes in place must not be views of another blob's
+  // memory, or the in-place writes would clobber it.
+  set<string> in_place_blobs;
+  for (int layer_id = 0; layer_id < param.layer_size(); ++layer_id) {
+    const LayerParameter& layer_param = param.layer(layer_id);
+    for (int top_id = 0; top_id < layer_param.top_size(); ++top_id) {
+      for (int i = 0; i < layer_param.bottom_size(); ++i) {
+        if (layer_param.bottom(i) == layer_param.top(top_id)) {
+          in_place_blobs.insert(layer_param.top(top_id));
+        }
+      }
+    }
+  }
   for (int layer_id = 0; layer_id < param.layer_size(); ++layer_id) {
     // Inherit phase from net if unset.
     if (!param.layer(layer_id).has_phase()) {
@@ -117,6 +140,13 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
         AppendTop(param, layer_id, num_top, NULL, NULL);
       }
     }
+    for (int top_id = 0; top_id < layer_param.top_size(); ++top_id) {
+      if (in_place_blobs.count(layer_param.top(top_id)) ||
+          (top_id < layer_param.loss_weight_size() &&
+           layer_param.loss_weight(top_id) != 0)) {
+        layer->set_allow_top_views(false);
+      }
+    }
     // After this layer is connected, set it up.
     layers_[layer_id]->SetUp(bottom_vecs_[layer_id], top_vecs_[layer_id]);
     LOG_IF(INFO, Caffe::root_solver())
@@ -252,10 +282,246 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
     layer_names_index_[layer_names_[layer_id]] = layer_id;
   }
   ShareWeights();
+  // Layers with a phase counter or a forward or backward mode of "never" ask
+  // the scheduler before they run; the nets nested in the layers share this
+  // net's scheduler.
+  layer_scheduled_.resize(layers_.size());
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    const SubnetParameter& schedule =
+        layers_[layer_id]->layer_param().subnet_param();
+    layer_scheduled_[layer_id] = schedule.phase_counter_index() >= 0 ||
+        schedule.forward_mode() == 3 || schedule.backward_mode() == 3;
+  }
+  forward_run_.assign(layers_.size(), true);
+  backward_run_.assign(layers_.size(), true);
+  backward_clear_param_diffs_.assign(layers_.size(), false);
+  set_scheduler(shared_ptr<NetScheduler>(new NetScheduler()));
   debug_info_ = param.debug_info();
+  parallel_forward_ = param.parallel_forward();
+  forward_threads_ = param.forward_threads();
+  if (param.plan_memory()) { PlanMemory(param); }
+  if (parallel_forward_) { InitForwardDependencies(); }
   LOG_IF(INFO, Caffe::root_solver()) << "Network initialization done.";
 }
 
+template <typename Dtype>
+void Net<Dtype>::set_scheduler(const shared_ptr<NetScheduler>& scheduler) {
+  scheduler_ = scheduler;
+  for (int i = 0; i < layers_.size(); ++i) {
+    const vector<shared_ptr<Net<Dtype> > > subnets = layers_[i]->subnets();
+    for (int j = 0; j < subnets.size(); ++j) {
+      if (subnets[j]->scheduler_ != scheduler) {
+        subnets[j]->set_scheduler(scheduler);
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+bool Net<Dtype>::LayerForwardUsesGlobalState(Layer<Dtype>* layer) {
+  if (layer->ForwardUsesGlobalState()) { return true; }
+  // Layers of a subnet that keep a phase counter advance the scheduler
+  // shared with this net while the subnet runs.
+  const vector<shared_ptr<Net<Dtype> > > subnets = layer->subnets();
+  for (int i = 0; i < subnets.size(); ++i) {
+    const vector<shared_ptr<Layer<Dtype> > >& layers = subnets[i]->layers();
+    for (int j = 0; j < layers.size(); ++j) {
+      if (layers[j]->layer_param().subnet_param().phase_counter_index() >= 0 ||
+          LayerForwardUsesGlobalState(layers[j].get())) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+template <typename Dtype>
+void Net<Dtype>::PlanMemory(const NetParameter& param) {
+  // Reusing memory is only safe if nothing reads a blob after its last
+  // consumer has run, which rules out the backward pass.
+  if (phase_ != TEST || param.force_backward()) {
+    LOG(WARNING) << "Ignoring plan_memory for " << name_
+                 << ": it is for TEST nets without force_backward only.";
+    return;
+  }
+  // Blobs whose data is already shared are planned as a group, which lives
+  // from the first layer using any of them to the last.
+  vector<int> group(blobs_.size(), -1);
+  vector<SyncedMemory*> group_memory;
+  map<SyncedMemory*, int> memory_group;
+  for (int i = 0; i < blobs_.size(); ++i) {
+    if (blobs_[i]->count() == 0) { continue; }
+    SyncedMemory* memory = blobs_[i]->data().get();
+    map<SyncedMemory*, int>::iterator it = memory_group.find(memory);
+    if (it == memory_group.end()) {
+      it = memory_group.insert(
+          std::make_pair(memory, static_cast<int>(group_memory.size()))).first;
+      group_memory.push_back(memory);
+    }
+    group[i] = it->second;
+  }
+  const int num_groups = group_memory.size();
+  vector<int> first_use(num_groups, INT_MAX);
+  vector<int> last_use(num_groups, -1);
+  vector<bool> keep(num_groups, false);
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    // Layers without bottoms may fill their tops once, at setup (e.g. Input
+    // and DummyData), or point them at memory of their own (the prefetching
+    // data layers).
+    const bool source = bottom_id_vecs_[layer_id].empty();
+    for (int k = 0; k < 2; ++k) {
+      const vector<int>& ids =
+          k ? top_id_vecs_[layer_id] : bottom_id_vecs_[layer_id];
+      for (int i = 0; i < ids.size(); ++i) {
+        const int g = group[ids[i]];
+        if (g < 0) { continue; }
+        first_use[g] = std::min(first_use[g], layer_id);
+        last_use[g] = std::max(last_use[g], layer_id);
+        if (source && k) { keep[g] = true; }
+      }
+    }
+  }
+  vector<int> kept(net_input_blob_indices_);
+  kept.insert(kept.end(), net_output_blob_indices_.begin(),
+              net_output_blob_indices_.end());
+  for (int i = 0; i < param.keep_blob_size(); ++i) {
+    CHECK(has_blob(param.keep_blob(i)))
+        << "Unknown blob " << param.keep_blob(i) << " in keep_blob";
+    kept.push_back(blob_names_index_[param.keep_blob(i)]);
+  }
+  for (int i = 0; i < kept.size(); ++i) {
+    if (group[kept[i]] >= 0) { keep[group[kept[i]]] = true; }
+  }
+
+  // Assign the groups to buffers in the order they come alive; a buffer is
+  // free once the last layer using its current group has run.
+  vector<pair<int, int> > order;
+  size_t bytes_before = 0, bytes_after = 0;
+  for (int g = 0; g < num_groups; ++g) {
+    bytes_before += group_memory[g]->size();
+    if (keep[g] || last_use[g] < 0) {
+      bytes_after += group_memory[g]->size();
+    } else {
+      order.push_back(std::make_pair(first_use[g], g));
+    }
+  }
+  std::sort(order.begin(), order.end());
+  vector<size_t> buffer_bytes;
+  vector<int> buffer_free_after;
+  vector<int> group_buffer(num_groups, -1);
+  for (int i = 0; i < order.size(); ++i) {
+    const int g = order[i].second;
+    const size_t bytes = group_memory[g]->size();
+    // The smallest free buffer that is large enough, else the largest one.
+    int best = -1;
+    for (int b = 0; b < buffer_bytes.size(); ++b) {
+      if (buffer_free_after[b] >= first_use[g]) { continue; }
+      if (best < 0) {
+        best = b;
+      } else if (buffer_bytes[best] < bytes) {
+        if (buffer_bytes[b] > buffer_bytes[best]) { best = b; }
+      } else if (buffer_bytes[b] >= bytes &&
+                 buffer_bytes[b] < buffer_bytes[best]) {
+        best = b;
+      }
+    }
+    if (best < 0) {
+      best = buffer_bytes.size();
+      buffer_bytes.push_back(0);
+      buffer_free_after.push_back(-1);
+    }
+    buffer_bytes[best] = std::max(buffer_bytes[best], bytes);
+    buffer_free_after[best] = last_use[g];
+    group_buffer[g] = best;
+  }
+  vector<shared_ptr<SyncedMemory> > buffers(buffer_bytes.size());
+  for (int b = 0; b < buffers.size(); ++b) {
+    buffers[b].reset(new SyncedMemory(buffer_bytes[b]));
+    bytes_after += buffer_bytes[b];
+  }
+  for (int i = 0; i < blobs_.size(); ++i) {
+    if (group[i] >= 0 && group_buffer[group[i]] >= 0) {
+      blobs_[i]->SetDataMemory(buffers[group_buffer[group[i]]]);
+    }
+  }
+  LOG_IF(INFO, Caffe::root_solver())
+      << "Memory required for data after plan_memory: " << bytes_after
+      << " (was " << bytes_before << ", " << order.size()
+      << " blob groups in " << buffers.size() << " shared buffers)";
+}
+
+template <typename Dtype>
+void Net<Dtype>::InitForwardDependencies() {
+  // Blobs sharing data or diff memory (e.g. the tops of Split and Reshape
+  // layers and their bottoms) are one resource; find the groups with a
+  // union-find over the SyncedMemory they point to.
+  vector<int> group(blobs_.size());
+  for (int i = 0; i < blobs_.size(); ++i) { group[i] = i; }
+  map<const SyncedMemory*, int> owner;
+  for (int i = 0; i < blobs_.size(); ++i) {
+    const SyncedMemory* mems[2] = { blobs_[i]->data().get(),
+                                    blobs_[i]->diff().get() };
+    for (int m = 0; m < 2; ++m) {
+      if (!mems[m]) { continue; }
+      map<const SyncedMemory*, int>::iterator it = owner.find(mems[m]);
+      if (it == owner.end()) {
+        owner[mems[m]] = i;
+        continue;
+      }
+      int a = i, b = it->second;
+      while (group[a] != a) { a = group[a]; }
+      while (group[b] != b) { b = group[b]; }
+      group[std::max(a, b)] = std::min(a, b);
+    }
+  }
+  for (int i = 0; i < blobs_.size(); ++i) {
+    int root = i;
+    while (group[root] != root) { root = group[root]; }
+    group[i] = root;
+  }
+
+  // Walk the layers in order, tracking the last writer and the readers since
+  // then of every group.
+  const int num_layers = layers_.size();
+  vector<int> last_writer(blobs_.size(), -1);
+  vector<vector<int> > readers(blobs_.size());
+  int last_on_caller = -1;
+  forward_preds_.assign(num_layers, vector<int>());
+  forward_succs_.assign(num_layers, vector<int>());
+  forward_on_caller_.assign(num_layers, false);
+  forward_losses_.assign(num_layers, Dtype(0));
+  for (int layer_id = 0; layer_id < num_layers; ++layer_id) {
+    set<int> preds;
+    for (int i = 0; i < bottom_id_vecs_[layer_id].size(); ++i) {
+      const int g = group[bottom_id_vecs_[layer_id][i]];
+      if (last_writer[g] >= 0) { preds.insert(last_writer[g]); }
+    }
+    for (int i = 0; i < top_id_vecs_[layer_id].size(); ++i) {
+      const int g = group[top_id_vecs_[layer_id][i]];
+      if (last_writer[g] >= 0) { preds.insert(last_writer[g]); }
+      preds.insert(readers[g].begin(), readers[g].end());
+    }
+    if (LayerForwardUsesGlobalState(layers_[layer_id].get())) {
+      forward_on_caller_[layer_id] = true;
+      if (last_on_caller >= 0) { preds.insert(last_on_caller); }
+      last_on_caller = layer_id;
+    }
+    preds.erase(layer_id);
+    for (int i = 0; i < bottom_id_vecs_[layer_id].size(); ++i) {
+      readers[group[bottom_id_vecs_[layer_id][i]]].push_back(layer_id);
+    }
+    for (int i = 0; i < top_id_vecs_[layer_id].size(); ++i) {
+      const int g = group[top_id_vecs_[layer_id][i]];
+      last_writer[g] = layer_id;
+      readers[g].clear();
+    }
+    forward_preds_[layer_id].assign(preds.begin(), preds.end());
+    for (set<int>::iterator it = preds.begin(); it != preds.end(); ++it) {
+      forward_succs_[*it].push_back(layer_id);
+    }
+  }
+}
+
 template <typename Dtype>
 void Net<Dtype>::FilterNet(const NetParameter& param,
     NetParameter* param_filtered) {
@@ -526,14 +792,21 @@ template <typename Dtype>
 Dtype Net<Dtype>::ForwardFromTo(int start, int end) {
   CHECK_GE(start, 0);
   CHECK_LT(end, layers_.size());
+  PlanForward(start, end);
+  if (parallel_forward_ && Caffe::mode() == Caffe::CPU && end > start &&
+      before_forward_.empty() && after_forward_.empty() && !debug_info_) {
+    return ForwardParallel(start, end);
+  }
   Dtype loss = 0;
   for (int i = start; i <= end; ++i) {
     for (int c = 0; c < before_forward_.size(); ++c) {
       before_forward_[c]->run(i);
     }
-    Dtype layer_loss = layers_[i]->Forward(bottom_vecs_[i], top_vecs_[i]);
-    loss += layer_loss;
-    if (debug_info_) { ForwardDebugInfo(i); }
+    if (forward_run_[i]) {
+      Dtype layer_loss = layers_[i]->Forward(bottom_vecs_[i], top_vecs_[i]);
+      loss += layer_loss;
+      if (debug_info_) { ForwardDebugInfo(i); }
+    }
     for (int c = 0; c < after_forward_.size(); ++c) {
       after_forward_[c]->run(i);
     }
@@ -541,6 +814,126 @@ Dtype Net<Dtype>::ForwardFromTo(int start, int end) {
   return loss;
 }
 
+template <typename Dtype>
+Dtype Net<Dtype>::ForwardParallel(int start, int end) {
+  if (forward_workers_.empty()) {
+    int num_threads = forward_threads_;
+    if (num_threads <= 0) {
+      num_threads = std::max(1u, boost::thread::hardware_concurrency());
+    }
+    for (int i = 0; i < num_threads; ++i) {
+      forward_workers_.push_back(shared_ptr<boost::thread>(new boost::thread(
+          &Net<Dtype>::ForwardWorkerEntry, this)));
+    }
+  }
+  forward_seed_ = Caffe::random_seed();
+  forward_solver_count_ = Caffe::solver_count();
+  forward_solver_rank_ = Caffe::solver_rank();
+  // Bring every input to the CPU up front, so that layers reading the same
+  // blob from different threads never race to allocate or copy it.  Strided
+  // inputs (only external memory is strided, so it is ready) are gathered
+  // here too, rather than by each Layer::Forward that reads them.
+  for (int i = start; i <= end; ++i) {
+    for (int j = 0; j < bottom_vecs_[i].size(); ++j) {
+      bottom_vecs_[i][j]->Contiguous();
+      if (bottom_vecs_[i][j]->count() > 0) { bottom_vecs_[i][j]->cpu_data(); }
+    }
+  }
+
+  vector<int> pending(end - start + 1, 0);
+  for (int i = start; i <= end; ++i) {
+    for (int j = 0; j < forward_preds_[i].size(); ++j) {
+      if (forward_preds_[i][j] >= start) { ++pending[i - start]; }
+    }
+  }
+  set<int> caller_ready;
+  for (int i = start; i <= end; ++i) {
+    if (pending[i - start] == 0) { DispatchForward(i, &caller_ready); }
+  }
+  for (int remaining = end - start + 1; remaining > 0; --remaining) {
+    int layer_id;
+    if (!caller_ready.empty()) {
+      layer_id = *caller_ready.begin();
+      caller_ready.erase(caller_ready.begin());
+      forward_losses_[layer_id] = !forward_run_[layer_id] ? Dtype(0) :
+          layers_[layer_id]->Forward(bottom_vecs_[layer_id],
+                                     top_vecs_[layer_id]);
+    } else {
+      layer_id = forward_done_.pop();
+    }
+    const vector<int>& succs = forward_succs_[layer_id];
+    for (int j = 0; j < succs.size() && succs[j] <= end; ++j) {
+      if (--pending[succs[j] - start] == 0) {
+        DispatchForward(succs[j], &caller_ready);
+      }
+    }
+  }
+  Dtype loss = 0;
+  for (int i = start; i <= end; ++i) { loss += forward_losses_[i]; }
+  return loss;
+}
+
+template <typename Dtype>
+void Net<Dtype>::DispatchForward(int layer_id, set<int>* caller_ready) {
+  // (layers that are skipped this time just complete on the calling thread)
+  if (forward_on_caller_[layer_id] || !forward_run_[layer_id]) {
+    caller_ready->insert(layer_id);
+  } else {
+    forward_jobs_.push(layer_id);
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::ForwardWorkerEntry() {
+  while (true) {
+    const int layer_id = forward_jobs_.pop();
+    if (layer_id < 0) { break; }
+    // Mirror the calling thread's thread-local state, so that e.g. the
+    // counter-based random streams come out the same as on that thread.
+    if (Caffe::random_seed() != forward_seed_) {
+      Caffe::set_random_seed(forward_seed_);
+    }
+    Caffe::set_solver_count(forward_solver_count_);
+    Caffe::set_solver_rank(forward_solver_rank_);
+    forward_losses_[layer_id] = layers_[layer_id]->Forward(
+        bottom_vecs_[layer_id], top_vecs_[layer_id]);
+    forward_done_.push(layer_id);
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::StopForwardWorkers() {
+  for (int i = 0; i < forward_workers_.size(); ++i) {
+    forward_jobs_.push(-1);
+  }
+  for (int i = 0; i < forward_workers_.size(); ++i) {
+    forward_workers_[i]->join();
+  }
+  forward_workers_.clear();
+}
+
+template <typename Dtype>
+void Net<Dtype>::PlanForward(int start, int end) {
+  for (int i = start; i <= end; ++i) {
+    forward_run_[i] = !layer_scheduled_[i] ||
+        scheduler_->Forward(layers_[i]->layer_param().subnet_param());
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::PlanBackward(int start, int end) {
+  for (int i = start; i >= end; --i) {
+    bool run = layer_need_backward_[i];
+    bool clear_param_diffs = false;
+    if (run && layer_scheduled_[i]) {
+      run = scheduler_->Backward(layers_[i]->layer_param().subnet_param(),
+                                 &clear_param_diffs);
+    }
+    backward_run_[i] = run;
+    backward_clear_param_diffs_[i] = clear_param_diffs;
+  }
+}
+
 template <typename Dtype>
 Dtype Net<Dtype>::ForwardFrom(int start) {
   return ForwardFromTo(start, layers_.size() - 1);
@@ -577,13 +970,15 @@ template <typename Dtype>
 void Net<Dtype>::BackwardFromTo(int start, int end) {
   CHECK_GE(end, 0);
   CHECK_LT(start, layers_.size());
+  PlanBackward(start, end);
   for (int i = start; i >= end; --i) {
     for (int c = 0; c < before_backward_.size(); ++c) {
       before_backward_[c]->run(i);
     }
-    if (layer_need_backward_[i]) {
+    if (backward_run_[i]) {
       layers_[i]->Backward(
           top_vecs_[i], bottom_need_backward_[i], bottom_vecs_[i]);
+      if (backward_clear_param_diffs_[i]) { ClearLayerParamDiffs(i); }
       if (debug_info_) { BackwardDebugInfo(i); }
     }
     for (int c = 0; c < after_backward_.size(); ++c) {
@@ -701,6 +1096,7 @@ void Net<Dtype>::ShareTrainedLayersWith(const Net* other) {
       target_blobs[j]->ShareData(*source_blob);
     }
   }
+  WeightsRebound();
 }
 
 template <typename Dtype>
@@ -757,13 +1153,16 @@ void Net<Dtype>::CopyTrainedLayersFrom(const NetParameter& param) {
     DLOG(INFO) << "Copying source layer " << source_layer_name;
     vector<shared_ptr<Blob<Dtype> > >& target_blobs =
         layers_[target_layer_id]->blobs();
-    CHECK_EQ(target_blobs.size(), source_layer.blobs_size())
+    const int offset =
+        layers_[target_layer_id]->TrainedBlobsOffset(source_layer.blobs_size());
+    CHECK_EQ(target_blobs.size() + offset, source_layer.blobs_size())
         << "Incompatible number of blobs for layer " << source_layer_name;
     for (int j = 0; j < target_blobs.size(); ++j) {
-      if (!target_blobs[j]->ShapeEquals(source_layer.blobs(j))) {
+      const BlobProto& source_proto = source_layer.blobs(j + offset);
+      if (!target_blobs[j]->ShapeEquals(source_proto)) {
         Blob<Dtype> source_blob;
         const bool kReshape = true;
-        source_blob.FromProto(source_layer.blobs(j), kReshape);
+        source_blob.FromProto(source_proto, kReshape);
         LOG(FATAL) << "Cannot copy param " << j << " weights from layer '"
             << source_layer_name << "'; shape mismatch.  Source param shape is "
             << source_blob.shape_string() << "; target param shape is "
@@ -772,9 +1171,10 @@ void Net<Dtype>::CopyTrainedLayersFrom(const NetParameter& param) {
             << "copying from a saved net, rename the layer.";
       }
       const bool kReshape = false;
-      target_blobs[j]->FromProto(source_layer.blobs(j), kReshape);
+      target_blobs[j]->FromProto(source_proto, kReshape);
     }
   }
+  WeightsRebound();
 }
 
 template <typename Dtype>
@@ -818,11 +1218,13 @@ void Net<Dtype>::CopyTrainedLayersFromHDF5(const string trained_filename) {
         << "Error reading weights from " << trained_filename;
     // Check that source layer doesn't have more params than target layer
     int num_source_params = hdf5_get_num_links(layer_hid);
-    CHECK_LE(num_source_params, target_blobs.size())
+    const int offset =
+        layers_[target_layer_id]->TrainedBlobsOffset(num_source_params);
+    CHECK_LE(num_source_params, target_blobs.size() + offset)
         << "Incompatible number of blobs for layer " << source_layer_name;
     for (int j = 0; j < target_blobs.size(); ++j) {
       ostringstream oss;
-      oss << j;
+      oss << j + offset;
       string dataset_name = oss.str();
       int target_net_param_id = param_id_vecs_[target_layer_id][j];
       if (!H5Lexists(layer_hid, dataset_name.c_str(), H5P_DEFAULT)) {
@@ -842,17 +1244,19 @@ void Net<Dtype>::CopyTrainedLayersFromHDF5(const string trained_filename) {
   }
   H5Gclose(data_hid);
   H5Fclose(file_hid);
+  WeightsRebound();
 }
 
 template <typename Dtype>
-void Net<Dtype>::ToProto(NetParameter* param, bool write_diff) const {
+void Net<Dtype>::ToProto(NetParameter* param, bool write_diff,
+    BlobProto::Precision precision) const {
   param->Clear();
   param->set_name(name_);
   // Add bottom and top
   DLOG(INFO) << "Serializing " << layers_.size() << " layers";
   for (int i = 0; i < layers_.size(); ++i) {
     LayerParameter* layer_param = param->add_layer();
-    layers_[i]->ToProto(layer_param, write_diff);
+    layers_[i]->ToProto(layer_param, write_diff, precision);
   }
 }
 
@@ -941,6 +1345,27 @@ void Net<Dtype>::ClearParamDiffs() {
   }
 }
 
+template <typename Dtype>
+void Net<Dtype>::ClearLayerParamDiffs(int layer_id) {
+  const vector<shared_ptr<Blob<Dtype> > >& blobs = layers_[layer_id]->blobs();
+  for (int i = 0; i < blobs.size(); ++i) {
+    switch (Caffe::mode()) {
+    case Caffe::CPU:
+      caffe_set(blobs[i]->count(), static_cast<Dtype>(0),
+                blobs[i]->mutable_cpu_diff());
+      break;
+    case Caffe::GPU:
+#ifndef CPU_ONLY
+      caffe_gpu_set(blobs[i]->count(), static_cast<Dtype>(0),
+                    blobs[i]->mutable_gpu_diff());
+#else
+      NO_GPU;
+#endif
+      break;
+    }
+  }
+}
+
 template <typename Dtype>
 void Net<Dtype>::ShareWeights() {
   for (int i = 0; i < params_.size(); ++i) {
@@ -950,6 +1375,19 @@ void Net<Dtype>::ShareWeights() {
   }
 }
 
+template <typename Dtype>
+void Net<Dtype>::WeightsRebound() {
+  ++weights_generation_;
+  // layers with subnets list all of their (nested) subnets, so there is no
+  // need to recurse here
+  for (int i = 0; i < layers_.size(); ++i) {
+    const vector<shared_ptr<Net<Dtype> > > subnets = layers_[i]->subnets();
+    for (int j = 0; j < subnets.size(); ++j) {
+      ++subnets[j]->weights_generation_;
+    }
+  }
+}
+
 template <typename Dtype>
 bool Net<Dtype>::has_blob(const string& blob_name) const {
   return blob_names_index_.find(blob_name) != blob_names_index_.end();
@@ -1005,8 +1443,8 @@ void Net<Dtype>::reset_blobs(vector<shared_ptr<Blob<Dtype> > >& updated){
           << "Net<Dtype>::reset_blobs called but the new version of blob " 
           << i << " differs in shape from the old one";
       }
-      blobs_[i]=updated[i];
     }
+    blobs_[i]=updated[i];
   }
 
   //also: use bottom_id_vecs_ and top_id_vecs_ to update the pointers in 
@@ -1021,6 +1459,7 @@ void Net<Dtype>::reset_blobs(vector<shared_ptr<Blob<Dtype> > >& updated){
       top_vecs_[i][j]=blobs_[top_id_vecs_[i][j]].get();
     }
   }
+  ++blobs_generation_;
   
   //finally:  layers that use this function (like UnrollLayer) may zero out
   //some or all of the network's diff blobs.  Odds are we will still want 
@@ -0,0 +1,60 @@
+#include <vector>
+
+#include "caffe/net_scheduler.hpp"
+
+namespace caffe {
+
+int NetScheduler::counter(int index) const {
+  CHECK_GE(index, 0);
+  return index < counters_.size() ? counters_[index] : 0;
+}
+
+int& NetScheduler::mutable_counter(int index) {
+  CHECK_GE(index, 0);
+  if (index >= counters_.size()) { counters_.resize(index + 1, 0); }
+  return counters_[index];
+}
+
+bool NetScheduler::Forward(const SubnetParameter& schedule) {
+  const int index = schedule.phase_counter_index();
+  if (index < 0) { return schedule.forward_mode() != 3; }
+  int& count = mutable_counter(index);
+  bool run = true;
+  switch (schedule.forward_mode()) {
+  case 1: run = (count == 0); break;
+  case 2: run = (count != 0); break;
+  case 3: run = false; break;
+  default: break;
+  }
+  if (schedule.increment_on_forward() && schedule.phase_counter_reset() > 0) {
+    ++count;
+  }
+  return run;
+}
+
+bool NetScheduler::Backward(const SubnetParameter& schedule,
+    bool* zero_param_diffs) {
+  *zero_param_diffs = false;
+  const int index = schedule.phase_counter_index();
+  if (index < 0) { return schedule.backward_mode() != 3; }
+  int& count = mutable_counter(index);
+  bool run = true;
+  switch (schedule.backward_mode()) {
+  case 1: run = (count == 0); break;
+  case 2: run = (count != 0); break;
+  case 3: run = false; break;
+  default: break;
+  }
+  const int reset = schedule.phase_counter_reset();
+  if (reset > 0) {
+    if (!schedule.increment_on_forward()) { ++count; }
+    if (count > reset) { count = 0; }
+  }
+  if (run) {
+    *zero_param_diffs = (count > 0 && schedule.backward_mode() == 4) ||
+                        (count == 0 && schedule.backward_mode() == 5);
+  }
+  return run;
+}
+
+}  // namespace caffe
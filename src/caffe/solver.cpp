@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cstdio>
 
 #include <string>
@@ -45,6 +46,9 @@ void Solver<Dtype>::Init(const SolverParameter& param) {
     << std::endl << param.DebugString();
   param_ = param;
   CHECK_GE(param_.average_loss(), 1) << "average_loss should be non-negative.";
+  CHECK(param_.snapshot_precision() == BlobProto::FULL ||
+        param_.snapshot_format() == SolverParameter_SnapshotFormat_BINARYPROTO)
+      << "snapshot_precision is only supported for BINARYPROTO snapshots.";
   CheckSnapshotWritePermissions();
   if (param_.random_seed() >= 0) {
     Caffe::set_random_seed(param_.random_seed() + Caffe::solver_rank());
@@ -52,6 +56,7 @@ void Solver<Dtype>::Init(const SolverParameter& param) {
   // Scaffolding code
   InitTrainNet();
   InitTestNets();
+  InitParamGroups();
   if (Caffe::root_solver()) {
     LOG(INFO) << "Solver scaffolding done.";
   }
@@ -100,6 +105,75 @@ void Solver<Dtype>::InitTrainNet() {
   net_.reset(new Net<Dtype>(net_param));
 }
 
+template <typename Dtype>
+void Solver<Dtype>::InitParamGroups() {
+  const vector<string>& display_names = net_->param_display_names();
+  const vector<int>& learnable_param_ids = net_->learnable_param_ids();
+  for (int i = 0; i < param_.param_group_size(); ++i) {
+    const ParamGroupParameter& group = param_.param_group(i);
+    CHECK(!group.has_type() || group.type() == "SGD" || group.type() == "Adam")
+        << "Unknown update rule for param_group " << group.name() << ": "
+        << group.type();
+    // Only the SGD and Adam rules read the overrides; refuse them elsewhere
+    // rather than train with settings other than the ones asked for.
+    const string& type = group.has_type() ? group.type() : param_.type();
+    CHECK(!group.has_momentum() || type == "SGD" || type == "Adam")
+        << "param_group " << group.name() << " sets momentum, which the "
+        << type << " update rule does not use";
+    CHECK((!group.has_momentum2() && !group.has_delta()) || type == "Adam")
+        << "param_group " << group.name() << " sets momentum2 or delta, which "
+        << "the " << type << " update rule does not use";
+    CHECK_GE(group.schedule_period(), 0);
+    if (group.schedule_period() > 0) {
+      CHECK(group.schedule_offset() >= 0 &&
+            group.schedule_offset() < group.schedule_period())
+          << "schedule_offset must lie in [0, schedule_period)";
+      CHECK_GT(group.schedule_steps(), 0);
+    }
+  }
+  // Display names are per net param; shared params have no learnable param
+  // of their own and follow their owner.
+  param_group_ids_.assign(net_->learnable_params().size(), -1);
+  for (int i = 0; i < display_names.size(); ++i) {
+    if (net_->param_owners()[i] >= 0) { continue; }
+    for (int g = 0; g < param_.param_group_size(); ++g) {
+      const ParamGroupParameter& group = param_.param_group(g);
+      bool match = false;
+      for (int j = 0; j < group.param_prefix_size(); ++j) {
+        match |= display_names[i].compare(0, group.param_prefix(j).size(),
+                                          group.param_prefix(j)) == 0;
+      }
+      if (!match) { continue; }
+      param_group_ids_[learnable_param_ids[i]] = g;
+      LOG_IF(INFO, Caffe::root_solver()) << "Param " << display_names[i]
+          << " is in param_group " << group.name();
+      break;
+    }
+  }
+}
+
+template <typename Dtype>
+bool Solver<Dtype>::ParamGroupActive(int group, int iter) const {
+  if (group < 0) { return true; }
+  const ParamGroupParameter& param_group = param_.param_group(group);
+  const int period = param_group.schedule_period();
+  if (period == 0) { return true; }
+  const int phase = iter % period - param_group.schedule_offset();
+  return phase >= 0 && phase < param_group.schedule_steps();
+}
+
+template <typename Dtype>
+int Solver<Dtype>::ParamGroupSteps(int group, int iter) const {
+  if (group < 0) { return iter + 1; }
+  const ParamGroupParameter& param_group = param_.param_group(group);
+  const int period = param_group.schedule_period();
+  if (period == 0) { return iter + 1; }
+  const int steps = std::min(param_group.schedule_steps(),
+                             period - param_group.schedule_offset());
+  const int partial = (iter + 1) % period - param_group.schedule_offset();
+  return (iter + 1) / period * steps + std::max(0, std::min(partial, steps));
+}
+
 template <typename Dtype>
 void Solver<Dtype>::InitTestNets() {
   const bool has_net_param = param_.has_net_param();
@@ -188,6 +262,7 @@ void Solver<Dtype>::Step(int iters) {
   while (iter_ < stop_iter) {
     // zero-init the params
     net_->ClearParamDiffs();
+    net_->scheduler()->set_iteration(iter_);
     if (param_.test_interval() && iter_ % param_.test_interval() == 0
         && (iter_ > 0 || param_.test_initialization())) {
       if (Caffe::root_solver()) {
@@ -446,7 +521,8 @@ string Solver<Dtype>::SnapshotToBinaryProto() {
   string model_filename = SnapshotFilename(".caffemodel");
   LOG(INFO) << "Snapshotting to binary proto file " << model_filename;
   NetParameter net_param;
-  net_->ToProto(&net_param, param_.snapshot_diff());
+  net_->ToProto(&net_param, param_.snapshot_diff(),
+                param_.snapshot_precision());
   WriteProtoToBinaryFile(net_param, model_filename);
   return model_filename;
 }
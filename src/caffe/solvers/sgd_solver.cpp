@@ -75,6 +75,27 @@ void SGDSolver<Dtype>::PreSolve() {
     update_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>(shape)));
     temp_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>(shape)));
   }
+  if (NeedsAdamHistory()) {
+    for (int i = 0; i < net_params.size(); ++i) {
+      const vector<int>& shape = net_params[i]->shape();
+      history_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>(shape)));
+    }
+  }
+}
+
+template <typename Dtype>
+bool SGDSolver<Dtype>::NeedsAdamHistory() const {
+  bool any_typed = false, any_adam = false;
+  for (int i = 0; i < this->param_.param_group_size(); ++i) {
+    const ParamGroupParameter& group = this->param_.param_group(i);
+    any_typed |= group.has_type();
+    any_adam |= group.type() == "Adam";
+  }
+  // Other solvers keep their own extra history in the same place.
+  CHECK(!any_typed || this->param_.type() == "SGD" ||
+        this->param_.type() == "Adam")
+      << "param_group type can only be set with the SGD or Adam solvers";
+  return any_adam && this->param_.type() != "Adam";
 }
 
 template <typename Dtype>
@@ -105,12 +126,55 @@ void SGDSolver<Dtype>::ApplyUpdate() {
     LOG_IF(INFO, Caffe::root_solver()) << "Iteration " << this->iter_
         << ", lr = " << rate;
   }
+  // Parameters whose group is not scheduled this iteration get a zero diff,
+  // so that Net::Update leaves them (and their history) as they are.
+  const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+  vector<bool> active(net_params.size());
+  for (int param_id = 0; param_id < net_params.size(); ++param_id) {
+    active[param_id] = this->ParamGroupActive(
+        this->param_group_ids_[param_id], this->iter_);
+    if (active[param_id]) { continue; }
+    switch (Caffe::mode()) {
+    case Caffe::CPU:
+      caffe_set(net_params[param_id]->count(), Dtype(0),
+          net_params[param_id]->mutable_cpu_diff());
+      break;
+    case Caffe::GPU:
+#ifndef CPU_ONLY
+      caffe_gpu_set(net_params[param_id]->count(), Dtype(0),
+          net_params[param_id]->mutable_gpu_diff());
+#else
+      NO_GPU;
+#endif
+      break;
+    default:
+      LOG(FATAL) << "Unknown caffe mode: " << Caffe::mode();
+    }
+  }
   ClipGradients();
-  for (int param_id = 0; param_id < this->net_->learnable_params().size();
-       ++param_id) {
+  for (int param_id = 0; param_id < net_params.size(); ++param_id) {
+    if (!active[param_id]) { continue; }
     Normalize(param_id);
     Regularize(param_id);
-    ComputeUpdateValue(param_id, rate);
+    const int group_id = this->param_group_ids_[param_id];
+    if (group_id < 0) {
+      ComputeUpdateValue(param_id, rate);
+      continue;
+    }
+    const ParamGroupParameter& group = this->param_.param_group(group_id);
+    const string& type = group.has_type() ? group.type() : this->param_.type();
+    const Dtype momentum = group.has_momentum() ?
+        group.momentum() : this->param_.momentum();
+    if (type == "SGD") {
+      SGDUpdateValue(param_id, rate * group.lr_mult(), momentum);
+    } else if (type == "Adam") {
+      AdamUpdateValue(param_id, rate * group.lr_mult(), momentum,
+          group.has_momentum2() ? group.momentum2() : this->param_.momentum2(),
+          group.has_delta() ? group.delta() : this->param_.delta(),
+          this->ParamGroupSteps(group_id, this->iter_));
+    } else {
+      ComputeUpdateValue(param_id, rate * group.lr_mult());
+    }
   }
   this->net_->Update();
 }
@@ -149,6 +213,10 @@ void SGDSolver<Dtype>::Regularize(int param_id) {
   Dtype weight_decay = this->param_.weight_decay();
   string regularization_type = this->param_.regularization_type();
   Dtype local_decay = weight_decay * net_params_weight_decay[param_id];
+  if (this->param_group_ids_[param_id] >= 0) {
+    local_decay *=
+        this->param_.param_group(this->param_group_ids_[param_id]).decay_mult();
+  }
   switch (Caffe::mode()) {
   case Caffe::CPU: {
     if (local_decay) {
@@ -207,13 +275,21 @@ void SGDSolver<Dtype>::Regularize(int param_id) {
 template <typename Dtype>
 void sgd_update_gpu(int N, Dtype* g, Dtype* h, Dtype momentum,
     Dtype local_rate);
+template <typename Dtype>
+void adam_update_gpu(int N, Dtype* g, Dtype* m, Dtype* v, Dtype beta1,
+    Dtype beta2, Dtype eps_hat, Dtype corrected_local_rate);
 #endif
 
 template <typename Dtype>
 void SGDSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
+  SGDUpdateValue(param_id, rate, this->param_.momentum());
+}
+
+template <typename Dtype>
+void SGDSolver<Dtype>::SGDUpdateValue(int param_id, Dtype rate,
+    Dtype momentum) {
   const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
   const vector<float>& net_params_lr = this->net_->params_lr();
-  Dtype momentum = this->param_.momentum();
   Dtype local_rate = rate * net_params_lr[param_id];
   // Compute the update to history, then copy it to the parameter diff.
   switch (Caffe::mode()) {
@@ -242,6 +318,69 @@ void SGDSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void SGDSolver<Dtype>::AdamUpdateValue(int param_id, Dtype rate, Dtype beta1,
+    Dtype beta2, Dtype eps_hat, int t) {
+  const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+  const vector<float>& net_params_lr = this->net_->params_lr();
+  Dtype local_rate = rate * net_params_lr[param_id];
+
+  // we create aliases for convenience
+  size_t update_history_offset = net_params.size();
+  Blob<Dtype>* val_m = history_[param_id].get();
+  Blob<Dtype>* val_v = history_[param_id + update_history_offset].get();
+  Blob<Dtype>* val_t = temp_[param_id].get();
+
+  const Dtype correction = std::sqrt(Dtype(1) - pow(beta2, t)) /
+      (Dtype(1.) - pow(beta1, t));
+  const int N = net_params[param_id]->count();
+
+  switch (Caffe::mode()) {
+    case Caffe::CPU: {
+    // update m <- \beta_1 m_{t-1} + (1-\beta_1)g_t
+    caffe_cpu_axpby(N, Dtype(1)-beta1,
+        net_params[param_id]->cpu_diff(), beta1,
+        val_m->mutable_cpu_data());
+
+    // update v <- \beta_2 m_{t-1} + (1-\beta_2)g_t^2
+    caffe_mul(N,
+        net_params[param_id]->cpu_diff(),
+        net_params[param_id]->cpu_diff(),
+    val_t->mutable_cpu_data());
+    caffe_cpu_axpby(N, Dtype(1)-beta2,
+        val_t->cpu_data(), beta2,
+        val_v->mutable_cpu_data());
+
+    // set update
+    caffe_powx(N,
+        val_v->cpu_data(), Dtype(0.5),
+        val_t->mutable_cpu_data());
+    caffe_add_scalar(N, eps_hat, val_t->mutable_cpu_data());
+    caffe_div(N,
+        val_m->cpu_data(),
+        val_t->cpu_data(),
+        val_t->mutable_cpu_data());
+
+    caffe_cpu_scale(N, local_rate*correction,
+        val_t->cpu_data(),
+        net_params[param_id]->mutable_cpu_diff());
+    break;
+  }
+  case Caffe::GPU: {
+#ifndef CPU_ONLY
+    adam_update_gpu(N, net_params[param_id]->mutable_gpu_diff(),
+        val_m->mutable_gpu_data(), val_v->mutable_gpu_data(), beta1, beta2,
+        eps_hat, local_rate*correction);
+#else
+    NO_GPU;
+#endif
+    break;
+  }
+  default:
+    LOG(FATAL) << "Unknown caffe mode: " << Caffe::mode();
+  }
+}
+
 template <typename Dtype>
 void SGDSolver<Dtype>::SnapshotSolverState(const string& model_filename) {
   switch (this->param_.snapshot_format()) {
@@ -5,7 +5,8 @@
 namespace caffe {
 SyncedMemory::SyncedMemory()
   : cpu_ptr_(NULL), gpu_ptr_(NULL), size_(0), head_(UNINITIALIZED),
-    own_cpu_data_(false), cpu_malloc_use_cuda_(false), own_gpu_data_(false) {
+    own_cpu_data_(false), cpu_malloc_use_cuda_(false), own_gpu_data_(false),
+    dirty_(false), version_(0) {
 #ifndef CPU_ONLY
 #ifdef DEBUG
   CUDA_CHECK(cudaGetDevice(&device_));
@@ -15,7 +16,8 @@ SyncedMemory::SyncedMemory()
 
 SyncedMemory::SyncedMemory(size_t size)
   : cpu_ptr_(NULL), gpu_ptr_(NULL), size_(size), head_(UNINITIALIZED),
-    own_cpu_data_(false), cpu_malloc_use_cuda_(false), own_gpu_data_(false) {
+    own_cpu_data_(false), cpu_malloc_use_cuda_(false), own_gpu_data_(false),
+    dirty_(false), version_(0) {
 #ifndef CPU_ONLY
 #ifdef DEBUG
   CUDA_CHECK(cudaGetDevice(&device_));
@@ -26,7 +28,7 @@ SyncedMemory::SyncedMemory(size_t size)
 SyncedMemory::~SyncedMemory() {
   check_device();
   if (cpu_ptr_ && own_cpu_data_) {
-    CaffeFreeHost(cpu_ptr_, cpu_malloc_use_cuda_);
+    free_host();
   }
 
 #ifndef CPU_ONLY
@@ -36,11 +38,35 @@ SyncedMemory::~SyncedMemory() {
 #endif  // CPU_ONLY
 }
 
+void SyncedMemory::malloc_host() {
+#ifndef CPU_ONLY
+  if (Caffe::mode() == Caffe::GPU) {
+    CUDA_CHECK(cudaMallocHost(&cpu_ptr_, size_));
+    cpu_malloc_use_cuda_ = true;
+    return;
+  }
+#endif
+  cpu_allocator_ = host_allocator();
+  cpu_ptr_ = cpu_allocator_->Allocate(size_);
+  cpu_malloc_use_cuda_ = false;
+}
+
+void SyncedMemory::free_host() {
+#ifndef CPU_ONLY
+  if (cpu_malloc_use_cuda_) {
+    CUDA_CHECK(cudaFreeHost(cpu_ptr_));
+    return;
+  }
+#endif
+  cpu_allocator_->Free(cpu_ptr_, size_);
+  cpu_allocator_.reset();
+}
+
 inline void SyncedMemory::to_cpu() {
   check_device();
   switch (head_) {
   case UNINITIALIZED:
-    CaffeMallocHost(&cpu_ptr_, size_, &cpu_malloc_use_cuda_);
+    malloc_host();
     caffe_memset(size_, 0, cpu_ptr_);
     head_ = HEAD_AT_CPU;
     own_cpu_data_ = true;
@@ -48,7 +74,7 @@ inline void SyncedMemory::to_cpu() {
   case HEAD_AT_GPU:
 #ifndef CPU_ONLY
     if (cpu_ptr_ == NULL) {
-      CaffeMallocHost(&cpu_ptr_, size_, &cpu_malloc_use_cuda_);
+      malloc_host();
       own_cpu_data_ = true;
     }
     caffe_gpu_memcpy(size_, gpu_ptr_, cpu_ptr_);
@@ -97,14 +123,21 @@ const void* SyncedMemory::cpu_data() {
 }
 
 void SyncedMemory::set_cpu_data(void* data) {
+  set_cpu_data(data, shared_ptr<void>());
+}
+
+void SyncedMemory::set_cpu_data(void* data, const shared_ptr<void>& owner) {
   check_device();
   CHECK(data);
   if (own_cpu_data_) {
-    CaffeFreeHost(cpu_ptr_, cpu_malloc_use_cuda_);
+    free_host();
   }
   cpu_ptr_ = data;
+  cpu_owner_ = owner;
   head_ = HEAD_AT_CPU;
   own_cpu_data_ = false;
+  dirty_ = true;
+  ++version_;
 }
 
 const void* SyncedMemory::gpu_data() {
@@ -119,6 +152,10 @@ const void* SyncedMemory::gpu_data() {
 }
 
 void SyncedMemory::set_gpu_data(void* data) {
+  set_gpu_data(data, shared_ptr<void>());
+}
+
+void SyncedMemory::set_gpu_data(void* data, const shared_ptr<void>& owner) {
   check_device();
 #ifndef CPU_ONLY
   CHECK(data);
@@ -126,8 +163,11 @@ void SyncedMemory::set_gpu_data(void* data) {
     CUDA_CHECK(cudaFree(gpu_ptr_));
   }
   gpu_ptr_ = data;
+  gpu_owner_ = owner;
   head_ = HEAD_AT_GPU;
   own_gpu_data_ = false;
+  dirty_ = true;
+  ++version_;
 #else
   NO_GPU;
 #endif
@@ -137,6 +177,8 @@ void* SyncedMemory::mutable_cpu_data() {
   check_device();
   to_cpu();
   head_ = HEAD_AT_CPU;
+  dirty_ = true;
+  ++version_;
   return cpu_ptr_;
 }
 
@@ -145,6 +187,8 @@ void* SyncedMemory::mutable_gpu_data() {
 #ifndef CPU_ONLY
   to_gpu();
   head_ = HEAD_AT_GPU;
+  dirty_ = true;
+  ++version_;
   return gpu_ptr_;
 #else
   NO_GPU;
@@ -0,0 +1,192 @@
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/adversarial_subnet_pair_layer.hpp"
+#include "caffe/util/io.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class AdversarialSubnetPairLayerTest : public CPUDeviceTest<Dtype> {
+ protected:
+  AdversarialSubnetPairLayerTest()
+      : blob_bottom_z_(new Blob<Dtype>(6, 3, 1, 1)),
+        blob_bottom_real_(new Blob<Dtype>(6, 4, 1, 1)) {}
+  virtual void SetUp() {
+    Caffe::set_random_seed(1701);
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_z_);
+    filler.Fill(this->blob_bottom_real_);
+    blob_bottom_vec_.push_back(blob_bottom_z_);
+    blob_bottom_vec_.push_back(blob_bottom_real_);
+    // A generator that maps z to a batch like the real one, and a
+    // discriminator that scores a batch against is_real_data.
+    generator_ = WriteSubnet(
+        "name: 'generator' "
+        "layer { name: 'input' type: 'Input' top: 'z' } "
+        "layer { name: 'gen' type: 'InnerProduct' bottom: 'z' top: 'gen' "
+        "  inner_product_param { num_output: 4 "
+        "    weight_filler { type: 'gaussian' std: 0.5 } } } ");
+    discriminator_ = WriteSubnet(DiscriminatorProto(""));
+  }
+  virtual ~AdversarialSubnetPairLayerTest() {
+    for (int i = 0; i < filenames_.size(); ++i) {
+      remove(filenames_[i].c_str());
+    }
+    delete blob_bottom_z_;
+    delete blob_bottom_real_;
+  }
+
+  string WriteSubnet(const string& proto) {
+    NetParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+    string filename;
+    MakeTempFilename(&filename);
+    WriteProtoToTextFile(param, filename);
+    filenames_.push_back(filename);
+    return filename;
+  }
+
+  // The discriminator, with extra_layers spliced in ahead of its classifier.
+  static string DiscriminatorProto(const string& extra_layers) {
+    return "name: 'discriminator' "
+        "layer { name: 'input' type: 'Input' top: 'gen' "
+        "  top: 'adv_is_real_data' } " + extra_layers +
+        "layer { name: 'score' type: 'InnerProduct' bottom: 'gen' "
+        "  top: 'score' inner_product_param { num_output: 2 "
+        "    weight_filler { type: 'gaussian' std: 0.5 } } } "
+        "layer { name: 'loss' type: 'SoftmaxWithLoss' bottom: 'score' "
+        "  bottom: 'adv_is_real_data' top: 'loss' "
+        "  propagate_down: true propagate_down: false } ";
+  }
+
+  LayerParameter AdversarialParam(bool async, bool prefetch_generated) {
+    LayerParameter layer_param;
+    layer_param.set_name("adv");
+    layer_param.set_phase(TRAIN);
+    layer_param.add_bottom("z");
+    layer_param.add_bottom("real");
+    layer_param.add_top("gen");
+    layer_param.add_top("gen_score");
+    layer_param.add_top("real_score");
+    layer_param.add_loss_weight(0);
+    layer_param.add_loss_weight(1);
+    layer_param.add_loss_weight(1);
+    AdversarialPairParameter* adversarial_param =
+        layer_param.mutable_adversarial_pair_param();
+    adversarial_param->set_subnet1_prototxt(generator_);
+    adversarial_param->set_subnet2_prototxt(discriminator_);
+    adversarial_param->set_do_data_concat(true);
+    adversarial_param->set_subnet2_k(2);
+    adversarial_param->set_async(async);
+    adversarial_param->set_prefetch_generated(prefetch_generated);
+    return layer_param;
+  }
+
+  // Runs passes of the synchronous layer and of one with the given options
+  // side by side, from the same weights, and checks that every pass (both
+  // generator and discriminator steps) has the same outputs and gradients.
+  void TestMatchesSynchronous(bool prefetch_generated) {
+    vector<Blob<Dtype>*> sync_top, async_top;
+    vector<shared_ptr<Blob<Dtype> > > holder;
+    for (int i = 0; i < 6; ++i) {
+      holder.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+      (i < 3 ? sync_top : async_top).push_back(holder.back().get());
+    }
+    AdversarialSubnetPairLayer<Dtype> sync_layer(
+        AdversarialParam(false, false));
+    sync_layer.SetUp(blob_bottom_vec_, sync_top);
+    AdversarialSubnetPairLayer<Dtype> async_layer(
+        AdversarialParam(true, prefetch_generated));
+    async_layer.SetUp(blob_bottom_vec_, async_top);
+    ASSERT_EQ(async_layer.blobs().size(), sync_layer.blobs().size());
+    for (int i = 0; i < sync_layer.blobs().size(); ++i) {
+      async_layer.blobs()[i]->CopyFrom(*sync_layer.blobs()[i]);
+    }
+    const vector<bool> propagate_down(2, false);
+    // with subnet2_k 2: generator steps at passes 0, 1, 3, 4
+    vector<Dtype> gradient_norm(2, 0);
+    for (int pass = 0; pass < 6; ++pass) {
+      for (int i = 0; i < sync_layer.blobs().size(); ++i) {
+        sync_layer.blobs()[i]->scale_diff(0);
+        async_layer.blobs()[i]->scale_diff(0);
+      }
+      sync_layer.Forward(blob_bottom_vec_, sync_top);
+      sync_layer.Backward(sync_top, propagate_down, blob_bottom_vec_);
+      async_layer.Forward(blob_bottom_vec_, async_top);
+      async_layer.Backward(async_top, propagate_down, blob_bottom_vec_);
+      for (int i = 0; i < sync_top.size(); ++i) {
+        for (int j = 0; j < sync_top[i]->count(); ++j) {
+          EXPECT_NEAR(async_top[i]->cpu_data()[j], sync_top[i]->cpu_data()[j],
+                      1e-5) << "pass " << pass << ", top " << i;
+        }
+      }
+      for (int i = 0; i < sync_layer.blobs().size(); ++i) {
+        const Blob<Dtype>& expected = *sync_layer.blobs()[i];
+        for (int j = 0; j < expected.count(); ++j) {
+          EXPECT_NEAR(async_layer.blobs()[i]->cpu_diff()[j],
+                      expected.cpu_diff()[j], 1e-5)
+              << "pass " << pass << ", param " << i;
+        }
+        const bool generator =
+            sync_layer.blob_names()[i].find("::subnet1::") != string::npos;
+        gradient_norm[generator ? 0 : 1] += expected.asum_diff();
+      }
+    }
+    // (so that the comparison is not between gradients that are all zero)
+    EXPECT_GT(gradient_norm[0], 0);
+    EXPECT_GT(gradient_norm[1], 0);
+  }
+
+  Blob<Dtype>* const blob_bottom_z_;
+  Blob<Dtype>* const blob_bottom_real_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  string generator_, discriminator_;
+  vector<string> filenames_;
+};
+
+TYPED_TEST_CASE(AdversarialSubnetPairLayerTest, TestDtypes);
+
+TYPED_TEST(AdversarialSubnetPairLayerTest, TestAsync) {
+  this->TestMatchesSynchronous(false);
+}
+
+TYPED_TEST(AdversarialSubnetPairLayerTest, TestPrefetchGenerated) {
+  // The generator does not change between the passes here, so the kept
+  // batch is the one the synchronous layer samples again.
+  this->TestMatchesSynchronous(true);
+}
+
+TYPED_TEST(AdversarialSubnetPairLayerTest, TestAsyncRefusesPhaseCounters) {
+  typedef TypeParam Dtype;
+  const string counted = this->WriteSubnet(
+      "name: 'counted' "
+      "layer { name: 'input' type: 'Input' top: 'copy' } "
+      "layer { name: 'relu' type: 'ReLU' bottom: 'copy' top: 'out' } ");
+  this->discriminator_ = this->WriteSubnet(this->DiscriminatorProto(
+      "layer { name: 'copy' type: 'Split' bottom: 'gen' top: 'copy' } "
+      "layer { name: 'counted' type: 'Subnet' bottom: 'copy' top: 'out' "
+      "  subnet_param { prototxt_filename: '" + counted + "' "
+      "    phase_counter_index: 0 phase_counter_reset: 1 } } "));
+  vector<Blob<Dtype>*> top;
+  vector<shared_ptr<Blob<Dtype> > > holder;
+  for (int i = 0; i < 3; ++i) {
+    holder.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+    top.push_back(holder.back().get());
+  }
+  AdversarialSubnetPairLayer<Dtype> layer(this->AdversarialParam(true, false));
+  EXPECT_DEATH(layer.SetUp(this->blob_bottom_vec_, top),
+               "async is not supported when subnet2 uses phase counters");
+}
+
+}  // namespace caffe
@@ -0,0 +1,75 @@
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/layers/bernoulli_sample_layer.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class BernoulliSampleLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  BernoulliSampleLayerTest()
+      : blob_bottom_(new Blob<Dtype>(4000, 5, 1, 1)),
+        blob_top_(new Blob<Dtype>()) {}
+  virtual void SetUp() {
+    Caffe::set_random_seed(1701);
+    // every item has the same probabilities, so that each column of the
+    // top is a set of independent draws from one distribution
+    Dtype* p = blob_bottom_->mutable_cpu_data();
+    for (int i = 0; i < blob_bottom_->count(); ++i) {
+      p[i] = kProbabilities[i % blob_bottom_->channels()];
+    }
+    blob_bottom_vec_.push_back(blob_bottom_);
+    blob_top_vec_.push_back(blob_top_);
+  }
+  virtual ~BernoulliSampleLayerTest() {
+    delete blob_bottom_;
+    delete blob_top_;
+  }
+
+  static const Dtype kProbabilities[5];
+  Blob<Dtype>* const blob_bottom_;
+  Blob<Dtype>* const blob_top_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+template <typename TypeParam>
+const typename TypeParam::Dtype
+BernoulliSampleLayerTest<TypeParam>::kProbabilities[5] =
+    {0, 0.1, 0.5, 0.8, 1};
+
+TYPED_TEST_CASE(BernoulliSampleLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(BernoulliSampleLayerTest, TestForwardMean) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  BernoulliSampleLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const int num = this->blob_top_->num();
+  const int channels = this->blob_top_->channels();
+  const Dtype* sample = this->blob_top_->cpu_data();
+  for (int c = 0; c < channels; ++c) {
+    const double p = this->kProbabilities[c];
+    double sum = 0;
+    for (int n = 0; n < num; ++n) {
+      const Dtype x = sample[n * channels + c];
+      ASSERT_TRUE(x == 0 || x == 1);
+      sum += x;
+    }
+    // a draw is 1 with probability p; allow 5 standard errors
+    EXPECT_NEAR(sum / num, p, 5 * sqrt(p * (1 - p) / num) + 1e-12)
+        << "p = " << p;
+  }
+}
+
+}  // namespace caffe
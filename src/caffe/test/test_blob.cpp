@@ -1,3 +1,4 @@
+#include <cmath>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -112,6 +113,193 @@ TYPED_TEST(BlobSimpleTest, TestLegacyBlobProtoShapeEquals) {
   EXPECT_FALSE(this->blob_->ShapeEquals(blob_proto));
 }
 
+// Counts the buffers it frees.
+struct CountingDeleter {
+  explicit CountingDeleter(int* count) : count_(count) {}
+  void operator()(void* ptr) { delete[] static_cast<char*>(ptr); ++*count_; }
+  int* count_;
+};
+
+TYPED_TEST(BlobSimpleTest, TestExternalData) {
+  typedef TypeParam Dtype;
+  int freed = 0;
+  Dtype* buffer = new Dtype[6];
+  for (int i = 0; i < 6; ++i) { buffer[i] = i; }
+  vector<int> shape(2);
+  shape[0] = 2;
+  shape[1] = 3;
+  {
+    Blob<Dtype> sharer;
+    this->blob_->set_cpu_data(buffer, shape, shared_ptr<void>(
+        reinterpret_cast<char*>(buffer), CountingDeleter(&freed)));
+    EXPECT_EQ(this->blob_->shape(), shape);
+    // The Blob uses the buffer itself...
+    EXPECT_EQ(this->blob_->cpu_data(), buffer);
+    EXPECT_EQ(this->blob_->data_at(1, 2, 0, 0), 5);
+    sharer.ReshapeLike(*this->blob_);
+    sharer.ShareData(*this->blob_);
+    // ...and it stays alive while any Blob uses it.
+    this->blob_->Reshape(4, 3, 1, 1);
+    EXPECT_NE(this->blob_->cpu_data(), buffer);
+    EXPECT_EQ(freed, 0);
+    EXPECT_EQ(sharer.cpu_data(), buffer);
+  }
+  EXPECT_EQ(freed, 1);
+}
+
+TYPED_TEST(BlobSimpleTest, TestExternalDataReuse) {
+  typedef TypeParam Dtype;
+  int freed = 0;
+  Dtype* buffers[] = {new Dtype[6], new Dtype[6], new Dtype[6]};
+  vector<int> shape(2);
+  shape[0] = 2;
+  shape[1] = 3;
+  this->blob_->set_cpu_data(buffers[0], shape, shared_ptr<void>(
+      reinterpret_cast<char*>(buffers[0]), CountingDeleter(&freed)));
+  const SyncedMemory* memory = this->blob_->data().get();
+  // The next batch of the same size only swaps the pointer and the owner.
+  this->blob_->set_cpu_data(buffers[1], shape, shared_ptr<void>(
+      reinterpret_cast<char*>(buffers[1]), CountingDeleter(&freed)));
+  EXPECT_EQ(this->blob_->data().get(), memory);
+  EXPECT_EQ(this->blob_->cpu_data(), buffers[1]);
+  EXPECT_EQ(freed, 1);
+  // Memory shared with another Blob is left to it.
+  Blob<Dtype> sharer;
+  sharer.ReshapeLike(*this->blob_);
+  sharer.ShareData(*this->blob_);
+  this->blob_->set_cpu_data(buffers[2], shape, shared_ptr<void>(
+      reinterpret_cast<char*>(buffers[2]), CountingDeleter(&freed)));
+  EXPECT_NE(this->blob_->data().get(), memory);
+  EXPECT_EQ(this->blob_->cpu_data(), buffers[2]);
+  EXPECT_EQ(sharer.cpu_data(), buffers[1]);
+  EXPECT_EQ(freed, 1);
+}
+
+#ifndef CPU_ONLY  // GPU test
+
+// Frees the device buffers it is given.
+struct CudaFreeDeleter {
+  void operator()(void* ptr) { CUDA_CHECK(cudaFree(ptr)); }
+};
+
+TYPED_TEST(BlobSimpleTest, TestExternalGpuDataReuse) {
+  typedef TypeParam Dtype;
+  Dtype* buffers[3];
+  for (int i = 0; i < 3; ++i) {
+    CUDA_CHECK(cudaMalloc(&buffers[i], 6 * sizeof(Dtype)));
+  }
+  vector<int> shape(2);
+  shape[0] = 2;
+  shape[1] = 3;
+  this->blob_->set_gpu_data(buffers[0], shape,
+      shared_ptr<void>(buffers[0], CudaFreeDeleter()));
+  const SyncedMemory* memory = this->blob_->data().get();
+  // The next batch of the same size only swaps the pointer and the owner.
+  this->blob_->set_gpu_data(buffers[1], shape,
+      shared_ptr<void>(buffers[1], CudaFreeDeleter()));
+  EXPECT_EQ(this->blob_->data().get(), memory);
+  EXPECT_EQ(this->blob_->gpu_data(), buffers[1]);
+  // Memory shared with another Blob is left to it.
+  Blob<Dtype> sharer;
+  sharer.ReshapeLike(*this->blob_);
+  sharer.ShareData(*this->blob_);
+  this->blob_->set_gpu_data(buffers[2], shape,
+      shared_ptr<void>(buffers[2], CudaFreeDeleter()));
+  EXPECT_NE(this->blob_->data().get(), memory);
+  EXPECT_EQ(this->blob_->gpu_data(), buffers[2]);
+  EXPECT_EQ(sharer.gpu_data(), buffers[1]);
+}
+
+#endif  // CPU_ONLY
+
+TYPED_TEST(BlobSimpleTest, TestShareView) {
+  typedef TypeParam Dtype;
+  Blob<Dtype> parent(4, 3, 1, 1);
+  Dtype* parent_data = parent.mutable_cpu_data();
+  for (int i = 0; i < parent.count(); ++i) { parent_data[i] = i; }
+  // Rows 1 and 2 of the parent, as a dense view.
+  vector<int> shape(2);
+  shape[0] = 2;
+  shape[1] = 3;
+  Blob<Dtype> view;
+  view.ShareView(parent, shape, 3);
+  EXPECT_TRUE(view.is_view());
+  EXPECT_TRUE(view.is_contiguous());
+  EXPECT_TRUE(view.SharesDataWith(parent, 3));
+  EXPECT_TRUE(view.SharesDiffWith(parent, 3));
+  EXPECT_EQ(view.cpu_data(), parent.cpu_data() + 3);
+  EXPECT_EQ(view.data_at(1, 2, 0, 0), 8);
+  view.mutable_cpu_diff()[0] = 7;
+  EXPECT_EQ(parent.cpu_diff()[3], 7);
+  // Growing the view gives it memory of its own.
+  view.Reshape(3, 3, 1, 1);
+  EXPECT_FALSE(view.is_view());
+  EXPECT_FALSE(view.SharesDataWith(parent, 3));
+  // So does ReleaseView.
+  view.ShareView(parent, shape, 6);
+  view.ReleaseView();
+  view.mutable_cpu_data()[0] = -1;
+  EXPECT_EQ(parent.cpu_data()[6], 6);
+}
+
+TYPED_TEST(BlobSimpleTest, TestContiguous) {
+  typedef TypeParam Dtype;
+  Blob<Dtype> parent(2, 3, 4, 1);
+  Dtype* parent_data = parent.mutable_cpu_data();
+  for (int i = 0; i < parent.count(); ++i) { parent_data[i] = i; }
+  // Channel 1 of both items: shape (2, 4), strides (12, 1), at offset 4.
+  vector<int> shape(2);
+  shape[0] = 2;
+  shape[1] = 4;
+  vector<int> strides(2);
+  strides[0] = 12;
+  strides[1] = 1;
+  Blob<Dtype> view;
+  view.ShareView(parent, shape, 4, strides);
+  EXPECT_FALSE(view.is_contiguous());
+  EXPECT_EQ(view.stride(0), 12);
+  view.Contiguous();
+  EXPECT_TRUE(view.is_contiguous());
+  EXPECT_FALSE(view.is_view());
+  EXPECT_EQ(view.stride(0), 4);
+  for (int n = 0; n < 2; ++n) {
+    for (int i = 0; i < 4; ++i) {
+      EXPECT_EQ(view.cpu_data()[n * 4 + i], n * 12 + 4 + i);
+    }
+  }
+  // The gathered copy is independent of the parent.
+  view.mutable_cpu_data()[0] = -1;
+  EXPECT_EQ(parent.cpu_data()[4], 4);
+}
+
+TYPED_TEST(BlobSimpleTest, TestHalfProto) {
+  typedef TypeParam Dtype;
+  Blob<Dtype> source(2, 3, 4, 5);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(&source);
+  const BlobProto::Precision precisions[] = {BlobProto::FP16, BlobProto::BF16};
+  for (int p = 0; p < 2; ++p) {
+    BlobProto proto;
+    source.ToProto(&proto, false, precisions[p]);
+    EXPECT_EQ(proto.precision(), precisions[p]);
+    EXPECT_EQ(proto.data_size() + proto.double_data_size(), 0);
+    EXPECT_EQ(proto.half_data().size(), 2 * source.count());
+    Blob<Dtype> target;
+    target.FromProto(proto);
+    EXPECT_TRUE(target.shape() == source.shape());
+    const Dtype tolerance = precisions[p] == BlobProto::FP16 ? 1e-3 : 1e-2;
+    for (int i = 0; i < source.count(); ++i) {
+      EXPECT_NEAR(target.cpu_data()[i], source.cpu_data()[i],
+                  tolerance * (1 + std::fabs(source.cpu_data()[i])));
+    }
+    // Writing full precision again drops the 16-bit fields.
+    target.ToProto(&proto);
+    EXPECT_EQ(proto.precision(), BlobProto::FULL);
+    EXPECT_FALSE(proto.has_half_data());
+  }
+}
+
 template <typename TypeParam>
 class BlobMathTest : public MultiDeviceTest<TypeParam> {
   typedef typename TypeParam::Dtype Dtype;
@@ -298,4 +486,24 @@ TYPED_TEST(BlobMathTest, TestScaleData) {
               this->epsilon_ * expected_diff_asum);
 }
 
+TYPED_TEST(BlobMathTest, TestZeroDiff) {
+  typedef typename TypeParam::Dtype Dtype;
+
+  // A diff nobody has touched is neither allocated nor dirtied.
+  this->blob_->zero_diff();
+  EXPECT_EQ(SyncedMemory::UNINITIALIZED, this->blob_->diff()->head());
+  FillerParameter filler_param;
+  filler_param.set_min(1);
+  filler_param.set_max(3);
+  UniformFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_);
+  caffe_copy(this->blob_->count(), this->blob_->cpu_data(),
+             this->blob_->mutable_cpu_diff());
+  EXPECT_TRUE(this->blob_->diff()->dirty());
+  EXPECT_GT(this->blob_->asum_diff(), 0);
+  this->blob_->zero_diff();
+  EXPECT_FALSE(this->blob_->diff()->dirty());
+  EXPECT_EQ(0, this->blob_->asum_diff());
+}
+
 }  // namespace caffe
@@ -238,6 +238,29 @@ TYPED_TEST(CropLayerTest, TestCrop5D) {
   }
 }
 
+TYPED_TEST(CropLayerTest, TestCropContiguous) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Cut down to one index on the leading axes, the crop is a contiguous run
+  // of the bottom, which the top views instead of copying.
+  this->blob_bottom_1_->Reshape(1, 1, 3, 4);
+  LayerParameter layer_param;
+  layer_param.mutable_crop_param()->set_axis(0);
+  layer_param.mutable_crop_param()->add_offset(1);
+  layer_param.mutable_crop_param()->add_offset(2);
+  layer_param.mutable_crop_param()->add_offset(1);
+  layer_param.mutable_crop_param()->add_offset(0);
+  CropLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_TRUE(this->blob_top_->is_view());
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  for (int h = 0; h < 3; ++h) {
+    for (int w = 0; w < 4; ++w) {
+      EXPECT_EQ(this->blob_top_->data_at(0, 0, h, w),
+          this->blob_bottom_0_->data_at(1, 2, h + 1, w));
+    }
+  }
+}
+
 TYPED_TEST(CropLayerTest, TestCropAllGradient) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
@@ -280,4 +303,19 @@ TYPED_TEST(CropLayerTest, TestCrop5DGradient) {
       this->blob_top_vec_);
 }
 
+TYPED_TEST(CropLayerTest, TestCropContiguousGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->blob_bottom_1_->Reshape(1, 1, 3, 4);
+  LayerParameter layer_param;
+  layer_param.mutable_crop_param()->set_axis(0);
+  layer_param.mutable_crop_param()->add_offset(1);
+  layer_param.mutable_crop_param()->add_offset(2);
+  layer_param.mutable_crop_param()->add_offset(1);
+  layer_param.mutable_crop_param()->add_offset(0);
+  CropLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 0);
+}
+
 }  // namespace caffe
@@ -0,0 +1,127 @@
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/gaussian_sample_layer.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+// Draws the same noise on every forward pass, so that the samples are a
+// deterministic function of mu and sigma and can be checked numerically.
+template <typename Dtype>
+class SeededGaussianSampleLayer : public GaussianSampleLayer<Dtype> {
+ public:
+  explicit SeededGaussianSampleLayer(const LayerParameter& param)
+      : GaussianSampleLayer<Dtype>(param) {}
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+    Caffe::set_random_seed(1701);
+    GaussianSampleLayer<Dtype>::Forward_cpu(bottom, top);
+  }
+  virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+    Caffe::set_random_seed(1701);
+    GaussianSampleLayer<Dtype>::Forward_gpu(bottom, top);
+  }
+};
+
+template <typename TypeParam>
+class GaussianSampleLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  GaussianSampleLayerTest()
+      : blob_bottom_mu_(new Blob<Dtype>(4, 3, 1, 1)),
+        blob_bottom_sigma_(new Blob<Dtype>(4, 3, 1, 1)),
+        blob_top_(new Blob<Dtype>()) {}
+  virtual void SetUp() {
+    Caffe::set_random_seed(1701);
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_mu_);
+    // keep sigma away from the 0.01 floor, where its gradient vanishes
+    filler_param.set_min(0.5);
+    filler_param.set_max(1.5);
+    UniformFiller<Dtype> sigma_filler(filler_param);
+    sigma_filler.Fill(this->blob_bottom_sigma_);
+    blob_bottom_vec_.push_back(blob_bottom_mu_);
+    blob_bottom_vec_.push_back(blob_bottom_sigma_);
+    blob_top_vec_.push_back(blob_top_);
+  }
+  virtual ~GaussianSampleLayerTest() {
+    delete blob_bottom_mu_;
+    delete blob_bottom_sigma_;
+    delete blob_top_;
+  }
+
+  LayerParameter SampleParam(int num_samples) {
+    LayerParameter layer_param;
+    layer_param.mutable_gaussian_mc_param()->set_num_samples(num_samples);
+    return layer_param;
+  }
+
+  Blob<Dtype>* const blob_bottom_mu_;
+  Blob<Dtype>* const blob_bottom_sigma_;
+  Blob<Dtype>* const blob_top_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(GaussianSampleLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(GaussianSampleLayerTest, TestForwardMultipleSamples) {
+  typedef typename TypeParam::Dtype Dtype;
+  const int num_samples = 2000;
+  GaussianSampleLayer<Dtype> layer(this->SampleParam(num_samples));
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  const int count = this->blob_bottom_mu_->count();
+  EXPECT_EQ(this->blob_top_->num(), 4 * num_samples);
+  EXPECT_EQ(this->blob_top_->count(), count * num_samples);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  // Draw iM of entry i is at iM*count+i; standardized, the draws of every
+  // entry should have mean 0 and variance 1.
+  const Dtype* mu = this->blob_bottom_mu_->cpu_data();
+  const Dtype* sigma = this->blob_bottom_sigma_->cpu_data();
+  const Dtype* sample = this->blob_top_->cpu_data();
+  for (int i = 0; i < count; ++i) {
+    double sum = 0, sum_sq = 0;
+    for (int iM = 0; iM < num_samples; ++iM) {
+      const double z = (sample[iM * count + i] - mu[i]) / sigma[i];
+      sum += z;
+      sum_sq += z * z;
+    }
+    const double mean = sum / num_samples;
+    // 5 standard errors of the mean and of the variance
+    EXPECT_NEAR(mean, 0, 5 / sqrt(num_samples));
+    EXPECT_NEAR(sum_sq / num_samples - mean * mean, 1,
+                5 * sqrt(2. / num_samples));
+  }
+}
+
+TYPED_TEST(GaussianSampleLayerTest, TestGradientMultipleSamples) {
+  typedef typename TypeParam::Dtype Dtype;
+  SeededGaussianSampleLayer<Dtype> layer(this->SampleParam(3));
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+TYPED_TEST(GaussianSampleLayerTest, TestGradientMultipleSamplesFixedSigma) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->blob_bottom_vec_.resize(1);
+  SeededGaussianSampleLayer<Dtype> layer(this->SampleParam(3));
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+}  // namespace caffe
@@ -0,0 +1,194 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/glimpse_cropping_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class GlimpseCroppingLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  GlimpseCroppingLayerTest()
+      : blob_bottom_image_(new Blob<Dtype>(2, 3, 12, 11)),
+        blob_bottom_location_(new Blob<Dtype>(4, 2, 1, 1)),
+        blob_top_(new Blob<Dtype>()) {}
+  virtual void SetUp() {
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_image_);
+    // Two locations per image: location i crops from image i % 2.
+    const Dtype locations[] = {0.3, 0.6, 0.9, 0.1, 0, 1, 0.5, 0.45};
+    caffe_copy(8, locations, blob_bottom_location_->mutable_cpu_data());
+    blob_bottom_vec_.push_back(blob_bottom_image_);
+    blob_bottom_vec_.push_back(blob_bottom_location_);
+    blob_top_vec_.push_back(blob_top_);
+  }
+  virtual ~GlimpseCroppingLayerTest() {
+    delete blob_bottom_image_;
+    delete blob_bottom_location_;
+    delete blob_top_;
+  }
+
+  // Checks that Backward is the adjoint of Forward for the image:
+  // <top, Forward(image)> equals <Backward(top), image> for any top diff.
+  void TestAdjoint(float scalefac, int depth) {
+    LayerParameter layer_param;
+    layer_param.mutable_glimpse_cropping_param()->set_window(3);
+    layer_param.mutable_glimpse_cropping_param()->set_depth(depth);
+    layer_param.mutable_glimpse_cropping_param()->set_scalefac(scalefac);
+    GlimpseCroppingLayer<Dtype> layer(layer_param);
+    layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    layer.Forward(blob_bottom_vec_, blob_top_vec_);
+    Blob<Dtype> top_diff(blob_top_->shape());
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(&top_diff);
+    caffe_copy(top_diff.count(), top_diff.cpu_data(),
+               blob_top_->mutable_cpu_diff());
+    vector<bool> propagate_down(2, false);
+    propagate_down[0] = true;
+    layer.Backward(blob_top_vec_, propagate_down, blob_bottom_vec_);
+    const Dtype forward_dot = caffe_cpu_dot(blob_top_->count(),
+        blob_top_->cpu_data(), blob_top_->cpu_diff());
+    const Dtype backward_dot = caffe_cpu_dot(blob_bottom_image_->count(),
+        blob_bottom_image_->cpu_data(), blob_bottom_image_->cpu_diff());
+    EXPECT_NEAR(forward_dot, backward_dot,
+                1e-4 * std::max(Dtype(1), std::fabs(forward_dot)))
+        << "scalefac " << scalefac;
+  }
+
+  Blob<Dtype>* const blob_bottom_image_;
+  Blob<Dtype>* const blob_bottom_location_;
+  Blob<Dtype>* const blob_top_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(GlimpseCroppingLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(GlimpseCroppingLayerTest, TestForward) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_glimpse_cropping_param()->set_window(4);
+  layer_param.mutable_glimpse_cropping_param()->set_depth(2);
+  GlimpseCroppingLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(this->blob_top_->num(), 4);
+  EXPECT_EQ(this->blob_top_->channels(), 6);
+  EXPECT_EQ(this->blob_top_->height(), 4);
+  EXPECT_EQ(this->blob_top_->width(), 4);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const Blob<Dtype>& image = *this->blob_bottom_image_;
+  const Dtype* location = this->blob_bottom_location_->cpu_data();
+  for (int n = 0; n < 4; ++n) {
+    for (int l = 0; l < 2; ++l) {
+      // Level l averages 2^l x 2^l boxes of a 4*2^l pixel square.
+      const int scale = 1 << l;
+      const int x0 = static_cast<int>(location[2 * n] * (12 - 4 * scale));
+      const int y0 = static_cast<int>(location[2 * n + 1] * (11 - 4 * scale));
+      for (int c = 0; c < 3; ++c) {
+        for (int i = 0; i < 4; ++i) {
+          for (int j = 0; j < 4; ++j) {
+            Dtype sum = 0;
+            for (int di = 0; di < scale; ++di) {
+              for (int dj = 0; dj < scale; ++dj) {
+                sum += image.data_at(n % 2, c, x0 + i * scale + di,
+                                     y0 + j * scale + dj);
+              }
+            }
+            EXPECT_NEAR(this->blob_top_->data_at(n, l * 3 + c, i, j),
+                        sum / (scale * scale), 1e-4);
+          }
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(GlimpseCroppingLayerTest, TestGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_glimpse_cropping_param()->set_window(4);
+  GlimpseCroppingLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  // The crop origin is quantized, so only the image has a gradient.
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 0);
+}
+
+TYPED_TEST(GlimpseCroppingLayerTest, TestGradientPyramid) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  // Levels of 3, 4 and 6 pixels: boxes of unequal sizes, and overlapping
+  // glimpses of the same image.
+  layer_param.mutable_glimpse_cropping_param()->set_window(3);
+  layer_param.mutable_glimpse_cropping_param()->set_depth(3);
+  layer_param.mutable_glimpse_cropping_param()->set_scalefac(1.5);
+  GlimpseCroppingLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 0);
+}
+
+TYPED_TEST(GlimpseCroppingLayerTest, TestAdjointScalefac) {
+  // levels of 3 and 6 pixels; of 3, 3 and 5; and of 3, 5 and 8
+  this->TestAdjoint(2, 2);
+  this->TestAdjoint(1.3, 3);
+  this->TestAdjoint(1.5, 3);
+  this->TestAdjoint(1.7, 3);
+}
+
+TYPED_TEST(GlimpseCroppingLayerTest, TestScalefacDefault) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_glimpse_cropping_param()->set_window(3);
+  layer_param.mutable_glimpse_cropping_param()->set_depth(2);
+  GlimpseCroppingLayer<Dtype> default_layer(layer_param);
+  default_layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  default_layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  Blob<Dtype> default_top;
+  default_top.CopyFrom(*this->blob_top_, false, true);
+  layer_param.mutable_glimpse_cropping_param()->set_scalefac(2);
+  GlimpseCroppingLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  for (int i = 0; i < default_top.count(); ++i) {
+    EXPECT_EQ(default_top.cpu_data()[i], this->blob_top_->cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(GlimpseCroppingLayerTest, TestScalefacOne) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_glimpse_cropping_param()->set_window(3);
+  layer_param.mutable_glimpse_cropping_param()->set_depth(2);
+  layer_param.mutable_glimpse_cropping_param()->set_scalefac(1);
+  GlimpseCroppingLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  // Both levels are the same unscaled crop.
+  for (int n = 0; n < 4; ++n) {
+    for (int c = 0; c < 3; ++c) {
+      for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+          EXPECT_EQ(this->blob_top_->data_at(n, c, i, j),
+                    this->blob_top_->data_at(n, 3 + c, i, j));
+        }
+      }
+    }
+  }
+}
+
+}  // namespace caffe
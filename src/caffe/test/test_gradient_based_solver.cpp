@@ -44,6 +44,8 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
   // TODO this is brittle and the hdf5 file should be checked instead.
   int num_, channels_, height_, width_;
   bool share_;
+  // appended to the SolverParameter built by RunLeastSquaresSolver
+  string extra_proto_;
   Dtype delta_;  // Stability constant for RMSProp, AdaGrad, AdaDelta and Adam
 
   // Test data: check out generate_sample_data.py in the same directory.
@@ -179,6 +181,7 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
     if (momentum != 0) {
       proto << "momentum: " << momentum << " ";
     }
+    proto << extra_proto_;
     MakeTempDir(&snapshot_prefix_);
     proto << "snapshot_prefix: '" << snapshot_prefix_ << "/' ";
     if (snapshot) {
@@ -706,6 +709,83 @@ TYPED_TEST(SGDSolverTest, TestSnapshot) {
   }
 }
 
+TYPED_TEST(SGDSolverTest, TestParamGroupSchedule) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  this->RunLeastSquaresSolver(kLearningRate, kWeightDecay, kMomentum, 0);
+  const vector<shared_ptr<Blob<Dtype> > >& initial =
+      this->solver_->net()->layer_by_name("innerprod")->blobs();
+  Blob<Dtype> weights, bias;
+  weights.CopyFrom(*initial[0], false, true);
+  bias.CopyFrom(*initial[1], false, true);
+
+  // Update the bias only on odd iterations, with no weight decay.
+  this->extra_proto_ =
+      "param_group { "
+      "  name: 'bias' "
+      "  param_prefix: 'innerprod_param_1' "
+      "  decay_mult: 0 "
+      "  schedule_period: 2 "
+      "  schedule_offset: 1 "
+      "} ";
+  this->RunLeastSquaresSolver(kLearningRate, kWeightDecay, kMomentum, 1);
+  const vector<shared_ptr<Blob<Dtype> > >& updated =
+      this->solver_->net()->layer_by_name("innerprod")->blobs();
+  bool weights_changed = false;
+  for (int i = 0; i < weights.count(); ++i) {
+    weights_changed |= weights.cpu_data()[i] != updated[0]->cpu_data()[i];
+  }
+  EXPECT_TRUE(weights_changed);
+  EXPECT_EQ(bias.cpu_data()[0], updated[1]->cpu_data()[0]);
+
+  this->RunLeastSquaresSolver(kLearningRate, kWeightDecay, kMomentum, 2);
+  EXPECT_NE(bias.cpu_data()[0],
+      this->solver_->net()->layer_by_name("innerprod")->blobs()[1]
+          ->cpu_data()[0]);
+}
+
+TYPED_TEST(SGDSolverTest, TestParamGroupAdam) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0;
+  const Dtype kMomentum = 0.9;
+  this->RunLeastSquaresSolver(kLearningRate, kWeightDecay, kMomentum, 0);
+  const vector<shared_ptr<Blob<Dtype> > >& initial =
+      this->solver_->net()->layer_by_name("innerprod")->blobs();
+  Blob<Dtype> weights, bias;
+  weights.CopyFrom(*initial[0], false, true);
+  bias.CopyFrom(*initial[1], false, true);
+
+  // An SGD solver with every param in an Adam group, updated on odd
+  // iterations only.  Iteration 1 is the group's first step, and the first
+  // Adam step moves each param by the learning rate (up to delta), whatever
+  // its gradient.  Counting steps from the solver's iteration instead would
+  // shrink it by sqrt(1 + momentum2) / (1 + momentum).
+  this->extra_proto_ =
+      "param_group { "
+      "  name: 'adam' "
+      "  param_prefix: 'innerprod' "
+      "  type: 'Adam' "
+      "  momentum2: 0.999 "
+      "  schedule_period: 2 "
+      "  schedule_offset: 1 "
+      "} ";
+  this->RunLeastSquaresSolver(kLearningRate, kWeightDecay, kMomentum, 2);
+  const vector<shared_ptr<Blob<Dtype> > >& updated =
+      this->solver_->net()->layer_by_name("innerprod")->blobs();
+  EXPECT_EQ(1, this->solver_->ParamGroupSteps(0, 1));
+  for (int i = 0; i < weights.count(); ++i) {
+    EXPECT_NEAR(kLearningRate,
+        fabs(updated[0]->cpu_data()[i] - weights.cpu_data()[i]),
+        kLearningRate * 1e-3);
+  }
+  EXPECT_NEAR(kLearningRate,
+      fabs(updated[1]->cpu_data()[0] - bias.cpu_data()[0]),
+      kLearningRate * 1e-3);
+}
+
 TYPED_TEST(SGDSolverTest, TestSnapshotShare) {
   typedef typename TypeParam::Dtype Dtype;
   const Dtype kLearningRate = 0.01;
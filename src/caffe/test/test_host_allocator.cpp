@@ -0,0 +1,72 @@
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/host_allocator.hpp"
+#include "caffe/syncedmem.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class HostAllocatorTest : public ::testing::Test {
+ protected:
+  HostAllocatorTest() : saved_(host_allocator()) {}
+  virtual ~HostAllocatorTest() { set_host_allocator(saved_); }
+
+  shared_ptr<HostAllocator> saved_;
+};
+
+TEST_F(HostAllocatorTest, TestAlignmentAndCounters) {
+  const string types[] = { "malloc", "pooled" };
+  for (int t = 0; t < 2; ++t) {
+    shared_ptr<HostAllocator> allocator = CreateHostAllocator(types[t]);
+    EXPECT_EQ(allocator->type(), types[t]);
+    void* a = allocator->Allocate(100);
+    void* b = allocator->Allocate(3);
+    EXPECT_EQ(reinterpret_cast<size_t>(a) % kHostAlignment, 0);
+    EXPECT_EQ(reinterpret_cast<size_t>(b) % kHostAlignment, 0);
+    EXPECT_EQ(allocator->allocations(), 2);
+    EXPECT_EQ(allocator->bytes_in_use(), 103);
+    allocator->Free(a, 100);
+    EXPECT_EQ(allocator->bytes_in_use(), 3);
+    EXPECT_EQ(allocator->peak_bytes_in_use(), 103);
+    allocator->ResetPeak();
+    EXPECT_EQ(allocator->peak_bytes_in_use(), 3);
+    allocator->Free(b, 3);
+    EXPECT_EQ(allocator->bytes_in_use(), 0);
+    allocator->ReleaseCached();
+  }
+}
+
+TEST_F(HostAllocatorTest, TestPooledReuse) {
+  shared_ptr<HostAllocator> allocator = CreateHostAllocator("pooled");
+  void* a = allocator->Allocate(1000);
+  allocator->Free(a, 1000);
+  // 1000 and 1001 bytes both round up to the 1024-byte size class.
+  void* b = allocator->Allocate(1001);
+  EXPECT_EQ(a, b);
+  void* c = allocator->Allocate(2000);
+  EXPECT_NE(b, c);
+  allocator->Free(b, 1001);
+  allocator->Free(c, 2000);
+  allocator->ReleaseCached();
+}
+
+TEST_F(HostAllocatorTest, TestSyncedMemory) {
+  shared_ptr<HostAllocator> pooled = CreateHostAllocator("pooled");
+  set_host_allocator(pooled);
+  {
+    SyncedMemory mem(1000);
+    EXPECT_EQ(pooled->bytes_in_use(), 0);
+    EXPECT_TRUE(mem.cpu_data());
+    EXPECT_EQ(pooled->bytes_in_use(), 1000);
+    // Memory goes back where it came from, whatever the current allocator.
+    set_host_allocator(CreateHostAllocator("malloc"));
+  }
+  EXPECT_EQ(pooled->bytes_in_use(), 0);
+  EXPECT_EQ(pooled->allocations(), 1);
+}
+
+}  // namespace caffe
@@ -208,6 +208,95 @@ TYPED_TEST(InnerProductLayerTest, TestForwardTranspose) {
   }
 }
 
+TYPED_TEST(InnerProductLayerTest, TestForwardHalfWeights) {
+  typedef typename TypeParam::Dtype Dtype;
+  // The 16-bit weights are only used by Forward_cpu.
+  if (Caffe::mode() != Caffe::CPU) { return; }
+  this->blob_bottom_vec_.push_back(this->blob_bottom_);
+  LayerParameter layer_param;
+  InnerProductParameter* inner_product_param =
+      layer_param.mutable_inner_product_param();
+  inner_product_param->set_num_output(10);
+  inner_product_param->mutable_weight_filler()->set_type("uniform");
+  inner_product_param->mutable_bias_filler()->set_type("uniform");
+  InnerProductLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  const BlobProto::Precision precisions[] = {BlobProto::FP16, BlobProto::BF16};
+  for (int p = 0; p < 2; ++p) {
+    inner_product_param->set_weight_precision(precisions[p]);
+    InnerProductLayer<Dtype> half_layer(layer_param);
+    Blob<Dtype> half_top;
+    vector<Blob<Dtype>*> half_top_vec(1, &half_top);
+    half_layer.SetUp(this->blob_bottom_vec_, half_top_vec);
+    for (int i = 0; i < 2; ++i) {
+      half_layer.blobs()[i]->CopyFrom(*layer.blobs()[i]);
+    }
+    // Twice, changing the weights in between: the 16-bit copy must follow.
+    for (int pass = 0; pass < 2; ++pass) {
+      layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+      half_layer.Forward(this->blob_bottom_vec_, half_top_vec);
+      ASSERT_EQ(this->blob_top_->count(), half_top.count());
+      for (int i = 0; i < half_top.count(); ++i) {
+        // K = 60 products of values in [0, 1], rounded to 8 or 11 bits
+        EXPECT_NEAR(half_top.cpu_data()[i], this->blob_top_->cpu_data()[i],
+                    precisions[p] == BlobProto::FP16 ? 2e-2 : 1e-1);
+      }
+      caffe_scal<Dtype>(layer.blobs()[0]->count(), Dtype(-0.5),
+                        layer.blobs()[0]->mutable_cpu_data());
+      half_layer.blobs()[0]->CopyFrom(*layer.blobs()[0]);
+    }
+  }
+}
+
+TYPED_TEST(InnerProductLayerTest, TestForwardReleaseFullWeights) {
+  typedef typename TypeParam::Dtype Dtype;
+  if (Caffe::mode() != Caffe::CPU) { return; }
+  this->blob_bottom_vec_.push_back(this->blob_bottom_);
+  LayerParameter layer_param;
+  layer_param.set_phase(TEST);
+  InnerProductParameter* inner_product_param =
+      layer_param.mutable_inner_product_param();
+  inner_product_param->set_num_output(10);
+  inner_product_param->mutable_weight_filler()->set_type("uniform");
+  inner_product_param->mutable_bias_filler()->set_type("uniform");
+  inner_product_param->set_weight_precision(BlobProto::FP16);
+  InnerProductLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  inner_product_param->set_release_full_weights(true);
+  InnerProductLayer<Dtype> release_layer(layer_param);
+  Blob<Dtype> release_top;
+  vector<Blob<Dtype>*> release_top_vec(1, &release_top);
+  release_layer.SetUp(this->blob_bottom_vec_, release_top_vec);
+  for (int i = 0; i < 2; ++i) {
+    release_layer.blobs()[i]->CopyFrom(*layer.blobs()[i]);
+  }
+  // Twice, to use the 16-bit copy once the weights are gone, and again after
+  // ToProto has brought them back.
+  LayerParameter proto;
+  for (int pass = 0; pass < 2; ++pass) {
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    release_layer.Forward(this->blob_bottom_vec_, release_top_vec);
+    EXPECT_EQ(SyncedMemory::UNINITIALIZED,
+              release_layer.blobs()[0]->data()->head());
+    for (int i = 0; i < release_top.count(); ++i) {
+      EXPECT_EQ(this->blob_top_->cpu_data()[i], release_top.cpu_data()[i]);
+    }
+    release_layer.ToProto(&proto);
+    ASSERT_EQ(2, proto.blobs_size());
+    Blob<Dtype> weights;
+    weights.FromProto(proto.blobs(0));
+    // The weights come back rounded to 16 bits.
+    const int count = weights.count();
+    vector<fp16> half(count);
+    caffe_cpu_to_half(count, layer.blobs()[0]->cpu_data(), &half[0]);
+    vector<Dtype> rounded(count);
+    caffe_cpu_from_half(count, &half[0], &rounded[0]);
+    for (int i = 0; i < count; ++i) {
+      EXPECT_EQ(rounded[i], weights.cpu_data()[i]);
+    }
+  }
+}
+
 TYPED_TEST(InnerProductLayerTest, TestForwardNoBatch) {
   typedef typename TypeParam::Dtype Dtype;
   this->blob_bottom_vec_.push_back(this->blob_bottom_nobatch_);
@@ -1,6 +1,7 @@
 #include <stdint.h>  // for uint32_t & uint64_t
 #include <time.h>
 #include <cmath>  // for std::fabs
+#include <vector>
 
 #include "gtest/gtest.h"
 
@@ -119,6 +120,121 @@ TYPED_TEST(CPUMathFunctionsTest, TestCopy) {
   }
 }
 
+TYPED_TEST(CPUMathFunctionsTest, TestHalfRoundTrip) {
+  const int n = this->blob_bottom_->count();
+  const TypeParam* x = this->blob_bottom_->cpu_data();
+  TypeParam* y = this->blob_bottom_->mutable_cpu_diff();
+  vector<fp16> x_fp16(n);
+  caffe_cpu_to_half(n, x, &x_fp16[0]);
+  caffe_cpu_from_half(n, &x_fp16[0], y);
+  for (int i = 0; i < n; ++i) {
+    // 11 significant bits: relative error at most 2^-11
+    EXPECT_NEAR(y[i], x[i], std::fabs(x[i]) / 2048 + 1e-7);
+  }
+  vector<bf16> x_bf16(n);
+  caffe_cpu_to_half(n, x, &x_bf16[0]);
+  caffe_cpu_from_half(n, &x_bf16[0], y);
+  for (int i = 0; i < n; ++i) {
+    // 8 significant bits: relative error at most 2^-8
+    EXPECT_NEAR(y[i], x[i], std::fabs(x[i]) / 256);
+  }
+  // Values that are exact in 16 bits survive unchanged.
+  const TypeParam exact[] = {0, 1, -2, 0.5, 65504, 0.25};
+  vector<fp16> exact_fp16(6);
+  caffe_cpu_to_half(6, exact, &exact_fp16[0]);
+  caffe_cpu_from_half(6, &exact_fp16[0], y);
+  for (int i = 0; i < 6; ++i) {
+    EXPECT_EQ(y[i], exact[i]);
+  }
+}
+
+// Checks C = 1.5 * op(A) * op(B) + 0.5 * C by caffe_cpu_gemm_half, with A
+// (half_A) or B in 16 bits, against a gemm with that operand rounded the
+// same way.
+template <typename Dtype, typename Half>
+void CheckGemmHalf(const CBLAS_TRANSPOSE TransA, const CBLAS_TRANSPOSE TransB,
+    const int M, const int N, const int K, const bool half_A, const Dtype* A,
+    const Dtype* B, const Dtype* C) {
+  const int count = half_A ? M * K : K * N;
+  vector<Half> half(count);
+  caffe_cpu_to_half(count, half_A ? A : B, &half[0]);
+  vector<Dtype> rounded(count);
+  caffe_cpu_from_half(count, &half[0], &rounded[0]);
+  vector<Dtype> C_expected(C, C + M * N);
+  vector<Dtype> C_half(C, C + M * N);
+  caffe_cpu_gemm<Dtype>(TransA, TransB, M, N, K, 1.5,
+      half_A ? &rounded[0] : A, half_A ? B : &rounded[0], 0.5,
+      &C_expected[0]);
+  if (half_A) {
+    caffe_cpu_gemm_half<Dtype>(TransA, TransB, M, N, K, 1.5, &half[0], B,
+        0.5, &C_half[0]);
+  } else {
+    caffe_cpu_gemm_half<Dtype>(TransA, TransB, M, N, K, 1.5, A, &half[0],
+        0.5, &C_half[0]);
+  }
+  for (int i = 0; i < M * N; ++i) {
+    EXPECT_NEAR(C_expected[i], C_half[i],
+                1e-4 * (1 + std::fabs(C_expected[i])));
+  }
+}
+
+TYPED_TEST(CPUMathFunctionsTest, TestGemmHalf) {
+  // C = A * B', with B (N x K) stored in 16 bits; compare against a gemm with
+  // B rounded the same way.
+  const int M = 3;
+  const int N = 37;
+  const int K = 53;
+  const TypeParam* A = this->blob_bottom_->cpu_data();
+  const TypeParam* B = this->blob_top_->cpu_data();
+  vector<fp16> B_fp16(N * K);
+  caffe_cpu_to_half(N * K, B, &B_fp16[0]);
+  vector<TypeParam> B_rounded(N * K);
+  caffe_cpu_from_half(N * K, &B_fp16[0], &B_rounded[0]);
+  vector<TypeParam> C(M * N);
+  vector<TypeParam> C_expected(M * N);
+  caffe_cpu_gemm<TypeParam>(CblasNoTrans, CblasTrans, M, N, K, 1., A,
+      &B_rounded[0], 0., &C_expected[0]);
+  caffe_cpu_gemm_half<TypeParam>(CblasNoTrans, CblasTrans, M, N, K, 1., A,
+      &B_fp16[0], 0., &C[0]);
+  for (int i = 0; i < M * N; ++i) {
+    EXPECT_NEAR(C[i], C_expected[i], 1e-4);
+  }
+  // The same product, B transposed (K x N) and with a 16-bit A instead.
+  vector<bf16> A_bf16(M * K);
+  caffe_cpu_to_half(M * K, A, &A_bf16[0]);
+  vector<TypeParam> A_rounded(M * K);
+  caffe_cpu_from_half(M * K, &A_bf16[0], &A_rounded[0]);
+  caffe_cpu_gemm<TypeParam>(CblasNoTrans, CblasNoTrans, M, N, K, 1.,
+      &A_rounded[0], B, 0., &C_expected[0]);
+  caffe_cpu_gemm_half<TypeParam>(CblasNoTrans, CblasNoTrans, M, N, K, 1.,
+      &A_bf16[0], B, 0., &C[0]);
+  for (int i = 0; i < M * N; ++i) {
+    EXPECT_NEAR(C[i], C_expected[i], 1e-4);
+  }
+}
+
+TYPED_TEST(CPUMathFunctionsTest, TestGemmHalfPanels) {
+  // 300 x 256 16-bit matrices take two panels of kHalfPanelSize elements.
+  const TypeParam* A = this->blob_bottom_->cpu_data();
+  const TypeParam* B = this->blob_top_->cpu_data();
+  const TypeParam* C = this->blob_bottom_->cpu_data() + 300 * 256;
+  // Rows of the 16-bit matrix along K: each panel's product is accumulated
+  // into C, which only the first scales by beta.
+  CheckGemmHalf<TypeParam, fp16>(CblasNoTrans, CblasNoTrans, 3, 256, 300,
+      false, A, B, C);
+  CheckGemmHalf<TypeParam, bf16>(CblasTrans, CblasNoTrans, 3, 256, 300,
+      false, A, B, C);
+  CheckGemmHalf<TypeParam, fp16>(CblasTrans, CblasNoTrans, 256, 3, 300,
+      true, A, B, C);
+  CheckGemmHalf<TypeParam, bf16>(CblasTrans, CblasTrans, 256, 3, 300,
+      true, A, B, C);
+  // Rows along N (M): each panel fills its own columns (rows) of C.
+  CheckGemmHalf<TypeParam, fp16>(CblasNoTrans, CblasTrans, 3, 256, 300,
+      false, A, B, C);
+  CheckGemmHalf<TypeParam, bf16>(CblasNoTrans, CblasNoTrans, 256, 3, 300,
+      true, A, B, C);
+}
+
 #ifndef CPU_ONLY
 
 template <typename Dtype>
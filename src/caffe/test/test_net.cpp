@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <string>
 #include <utility>
 #include <vector>
@@ -839,6 +840,221 @@ class NetTest : public MultiDeviceTest<TypeParam> {
     InitNetFromProtoFileWithState(proto, phase, level, stages);
   }
 
+  // Two independent branches (one with dropout, one with an in-place ReLU)
+  // joined by an Eltwise sum.
+  virtual void InitParallelBranchesNet(const bool parallel_forward) {
+    string proto =
+        "name: 'ParallelBranchesNetwork' "
+        "state { phase: TRAIN } "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'DummyData' "
+        "  dummy_data_param { "
+        "    shape { dim: 5 dim: 8 } "
+        "    data_filler { "
+        "      type: 'gaussian' "
+        "      std: 1 "
+        "    } "
+        "  } "
+        "  top: 'data' "
+        "} "
+        "layer { "
+        "  name: 'innerproduct1' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 6 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 1 "
+        "    } "
+        "  } "
+        "  bottom: 'data' "
+        "  top: 'innerproduct1' "
+        "} "
+        "layer { "
+        "  name: 'relu1' "
+        "  type: 'ReLU' "
+        "  bottom: 'innerproduct1' "
+        "  top: 'innerproduct1' "
+        "} "
+        "layer { "
+        "  name: 'innerproduct2' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 6 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 1 "
+        "    } "
+        "  } "
+        "  bottom: 'data' "
+        "  top: 'innerproduct2' "
+        "} "
+        "layer { "
+        "  name: 'dropout2' "
+        "  type: 'Dropout' "
+        "  bottom: 'innerproduct2' "
+        "  top: 'dropout2' "
+        "} "
+        "layer { "
+        "  name: 'sum' "
+        "  type: 'Eltwise' "
+        "  bottom: 'innerproduct1' "
+        "  bottom: 'dropout2' "
+        "  top: 'sum' "
+        "} "
+        "layer { "
+        "  name: 'loss' "
+        "  type: 'Reduction' "
+        "  reduction_param { operation: SUMSQ } "
+        "  bottom: 'sum' "
+        "  top: 'loss' "
+        "  loss_weight: 1 "
+        "} ";
+    if (parallel_forward) {
+      proto += "parallel_forward: true forward_threads: 3 ";
+    }
+    InitNetFromProtoString(proto);
+  }
+
+  virtual void InitChainNet(const bool plan_memory, const string& keep_blob) {
+    string proto =
+        "name: 'ChainNetwork' "
+        "state { phase: TEST } "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'DummyData' "
+        "  dummy_data_param { "
+        "    shape { dim: 5 dim: 8 } "
+        "    data_filler { "
+        "      type: 'gaussian' "
+        "      std: 1 "
+        "    } "
+        "  } "
+        "  top: 'data' "
+        "} "
+        "layer { "
+        "  name: 'innerproduct1' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 6 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 1 "
+        "    } "
+        "  } "
+        "  bottom: 'data' "
+        "  top: 'innerproduct1' "
+        "} "
+        "layer { "
+        "  name: 'relu1' "
+        "  type: 'ReLU' "
+        "  bottom: 'innerproduct1' "
+        "  top: 'innerproduct1' "
+        "} "
+        "layer { "
+        "  name: 'innerproduct2' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 6 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 1 "
+        "    } "
+        "  } "
+        "  bottom: 'innerproduct1' "
+        "  top: 'innerproduct2' "
+        "} "
+        "layer { "
+        "  name: 'innerproduct3' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 6 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 1 "
+        "    } "
+        "  } "
+        "  bottom: 'innerproduct2' "
+        "  top: 'innerproduct3' "
+        "} "
+        "layer { "
+        "  name: 'innerproduct4' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 6 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 1 "
+        "    } "
+        "  } "
+        "  bottom: 'innerproduct3' "
+        "  top: 'innerproduct4' "
+        "} ";
+    if (plan_memory) {
+      proto += "plan_memory: true ";
+    }
+    if (!keep_blob.empty()) {
+      proto += "keep_blob: '" + keep_blob + "' ";
+    }
+    InitNetFromProtoString(proto);
+  }
+
+  // Three Slices along axis 0, which may make their tops views of their
+  // bottoms: one with a top computed in place, one with a loss-weighted top,
+  // and one with neither.
+  virtual void InitTopViewsNet() {
+    string proto =
+        "name: 'TopViewsNetwork' "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'DummyData' "
+        "  dummy_data_param { "
+        "    shape { dim: 4 dim: 5 } "
+        "    data_filler { "
+        "      type: 'gaussian' "
+        "      std: 1 "
+        "    } "
+        "  } "
+        "  top: 'data1' "
+        "  top: 'data2' "
+        "  top: 'data3' "
+        "} "
+        "layer { "
+        "  name: 'slice_in_place' "
+        "  type: 'Slice' "
+        "  slice_param { axis: 0 slice_point: 2 } "
+        "  bottom: 'data1' "
+        "  top: 'a' "
+        "  top: 'b' "
+        "} "
+        "layer { "
+        "  name: 'relu' "
+        "  type: 'ReLU' "
+        "  bottom: 'a' "
+        "  top: 'a' "
+        "} "
+        "layer { "
+        "  name: 'slice_loss' "
+        "  type: 'Slice' "
+        "  slice_param { axis: 0 slice_point: 2 } "
+        "  bottom: 'data2' "
+        "  top: 'c' "
+        "  top: 'd' "
+        "  loss_weight: 0 "
+        "  loss_weight: 2 "
+        "} "
+        "layer { "
+        "  name: 'slice_view' "
+        "  type: 'Slice' "
+        "  slice_param { axis: 0 slice_point: 2 } "
+        "  bottom: 'data3' "
+        "  top: 'e' "
+        "  top: 'f' "
+        "} ";
+    InitNetFromProtoString(proto);
+  }
+
   int seed_;
   shared_ptr<Net<Dtype> > net_;
 };
@@ -1342,6 +1558,25 @@ TYPED_TEST(NetTest, TestSharedWeightsResume) {
   }
 }
 
+TYPED_TEST(NetTest, TestWeightsGeneration) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Re-binding weights from another net or a NetParameter bumps the
+  // generation; running the net does not.
+  this->InitDiffDataSharedWeightsNet();
+  shared_ptr<Net<Dtype> > source_net = this->net_;
+  this->InitDiffDataSharedWeightsNet();
+  const int generation = this->net_->weights_generation();
+  this->net_->ForwardBackward();
+  EXPECT_EQ(generation, this->net_->weights_generation());
+  this->net_->ShareTrainedLayersWith(source_net.get());
+  EXPECT_NE(generation, this->net_->weights_generation());
+  const int shared_generation = this->net_->weights_generation();
+  NetParameter net_param;
+  source_net->ToProto(&net_param);
+  this->net_->CopyTrainedLayersFrom(net_param);
+  EXPECT_NE(shared_generation, this->net_->weights_generation());
+}
+
 TYPED_TEST(NetTest, TestParamPropagateDown) {
   typedef typename TypeParam::Dtype Dtype;
   const bool kBiasTerm = true, kForceBackward = false;
@@ -2601,4 +2836,114 @@ TYPED_TEST(NetTest, TestAllInOneNetDeploy) {
   ASSERT_TRUE(found_data);
 }
 
+TYPED_TEST(NetTest, TestParallelForward) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Run the same net sequentially and in parallel, from the same seed.
+  vector<shared_ptr<Blob<Dtype> > > blobs[2];
+  Dtype loss[2];
+  for (int parallel = 0; parallel < 2; ++parallel) {
+    Caffe::set_random_seed(this->seed_);
+    this->InitParallelBranchesNet(parallel);
+    for (int iter = 0; iter < 3; ++iter) {
+      this->net_->Forward(&loss[parallel]);
+    }
+    this->CopyNetBlobs(false, &blobs[parallel]);
+  }
+  EXPECT_EQ(loss[0], loss[1]);
+  ASSERT_EQ(blobs[0].size(), blobs[1].size());
+  for (int i = 0; i < blobs[0].size(); ++i) {
+    ASSERT_EQ(blobs[0][i]->count(), blobs[1][i]->count());
+    for (int j = 0; j < blobs[0][i]->count(); ++j) {
+      EXPECT_EQ(blobs[0][i]->cpu_data()[j], blobs[1][i]->cpu_data()[j]);
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestPlanMemory) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Run the same chain of layers with and without plan_memory.
+  Blob<Dtype> output[2];
+  for (int plan = 0; plan < 2; ++plan) {
+    Caffe::set_random_seed(this->seed_);
+    this->InitChainNet(plan, "");
+    this->net_->Forward();
+    output[plan].CopyFrom(*this->net_->output_blobs()[0], false, true);
+  }
+  // innerproduct1 is dead once innerproduct2 has read it, so innerproduct3
+  // reuses its memory; innerproduct2 overlaps both, and the net's source
+  // and output keep their own.
+  Net<Dtype>* net = this->net_.get();
+  EXPECT_EQ(net->blob_by_name("innerproduct1")->data(),
+            net->blob_by_name("innerproduct3")->data());
+  EXPECT_NE(net->blob_by_name("innerproduct1")->data(),
+            net->blob_by_name("innerproduct2")->data());
+  EXPECT_NE(net->blob_by_name("innerproduct2")->data(),
+            net->blob_by_name("innerproduct4")->data());
+  EXPECT_NE(net->blob_by_name("data")->data(),
+            net->blob_by_name("innerproduct2")->data());
+  ASSERT_EQ(output[0].count(), output[1].count());
+  for (int i = 0; i < output[0].count(); ++i) {
+    EXPECT_EQ(output[0].cpu_data()[i], output[1].cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(NetTest, TestPlanMemoryKeepBlob) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_random_seed(this->seed_);
+  this->InitChainNet(false, "");
+  this->net_->Forward();
+  Blob<Dtype> features;
+  features.CopyFrom(*this->net_->blob_by_name("innerproduct1"), false, true);
+  Caffe::set_random_seed(this->seed_);
+  this->InitChainNet(true, "innerproduct1");
+  this->net_->Forward();
+  Net<Dtype>* net = this->net_.get();
+  EXPECT_NE(net->blob_by_name("innerproduct1")->data(),
+            net->blob_by_name("innerproduct3")->data());
+  const Blob<Dtype>& kept = *net->blob_by_name("innerproduct1");
+  ASSERT_EQ(features.count(), kept.count());
+  for (int i = 0; i < features.count(); ++i) {
+    EXPECT_EQ(features.cpu_data()[i], kept.cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(NetTest, TestTopViews) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_random_seed(this->seed_);
+  this->InitTopViewsNet();
+  Net<Dtype>* net = this->net_.get();
+  EXPECT_FALSE(net->layer_by_name("slice_in_place")->allow_top_views());
+  EXPECT_FALSE(net->layer_by_name("slice_loss")->allow_top_views());
+  EXPECT_TRUE(net->layer_by_name("slice_view")->allow_top_views());
+  EXPECT_FALSE(net->blob_by_name("a")->is_view());
+  EXPECT_FALSE(net->blob_by_name("d")->is_view());
+  EXPECT_TRUE(net->blob_by_name("e")->is_view());
+  EXPECT_TRUE(net->blob_by_name("f")->is_view());
+  Dtype loss;
+  net->Forward(&loss);
+  // The in-place ReLU only clamps its own copy of the slice.
+  const Dtype* data1 = net->blob_by_name("data1")->cpu_data();
+  const Dtype* a = net->blob_by_name("a")->cpu_data();
+  int num_negative = 0;
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_EQ(std::max(data1[i], Dtype(0)), a[i]);
+    num_negative += data1[i] < 0;
+  }
+  EXPECT_GT(num_negative, 0);
+  // The loss weight is written to the top's own diff, not data2's.
+  const Dtype* data2 = net->blob_by_name("data2")->cpu_data();
+  Dtype expected_loss = 0;
+  for (int i = 0; i < 10; ++i) {
+    expected_loss += 2 * data2[10 + i];
+    EXPECT_EQ(0, net->blob_by_name("data2")->cpu_diff()[10 + i]);
+  }
+  EXPECT_NEAR(expected_loss, loss, 1e-4);
+  // The views still read their bottom.
+  const Dtype* data3 = net->blob_by_name("data3")->cpu_data();
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_EQ(data3[i], net->blob_by_name("e")->cpu_data()[i]);
+    EXPECT_EQ(data3[10 + i], net->blob_by_name("f")->cpu_data()[i]);
+  }
+}
+
 }  // namespace caffe
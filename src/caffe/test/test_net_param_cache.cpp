@@ -0,0 +1,75 @@
+#include <string>
+
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/net_param_cache.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class NetParamsCacheTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    const string proto =
+        "name: 'cached' "
+        "layer { name: 'data' type: 'Input' top: 'data' "
+        "  input_param { shape { dim: 1 } } } "
+        "layer { name: 'train_only' type: 'ReLU' bottom: 'data' top: 'data' "
+        "  include { phase: TRAIN } } "
+        "layer { name: 'staged' type: 'ReLU' bottom: 'data' top: 'data' "
+        "  include { stage: 'extra' } } ";
+    NetParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+    MakeTempFilename(&filename_);
+    WriteProtoToTextFile(param, filename_);
+    ClearNetParamsCache();
+  }
+
+  virtual void TearDown() {
+    ClearNetParamsCache();
+    remove(filename_.c_str());
+  }
+
+  string filename_;
+};
+
+TEST_F(NetParamsCacheTest, TestFilterByState) {
+  NetState state;
+  state.set_phase(TEST);
+  NetParameter filtered;
+  ReadFilteredNetParamsCached(filename_, state, &filtered);
+  ASSERT_EQ(filtered.layer_size(), 1);
+  EXPECT_EQ(filtered.layer(0).name(), "data");
+
+  state.set_phase(TRAIN);
+  state.add_stage("extra");
+  ReadFilteredNetParamsCached(filename_, state, &filtered);
+  ASSERT_EQ(filtered.layer_size(), 3);
+  EXPECT_EQ(filtered.layer(2).name(), "staged");
+}
+
+TEST_F(NetParamsCacheTest, TestParseOnce) {
+  NetParameter first;
+  ReadNetParamsFromTextFileCached(filename_, &first);
+  EXPECT_EQ(first.layer_size(), 3);
+  // Later reads come from the cache, even with the file gone...
+  remove(filename_.c_str());
+  NetParameter second;
+  ReadNetParamsFromTextFileCached(filename_, &second);
+  EXPECT_EQ(second.DebugString(), first.DebugString());
+  NetState state;
+  state.set_phase(TRAIN);
+  NetParameter filtered;
+  ReadFilteredNetParamsCached(filename_, state, &filtered);
+  EXPECT_EQ(filtered.layer_size(), 2);
+  // ...and are copies that the caller is free to modify.
+  second.mutable_layer(0)->set_name("changed");
+  ReadNetParamsFromTextFileCached(filename_, &second);
+  EXPECT_EQ(second.layer(0).name(), "data");
+}
+
+}  // namespace caffe
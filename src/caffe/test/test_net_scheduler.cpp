@@ -0,0 +1,66 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/net_scheduler.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class NetSchedulerTest : public ::testing::Test {
+ protected:
+  SubnetParameter Schedule(int forward_mode, int backward_mode, int reset) {
+    SubnetParameter schedule;
+    schedule.set_phase_counter_index(0);
+    schedule.set_phase_counter_reset(reset);
+    schedule.set_forward_mode(forward_mode);
+    schedule.set_backward_mode(backward_mode);
+    return schedule;
+  }
+
+  NetScheduler scheduler_;
+};
+
+TEST_F(NetSchedulerTest, TestAlternatingBackward) {
+  // A discriminator that trains every iteration and advances the counter on
+  // its backward pass (which comes first, as it is further downstream), and
+  // a generator that trains only when the counter has wrapped back to 0.
+  const SubnetParameter generator = Schedule(0, 1, -1);
+  const SubnetParameter discriminator = Schedule(0, 0, 2);
+  const bool expected[6] = { false, false, true, false, false, true };
+  for (int iter = 0; iter < 6; ++iter) {
+    EXPECT_TRUE(scheduler_.Forward(generator));
+    EXPECT_TRUE(scheduler_.Forward(discriminator));
+    bool zero_param_diffs;
+    EXPECT_TRUE(scheduler_.Backward(discriminator, &zero_param_diffs));
+    EXPECT_FALSE(zero_param_diffs);
+    EXPECT_EQ(expected[iter],
+              scheduler_.Backward(generator, &zero_param_diffs));
+  }
+}
+
+TEST_F(NetSchedulerTest, TestZeroParamDiffs) {
+  const SubnetParameter schedule = Schedule(0, 4, 1);
+  bool zero_param_diffs;
+  EXPECT_TRUE(scheduler_.Backward(schedule, &zero_param_diffs));
+  EXPECT_EQ(scheduler_.counter(0), 1);
+  EXPECT_TRUE(zero_param_diffs);
+  EXPECT_TRUE(scheduler_.Backward(schedule, &zero_param_diffs));
+  EXPECT_EQ(scheduler_.counter(0), 0);
+  EXPECT_FALSE(zero_param_diffs);
+}
+
+TEST_F(NetSchedulerTest, TestIndependentSchedulers) {
+  const SubnetParameter schedule = Schedule(1, 0, 5);
+  SubnetParameter counting(schedule);
+  counting.set_increment_on_forward(true);
+  NetScheduler other;
+  EXPECT_TRUE(scheduler_.Forward(counting));
+  EXPECT_FALSE(scheduler_.Forward(schedule));
+  EXPECT_TRUE(other.Forward(schedule));
+  EXPECT_EQ(other.counter(0), 0);
+}
+
+}  // namespace caffe
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cmath>
 
 #include "gtest/gtest.h"
@@ -395,6 +396,95 @@ TYPED_TEST(RandomNumberGeneratorTest, TestRngBernoulliTimesBernoulli) {
   EXPECT_NEAR(true_mean, sample_p, bound);
 }
 
+TEST(PhiloxTest, TestKnownAnswer) {
+  // Philox4x32-10 test vectors from the Random123 distribution
+  const uint32_t ctr[4] = { 0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344 };
+  uint32_t out[4];
+  philox4x32_10(ctr, 0xa4093822, 0x299f31d0, out);
+  EXPECT_EQ(0xd16cfe09u, out[0]);
+  EXPECT_EQ(0x94fdccebu, out[1]);
+  EXPECT_EQ(0x5001e420u, out[2]);
+  EXPECT_EQ(0x24126ea1u, out[3]);
+  const uint32_t zero[4] = { 0, 0, 0, 0 };
+  philox4x32_10(zero, 0, 0, out);
+  EXPECT_EQ(0x6627e8d5u, out[0]);
+  EXPECT_EQ(0xe169c58du, out[1]);
+  EXPECT_EQ(0xbc57ac4cu, out[2]);
+  EXPECT_EQ(0x9b00dbd8u, out[3]);
+}
+
+
+TYPED_TEST(RandomNumberGeneratorTest, TestRngStreamUniform) {
+  const TypeParam lower = -7.3;
+  const TypeParam upper = -2.3;
+  TypeParam* uniform_data =
+      static_cast<TypeParam*>(this->data_->mutable_cpu_data());
+  caffe_rng_stream_uniform(Caffe::philox_stream(3, 17), this->sample_size_,
+                           lower, upper, uniform_data);
+  this->RngUniformChecks(lower, upper, uniform_data);
+}
+
+
+TYPED_TEST(RandomNumberGeneratorTest, TestRngStreamGaussian) {
+  const TypeParam mu = -2;
+  const TypeParam sigma = 3;
+  TypeParam* gaussian_data =
+      static_cast<TypeParam*>(this->data_->mutable_cpu_data());
+  caffe_rng_stream_gaussian(Caffe::philox_stream(3, 17), this->sample_size_,
+                            mu, sigma, gaussian_data);
+  this->RngGaussianChecks(mu, sigma, gaussian_data);
+}
+
+
+TYPED_TEST(RandomNumberGeneratorTest, TestRngStreamChunked) {
+  const PhiloxStream stream = Caffe::philox_stream(5, 1);
+  const int n = this->sample_size_;
+  TypeParam* whole = static_cast<TypeParam*>(this->data_->mutable_cpu_data());
+  TypeParam* chunked =
+      static_cast<TypeParam*>(this->data_2_->mutable_cpu_data());
+  caffe_rng_stream_gaussian(stream, n, TypeParam(0), TypeParam(1), whole);
+  // chunks that do not line up with the four-element Philox blocks, drawn
+  // in reverse order and interleaved with draws from the global generator
+  const int chunk = 37;
+  for (int start = (n - 1) / chunk * chunk; start >= 0; start -= chunk) {
+    caffe_rng_rand();
+    caffe_rng_stream_gaussian(stream, std::min(chunk, n - start),
+        TypeParam(0), TypeParam(1), chunked + start, start);
+  }
+  for (int i = 0; i < n; ++i) {
+    EXPECT_EQ(whole[i], chunked[i]);
+  }
+}
+
+
+TYPED_TEST(RandomNumberGeneratorTest, TestRngStreamKeys) {
+  const int n = this->sample_size_;
+  TypeParam* data = static_cast<TypeParam*>(this->data_->mutable_cpu_data());
+  TypeParam* data_2 =
+      static_cast<TypeParam*>(this->data_2_->mutable_cpu_data());
+  // the same key reproduces the same draws...
+  caffe_rng_stream_uniform(Caffe::philox_stream(1, 2), n, TypeParam(0),
+                           TypeParam(1), data);
+  caffe_rng_stream_uniform(Caffe::philox_stream(1, 2), n, TypeParam(0),
+                           TypeParam(1), data_2);
+  for (int i = 0; i < n; ++i) {
+    EXPECT_EQ(data[i], data_2[i]);
+  }
+  // ...while changing the stream id, the iteration or the seed does not
+  PhiloxStream other[3] = { Caffe::philox_stream(2, 2),
+                            Caffe::philox_stream(1, 3),
+                            Caffe::philox_stream(1, 2) };
+  other[2].seed += 1;
+  for (int k = 0; k < 3; ++k) {
+    caffe_rng_stream_uniform(other[k], n, TypeParam(0), TypeParam(1), data_2);
+    int num_equal = 0;
+    for (int i = 0; i < n; ++i) {
+      num_equal += (data[i] == data_2[i]);
+    }
+    EXPECT_LT(num_equal, n / 100);
+  }
+}
+
 #ifndef CPU_ONLY
 
 TYPED_TEST(RandomNumberGeneratorTest, TestRngGaussianGPU) {
@@ -437,6 +527,25 @@ TYPED_TEST(RandomNumberGeneratorTest, TestRngUniform2GPU) {
 }
 
 
+TYPED_TEST(RandomNumberGeneratorTest, TestRngStreamGaussianGPU) {
+  const PhiloxStream stream = Caffe::philox_stream(3, 17);
+  const int n = this->sample_size_ - 3;
+  TypeParam* gpu_data =
+      static_cast<TypeParam*>(this->data_->mutable_gpu_data());
+  caffe_gpu_rng_stream_gaussian(stream, n, TypeParam(-2), TypeParam(3),
+                                gpu_data, 3);
+  TypeParam* cpu_data =
+      static_cast<TypeParam*>(this->data_2_->mutable_cpu_data());
+  caffe_rng_stream_gaussian(stream, n, TypeParam(-2), TypeParam(3),
+                            cpu_data, 3);
+  const TypeParam* from_gpu =
+      static_cast<const TypeParam*>(this->data_->cpu_data());
+  for (int i = 0; i < n; ++i) {
+    EXPECT_NEAR(cpu_data[i], from_gpu[i], 1e-4 * (1 + fabs(cpu_data[i])));
+  }
+}
+
+
 TYPED_TEST(RandomNumberGeneratorTest, TestRngUniformIntGPU) {
   unsigned int* uniform_uint_gpu_data =
       static_cast<unsigned int*>(this->int_data_->mutable_gpu_data());
@@ -0,0 +1,164 @@
+#include <algorithm>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/replay_layer.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class ReplayLayerTest : public CPUDeviceTest<Dtype> {
+ protected:
+  ReplayLayerTest()
+      : blob_bottom_data_(new Blob<Dtype>()),
+        blob_bottom_category_(new Blob<Dtype>()),
+        blob_top_data_(new Blob<Dtype>()) {
+    Caffe::set_random_seed(1701);
+    blob_bottom_vec_.push_back(blob_bottom_data_);
+    blob_top_vec_.push_back(blob_top_data_);
+  }
+  virtual ~ReplayLayerTest() {
+    delete blob_bottom_data_;
+    delete blob_bottom_category_;
+    delete blob_top_data_;
+  }
+
+  // Sets the bottom to a batch of tuples (values[i], 2 * values[i]).
+  void SetBatch(const vector<Dtype>& values) {
+    vector<int> shape(2);
+    shape[0] = values.size();
+    shape[1] = 2;
+    blob_bottom_data_->Reshape(shape);
+    Dtype* data = blob_bottom_data_->mutable_cpu_data();
+    for (int i = 0; i < values.size(); ++i) {
+      data[2 * i] = values[i];
+      data[2 * i + 1] = 2 * values[i];
+    }
+  }
+
+  // The first entries of the replayed tuples, checking that each tuple was
+  // replayed whole.
+  vector<Dtype> Replayed() {
+    vector<Dtype> values;
+    const Dtype* data = blob_top_data_->cpu_data();
+    for (int i = 0; i < blob_top_data_->shape(0); ++i) {
+      EXPECT_EQ(data[2 * i + 1], 2 * data[2 * i]);
+      values.push_back(data[2 * i]);
+    }
+    return values;
+  }
+
+  Blob<Dtype>* const blob_bottom_data_;
+  Blob<Dtype>* const blob_bottom_category_;
+  Blob<Dtype>* const blob_top_data_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(ReplayLayerTest, TestDtypes);
+
+TYPED_TEST(ReplayLayerTest, TestRingOverwrite) {
+  LayerParameter layer_param;
+  layer_param.set_phase(TRAIN);
+  layer_param.mutable_replay_param()->set_num_slots(3);
+  layer_param.mutable_replay_param()->set_buffer_index(1);
+  ReplayLayer<TypeParam> layer(layer_param);
+  vector<TypeParam> batch(2);
+  batch[0] = 0;
+  batch[1] = 1;
+  this->SetBatch(batch);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  for (int pass = 0; pass < 3; ++pass) {
+    batch[0] = 2 * pass;
+    batch[1] = 2 * pass + 1;
+    this->SetBatch(batch);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    EXPECT_EQ(layer.size(), std::min(2 * pass + 2, 3));
+    // Once full, the oldest tuples are overwritten first: the buffer holds
+    // the last three tuples stored.
+    const vector<TypeParam> replayed = this->Replayed();
+    ASSERT_EQ(replayed.size(), 2);
+    for (int i = 0; i < replayed.size(); ++i) {
+      EXPECT_GE(replayed[i], std::max(0, 2 * pass - 1));
+      EXPECT_LE(replayed[i], 2 * pass + 1);
+    }
+  }
+}
+
+TYPED_TEST(ReplayLayerTest, TestMaxUseCount) {
+  LayerParameter layer_param;
+  layer_param.set_phase(TRAIN);
+  layer_param.mutable_replay_param()->set_num_slots(4);
+  layer_param.mutable_replay_param()->set_buffer_index(2);
+  layer_param.mutable_replay_param()->set_max_use_count(1);
+  ReplayLayer<TypeParam> layer(layer_param);
+  this->SetBatch(vector<TypeParam>(1, 5));
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  for (int pass = 0; pass < 3; ++pass) {
+    // Each tuple is sampled right after it is stored, which retires it.
+    this->SetBatch(vector<TypeParam>(1, pass));
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    EXPECT_EQ(layer.size(), 0);
+    EXPECT_EQ(this->Replayed()[0], pass);
+  }
+}
+
+TYPED_TEST(ReplayLayerTest, TestStratifiedSampling) {
+  LayerParameter layer_param;
+  layer_param.set_phase(TRAIN);
+  layer_param.mutable_replay_param()->set_num_slots(100);
+  layer_param.mutable_replay_param()->set_buffer_index(3);
+  layer_param.mutable_replay_param()->set_num_categories(2);
+  ReplayLayer<TypeParam> layer(layer_param);
+  // Seven tuples of category 0 (values < 100) and one of category 1.
+  vector<TypeParam> batch;
+  for (int i = 0; i < 7; ++i) { batch.push_back(i); }
+  batch.push_back(100);
+  this->SetBatch(batch);
+  this->blob_bottom_category_->Reshape(vector<int>(1, 8));
+  TypeParam* category = this->blob_bottom_category_->mutable_cpu_data();
+  for (int i = 0; i < 8; ++i) { category[i] = i < 7 ? 0 : 1; }
+  this->blob_bottom_vec_.push_back(this->blob_bottom_category_);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  for (int pass = 0; pass < 5; ++pass) {
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    // Each category gets half the batch, however rare it is.
+    const vector<TypeParam> replayed = this->Replayed();
+    int num_rare = 0;
+    for (int i = 0; i < replayed.size(); ++i) {
+      if (replayed[i] == 100) { ++num_rare; }
+    }
+    EXPECT_EQ(num_rare, 4);
+  }
+}
+
+TYPED_TEST(ReplayLayerTest, TestBackward) {
+  LayerParameter layer_param;
+  layer_param.set_phase(TRAIN);
+  layer_param.mutable_replay_param()->set_buffer_index(4);
+  ReplayLayer<TypeParam> layer(layer_param);
+  this->SetBatch(vector<TypeParam>(3, 1));
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  FillerParameter filler_param;
+  GaussianFiller<TypeParam> filler(filler_param);
+  filler.Fill(this->blob_top_data_);
+  caffe_copy(this->blob_top_data_->count(), this->blob_top_data_->cpu_data(),
+             this->blob_top_data_->mutable_cpu_diff());
+  caffe_copy(this->blob_top_data_->count(), this->blob_top_data_->cpu_data(),
+             this->blob_bottom_data_->mutable_cpu_diff());
+  // Replayed tuples pass no gradient on: no stale diff may survive.
+  layer.Backward(this->blob_top_vec_, vector<bool>(1, true),
+                 this->blob_bottom_vec_);
+  for (int i = 0; i < this->blob_bottom_data_->count(); ++i) {
+    EXPECT_EQ(this->blob_bottom_data_->cpu_diff()[i], 0);
+  }
+}
+
+}  // namespace caffe
@@ -0,0 +1,116 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/layers/reward_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+// Two inputs with two tosses each (N = 2, M = 2), three classes and four
+// timesteps split over two targets (C = 3, T = 4, t = 2).
+static const int kPredicted[4][4] = {
+  {0, 1, 2, 2},  // toss 0 of input 0, labels 0 0 2 2
+  {2, 0, 1, 2},  // toss 0 of input 1, labels 1 1 1 1
+  {0, 0, 2, 2},  // toss 1 of input 0
+  {1, 2, 2, 1},  // toss 1 of input 1
+};
+
+template <typename TypeParam>
+class RewardLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  RewardLayerTest()
+      : blob_bottom_pred_(new Blob<Dtype>(4, 3, 4, 1)),
+        blob_bottom_label_(new Blob<Dtype>(vector<int>(2, 2))),
+        blob_bottom_reward_(new Blob<Dtype>(4, 1, 4, 1)),
+        blob_bottom_curriculum_(new Blob<Dtype>(4, 1, 4, 1)),
+        blob_top_accuracy_(new Blob<Dtype>()),
+        blob_top_reward_(new Blob<Dtype>()) {}
+  virtual void SetUp() {
+    // every sample predicts kPredicted, with a distinct runner-up score
+    Dtype* pred = blob_bottom_pred_->mutable_cpu_data();
+    for (int n = 0; n < 4; ++n) {
+      for (int c = 0; c < 3; ++c) {
+        for (int t = 0; t < 4; ++t) {
+          pred[(n * 3 + c) * 4 + t] =
+              kPredicted[n][t] == c ? Dtype(1) : Dtype(0.1) * c - Dtype(0.5);
+        }
+      }
+    }
+    const Dtype labels[] = {0, 2, 1, 1};
+    caffe_copy(4, labels, blob_bottom_label_->mutable_cpu_data());
+    blob_bottom_vec_.push_back(blob_bottom_pred_);
+    blob_bottom_vec_.push_back(blob_bottom_label_);
+    blob_bottom_vec_.push_back(blob_bottom_reward_);
+    blob_bottom_vec_.push_back(blob_bottom_curriculum_);
+    blob_top_vec_.push_back(blob_top_accuracy_);
+    blob_top_vec_.push_back(blob_top_reward_);
+  }
+  virtual ~RewardLayerTest() {
+    delete blob_bottom_pred_;
+    delete blob_bottom_label_;
+    delete blob_bottom_reward_;
+    delete blob_bottom_curriculum_;
+    delete blob_top_accuracy_;
+    delete blob_top_reward_;
+  }
+
+  void TestRewards(bool per_target_rewards, Dtype accuracy,
+      const Dtype* reward, const Dtype* curriculum) {
+    LayerParameter layer_param;
+    layer_param.mutable_reward_param()->set_per_target_rewards(
+        per_target_rewards);
+    RewardLayer<Dtype> layer(layer_param);
+    layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    layer.Forward(blob_bottom_vec_, blob_top_vec_);
+    EXPECT_EQ(accuracy, blob_top_accuracy_->cpu_data()[0]);
+    for (int i = 0; i < 16; ++i) {
+      EXPECT_EQ(reward[i], blob_top_reward_->cpu_data()[i]) << "at " << i;
+    }
+    layer.Backward(blob_top_vec_, vector<bool>(4, false), blob_bottom_vec_);
+    for (int i = 0; i < 16; ++i) {
+      EXPECT_EQ(reward[i], blob_bottom_reward_->cpu_data()[i]) << "at " << i;
+      EXPECT_EQ(reward[i], blob_bottom_reward_->cpu_diff()[i]) << "at " << i;
+      EXPECT_EQ(curriculum[i], blob_bottom_curriculum_->cpu_diff()[i])
+          << "at " << i;
+    }
+  }
+
+  Blob<Dtype>* const blob_bottom_pred_;
+  Blob<Dtype>* const blob_bottom_label_;
+  Blob<Dtype>* const blob_bottom_reward_;
+  Blob<Dtype>* const blob_bottom_curriculum_;
+  Blob<Dtype>* const blob_top_accuracy_;
+  Blob<Dtype>* const blob_top_reward_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(RewardLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(RewardLayerTest, TestRewards) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Every timestep is scored.  The curriculum flag stays 1 up to and
+  // including the first miss, and after it is 1 only where correct.
+  const Dtype reward[] = {1, 0, 1, 1,  0, 0, 1, 0,  1, 1, 1, 1,  1, 0, 0, 1};
+  const Dtype curriculum[] =
+      {1, 1, 1, 1,  1, 0, 1, 0,  1, 1, 1, 1,  1, 1, 0, 1};
+  this->TestRewards(false, Dtype(10) / 16, reward, curriculum);
+}
+
+TYPED_TEST(RewardLayerTest, TestPerTargetRewards) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Only the last timestep of each target (timesteps 1 and 3) is scored.
+  const Dtype reward[] = {0, 0, 0, 1,  0, 0, 0, 0,  0, 1, 0, 1,  0, 0, 0, 1};
+  const Dtype curriculum[] =
+      {0, 1, 0, 1,  0, 1, 0, 0,  0, 1, 0, 1,  0, 1, 0, 1};
+  this->TestRewards(true, Dtype(4) / 8, reward, curriculum);
+}
+
+}  // namespace caffe
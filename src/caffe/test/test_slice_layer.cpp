@@ -132,6 +132,33 @@ TYPED_TEST(SliceLayerTest, TestSliceAcrossNum) {
   }
 }
 
+TYPED_TEST(SliceLayerTest, TestSliceAcrossNumViews) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_slice_param()->set_axis(0);
+  SliceLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_0_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_0_);
+  // Slices along the first axis are views of the bottom, not copies.
+  const int top_0_count = this->blob_top_0_->count();
+  EXPECT_TRUE(this->blob_top_0_->SharesDataWith(*this->blob_bottom_, 0));
+  EXPECT_TRUE(this->blob_top_1_->SharesDataWith(*this->blob_bottom_,
+                                                top_0_count));
+  EXPECT_TRUE(this->blob_top_1_->SharesDiffWith(*this->blob_bottom_,
+                                                top_0_count));
+  EXPECT_EQ(this->blob_top_1_->cpu_data()[0],
+            this->blob_bottom_->cpu_data()[top_0_count]);
+  // Unless they are not allowed to be.
+  SliceLayer<Dtype> copying_layer(layer_param);
+  copying_layer.set_allow_top_views(false);
+  copying_layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_0_);
+  copying_layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_0_);
+  EXPECT_FALSE(this->blob_top_1_->SharesDataWith(*this->blob_bottom_,
+                                                 top_0_count));
+  EXPECT_EQ(this->blob_top_1_->cpu_data()[0],
+            this->blob_bottom_->cpu_data()[top_0_count]);
+}
+
 TYPED_TEST(SliceLayerTest, TestSliceAcrossChannels) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
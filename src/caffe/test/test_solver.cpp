@@ -106,4 +106,50 @@ TYPED_TEST(SolverTest, TestInitTrainTestNets) {
   EXPECT_TRUE(this->solver_->test_nets()[1]->has_layer("accuracy"));
 }
 
+TYPED_TEST(SolverTest, TestParamGroupSteps) {
+  const string& proto =
+     "param_group { "
+     "  name: 'scheduled' "
+     "  param_prefix: 'innerprod' "
+     "  schedule_period: 3 "
+     "  schedule_offset: 1 "
+     "  schedule_steps: 2 "
+     "} "
+     "net_param { "
+     "  name: 'TestNetwork' "
+     "  layer { "
+     "    name: 'data' "
+     "    type: 'DummyData' "
+     "    dummy_data_param { "
+     "      shape { "
+     "        dim: 5 "
+     "        dim: 2 "
+     "      } "
+     "    } "
+     "    top: 'data' "
+     "  } "
+     "  layer { "
+     "    name: 'innerprod' "
+     "    type: 'InnerProduct' "
+     "    inner_product_param { "
+     "      num_output: 1 "
+     "    } "
+     "    bottom: 'data' "
+     "    top: 'innerprod' "
+     "  } "
+     "} ";
+  this->InitSolverFromProtoString(proto);
+  // Updated on iterations 1, 2, 4, 5, ...: the steps up to and including
+  // each iteration count only those.
+  const bool kActive[] = {false, true, true, false, true, true, false};
+  const int kSteps[] = {0, 1, 2, 2, 3, 4, 4};
+  for (int iter = 0; iter < 7; ++iter) {
+    EXPECT_EQ(kActive[iter], this->solver_->ParamGroupActive(0, iter));
+    EXPECT_EQ(kSteps[iter], this->solver_->ParamGroupSteps(0, iter));
+    // The params in no group are updated on every iteration.
+    EXPECT_TRUE(this->solver_->ParamGroupActive(-1, iter));
+    EXPECT_EQ(iter + 1, this->solver_->ParamGroupSteps(-1, iter));
+  }
+}
+
 }  // namespace caffe
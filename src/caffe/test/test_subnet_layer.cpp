@@ -0,0 +1,207 @@
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/subnet_layer.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/math_functions.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class SubnetLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  SubnetLayerTest()
+      : blob_bottom_(new Blob<Dtype>(4, 5, 1, 1)),
+        blob_top_y_(new Blob<Dtype>()),
+        blob_top_z_(new Blob<Dtype>()) {}
+  virtual void SetUp() {
+    Caffe::set_random_seed(1701);
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_);
+    blob_bottom_vec_.push_back(blob_bottom_);
+    blob_top_vec_.push_back(blob_top_y_);
+    blob_top_vec_.push_back(blob_top_z_);
+    // Output y is also used inside the subnet; z is only an output.
+    NetParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(
+        "name: 'sub' "
+        "layer { name: 'input' type: 'Input' top: 'x' } "
+        "layer { name: 'ip' type: 'InnerProduct' bottom: 'x' top: 'y' "
+        "  inner_product_param { num_output: 3 "
+        "    weight_filler { type: 'gaussian' std: 0.5 } "
+        "    bias_filler { type: 'gaussian' std: 0.5 } } } "
+        "layer { name: 'tanh' type: 'TanH' bottom: 'y' top: 'z' } ",
+        &param));
+    MakeTempFilename(&filename_);
+    WriteProtoToTextFile(param, filename_);
+  }
+  virtual ~SubnetLayerTest() {
+    remove(filename_.c_str());
+    delete blob_bottom_;
+    delete blob_top_y_;
+    delete blob_top_z_;
+  }
+
+  LayerParameter SubnetParam(bool shared_inputs, bool shared_outputs) {
+    LayerParameter layer_param;
+    layer_param.set_name("sub");
+    layer_param.add_bottom("x");
+    layer_param.add_top("y");
+    layer_param.add_top("z");
+    SubnetParameter* subnet_param = layer_param.mutable_subnet_param();
+    subnet_param->set_prototxt_filename(filename_);
+    subnet_param->add_shared_inputs(shared_inputs);
+    subnet_param->add_shared_outputs(shared_outputs);
+    subnet_param->add_shared_outputs(shared_outputs);
+    return layer_param;
+  }
+
+  // Fills the top diffs with a fixed pattern.
+  void FillTopDiffs(const vector<Blob<Dtype>*>& top) {
+    for (int i = 0; i < top.size(); ++i) {
+      Dtype* diff = top[i]->mutable_cpu_diff();
+      for (int j = 0; j < top[i]->count(); ++j) {
+        diff[j] = Dtype(0.1) * ((3 * j + i) % 7) - Dtype(0.3);
+      }
+    }
+  }
+
+  Blob<Dtype>* const blob_bottom_;
+  Blob<Dtype>* const blob_top_y_;
+  Blob<Dtype>* const blob_top_z_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+  string filename_;
+};
+
+TYPED_TEST_CASE(SubnetLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(SubnetLayerTest, TestSharedBlobsAlias) {
+  typedef typename TypeParam::Dtype Dtype;
+  SubnetLayer<Dtype> layer(this->SubnetParam(true, true));
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const Net<Dtype>& subnet = *layer.subnets()[0];
+  EXPECT_TRUE(subnet.blob_by_name("x")->data() == this->blob_bottom_->data());
+  EXPECT_TRUE(subnet.blob_by_name("x")->diff() == this->blob_bottom_->diff());
+  EXPECT_TRUE(subnet.blob_by_name("y")->data() == this->blob_top_y_->data());
+  EXPECT_TRUE(subnet.blob_by_name("z")->data() == this->blob_top_z_->data());
+  EXPECT_TRUE(subnet.blob_by_name("z")->diff() == this->blob_top_z_->diff());
+  // y also feeds tanh, so its gradient arrives through the split in front
+  // of its pseudo-loss rather than in y itself
+  EXPECT_FALSE(subnet.blob_by_name("y")->diff() == this->blob_top_y_->diff());
+}
+
+TYPED_TEST(SubnetLayerTest, TestSharedMatchesCopy) {
+  typedef typename TypeParam::Dtype Dtype;
+  SubnetLayer<Dtype> copy_layer(this->SubnetParam(false, false));
+  copy_layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  copy_layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  this->FillTopDiffs(this->blob_top_vec_);
+  copy_layer.Backward(this->blob_top_vec_, vector<bool>(1, true),
+                      this->blob_bottom_vec_);
+
+  Blob<Dtype> bottom(this->blob_bottom_->shape()), top_y, top_z;
+  bottom.CopyFrom(*this->blob_bottom_);
+  vector<Blob<Dtype>*> bottom_vec(1, &bottom), top_vec;
+  top_vec.push_back(&top_y);
+  top_vec.push_back(&top_z);
+  SubnetLayer<Dtype> shared_layer(this->SubnetParam(true, true));
+  shared_layer.SetUp(bottom_vec, top_vec);
+  ASSERT_EQ(shared_layer.blobs().size(), copy_layer.blobs().size());
+  for (int i = 0; i < copy_layer.blobs().size(); ++i) {
+    shared_layer.blobs()[i]->CopyFrom(*copy_layer.blobs()[i]);
+  }
+  // two passes, so that the second one starts from the diffs left behind
+  for (int pass = 0; pass < 2; ++pass) {
+    for (int i = 0; i < shared_layer.blobs().size(); ++i) {
+      shared_layer.blobs()[i]->scale_diff(0);
+    }
+    shared_layer.Forward(bottom_vec, top_vec);
+    this->FillTopDiffs(top_vec);
+    shared_layer.Backward(top_vec, vector<bool>(1, true), bottom_vec);
+    for (int i = 0; i < top_vec.size(); ++i) {
+      for (int j = 0; j < top_vec[i]->count(); ++j) {
+        EXPECT_EQ(top_vec[i]->cpu_data()[j],
+                  this->blob_top_vec_[i]->cpu_data()[j]);
+      }
+    }
+    for (int j = 0; j < bottom.count(); ++j) {
+      EXPECT_NEAR(bottom.cpu_diff()[j], this->blob_bottom_->cpu_diff()[j],
+                  1e-6);
+    }
+    for (int i = 0; i < copy_layer.blobs().size(); ++i) {
+      for (int j = 0; j < copy_layer.blobs()[i]->count(); ++j) {
+        EXPECT_NEAR(shared_layer.blobs()[i]->cpu_diff()[j],
+                    copy_layer.blobs()[i]->cpu_diff()[j], 1e-6);
+      }
+    }
+  }
+}
+
+TYPED_TEST(SubnetLayerTest, TestGradientShared) {
+  typedef typename TypeParam::Dtype Dtype;
+  SubnetLayer<Dtype> layer(this->SubnetParam(true, true));
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+TYPED_TEST(SubnetLayerTest, TestBlobHandlesFollowResetBlobs) {
+  typedef typename TypeParam::Dtype Dtype;
+  for (int shared = 0; shared < 2; ++shared) {
+    SubnetLayer<Dtype> layer(this->SubnetParam(shared, shared));
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    this->FillTopDiffs(this->blob_top_vec_);
+    layer.Backward(this->blob_top_vec_, vector<bool>(1, true),
+                   this->blob_bottom_vec_);
+    Blob<Dtype> expected_z, expected_bottom_diff;
+    expected_z.CopyFrom(*this->blob_top_z_, false, true);
+    expected_bottom_diff.CopyFrom(*this->blob_bottom_, true, true);
+
+    // Swap every blob of the subnet for a fresh one; the layer's cached
+    // handles must follow, and the old blobs must no longer be written.
+    Net<Dtype>& subnet = *layer.subnets()[0];
+    shared_ptr<Blob<Dtype> > old_z = subnet.blob_by_name("z");
+    vector<shared_ptr<Blob<Dtype> > > fresh;
+    for (int i = 0; i < subnet.blobs().size(); ++i) {
+      fresh.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+      fresh.back()->ReshapeLike(*subnet.blobs()[i]);
+    }
+    subnet.reset_blobs(fresh);
+    caffe_set(old_z->count(), Dtype(7), old_z->mutable_cpu_data());
+
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    this->FillTopDiffs(this->blob_top_vec_);
+    layer.Backward(this->blob_top_vec_, vector<bool>(1, true),
+                   this->blob_bottom_vec_);
+    const Blob<Dtype>& new_z = *subnet.blob_by_name("z");
+    EXPECT_TRUE(&new_z == fresh[subnet.blob_names_index().at("z")].get());
+    EXPECT_EQ(shared != 0, new_z.data() == this->blob_top_z_->data());
+    for (int j = 0; j < new_z.count(); ++j) {
+      EXPECT_EQ(expected_z.cpu_data()[j], new_z.cpu_data()[j]);
+      EXPECT_EQ(expected_z.cpu_data()[j], this->blob_top_z_->cpu_data()[j]);
+      EXPECT_EQ(Dtype(7), old_z->cpu_data()[j]);
+    }
+    for (int j = 0; j < this->blob_bottom_->count(); ++j) {
+      EXPECT_NEAR(expected_bottom_diff.cpu_diff()[j],
+                  this->blob_bottom_->cpu_diff()[j], 1e-6);
+    }
+  }
+}
+
+}  // namespace caffe
@@ -50,6 +50,19 @@ TEST_F(SyncedMemoryTest, TestAllocationGPU) {
 
 #endif
 
+TEST_F(SyncedMemoryTest, TestDirty) {
+  SyncedMemory mem(10);
+  EXPECT_FALSE(mem.dirty());
+  mem.cpu_data();
+  EXPECT_FALSE(mem.dirty());
+  mem.mutable_cpu_data();
+  EXPECT_TRUE(mem.dirty());
+  mem.mark_clean();
+  EXPECT_FALSE(mem.dirty());
+  mem.cpu_data();
+  EXPECT_FALSE(mem.dirty());
+}
+
 TEST_F(SyncedMemoryTest, TestCPUWrite) {
   SyncedMemory mem(10);
   void* cpu_data = mem.mutable_cpu_data();
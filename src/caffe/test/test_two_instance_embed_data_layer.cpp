@@ -0,0 +1,200 @@
+#include <string>
+#include <vector>
+
+#include "boost/scoped_ptr.hpp"
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/layers/two_instance_embed_data_layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/db.hpp"
+#include "caffe/util/io.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+using boost::scoped_ptr;
+
+template <typename TypeParam>
+class TwoInstanceEmbedDataLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  TwoInstanceEmbedDataLayerTest()
+      : blob_top_data_(new Blob<Dtype>()),
+        blob_top_label_(new Blob<Dtype>()),
+        blob_top_location_(new Blob<Dtype>()) {}
+  virtual void SetUp() {
+    filename_.reset(new string());
+    MakeTempDir(filename_.get());
+    *filename_ += "/db";
+    blob_top_vec_.push_back(blob_top_data_);
+    blob_top_vec_.push_back(blob_top_label_);
+    blob_top_vec_.push_back(blob_top_location_);
+  }
+  virtual ~TwoInstanceEmbedDataLayerTest() {
+    delete blob_top_data_;
+    delete blob_top_label_;
+    delete blob_top_location_;
+  }
+
+  // Pixel j of pattern i; every pixel of every pattern is distinct.
+  static uint8_t Pixel(int i, int j) { return 10 * i + j + 1; }
+
+  static string Pattern(int i) {
+    string pixels;
+    for (int j = 0; j < 12; ++j) {
+      pixels.push_back(static_cast<char>(Pixel(i, j)));
+    }
+    return pixels;
+  }
+
+  // Fills the DB with three 1 x 3 x 4 patterns, labelled 0 to 2.
+  void Fill(DataParameter_DB backend) {
+    backend_ = backend;
+    scoped_ptr<db::DB> db(db::GetDB(backend));
+    db->Open(*filename_, db::NEW);
+    scoped_ptr<db::Transaction> txn(db->NewTransaction());
+    for (int i = 0; i < 3; ++i) {
+      Datum datum;
+      datum.set_label(i);
+      datum.set_channels(1);
+      datum.set_height(3);
+      datum.set_width(4);
+      datum.set_data(Pattern(i));
+      stringstream ss;
+      ss << i;
+      string out;
+      CHECK(datum.SerializeToString(&out));
+      txn->Put(ss.str(), out);
+    }
+    txn->Commit();
+    db->Close();
+  }
+
+  LayerParameter EmbedParam(int assembly_threads) {
+    LayerParameter param;
+    param.set_phase(TRAIN);
+    DataParameter* data_param = param.mutable_data_param();
+    data_param->set_batch_size(6);
+    data_param->set_source(filename_->c_str());
+    data_param->set_backend(backend_);
+    data_param->set_canvas_height(8);
+    data_param->set_canvas_width(10);
+    data_param->set_assembly_threads(assembly_threads);
+    return param;
+  }
+
+  // Checks that every canvas holds its two instances at the offsets given
+  // by the location top, and returns the batches of two passes.
+  void TestRead(int assembly_threads, vector<vector<Dtype> >* batches) {
+    Caffe::set_random_seed(1701);
+    TwoInstanceEmbedDataLayer<Dtype> layer(EmbedParam(assembly_threads));
+    layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    EXPECT_EQ(blob_top_data_->num(), 6);
+    EXPECT_EQ(blob_top_data_->channels(), 1);
+    EXPECT_EQ(blob_top_data_->height(), 8);
+    EXPECT_EQ(blob_top_data_->width(), 10);
+    EXPECT_EQ(blob_top_location_->shape(1), 4);
+    for (int iter = 0; iter < 2; ++iter) {
+      layer.Forward(blob_bottom_vec_, blob_top_vec_);
+      for (int n = 0; n < 6; ++n) {
+        const int label = blob_top_label_->cpu_data()[2 * n];
+        EXPECT_EQ(label, blob_top_label_->cpu_data()[2 * n + 1]);
+        // the patterns can move 6 pixels across and 5 down
+        const Dtype* location = blob_top_location_->cpu_data() + 4 * n;
+        int offsets[4];
+        for (int k = 0; k < 4; ++k) {
+          offsets[k] = static_cast<int>(location[k] * (k % 2 ? 5 : 6) + 0.5);
+        }
+        EXPECT_LE(offsets[0], offsets[2]);
+        vector<Dtype> expected(80, 0);
+        for (int k = 0; k < 2; ++k) {
+          for (int j = 0; j < 12; ++j) {
+            expected[(offsets[2 * k + 1] + j / 4) * 10 + offsets[2 * k] +
+                     j % 4] = Pixel(label, j) / Dtype(256);
+          }
+        }
+        for (int j = 0; j < 80; ++j) {
+          EXPECT_EQ(expected[j], blob_top_data_->cpu_data()[n * 80 + j])
+              << "iter " << iter << ", item " << n << ", pixel " << j;
+        }
+      }
+      batches->push_back(vector<Dtype>(blob_top_data_->cpu_data(),
+          blob_top_data_->cpu_data() + blob_top_data_->count()));
+      batches->back().insert(batches->back().end(),
+          blob_top_location_->cpu_data(),
+          blob_top_location_->cpu_data() + blob_top_location_->count());
+    }
+  }
+
+  void TestAssemblyThreads() {
+    vector<vector<Dtype> > serial, parallel;
+    TestRead(1, &serial);
+    TestRead(4, &parallel);
+    ASSERT_EQ(serial.size(), parallel.size());
+    for (int i = 0; i < serial.size(); ++i) {
+      EXPECT_TRUE(serial[i] == parallel[i]) << "batch " << i;
+    }
+  }
+
+  DataParameter_DB backend_;
+  shared_ptr<string> filename_;
+  Blob<Dtype>* const blob_top_data_;
+  Blob<Dtype>* const blob_top_label_;
+  Blob<Dtype>* const blob_top_location_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(TwoInstanceEmbedDataLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(TwoInstanceEmbedDataLayerTest, TestEmbedInstances) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Two channels of 2 x 3 on a 6 x 7 canvas; the instances overlap in
+  // row 1, columns 2 and 3.
+  string pixels;
+  for (int j = 0; j < 12; ++j) {
+    pixels.push_back(static_cast<char>(this->Pixel(0, j)));
+  }
+  const int offsets[] = {1, 0, 2, 1};
+  vector<Dtype> canvas(2 * 42, Dtype(7));
+  TwoInstanceEmbedDataLayer<Dtype>::EmbedInstances(pixels, 2, 2, 3, offsets,
+      6, 7, &canvas[0]);
+  for (int c = 0; c < 2; ++c) {
+    for (int y = 0; y < 6; ++y) {
+      for (int x = 0; x < 7; ++x) {
+        Dtype expected = 0;
+        for (int k = 0; k < 2; ++k) {
+          const int dx = x - offsets[2 * k];
+          const int dy = y - offsets[2 * k + 1];
+          if (dx >= 0 && dx < 3 && dy >= 0 && dy < 2) {
+            expected = this->Pixel(0, (c * 2 + dy) * 3 + dx) / Dtype(256);
+          }
+        }
+        EXPECT_EQ(expected, canvas[(c * 6 + y) * 7 + x])
+            << "channel " << c << ", (" << x << "," << y << ")";
+      }
+    }
+  }
+  // the second instance wins where they overlap
+  EXPECT_EQ(this->Pixel(0, 0) / Dtype(256), canvas[1 * 7 + 2]);
+}
+
+#ifdef USE_LEVELDB
+TYPED_TEST(TwoInstanceEmbedDataLayerTest, TestAssemblyThreadsLevelDB) {
+  this->Fill(DataParameter_DB_LEVELDB);
+  this->TestAssemblyThreads();
+}
+#endif  // USE_LEVELDB
+
+#ifdef USE_LMDB
+TYPED_TEST(TwoInstanceEmbedDataLayerTest, TestAssemblyThreadsLMDB) {
+  this->Fill(DataParameter_DB_LMDB);
+  this->TestAssemblyThreads();
+}
+#endif  // USE_LMDB
+
+}  // namespace caffe
@@ -0,0 +1,284 @@
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/unroll_layer.hpp"
+#include "caffe/util/io.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class UnrollLayerTest : public CPUDeviceTest<Dtype> {
+ protected:
+  UnrollLayerTest()
+      : blob_bottom_h0_(new Blob<Dtype>(2, 2, 1, 1)),
+        blob_bottom_x_(new Blob<Dtype>(2, 3, 1, 1)),
+        blob_top_h_(new Blob<Dtype>()),
+        blob_top_a_(new Blob<Dtype>()) {}
+  virtual void SetUp() {
+    Caffe::set_random_seed(1701);
+    FillerParameter filler_param;
+    filler_param.set_std(0.5);
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_h0_);
+    filler.Fill(this->blob_bottom_x_);
+    blob_bottom_vec_.push_back(blob_bottom_h0_);
+    blob_bottom_vec_.push_back(blob_bottom_x_);
+    blob_top_vec_.push_back(blob_top_h_);
+    blob_top_vec_.push_back(blob_top_a_);
+    // One step of h_t = tanh(a_t), a_t = W h_{t-1} + U x + b.  The product
+    // "a" is also used inside the subnet.
+    subnet_filename_ = WriteSubnet(
+        "name: 'rnn_step' force_backward: true "
+        "layer { name: 'input' type: 'Input' top: 'h_in' top: 'x' } "
+        "layer { name: 'ip_h' type: 'InnerProduct' bottom: 'h_in' top: 'hh' "
+        "  inner_product_param { num_output: 2 bias_term: false "
+        "    weight_filler { type: 'gaussian' std: 0.5 } } } "
+        "layer { name: 'ip_x' type: 'InnerProduct' bottom: 'x' top: 'hx' "
+        "  inner_product_param { num_output: 2 "
+        "    weight_filler { type: 'gaussian' std: 0.5 } "
+        "    bias_filler { type: 'gaussian' std: 0.5 } } } "
+        "layer { name: 'sum' type: 'Eltwise' bottom: 'hh' bottom: 'hx' "
+        "  top: 'a' } "
+        "layer { name: 'h_out' type: 'TanH' bottom: 'a' top: 'h_out' } ");
+  }
+  virtual ~UnrollLayerTest() {
+    for (int i = 0; i < filenames_.size(); ++i) {
+      remove(filenames_[i].c_str());
+    }
+    delete blob_bottom_h0_;
+    delete blob_bottom_x_;
+    delete blob_top_h_;
+    delete blob_top_a_;
+  }
+
+  string WriteSubnet(const string& proto) {
+    NetParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+    string filename;
+    MakeTempFilename(&filename);
+    WriteProtoToTextFile(param, filename);
+    filenames_.push_back(filename);
+    return filename;
+  }
+
+  LayerParameter UnrollParam(int checkpoint_interval) {
+    LayerParameter layer_param;
+    layer_param.set_name("rnn");
+    layer_param.set_phase(TRAIN);
+    layer_param.add_top("h_seq");
+    layer_param.add_top("a");
+    UnrollParameter* unroll_param = layer_param.mutable_unroll_param();
+    unroll_param->set_num_timesteps(3);
+    unroll_param->set_subnet_prototxt(subnet_filename_);
+    unroll_param->add_recurrent_input("h");
+    unroll_param->set_checkpoint_interval(checkpoint_interval);
+    return layer_param;
+  }
+
+  // Fills the top diffs with a fixed pattern.
+  void FillTopDiffs() {
+    for (int i = 0; i < blob_top_vec_.size(); ++i) {
+      Dtype* diff = blob_top_vec_[i]->mutable_cpu_diff();
+      for (int j = 0; j < blob_top_vec_[i]->count(); ++j) {
+        diff[j] = Dtype(0.1) * ((3 * j + i) % 7) - Dtype(0.3);
+      }
+    }
+  }
+
+  Blob<Dtype>* const blob_bottom_h0_;
+  Blob<Dtype>* const blob_bottom_x_;
+  Blob<Dtype>* const blob_top_h_;
+  Blob<Dtype>* const blob_top_a_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+  string subnet_filename_;
+  vector<string> filenames_;
+};
+
+TYPED_TEST_CASE(UnrollLayerTest, TestDtypes);
+
+TYPED_TEST(UnrollLayerTest, TestForwardBackwardReference) {
+  typedef TypeParam Dtype;
+  UnrollLayer<Dtype> layer(this->UnrollParam(0));
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  // (the subnet's Input layer holds a dummy blob ahead of the weights)
+  ASSERT_EQ(layer.blobs().size(), 4);
+  EXPECT_EQ(this->blob_top_h_->num_axes(), 3);
+  EXPECT_EQ(this->blob_top_h_->shape(2), 3);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  this->FillTopDiffs();
+  for (int i = 0; i < layer.blobs().size(); ++i) {
+    layer.blobs()[i]->scale_diff(0);
+  }
+  layer.Backward(this->blob_top_vec_, vector<bool>(2, true),
+                 this->blob_bottom_vec_);
+
+  // The same recurrence unrolled by hand, forward and then backward through
+  // time.  Top blobs interleave the timesteps along their last axis.
+  const int T = 3, N = 2, H = 2, X = 3;
+  const Dtype* W = layer.blobs()[1]->cpu_data();
+  const Dtype* U = layer.blobs()[2]->cpu_data();
+  const Dtype* b = layer.blobs()[3]->cpu_data();
+  const Dtype* x = this->blob_bottom_x_->cpu_data();
+  vector<Dtype> h((T + 1) * N * H), a(T * N * H);
+  for (int k = 0; k < N * H; ++k) {
+    h[k] = this->blob_bottom_h0_->cpu_data()[k];
+  }
+  for (int t = 0; t < T; ++t) {
+    for (int n = 0; n < N; ++n) {
+      for (int i = 0; i < H; ++i) {
+        Dtype sum = b[i];
+        for (int j = 0; j < H; ++j) {
+          sum += W[i * H + j] * h[(t * N + n) * H + j];
+        }
+        for (int j = 0; j < X; ++j) {
+          sum += U[i * X + j] * x[n * X + j];
+        }
+        a[(t * N + n) * H + i] = sum;
+        h[((t + 1) * N + n) * H + i] = tanh(sum);
+        EXPECT_NEAR(this->blob_top_a_->cpu_data()[(n * H + i) * T + t], sum,
+                    1e-5);
+        EXPECT_NEAR(this->blob_top_h_->cpu_data()[(n * H + i) * T + t],
+                    tanh(sum), 1e-5);
+      }
+    }
+  }
+  vector<Dtype> dW(H * H, 0), dU(H * X, 0), db(H, 0), dx(N * X, 0);
+  vector<Dtype> dh(N * H, 0), dh_prev(N * H);
+  for (int t = T - 1; t >= 0; --t) {
+    dh_prev.assign(N * H, 0);
+    for (int n = 0; n < N; ++n) {
+      for (int i = 0; i < H; ++i) {
+        const int k = n * H + i;
+        const Dtype h_t = h[((t + 1) * N + n) * H + i];
+        const Dtype da = (dh[k] + this->blob_top_h_->cpu_diff()[k * T + t])
+            * (1 - h_t * h_t) + this->blob_top_a_->cpu_diff()[k * T + t];
+        db[i] += da;
+        for (int j = 0; j < H; ++j) {
+          dW[i * H + j] += da * h[(t * N + n) * H + j];
+          dh_prev[n * H + j] += da * W[i * H + j];
+        }
+        for (int j = 0; j < X; ++j) {
+          dU[i * X + j] += da * x[n * X + j];
+          dx[n * X + j] += da * U[i * X + j];
+        }
+      }
+    }
+    dh = dh_prev;
+  }
+  for (int k = 0; k < H * H; ++k) {
+    EXPECT_NEAR(layer.blobs()[1]->cpu_diff()[k], dW[k], 1e-5);
+  }
+  for (int k = 0; k < H * X; ++k) {
+    EXPECT_NEAR(layer.blobs()[2]->cpu_diff()[k], dU[k], 1e-5);
+  }
+  for (int k = 0; k < H; ++k) {
+    EXPECT_NEAR(layer.blobs()[3]->cpu_diff()[k], db[k], 1e-5);
+  }
+  for (int k = 0; k < N * H; ++k) {
+    EXPECT_NEAR(this->blob_bottom_h0_->cpu_diff()[k], dh[k], 1e-5);
+  }
+  for (int k = 0; k < N * X; ++k) {
+    EXPECT_NEAR(this->blob_bottom_x_->cpu_diff()[k], dx[k], 1e-5);
+  }
+}
+
+TYPED_TEST(UnrollLayerTest, TestGradient) {
+  typedef TypeParam Dtype;
+  UnrollLayer<Dtype> layer(this->UnrollParam(0));
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+TYPED_TEST(UnrollLayerTest, TestCheckpointGradients) {
+  typedef TypeParam Dtype;
+  UnrollLayer<Dtype> layer(this->UnrollParam(0));
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  this->FillTopDiffs();
+  layer.Backward(this->blob_top_vec_, vector<bool>(2, true),
+                 this->blob_bottom_vec_);
+  vector<shared_ptr<Blob<Dtype> > > expected;
+  for (int i = 0; i < this->blob_bottom_vec_.size(); ++i) {
+    expected.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+    expected.back()->CopyFrom(*this->blob_bottom_vec_[i], true, true);
+  }
+  for (int i = 0; i < layer.blobs().size(); ++i) {
+    expected.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+    expected.back()->CopyFrom(*layer.blobs()[i], true, true);
+  }
+  // One slot (every timestep recomputed but the last), and two slots (an
+  // uneven split into segments [0, 2) and [2, 3)).
+  for (int interval = 1; interval <= 2; ++interval) {
+    UnrollLayer<Dtype> checkpointed(this->UnrollParam(interval));
+    checkpointed.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    for (int i = 0; i < layer.blobs().size(); ++i) {
+      checkpointed.blobs()[i]->CopyFrom(*layer.blobs()[i]);
+      checkpointed.blobs()[i]->scale_diff(0);
+    }
+    checkpointed.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    this->FillTopDiffs();
+    checkpointed.Backward(this->blob_top_vec_, vector<bool>(2, true),
+                          this->blob_bottom_vec_);
+    vector<Blob<Dtype>*> actual(this->blob_bottom_vec_);
+    for (int i = 0; i < checkpointed.blobs().size(); ++i) {
+      actual.push_back(checkpointed.blobs()[i].get());
+    }
+    for (int i = 0; i < actual.size(); ++i) {
+      for (int j = 0; j < actual[i]->count(); ++j) {
+        EXPECT_EQ(actual[i]->cpu_diff()[j], expected[i]->cpu_diff()[j])
+            << "checkpoint_interval " << interval << ", blob " << i;
+      }
+    }
+  }
+}
+
+TYPED_TEST(UnrollLayerTest, TestCheckpointMemory) {
+  typedef TypeParam Dtype;
+  size_t peak_memory_bytes[3];
+  for (int interval = 0; interval <= 2; ++interval) {
+    UnrollLayer<Dtype> layer(this->UnrollParam(interval));
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    peak_memory_bytes[interval] = layer.peak_memory_bytes();
+  }
+  // Without checkpointing, each of the three timesteps holds one copy of the
+  // subnet's activations; with it, every slot holds one and the outputs of
+  // every timestep are stored apart.
+  EXPECT_EQ(peak_memory_bytes[0] % 3, 0);
+  EXPECT_EQ(peak_memory_bytes[2] - peak_memory_bytes[1],
+            peak_memory_bytes[0] / 3);
+  EXPECT_LT(peak_memory_bytes[1], peak_memory_bytes[0]);
+}
+
+TYPED_TEST(UnrollLayerTest, TestCheckpointRefusesSampling) {
+  typedef TypeParam Dtype;
+  this->subnet_filename_ = this->WriteSubnet(
+      "name: 'dropout_step' force_backward: true "
+      "layer { name: 'input' type: 'Input' top: 'h_in' top: 'x' } "
+      "layer { name: 'ip_h' type: 'InnerProduct' bottom: 'h_in' top: 'hh' "
+      "  inner_product_param { num_output: 2 } } "
+      "layer { name: 'drop' type: 'Dropout' bottom: 'hh' top: 'h_out' } "
+      "layer { name: 'ip_x' type: 'InnerProduct' bottom: 'x' top: 'a' "
+      "  inner_product_param { num_output: 2 } } ");
+  // Re-running a Dropout layer draws a new mask: allowed without
+  // checkpointing, refused with it.
+  UnrollLayer<Dtype> layer(this->UnrollParam(0));
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  UnrollLayer<Dtype> checkpointed(this->UnrollParam(1));
+  EXPECT_DEATH(checkpointed.SetUp(this->blob_bottom_vec_, this->blob_top_vec_),
+               "layer .*drop \\(Dropout\\) samples");
+}
+
+}  // namespace caffe
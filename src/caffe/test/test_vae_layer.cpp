@@ -0,0 +1,253 @@
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/vae_layer.hpp"
+#include "caffe/net.hpp"
+#include "caffe/util/io.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class VAELayerTest : public CPUDeviceTest<Dtype> {
+ protected:
+  VAELayerTest()
+      : blob_bottom_z_(new Blob<Dtype>(5, 2, 1, 1)),
+        blob_top_loss_(new Blob<Dtype>()),
+        blob_top_z_(new Blob<Dtype>()),
+        blob_top_sample_(new Blob<Dtype>()) {}
+  virtual void SetUp() {
+    Caffe::set_random_seed(1701);
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_z_);
+    blob_bottom_vec_.push_back(blob_bottom_z_);
+    blob_top_vec_.push_back(blob_top_loss_);
+    blob_top_vec_.push_back(blob_top_z_);
+    blob_top_vec_.push_back(blob_top_sample_);
+    // The encoder maps X (5 x 4) to z (5 x 2); the decoder maps z back,
+    // and under the 'sample' stage leaves out its loss and the X input.
+    // The losses are per item, since a subnet output needs an axis 0.
+    encoder_ = WriteSubnet(
+        "name: 'encoder' "
+        "layer { name: 'input' type: 'Input' top: 'X' } "
+        "layer { name: 'enc' type: 'InnerProduct' bottom: 'X' top: 'sample' "
+        "  inner_product_param { num_output: 2 "
+        "    weight_filler { type: 'gaussian' std: 0.5 } "
+        "    bias_filler { type: 'gaussian' std: 0.5 } } } "
+        "layer { name: 'kl' type: 'Reduction' bottom: 'sample' top: 'loss' "
+        "  reduction_param { operation: SUMSQ axis: 1 } } ");
+    decoder_ = WriteSubnet(
+        "name: 'decoder' "
+        "layer { name: 'input' type: 'Input' top: 'latent' top: 'X' "
+        "  exclude { stage: 'sample' } } "
+        "layer { name: 'input_sample' type: 'Input' top: 'latent' "
+        "  include { stage: 'sample' } } "
+        "layer { name: 'dec' type: 'InnerProduct' bottom: 'latent' "
+        "  top: 'sample' inner_product_param { num_output: 4 "
+        "    weight_filler { type: 'gaussian' std: 0.5 } "
+        "    bias_filler { type: 'gaussian' std: 0.5 } } } "
+        "layer { name: 'error' type: 'Eltwise' bottom: 'sample' bottom: 'X' "
+        "  top: 'error' eltwise_param { coeff: 1 coeff: -1 } "
+        "  exclude { stage: 'sample' } } "
+        "layer { name: 'loss' type: 'Reduction' bottom: 'error' top: 'loss' "
+        "  reduction_param { operation: SUMSQ axis: 1 } "
+        "  exclude { stage: 'sample' } } ");
+  }
+  virtual ~VAELayerTest() {
+    for (int i = 0; i < filenames_.size(); ++i) {
+      remove(filenames_[i].c_str());
+    }
+    delete blob_bottom_z_;
+    delete blob_top_loss_;
+    delete blob_top_z_;
+    delete blob_top_sample_;
+  }
+
+  string WriteSubnet(const string& proto) {
+    NetParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+    string filename;
+    MakeTempFilename(&filename);
+    WriteProtoToTextFile(param, filename);
+    filenames_.push_back(filename);
+    return filename;
+  }
+
+  LayerParameter DecoderOnlyParam(int decoder_batch_size,
+      float latent_sigma) {
+    LayerParameter layer_param;
+    layer_param.set_name("vae");
+    VAEParameter* vae_param = layer_param.mutable_vae_param();
+    vae_param->set_encoder_prototxt(encoder_);
+    vae_param->set_decoder_prototxt(decoder_);
+    vae_param->set_decoder_only(true);
+    vae_param->set_decoder_stage("sample");
+    vae_param->set_decoder_batch_size(decoder_batch_size);
+    vae_param->set_latent_sigma(latent_sigma);
+    return layer_param;
+  }
+
+  // A net holding the VAE layer 'vae', fed by an Input layer.
+  string NetProto(bool decoder_only) {
+    const string vae_param = "vae_param { encoder_prototxt: '" + encoder_ +
+        "' decoder_prototxt: '" + decoder_ + "' ";
+    if (decoder_only) {
+      return "layer { name: 'data' type: 'Input' top: 'z' "
+          "  input_param { shape { dim: 5 dim: 2 } } } "
+          "layer { name: 'vae' type: 'VAE' bottom: 'z' top: 'loss' "
+          "  top: 'z_out' top: 'sample' " + vae_param +
+          "  decoder_only: true decoder_stage: 'sample' } } ";
+    }
+    return "layer { name: 'data' type: 'Input' top: 'X' "
+        "  input_param { shape { dim: 5 dim: 4 } } } "
+        "layer { name: 'vae' type: 'VAE' bottom: 'X' top: 'loss' "
+        "  top: 'z' top: 'sample' " + vae_param + "} } ";
+  }
+
+  // Saves the weights of a full VAE and loads them into a decoder-only one,
+  // which must pick up the decoder's blobs, skipping the encoder's.
+  void TestLoadFullWeights(bool hdf5) {
+    NetParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(NetProto(false),
+                                                        &param));
+    Net<Dtype> full_net(param);
+    string filename;
+    MakeTempFilename(&filename);
+    if (hdf5) {
+      filename += ".h5";
+      full_net.ToHDF5(filename);
+    } else {
+      NetParameter weights;
+      full_net.ToProto(&weights);
+      WriteProtoToBinaryFile(weights, filename);
+    }
+    filenames_.push_back(filename);
+
+    CHECK(google::protobuf::TextFormat::ParseFromString(NetProto(true),
+                                                        &param));
+    Net<Dtype> decoder_net(param);
+    decoder_net.CopyTrainedLayersFrom(filename);
+    const vector<shared_ptr<Blob<Dtype> > >& source =
+        full_net.layer_by_name("vae")->blobs();
+    const vector<shared_ptr<Blob<Dtype> > >& target =
+        decoder_net.layer_by_name("vae")->blobs();
+    ASSERT_LT(target.size(), source.size());
+    const int offset = source.size() - target.size();
+    for (int i = 0; i < target.size(); ++i) {
+      ASSERT_EQ(source[offset + i]->shape(), target[i]->shape());
+      for (int j = 0; j < target[i]->count(); ++j) {
+        EXPECT_EQ(source[offset + i]->cpu_data()[j],
+                  target[i]->cpu_data()[j]);
+      }
+    }
+  }
+
+  Blob<Dtype>* const blob_bottom_z_;
+  Blob<Dtype>* const blob_top_loss_;
+  Blob<Dtype>* const blob_top_z_;
+  Blob<Dtype>* const blob_top_sample_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+  string encoder_, decoder_;
+  vector<string> filenames_;
+};
+
+TYPED_TEST_CASE(VAELayerTest, TestDtypes);
+
+TYPED_TEST(VAELayerTest, TestDecoderOnly) {
+  typedef TypeParam Dtype;
+  VAELayer<Dtype> layer(this->DecoderOnlyParam(0, 0));
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(this->blob_top_loss_->count(), 1);
+  EXPECT_EQ(this->blob_top_z_->shape(), this->blob_bottom_z_->shape());
+  EXPECT_EQ(this->blob_top_sample_->num(), 5);
+  EXPECT_EQ(this->blob_top_sample_->count(1), 4);
+  // Only the decoder is built.
+  EXPECT_EQ(layer.subnets().size(), 1);
+  const Blob<Dtype>* weight = NULL;
+  const Blob<Dtype>* bias = NULL;
+  for (int i = 0; i < layer.blobs().size(); ++i) {
+    EXPECT_NE(layer.blob_names()[i].find("vae::decoder::"), string::npos)
+        << layer.blob_names()[i];
+    if (layer.blobs()[i]->count() == 8) weight = layer.blobs()[i].get();
+    if (layer.blobs()[i]->count() == 4) bias = layer.blobs()[i].get();
+  }
+  ASSERT_TRUE(weight != NULL);
+  ASSERT_TRUE(bias != NULL);
+
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(this->blob_top_loss_->cpu_data()[0], 0);
+  const Dtype* z = this->blob_bottom_z_->cpu_data();
+  for (int i = 0; i < this->blob_bottom_z_->count(); ++i) {
+    EXPECT_EQ(z[i], this->blob_top_z_->cpu_data()[i]);
+  }
+  for (int n = 0; n < 5; ++n) {
+    for (int k = 0; k < 4; ++k) {
+      Dtype expected = bias->cpu_data()[k];
+      for (int d = 0; d < 2; ++d) {
+        expected += weight->cpu_data()[k * 2 + d] * z[n * 2 + d];
+      }
+      EXPECT_NEAR(expected, this->blob_top_sample_->cpu_data()[n * 4 + k],
+                  1e-5);
+    }
+  }
+  EXPECT_DEATH(layer.Backward(this->blob_top_vec_, vector<bool>(1, false),
+                              this->blob_bottom_vec_),
+               "decoder_only, which is inference-only");
+}
+
+TYPED_TEST(VAELayerTest, TestDecoderBatchSize) {
+  typedef TypeParam Dtype;
+  const float latent_sigmas[] = {0, 0.5};
+  for (int s = 0; s < 2; ++s) {
+    VAELayer<Dtype> whole(this->DecoderOnlyParam(0, latent_sigmas[s]));
+    whole.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    whole.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    Blob<Dtype> expected_z, expected_sample;
+    expected_z.CopyFrom(*this->blob_top_z_, false, true);
+    expected_sample.CopyFrom(*this->blob_top_sample_, false, true);
+    // chunks of 2 and 3 leave a short last chunk; 5 is the whole batch
+    const int batch_sizes[] = {1, 2, 3, 5};
+    for (int b = 0; b < 4; ++b) {
+      VAELayer<Dtype> layer(
+          this->DecoderOnlyParam(batch_sizes[b], latent_sigmas[s]));
+      layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+      ASSERT_EQ(layer.blobs().size(), whole.blobs().size());
+      for (int i = 0; i < whole.blobs().size(); ++i) {
+        layer.blobs()[i]->CopyFrom(*whole.blobs()[i]);
+      }
+      layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+      ASSERT_EQ(expected_sample.shape(), this->blob_top_sample_->shape());
+      for (int i = 0; i < expected_z.count(); ++i) {
+        EXPECT_EQ(expected_z.cpu_data()[i], this->blob_top_z_->cpu_data()[i])
+            << "latent_sigma " << latent_sigmas[s]
+            << ", decoder_batch_size " << batch_sizes[b];
+      }
+      for (int i = 0; i < expected_sample.count(); ++i) {
+        EXPECT_NEAR(expected_sample.cpu_data()[i],
+                    this->blob_top_sample_->cpu_data()[i], 1e-5)
+            << "latent_sigma " << latent_sigmas[s]
+            << ", decoder_batch_size " << batch_sizes[b];
+      }
+    }
+  }
+}
+
+TYPED_TEST(VAELayerTest, TestLoadFullWeightsBinaryProto) {
+  this->TestLoadFullWeights(false);
+}
+
+TYPED_TEST(VAELayerTest, TestLoadFullWeightsHDF5) {
+  this->TestLoadFullWeights(true);
+}
+
+}  // namespace caffe
@@ -1,7 +1,9 @@
 #include <boost/math/special_functions/next.hpp>
 #include <boost/random.hpp>
 
+#include <algorithm>
 #include <limits>
+#include <vector>
 
 #include "caffe/common.hpp"
 #include "caffe/util/math_functions.hpp"
@@ -335,6 +337,73 @@ void caffe_rng_bernoulli<double>(const int n, const double p, unsigned int* r);
 template
 void caffe_rng_bernoulli<float>(const int n, const float p, unsigned int* r);
 
+template <typename Dtype>
+void caffe_rng_stream_uniform(const PhiloxStream& stream, const int n,
+                              const Dtype a, const Dtype b, Dtype* r,
+                              const int offset) {
+  CHECK_GE(n, 0);
+  CHECK_GE(offset, 0);
+  CHECK(r);
+  CHECK_LE(a, b);
+  // each Philox block yields four elements; blocks are independent
+  const int first_block = offset / 4;
+  const int end_block = (offset + n + 3) / 4;
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+  for (int block = first_block; block < end_block; ++block) {
+    Dtype u[4];
+    philox_uniform4(stream, block, u);
+    for (int lane = 0; lane < 4; ++lane) {
+      const int i = block * 4 + lane - offset;
+      if (i >= 0 && i < n) {
+        r[i] = a + (b - a) * u[lane];
+      }
+    }
+  }
+}
+
+template
+void caffe_rng_stream_uniform<float>(const PhiloxStream& stream, const int n,
+    const float a, const float b, float* r, const int offset);
+
+template
+void caffe_rng_stream_uniform<double>(const PhiloxStream& stream, const int n,
+    const double a, const double b, double* r, const int offset);
+
+template <typename Dtype>
+void caffe_rng_stream_gaussian(const PhiloxStream& stream, const int n,
+                               const Dtype mu, const Dtype sigma, Dtype* r,
+                               const int offset) {
+  CHECK_GE(n, 0);
+  CHECK_GE(offset, 0);
+  CHECK(r);
+  CHECK_GT(sigma, 0);
+  const int first_block = offset / 4;
+  const int end_block = (offset + n + 3) / 4;
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+  for (int block = first_block; block < end_block; ++block) {
+    Dtype z[4];
+    philox_gaussian4(stream, block, z);
+    for (int lane = 0; lane < 4; ++lane) {
+      const int i = block * 4 + lane - offset;
+      if (i >= 0 && i < n) {
+        r[i] = mu + sigma * z[lane];
+      }
+    }
+  }
+}
+
+template
+void caffe_rng_stream_gaussian<float>(const PhiloxStream& stream, const int n,
+    const float mu, const float sigma, float* r, const int offset);
+
+template
+void caffe_rng_stream_gaussian<double>(const PhiloxStream& stream, const int n,
+    const double mu, const double sigma, double* r, const int offset);
+
 template <>
 float caffe_cpu_strided_dot<float>(const int n, const float* x, const int incx,
     const float* y, const int incy) {
@@ -382,4 +451,181 @@ void caffe_cpu_scale<double>(const int n, const double alpha, const double *x,
   cblas_dscal(n, alpha, y, 1);
 }
 
+// Element-wise conversions to and from the 16-bit formats, with an 8-wide
+// path for float and IEEE half on CPUs with F16C.
+template <typename Dtype, typename Half>
+static void ConvertToHalf(const int n, const Dtype* x, Half* y) {
+  for (int i = 0; i < n; ++i) {
+    float_to_half(static_cast<float>(x[i]), &y[i]);
+  }
+}
+
+template <typename Dtype, typename Half>
+static void ConvertFromHalf(const int n, const Half* x, Dtype* y) {
+  for (int i = 0; i < n; ++i) {
+    y[i] = half_to_float(x[i]);
+  }
+}
+
+#ifdef __F16C__
+static void ConvertToHalf(const int n, const float* x, fp16* y) {
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(y + i),
+                     _mm256_cvtps_ph(_mm256_loadu_ps(x + i), 0));
+  }
+  for (; i < n; ++i) {
+    y[i] = float_to_fp16(x[i]);
+  }
+}
+
+static void ConvertFromHalf(const int n, const fp16* x, float* y) {
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    _mm256_storeu_ps(y + i, _mm256_cvtph_ps(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i))));
+  }
+  for (; i < n; ++i) {
+    y[i] = fp16_to_float(x[i]);
+  }
+}
+#endif
+
+template <typename Dtype, typename Half>
+void caffe_cpu_to_half(const int n, const Dtype* x, Half* y) {
+  ConvertToHalf(n, x, y);
+}
+
+template <typename Dtype, typename Half>
+void caffe_cpu_from_half(const int n, const Half* x, Dtype* y) {
+  ConvertFromHalf(n, x, y);
+}
+
+template void caffe_cpu_to_half<float, fp16>(const int n, const float* x,
+    fp16* y);
+template void caffe_cpu_to_half<float, bf16>(const int n, const float* x,
+    bf16* y);
+template void caffe_cpu_to_half<double, fp16>(const int n,
+    const double* x, fp16* y);
+template void caffe_cpu_to_half<double, bf16>(const int n,
+    const double* x, bf16* y);
+template void caffe_cpu_from_half<float, fp16>(const int n,
+    const fp16* x, float* y);
+template void caffe_cpu_from_half<float, bf16>(const int n,
+    const bf16* x, float* y);
+template void caffe_cpu_from_half<double, fp16>(const int n,
+    const fp16* x, double* y);
+template void caffe_cpu_from_half<double, bf16>(const int n,
+    const bf16* x, double* y);
+
+// The number of elements of the 16-bit operand caffe_cpu_gemm_half expands
+// at a time: 256KB of floats, which stay in cache while gemm reads them.
+static const int kHalfPanelSize = 1 << 16;
+
+static void cblas_gemm(const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+    const float alpha, const float* A, const int lda, const float* B,
+    const int ldb, const float beta, float* C, const int ldc) {
+  cblas_sgemm(CblasRowMajor, TransA, TransB, M, N, K, alpha, A, lda, B,
+      ldb, beta, C, ldc);
+}
+
+static void cblas_gemm(const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+    const double alpha, const double* A, const int lda, const double* B,
+    const int ldb, const double beta, double* C, const int ldc) {
+  cblas_dgemm(CblasRowMajor, TransA, TransB, M, N, K, alpha, A, lda, B,
+      ldb, beta, C, ldc);
+}
+
+// C = alpha * op(A) * op(B) + beta * C, with A given as half_A or B as
+// half_B in 16-bit storage.  The 16-bit matrix is expanded a block of its
+// (row-major) rows at a time, so each block converts in one contiguous run;
+// depending on the transpose, its rows run along K, and the blocks' products
+// are summed into C, or along M (N), and each block fills rows (columns)
+// of C.
+template <typename Dtype, typename Half>
+static void GemmHalf(const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+    const Dtype alpha, const Dtype* A, const Half* half_A, const Dtype* B,
+    const Half* half_B, const Dtype beta, Dtype* C) {
+  if (M == 0 || N == 0) { return; }
+  if (K == 0) {
+    if (beta == 0) {
+      caffe_set(M * N, Dtype(0), C);
+    } else {
+      caffe_scal(M * N, beta, C);
+    }
+    return;
+  }
+  const int lda = (TransA == CblasNoTrans) ? K : M;
+  const int ldb = (TransB == CblasNoTrans) ? N : K;
+  // The stored 16-bit matrix is rows x cols, with rows along K if
+  // along_k, else along M (for A) or N (for B).
+  const bool along_k = half_A ? (TransA != CblasNoTrans) :
+      (TransB == CblasNoTrans);
+  const int rows = along_k ? K : (half_A ? M : N);
+  const int cols = half_A ? lda : ldb;
+  const int panel = std::max(1, std::min(rows, kHalfPanelSize / cols));
+  std::vector<Dtype> expanded(static_cast<size_t>(panel) * cols);
+  for (int r = 0; r < rows; r += panel) {
+    const int p = std::min(panel, rows - r);
+    caffe_cpu_from_half(p * cols, (half_A ? half_A : half_B) + r * cols,
+        &expanded[0]);
+    if (along_k) {
+      // rows [r, r + p) of op(B), or columns of op(A), accumulate into C
+      const Dtype beta_r = (r == 0) ? beta : Dtype(1);
+      if (half_A) {
+        cblas_gemm(TransA, TransB, M, N, p, alpha, &expanded[0], lda,
+            B + (TransB == CblasNoTrans ? r * ldb : r), ldb, beta_r, C, N);
+      } else {
+        cblas_gemm(TransA, TransB, M, N, p, alpha,
+            A + (TransA == CblasNoTrans ? r : r * lda), lda, &expanded[0],
+            ldb, beta_r, C, N);
+      }
+    } else if (half_A) {
+      // rows [r, r + p) of op(A) give those rows of C
+      cblas_gemm(TransA, TransB, p, N, K, alpha, &expanded[0], lda, B, ldb,
+          beta, C + r * N, N);
+    } else {
+      // columns [r, r + p) of op(B) give those columns of C
+      cblas_gemm(TransA, TransB, M, p, K, alpha, A, lda, &expanded[0], ldb,
+          beta, C + r, N);
+    }
+  }
+}
+
+template <typename Dtype, typename Half>
+void caffe_cpu_gemm_half(const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+    const Dtype alpha, const Dtype* A, const Half* B, const Dtype beta,
+    Dtype* C) {
+  GemmHalf<Dtype, Half>(TransA, TransB, M, N, K, alpha, A, NULL, NULL, B,
+      beta, C);
+}
+
+template <typename Dtype, typename Half>
+void caffe_cpu_gemm_half(const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+    const Dtype alpha, const Half* A, const Dtype* B, const Dtype beta,
+    Dtype* C) {
+  GemmHalf<Dtype, Half>(TransA, TransB, M, N, K, alpha, NULL, A, B, NULL,
+      beta, C);
+}
+
+#define INSTANTIATE_GEMM_HALF(Dtype, Half) \
+  template void caffe_cpu_gemm_half<Dtype, Half>( \
+      const CBLAS_TRANSPOSE TransA, const CBLAS_TRANSPOSE TransB, \
+      const int M, const int N, const int K, const Dtype alpha, \
+      const Dtype* A, const Half* B, const Dtype beta, Dtype* C); \
+  template void caffe_cpu_gemm_half<Dtype, Half>( \
+      const CBLAS_TRANSPOSE TransA, const CBLAS_TRANSPOSE TransB, \
+      const int M, const int N, const int K, const Dtype alpha, \
+      const Half* A, const Dtype* B, const Dtype beta, Dtype* C)
+
+INSTANTIATE_GEMM_HALF(float, fp16);
+INSTANTIATE_GEMM_HALF(float, bf16);
+INSTANTIATE_GEMM_HALF(double, fp16);
+INSTANTIATE_GEMM_HALF(double, bf16);
+
 }  // namespace caffe
@@ -456,6 +456,93 @@ void caffe_gpu_rng_gaussian(const int n, const double mu, const double sigma,
       curandGenerateNormalDouble(Caffe::curand_generator(), r, n, mu, sigma));
 }
 
+// one thread per Philox block of four elements
+template <typename Dtype>
+__global__ void rng_stream_uniform_kernel(const int nblocks,
+    const PhiloxStream stream, const int first_block, const int offset,
+    const int n, const Dtype a, const Dtype b, Dtype* r) {
+  CUDA_KERNEL_LOOP(index, nblocks) {
+    const int block = first_block + index;
+    Dtype u[4];
+    philox_uniform4(stream, block, u);
+    for (int lane = 0; lane < 4; ++lane) {
+      const int i = block * 4 + lane - offset;
+      if (i >= 0 && i < n) {
+        r[i] = a + (b - a) * u[lane];
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+__global__ void rng_stream_gaussian_kernel(const int nblocks,
+    const PhiloxStream stream, const int first_block, const int offset,
+    const int n, const Dtype mu, const Dtype sigma, Dtype* r) {
+  CUDA_KERNEL_LOOP(index, nblocks) {
+    const int block = first_block + index;
+    Dtype z[4];
+    philox_gaussian4(stream, block, z);
+    for (int lane = 0; lane < 4; ++lane) {
+      const int i = block * 4 + lane - offset;
+      if (i >= 0 && i < n) {
+        r[i] = mu + sigma * z[lane];
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void caffe_gpu_rng_stream_uniform(const PhiloxStream& stream, const int n,
+                                  const Dtype a, const Dtype b, Dtype* r,
+                                  const int offset) {
+  CHECK_GE(n, 0);
+  CHECK_GE(offset, 0);
+  CHECK_LE(a, b);
+  const int first_block = offset / 4;
+  const int nblocks = (offset + n + 3) / 4 - first_block;
+  if (n == 0) { return; }
+  // NOLINT_NEXT_LINE(whitespace/operators)
+  rng_stream_uniform_kernel<Dtype><<<CAFFE_GET_BLOCKS(nblocks),
+      CAFFE_CUDA_NUM_THREADS>>>(nblocks, stream, first_block, offset, n,
+      a, b, r);
+  CUDA_POST_KERNEL_CHECK;
+}
+
+template
+void caffe_gpu_rng_stream_uniform<float>(const PhiloxStream& stream,
+    const int n, const float a, const float b, float* r, const int offset);
+
+template
+void caffe_gpu_rng_stream_uniform<double>(const PhiloxStream& stream,
+    const int n, const double a, const double b, double* r, const int offset);
+
+template <typename Dtype>
+void caffe_gpu_rng_stream_gaussian(const PhiloxStream& stream, const int n,
+                                   const Dtype mu, const Dtype sigma, Dtype* r,
+                                   const int offset) {
+  CHECK_GE(n, 0);
+  CHECK_GE(offset, 0);
+  CHECK_GT(sigma, 0);
+  const int first_block = offset / 4;
+  const int nblocks = (offset + n + 3) / 4 - first_block;
+  if (n == 0) { return; }
+  // NOLINT_NEXT_LINE(whitespace/operators)
+  rng_stream_gaussian_kernel<Dtype><<<CAFFE_GET_BLOCKS(nblocks),
+      CAFFE_CUDA_NUM_THREADS>>>(nblocks, stream, first_block, offset, n,
+      mu, sigma, r);
+  CUDA_POST_KERNEL_CHECK;
+}
+
+template
+void caffe_gpu_rng_stream_gaussian<float>(const PhiloxStream& stream,
+    const int n, const float mu, const float sigma, float* r,
+    const int offset);
+
+template
+void caffe_gpu_rng_stream_gaussian<double>(const PhiloxStream& stream,
+    const int n, const double mu, const double sigma, double* r,
+    const int offset);
+
 template<>
 void caffe_gpu_absmax<float>(const int n, const float* x, int* r){
    CUBLAS_CHECK(cublasIsamax(Caffe::cublas_handle(), n, x, 1, r));
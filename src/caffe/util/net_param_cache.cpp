@@ -0,0 +1,71 @@
+#include <boost/thread.hpp>
+
+#include <map>
+#include <string>
+
+#include "caffe/net.hpp"
+#include "caffe/util/net_param_cache.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+namespace caffe {
+
+namespace {
+
+// Both maps are guarded by one mutex.  Filtering does not depend on Dtype, so
+// Net<float>::FilterNet serves nets of either type.
+boost::mutex& CacheMutex() {
+  static boost::mutex mutex;
+  return mutex;
+}
+
+std::map<string, NetParameter>& ParsedCache() {
+  static std::map<string, NetParameter> cache;
+  return cache;
+}
+
+std::map<string, NetParameter>& FilteredCache() {
+  static std::map<string, NetParameter> cache;
+  return cache;
+}
+
+// Requires CacheMutex to be held.
+const NetParameter& ParsedLocked(const string& param_file) {
+  std::map<string, NetParameter>::iterator it =
+      ParsedCache().find(param_file);
+  if (it == ParsedCache().end()) {
+    it = ParsedCache().insert(make_pair(param_file, NetParameter())).first;
+    ReadNetParamsFromTextFileOrDie(param_file, &it->second);
+  }
+  return it->second;
+}
+
+}  // namespace
+
+void ReadNetParamsFromTextFileCached(const string& param_file,
+                                     NetParameter* param) {
+  boost::mutex::scoped_lock lock(CacheMutex());
+  param->CopyFrom(ParsedLocked(param_file));
+}
+
+void ReadFilteredNetParamsCached(const string& param_file,
+                                 const NetState& state, NetParameter* param) {
+  boost::mutex::scoped_lock lock(CacheMutex());
+  // NUL cannot appear in a file name, so the key is unambiguous.
+  const string key = param_file + '\0' + state.SerializeAsString();
+  std::map<string, NetParameter>::iterator it = FilteredCache().find(key);
+  if (it == FilteredCache().end()) {
+    NetParameter unfiltered(ParsedLocked(param_file));
+    unfiltered.mutable_state()->MergeFrom(state);
+    it = FilteredCache().insert(make_pair(key, NetParameter())).first;
+    Net<float>::FilterNet(unfiltered, &it->second);
+  }
+  param->CopyFrom(it->second);
+}
+
+void ClearNetParamsCache() {
+  boost::mutex::scoped_lock lock(CacheMutex());
+  ParsedCache().clear();
+  FilteredCache().clear();
+}
+
+}  // namespace caffe
@@ -48,6 +48,8 @@ DEFINE_string(weights, "",
     "separated by ','. Cannot be set simultaneously with snapshot.");
 DEFINE_int32(iterations, 50,
     "The number of iterations to run.");
+DEFINE_string(host_allocator, "",
+    "Optional; the allocator for host memory: malloc (default) or pooled.");
 DEFINE_string(sigint_effect, "stop",
              "Optional; action to take when a SIGINT signal is received: "
               "snapshot, stop or none.");
@@ -421,6 +423,10 @@ int time() {
   LOG(INFO) << "Average Forward-Backward: " << total_timer.MilliSeconds() /
     FLAGS_iterations << " ms.";
   LOG(INFO) << "Total Time: " << total_timer.MilliSeconds() << " ms.";
+  const shared_ptr<caffe::HostAllocator>& allocator = caffe::host_allocator();
+  LOG(INFO) << "Host memory (" << allocator->type() << "): "
+    << allocator->allocations() << " allocations, "
+    << allocator->peak_bytes_in_use() << " bytes at peak.";
   LOG(INFO) << "*** Benchmark ends ***";
   return 0;
 }
@@ -441,6 +447,10 @@ int main(int argc, char** argv) {
       "  time            benchmark model execution time");
   // Run tool or show usage.
   caffe::GlobalInit(&argc, &argv);
+  if (FLAGS_host_allocator.size()) {
+    caffe::set_host_allocator(
+        caffe::CreateHostAllocator(FLAGS_host_allocator));
+  }
   if (argc == 2) {
 #ifdef WITH_PYTHON_LAYER
     try {
@@ -0,0 +1,162 @@
+// Times GlimpseCroppingLayer against the original per-pixel implementation
+// and checks that both produce the same glimpses.
+//
+// Usage:
+//    glimpse_cropping_benchmark [FLAGS]
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layer_factory.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/benchmark.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+DEFINE_int32(num, 64, "Number of images");
+DEFINE_int32(samples, 1, "Glimpse locations per image");
+DEFINE_int32(channels, 1, "Image channels");
+DEFINE_int32(size, 100, "Image height and width");
+DEFINE_int32(window, 21, "Glimpse window size");
+DEFINE_bool(downsamp, true, "Add one 2x downsampled level to the glimpse");
+DEFINE_int32(iterations, 50, "Number of timed iterations");
+DEFINE_bool(gpu, false, "Also time the layer in GPU mode");
+
+// The original Forward_cpu: four nested scalar loops with Blob::offset()
+// per pixel and the downsampled origin recomputed in the innermost loop.
+void ReferenceForward(const Blob<float>& image, const Blob<float>& loc,
+    int crop_size, bool do_downsamp, Blob<float>* glimpse) {
+  const float* full_data=image.cpu_data();
+  const float* location_tuple=loc.cpu_data();
+  float* glimpse_data=glimpse->mutable_cpu_data();
+  const int H=image.height();
+  const int W=image.width();
+  for(int iN=0;iN<loc.shape(0);iN++){
+    const int img=iN%image.num();
+    float crop_x=location_tuple[iN*2];
+    float crop_y=location_tuple[iN*2+1];
+    int crop_xmin_pix=(int)(crop_x*(H-crop_size));
+    int crop_ymin_pix=(int)(crop_y*(W-crop_size));
+    for(int ich=0;ich<image.channels();ich++){
+      for(int iX=0;iX<crop_size;iX++){
+        for(int iY=0;iY<crop_size;iY++){
+          glimpse_data[glimpse->offset(iN,ich,iX,iY)]=
+            full_data[image.offset(img,ich,crop_xmin_pix+iX,crop_ymin_pix+iY)];
+          if(do_downsamp){
+            int crop_xmin_pix_ds=(int)(crop_x*(H-2*crop_size));
+            int crop_ymin_pix_ds=(int)(crop_y*(W-2*crop_size));
+            float downsamp=
+              (full_data[image.offset(img,ich,crop_xmin_pix_ds+iX*2,
+                                      crop_ymin_pix_ds+iY*2)]
+              +full_data[image.offset(img,ich,crop_xmin_pix_ds+iX*2,
+                                      crop_ymin_pix_ds+iY*2+1)]
+              +full_data[image.offset(img,ich,crop_xmin_pix_ds+iX*2+1,
+                                      crop_ymin_pix_ds+iY*2)]
+              +full_data[image.offset(img,ich,crop_xmin_pix_ds+iX*2+1,
+                                      crop_ymin_pix_ds+iY*2+1)])/4.;
+            glimpse_data[glimpse->offset(iN,ich+image.channels(),iX,iY)]=
+              downsamp;
+          }
+        }
+      }
+    }
+  }
+}
+
+float MaxAbsDiff(const Blob<float>& a, const Blob<float>& b) {
+  CHECK_EQ(a.count(),b.count());
+  float maxdiff=0;
+  for(int i=0;i<a.count();i++){
+    maxdiff=std::max(maxdiff,std::fabs(a.cpu_data()[i]-b.cpu_data()[i]));
+  }
+  return maxdiff;
+}
+
+float TimeLayer(Layer<float>* layer, const vector<Blob<float>*>& bottom,
+    const vector<Blob<float>*>& top) {
+  layer->Forward(bottom,top);  // warm up
+  Timer timer;
+  timer.Start();
+  for(int i=0;i<FLAGS_iterations;i++) layer->Forward(bottom,top);
+  timer.Stop();
+  return timer.MilliSeconds()/FLAGS_iterations;
+}
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  FLAGS_alsologtostderr = 1;
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Benchmark GlimpseCroppingLayer against the "
+        "original per-pixel implementation\n"
+        "Usage:\n"
+        "    glimpse_cropping_benchmark [FLAGS]\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  Blob<float> image(FLAGS_num,FLAGS_channels,FLAGS_size,FLAGS_size);
+  vector<int> loc_shape(2);
+  loc_shape[0]=FLAGS_num*FLAGS_samples;
+  loc_shape[1]=2;
+  Blob<float> loc(loc_shape);
+  Blob<float> glimpse, reference;
+
+  FillerParameter filler_param;
+  GaussianFiller<float>(filler_param).Fill(&image);
+  caffe_rng_uniform<float>(loc.count(),0,1,loc.mutable_cpu_data());
+
+  LayerParameter param;
+  param.set_type("GlimpseCropping");
+  param.mutable_glimpse_cropping_param()->set_window(FLAGS_window);
+  param.mutable_glimpse_cropping_param()->set_do_downsamp(FLAGS_downsamp);
+  shared_ptr<Layer<float> > layer=LayerRegistry<float>::CreateLayer(param);
+
+  vector<Blob<float>*> bottom, top;
+  bottom.push_back(&image);
+  bottom.push_back(&loc);
+  top.push_back(&glimpse);
+  layer->SetUp(bottom,top);
+  reference.ReshapeLike(glimpse);
+
+  Caffe::set_mode(Caffe::CPU);
+  ReferenceForward(image,loc,FLAGS_window,FLAGS_downsamp,&reference);
+  CPUTimer timer;
+  timer.Start();
+  for(int i=0;i<FLAGS_iterations;i++){
+    ReferenceForward(image,loc,FLAGS_window,FLAGS_downsamp,&reference);
+  }
+  timer.Stop();
+  const float reference_ms=timer.MilliSeconds()/FLAGS_iterations;
+  const float cpu_ms=TimeLayer(layer.get(),bottom,top);
+  const float glimpses=FLAGS_num*FLAGS_samples;
+
+  LOG(INFO) << "Reference forward: " << reference_ms << " ms ("
+            << glimpses/reference_ms*1000 << " glimpses/s)";
+  LOG(INFO) << "Layer forward (CPU): " << cpu_ms << " ms ("
+            << glimpses/cpu_ms*1000 << " glimpses/s, "
+            << reference_ms/cpu_ms << "x)";
+  LOG(INFO) << "Max abs difference (CPU): " << MaxAbsDiff(glimpse,reference);
+
+  if(FLAGS_gpu){
+#ifndef CPU_ONLY
+    Caffe::set_mode(Caffe::GPU);
+    const float gpu_ms=TimeLayer(layer.get(),bottom,top);
+    LOG(INFO) << "Layer forward (GPU): " << gpu_ms << " ms ("
+              << glimpses/gpu_ms*1000 << " glimpses/s, "
+              << reference_ms/gpu_ms << "x)";
+    LOG(INFO) << "Max abs difference (GPU): " 
+              << MaxAbsDiff(glimpse,reference);
+#else
+    LOG(ERROR) << "Built with CPU_ONLY; skipping the GPU timing";
+#endif
+  }
+  return 0;
+}
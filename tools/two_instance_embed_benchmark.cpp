@@ -0,0 +1,157 @@
+// Times the TwoInstanceEmbedDataLayer batch assembly against the original
+// per-pixel implementation on synthetic patterns, and checks that both
+// produce the same canvases.
+//
+// Usage:
+//    two_instance_embed_benchmark [FLAGS]
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include <stdint.h>
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/layers/two_instance_embed_data_layer.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/math_functions.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+DEFINE_int32(num, 64, "Batch size");
+DEFINE_int32(channels, 1, "Pattern channels");
+DEFINE_int32(size, 28, "Pattern height and width");
+DEFINE_int32(canvas, 100, "Canvas height and width");
+DEFINE_int32(threads, 0, "Assembly threads (0: the OpenMP default)");
+DEFINE_int32(iterations, 50, "Number of timed iterations");
+
+// The original load_batch inner work: a scalar pass zeroing the batch, then
+// a triple loop over (channel, x, y) writing both instances per pixel.
+void ReferenceAssemble(const vector<string>& pixels, const vector<int>& offsets,
+    Blob<float>* canvas) {
+  float* top_data=canvas->mutable_cpu_data();
+  for(int i=0;i<canvas->count();i++) top_data[i]=0;
+  const int H=canvas->height();
+  const int W=canvas->width();
+  for(int item_id=0;item_id<canvas->num();item_id++){
+    const string& data1=pixels[item_id];
+    const string& data2=pixels[item_id];
+    const int* off=&offsets[item_id*4];
+    for(int ic=0;ic<FLAGS_channels;ic++){
+      for(int ix=0;ix<FLAGS_size;ix++){
+        for(int iy=0;iy<FLAGS_size;iy++){
+          int top_idx1=((item_id*FLAGS_channels+ic)*H+off[1]+iy)*W+off[0]+ix;
+          int top_idx2=((item_id*FLAGS_channels+ic)*H+off[3]+iy)*W+off[2]+ix;
+          int data_index=(ic*FLAGS_size+iy)*FLAGS_size+ix;
+          float datum1_element=static_cast<float>(
+              static_cast<uint8_t>(data1[data_index]))*0.00390625;
+          float datum2_element=static_cast<float>(
+              static_cast<uint8_t>(data2[data_index]))*0.00390625;
+          top_data[top_idx1]=datum1_element;
+          top_data[top_idx2]=datum2_element;
+        }
+      }
+    }
+  }
+}
+
+// What load_batch now does once the items are read: one EmbedInstances call
+// per item, spread over the assembly threads.
+void Assemble(const vector<string>& pixels, const vector<int>& offsets,
+    int threads, Blob<float>* canvas) {
+  float* top_data=canvas->mutable_cpu_data();
+#ifdef _OPENMP
+  #pragma omp parallel for num_threads(threads)
+#endif
+  for(int item_id=0;item_id<canvas->num();item_id++){
+    TwoInstanceEmbedDataLayer<float>::EmbedInstances(pixels[item_id],
+        FLAGS_channels,FLAGS_size,FLAGS_size,&offsets[item_id*4],
+        canvas->height(),canvas->width(),top_data+canvas->offset(item_id));
+  }
+}
+
+float MaxAbsDiff(const Blob<float>& a, const Blob<float>& b) {
+  CHECK_EQ(a.count(),b.count());
+  float maxdiff=0;
+  for(int i=0;i<a.count();i++){
+    maxdiff=std::max(maxdiff,std::fabs(a.cpu_data()[i]-b.cpu_data()[i]));
+  }
+  return maxdiff;
+}
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  FLAGS_alsologtostderr = 1;
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Benchmark TwoInstanceEmbedDataLayer batch "
+        "assembly against the original per-pixel implementation\n"
+        "Usage:\n"
+        "    two_instance_embed_benchmark [FLAGS]\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  CHECK_LE(FLAGS_size,FLAGS_canvas);
+
+  int threads=1;
+#ifdef _OPENMP
+  threads=FLAGS_threads>0 ? FLAGS_threads : omp_get_max_threads();
+#else
+  LOG(INFO) << "Built without OpenMP; assembling on one thread";
+#endif
+
+  // random patterns and placements, as load_batch would draw them
+  const int pattern_size=FLAGS_channels*FLAGS_size*FLAGS_size;
+  vector<float> noise(FLAGS_num*pattern_size);
+  caffe_rng_uniform<float>(noise.size(),0,256,&noise[0]);
+  vector<string> pixels(FLAGS_num,string(pattern_size,'\0'));
+  for(int i=0;i<FLAGS_num;i++){
+    for(int j=0;j<pattern_size;j++){
+      const int value=std::min(255,(int)noise[i*pattern_size+j]);
+      pixels[i][j]=static_cast<char>(value);
+    }
+  }
+  const int range=FLAGS_canvas-FLAGS_size;
+  vector<float> rand(4*FLAGS_num);
+  caffe_rng_uniform<float>(rand.size(),0,1,&rand[0]);
+  vector<int> offsets(4*FLAGS_num);
+  for(int i=0;i<offsets.size();i++) offsets[i]=(int)(range*rand[i]);
+
+  Blob<float> canvas(FLAGS_num,FLAGS_channels,FLAGS_canvas,FLAGS_canvas);
+  Blob<float> reference(FLAGS_num,FLAGS_channels,FLAGS_canvas,FLAGS_canvas);
+
+  ReferenceAssemble(pixels,offsets,&reference);  // warm up
+  CPUTimer timer;
+  timer.Start();
+  for(int i=0;i<FLAGS_iterations;i++){
+    ReferenceAssemble(pixels,offsets,&reference);
+  }
+  timer.Stop();
+  const float reference_ms=timer.MilliSeconds()/FLAGS_iterations;
+
+  Assemble(pixels,offsets,threads,&canvas);  // warm up
+  timer.Start();
+  for(int i=0;i<FLAGS_iterations;i++){
+    Assemble(pixels,offsets,threads,&canvas);
+  }
+  timer.Stop();
+  const float assemble_ms=timer.MilliSeconds()/FLAGS_iterations;
+
+  const float images=FLAGS_num;
+  LOG(INFO) << "Reference assembly: " << reference_ms << " ms ("
+            << images/reference_ms*1000 << " images/s on 1 core)";
+  LOG(INFO) << "Batch assembler: " << assemble_ms << " ms ("
+            << images/assemble_ms*1000 << " images/s on " << threads
+            << " threads, " << images/assemble_ms*1000/threads
+            << " images/s per core, " << reference_ms/assemble_ms << "x)";
+  LOG(INFO) << "Max abs difference: " << MaxAbsDiff(canvas,reference);
+  return 0;
+}